@@ -0,0 +1,280 @@
+/**
+ * @file aggregate.c
+ * @author Sebastien Galvagno
+ * @brief Aggregation tables on a projection of the flux key
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The sequence numbers only make sense inside a flux: an aggregate sums the growth of the
+ * sizes of its flux, given by the flux table each time a flux is updated.
+ * An update only adds to the leaf of the aggregate: the aggregates are ranked once, when they are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#ifdef __UNITTEST_AGGREGATE__
+#include <assert.h>
+#endif
+
+#include "aggregate.h"
+#include "pool.h"
+
+static const char* projectionNames[] = { "src", "dst", "sport", "dport", "pair" };
+
+/**
+ * @brief parse a list of projections "src,dst,sport,dport,pair" and initialise the tables
+ * 
+ * @param str the list of projections, separated by commas
+ * @param tables the tables to initialise
+ * @param max the number of tables
+ * @return int the number of tables, -1 on an unknown projection
+ */
+int parseProjections(const char* str, aggregateTable* tables, int max){
+    int nb = 0;
+    while ( *str ){
+        size_t size = strcspn(str, ",");
+        int found = -1;
+        for (int i=0; i<(int)(sizeof(projectionNames)/sizeof(*projectionNames)); i++){
+            if ( strlen(projectionNames[i]) == size && strncmp(projectionNames[i], str, size) == 0 ) found = i;
+        }
+        if ( found < 0 || nb == max ) return -1;
+
+        memset(&tables[nb], 0, sizeof(aggregateTable));
+        tables[nb].proj = (projection)found;
+        nb++;
+
+        str += size;
+        if ( *str == ',' ) str++;
+    }
+    return nb;
+}
+
+/**
+ * @brief the projection of a packet: the key of the radix tree and the fields of the aggregate
+ * 
+ * @param proj the projection
+ * @param packet the packet
+ * @param key the projected packet
+ * @param bits the key of the radix tree: 1 word, 2 words for a pair
+ */
+static void project(projection proj, const fromtopacket* packet, fromtopacket* key, UInt32 bits[2]){
+    memset(key, 0, sizeof(fromtopacket));
+    switch ( proj ){
+        case keySource:
+            key->from = packet->from;
+            bits[0] = ntohl(packet->from);
+            break;
+        case keyDestination:
+            key->to = packet->to;
+            bits[0] = ntohl(packet->to);
+            break;
+        case keyPortFrom:
+            key->portFrom = packet->portFrom;
+            bits[0] = (UInt32)packet->portFrom << 16;
+            break;
+        case keyPortTo:
+            key->portTo = packet->portTo;
+            bits[0] = (UInt32)packet->portTo << 16;
+            break;
+        case keyPair:
+            key->from = packet->from;
+            key->to = packet->to;
+            bits[0] = ntohl(packet->from);
+            bits[1] = ntohl(packet->to);
+            break;
+    }
+}
+
+/**
+ * @brief the function to compare 2 aggregates by size, then by key
+ */
+static int compareAggregate(const void* a, const void* b){
+    const aggregate* a1 = *(aggregate* const*)a;
+    const aggregate* a2 = *(aggregate* const*)b;
+    if ( a1->size != a2->size ) return a1->size < a2->size ? -1 : 1;
+    // the same sizes in the order of the keys: the fields out of the projection are zero
+    UInt64 k1 = (UInt64)ntohl(a1->key.from) << 32 | ntohl(a1->key.to);
+    UInt64 k2 = (UInt64)ntohl(a2->key.from) << 32 | ntohl(a2->key.to);
+    if ( k1 != k2 ) return k1 < k2 ? -1 : 1;
+    UInt32 p1 = (UInt32)a1->key.portFrom << 16 | a1->key.portTo;
+    UInt32 p2 = (UInt32)a2->key.portFrom << 16 | a2->key.portTo;
+    return p1 < p2 ? -1 : p1 > p2 ? 1 : 0;
+}
+
+/**
+ * @brief add the growth of a flux to its aggregate
+ * 
+ * @param table the aggregation table
+ * @param packet the flux
+ * @param delta the growth of the size of the flux
+ * @param newFlux true for the first packet of the flux
+ */
+void aggregateUpdate(aggregateTable* table, const fromtopacket* packet, UInt32 delta, int newFlux){
+    fromtopacket key;
+    UInt32 bits[2];
+    project(table->proj, packet, &key, bits);
+
+    void** data = table->proj == keyPair ? radix64Insert(&table->tree.pair, bits)
+                                         : radix32Insert(&table->tree.one, bits);
+    if ( data == NULL ) return;
+
+    aggregate* a = (aggregate*)*data;
+    if ( a == NULL ){
+        a = (aggregate*)poolAlloc(sizeof(aggregate));
+        if ( a == NULL ) return;
+        memset(a, 0, sizeof(aggregate));
+        a->key = key;
+        *data = a;
+    }
+    a->size += delta;
+    if ( newFlux ) a->flux++;
+}
+
+typedef struct {
+    aggregate** all;
+    UInt64 nb;
+} aggregateCollect;
+
+static int collectAggregate(const UInt32* key, void* data, void* ctx){
+    (void)key;
+    aggregateCollect* c = (aggregateCollect*)ctx;
+    c->all[c->nb++] = (aggregate*)data;
+    return 0;
+}
+
+/**
+ * @brief the aggregates sorted by size, the smallest first (the same sizes in the order of the keys)
+ * 
+ * @param table the aggregation table
+ * @param nb the number of aggregates
+ * @return aggregate** the aggregates, allocated with malloc, NULL if out of memory or when there is none
+ */
+aggregate** sortAggregates(aggregateTable* table, UInt64* nb){
+    aggregateCollect c = { .all = NULL, .nb = 0 };
+    *nb = 0;
+    UInt64 leaves = table->proj == keyPair ? table->tree.pair.leaves : table->tree.one.leaves;
+    if ( leaves == 0 ) return NULL;
+    c.all = (aggregate**)malloc(leaves * sizeof(aggregate*));
+    if ( c.all == NULL ) return NULL;
+    if ( table->proj == keyPair ) radix64Walk(&table->tree.pair, NULL, 0, &collectAggregate, &c);
+    else radix32Walk(&table->tree.one, NULL, 0, &collectAggregate, &c);
+    qsort(c.all, c.nb, sizeof(aggregate*), &compareAggregate);
+    *nb = c.nb;
+    return c.all;
+}
+
+static projection printed;
+
+static void printAggregate(void* data){
+    aggregate* a = (aggregate*)data;
+    char from[INET_ADDRSTRLEN], to[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &a->key.from, from, sizeof(from));
+    inet_ntop(AF_INET, &a->key.to, to, sizeof(to));
+
+    switch ( printed ){
+        case keySource:      printf("Src %s", from); break;
+        case keyDestination: printf("Dst %s", to); break;
+        case keyPortFrom:    printf("Sport %u", a->key.portFrom); break;
+        case keyPortTo:      printf("Dport %u", a->key.portTo); break;
+        case keyPair:        printf("Pair %s,%s", from, to); break;
+    }
+    printf(" / Flux : %llu / Taille : %llu\n", (unsigned long long)a->flux, (unsigned long long)a->size);
+}
+
+/**
+ * @brief print the aggregates sorted by size
+ * 
+ * @param table the aggregation table
+ */
+void printAggregates(aggregateTable* table){
+    printf("---- by %s ----\n", projectionNames[table->proj]);
+    printed = table->proj;
+    UInt64 nb;
+    aggregate** sorted = sortAggregates(table, &nb);
+    for (UInt64 i=0; i<nb; i++) printAggregate(sorted[i]);
+    free(sorted);
+}
+
+
+#ifdef __UNITTEST_AGGREGATE__
+
+fromtopacket* initPacket(const char* from, const char* to, UInt16 portFrom, UInt16 portTo){
+    static fromtopacket packet;
+    struct in_addr addr;
+    inet_aton(from, &addr);
+    packet.from = addr.s_addr;
+    inet_aton(to, &addr);
+    packet.to = addr.s_addr;
+    packet.portFrom = portFrom;
+    packet.portTo = portTo;
+    return &packet;
+}
+
+int main(){
+    aggregateTable tables[MAXAGGREGATES];
+    assert(parseProjections("src,dport,pair", tables, MAXAGGREGATES) == 3);
+    assert(tables[0].proj == keySource && tables[1].proj == keyPortTo && tables[2].proj == keyPair);
+    assert(parseProjections("src,port", tables, MAXAGGREGATES) == -1);
+    assert(parseProjections("src,src,src,src,src,src", tables, MAXAGGREGATES) == -1);
+
+    parseProjections("src,dport", tables, MAXAGGREGATES);
+    for (int i=0; i<2; i++){
+        aggregateUpdate(&tables[i], initPacket("10.0.0.1", "10.0.0.2", 1000, 80), 0, 1);
+        aggregateUpdate(&tables[i], initPacket("10.0.0.1", "10.0.0.2", 1000, 80), 10, 0);
+        aggregateUpdate(&tables[i], initPacket("10.0.0.1", "10.0.0.3", 1001, 443), 0, 1);
+        aggregateUpdate(&tables[i], initPacket("10.0.0.1", "10.0.0.3", 1001, 443), 5, 0);
+        aggregateUpdate(&tables[i], initPacket("10.0.0.9", "10.0.0.3", 1002, 443), 0, 1);
+        aggregateUpdate(&tables[i], initPacket("10.0.0.9", "10.0.0.3", 1002, 443), 20, 0);
+        printAggregates(&tables[i]);
+    }
+
+    // by source: 10.0.0.9 - 20, 10.0.0.1 - 15 (2 flux)
+    UInt64 nb;
+    aggregate** sorted = sortAggregates(&tables[0], &nb);
+    assert(nb == 2);
+    assert(sorted[1]->size == 20 && sorted[1]->flux == 1);
+    assert(sorted[0]->size == 15 && sorted[0]->flux == 2);
+    free(sorted);
+
+    // by destination port: 443 - 25 (2 flux), 80 - 10
+    sorted = sortAggregates(&tables[1], &nb);
+    assert(nb == 2);
+    assert(sorted[1]->key.portTo == 443 && sorted[1]->size == 25 && sorted[1]->flux == 2);
+    assert(sorted[0]->key.portTo == 80 && sorted[0]->size == 10);
+    free(sorted);
+
+    // the same sizes in the order of the keys, whatever the order of the updates
+    aggregateTable ties;
+    parseProjections("dst", &ties, 1);
+    for (int i=200; i>0; i--){
+        char to[16];
+        snprintf(to, sizeof(to), "10.0.%d.%d", i % 3, i);
+        aggregateUpdate(&ties, initPacket("10.0.0.1", to, 1000, 80), 7, 1);
+    }
+    sorted = sortAggregates(&ties, &nb);
+    assert(nb == 200);
+    for (UInt64 i=1; i<nb; i++) assert(ntohl(sorted[i-1]->key.to) < ntohl(sorted[i]->key.to));
+    free(sorted);
+
+    // a pair on a 64 bits key, a source on a 32 bits key: 10.0.0.1,10.0.0.2 - 10, 10.0.0.1,10.0.0.3 - 5
+    aggregateTable pairs[2];
+    parseProjections("pair,src", pairs, 2);
+    for (int i=0; i<2; i++){
+        aggregateUpdate(&pairs[i], initPacket("10.0.0.1", "10.0.0.2", 1000, 80), 10, 1);
+        aggregateUpdate(&pairs[i], initPacket("10.0.0.1", "10.0.0.3", 1001, 80), 5, 1);
+    }
+    assert(pairs[0].tree.pair.leaves == 2 && pairs[1].tree.one.leaves == 1);
+    sorted = sortAggregates(&pairs[0], &nb);
+    assert(nb == 2 && sorted[0]->size == 5 && ntohl(sorted[0]->key.to) == 0x0A000003 && sorted[1]->size == 10);
+    free(sorted);
+    return 0;
+}
+
+// gcc -o aggregate pool.c packet.c radixfixed.c aggregate.c -g -D__UNITTEST_AGGREGATE__ && ./aggregate
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file aggregate.h
+ * @author Sebastien Galvagno
+ * @brief Aggregation tables on a projection of the flux key
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_AGGREGATE_H__
+#define __SG__CHIMERE_AGGREGATE_H__
+
+#include "SG_Types.h"
+#include "packet.h"
+#include "radixfixed.h"
+
+// the maximum number of aggregation tables fed by one pass
+#define MAXAGGREGATES 5
+
+typedef enum { keySource, keyDestination, keyPortFrom, keyPortTo, keyPair } projection;
+
+/**
+ * @brief an aggregate: the fields of the projection, the sum of the sizes and the number of flux
+ */
+typedef struct {
+    fromtopacket key;
+    UInt64 size;
+    UInt64 flux;
+} aggregate;
+
+/**
+ * @brief an aggregation table: a radix tree on the projected key, its leaves are the aggregates.
+ * The aggregates are only sorted by size when they are reported (sortAggregates).
+ * 
+ * The key of the radix tree is the projection in the first bits: an address or a port in the
+ * single word of a radix32 tree, the source and the destination of a pair in the 2 words of a radix64 tree.
+ * The tree is as wide as the projection: a narrow key is shallower and its leaves are smaller.
+ */
+typedef struct {
+    projection proj;
+    union {
+        radix32Tree one;    // src, dst, sport, dport
+        radix64Tree pair;   // pair
+    } tree;
+} aggregateTable;
+
+/**
+ * @brief parse a list of projections "src,dst,sport,dport,pair" and initialise the tables
+ * 
+ * @param str the list of projections, separated by commas
+ * @param tables the tables to initialise
+ * @param max the number of tables
+ * @return int the number of tables, -1 on an unknown projection
+ */
+int parseProjections(const char* str, aggregateTable* tables, int max);
+
+/**
+ * @brief add the growth of a flux to its aggregate
+ * 
+ * @param table the aggregation table
+ * @param packet the flux
+ * @param delta the growth of the size of the flux
+ * @param newFlux true for the first packet of the flux
+ */
+void aggregateUpdate(aggregateTable* table, const fromtopacket* packet, UInt32 delta, int newFlux);
+
+/**
+ * @brief the aggregates sorted by size, the smallest first (the same sizes in the order of the keys)
+ * 
+ * @param table the aggregation table
+ * @param nb the number of aggregates
+ * @return aggregate** the aggregates, allocated with malloc, NULL if out of memory or when there is none
+ */
+aggregate** sortAggregates(aggregateTable* table, UInt64* nb);
+
+/**
+ * @brief print the aggregates sorted by size
+ * 
+ * @param table the aggregation table
+ */
+void printAggregates(aggregateTable* table);
+
+#endif
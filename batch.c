@@ -0,0 +1,634 @@
+/**
+ * @file batch.c
+ * @author Sebastien Galvagno
+ * @brief Read many logs in parallel and merge their flux
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * A worker reads a file in a table of its scratch pool, merges the table in its own table
+ * and resets the scratch pool for the next file: the order of the sequence numbers is only checked
+ * inside a file, the files can be read in any order.
+ *
+ * The files, or their chunks (readChunks), are scheduled by a deque per worker: the tasks are dealt in contiguous
+ * blocks, a worker takes its own tasks from the front, in the order of the file, and an idle worker steals
+ * the last task of another worker. No task is added once the workers run, so a deque is a single word
+ * (its first and end tasks) changed by compare and swap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef __UNITTEST_BATCH__
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "reader.h"
+#endif
+
+#include "batch.h"
+
+/**
+ * @brief a file or a range of bytes of a file
+ */
+typedef struct {
+    int path;           // the index of the file
+    UInt64 begin;
+    UInt64 end;         // the byte after the range
+} batchTask;
+
+/**
+ * @brief the tasks left to a worker: the first task in the high 32 bits, the end in the low 32 bits,
+ * on a cache line of its own
+ */
+typedef struct {
+    UInt64 range;
+    char padding[56];
+} batchDeque;
+
+typedef struct {
+    char** paths;
+    batchTask* tasks;
+    UInt32 nbTasks;
+    batchDeque* deques; // a deque per worker
+    int nbDeques;
+    int error;
+    fileReader reader;  // the reader of a whole file, NULL for the ranges
+    rangeReader ranges; // the reader of the chunks, NULL for the files
+    void* ctx;
+    UInt32 expire;
+    UInt32 sample;      // the sampling of the flux
+    int bidirectional;  // the tables of the files count conversations
+    int sequences;      // the tables of the files keep the sequence numbers
+    quarantine* quarantine; // the packets out of order of all the files
+    metrics* metrics;   // each worker publishes the counters of its files in a slot of its own
+} batchJob;
+
+typedef struct {
+    batchJob* job;
+    int index;          // the deque of the worker
+    pool* memory;       // the table of the worker
+    pool* scratch;      // the table of the file read
+    fluxTable table;
+} batchWorker;
+
+static int comparePath(const void* a, const void* b){
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int addFile(char*** paths, int* nb, int* capacity, char* path){
+    if ( path == NULL ) return -1;
+    if ( *nb == *capacity ){
+        *capacity = *capacity ? *capacity * 2 : 64;
+        char** p = (char**)realloc(*paths, *capacity * sizeof(char*));
+        if ( p == NULL ){
+            free(path);
+            return -1;
+        }
+        *paths = p;
+    }
+    (*paths)[(*nb)++] = path;
+    return 0;
+}
+
+/**
+ * @brief the files of the arguments: a directory gives its regular files, in the order of their names
+ * 
+ * @param args the files and directories
+ * @param nbArgs the number of arguments
+ * @param paths the files, allocated with malloc, freed with freeFiles
+ * @return int the number of files, -1 on error
+ */
+int listFiles(char** args, int nbArgs, char*** paths){
+    int nb = 0, capacity = 0;
+    *paths = NULL;
+    for (int i=0; i<nbArgs; i++){
+        struct stat st;
+        if ( stat(args[i], &st) == 0 && S_ISDIR(st.st_mode) ){
+            DIR* dir = opendir(args[i]);
+            if ( dir == NULL ){
+                perror(args[i]);
+                freeFiles(*paths, nb);
+                return -1;
+            }
+            int first = nb;
+            struct dirent* e;
+            while ( (e = readdir(dir)) != NULL ){
+                if ( e->d_name[0] == '.' ) continue;
+                size_t len = strlen(args[i]) + strlen(e->d_name) + 2;
+                char* path = (char*)malloc(len);
+                if ( path ) snprintf(path, len, "%s/%s", args[i], e->d_name);
+                if ( path == NULL || stat(path, &st) != 0 || !S_ISREG(st.st_mode) ){
+                    free(path);
+                    continue;
+                }
+                if ( addFile(paths, &nb, &capacity, path) ){
+                    closedir(dir);
+                    freeFiles(*paths, nb);
+                    return -1;
+                }
+            }
+            closedir(dir);
+            qsort(*paths + first, nb - first, sizeof(char*), &comparePath);
+        } else if ( addFile(paths, &nb, &capacity, strdup(args[i])) ){
+            freeFiles(*paths, nb);
+            return -1;
+        }
+    }
+    return nb;
+}
+
+/**
+ * @brief free the files given by listFiles
+ * 
+ * @param paths the files
+ * @param nbPaths the number of files
+ */
+void freeFiles(char** paths, int nbPaths){
+    for (int i=0; i<nbPaths; i++) free(paths[i]);
+    free(paths);
+}
+
+/**
+ * @brief take a task of a deque: the first one for its worker, the last one for a thief
+ * 
+ * @return SInt64 the task, -1 when the deque is empty
+ */
+static SInt64 takeTask(batchDeque* deque, int steal){
+    UInt64 range = __atomic_load_n(&deque->range, __ATOMIC_ACQUIRE);
+    for (;;){
+        UInt32 first = (UInt32)(range >> 32);
+        UInt32 end = (UInt32)range;
+        if ( first >= end ) return -1;
+        UInt64 left = steal ? ((UInt64)first << 32) | (end - 1) : ((UInt64)(first + 1) << 32) | end;
+        if ( __atomic_compare_exchange_n(&deque->range, &range, left, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ){
+            return steal ? end - 1 : first;
+        }
+    }
+}
+
+/**
+ * @brief the next task of a worker: its own tasks, then the tasks stolen from the next workers
+ */
+static SInt64 nextTask(batchJob* job, int index){
+    SInt64 t = takeTask(&job->deques[index], 0);
+    for (int i=1; t < 0 && i<job->nbDeques; i++){
+        t = takeTask(&job->deques[(index + i) % job->nbDeques], 1);
+    }
+    return t;
+}
+
+static void* batchWorkerThread(void* arg){
+    batchWorker* w = (batchWorker*)arg;
+    batchJob* job = w->job;
+    metricsSlot* slot = metricsClaim(job->metrics);
+
+    for (;;){
+        SInt64 t = __atomic_load_n(&job->error, __ATOMIC_RELAXED) ? -1 : nextTask(job, w->index);
+        if ( t < 0 ) break;
+        const batchTask* task = &job->tasks[t];
+
+        fluxTable file;
+        memset(&file, 0, sizeof(file));
+        file.expire = job->expire;
+        file.nextSweep = job->expire;
+        setSampling(&file, job->sample);
+        if ( job->bidirectional ) setBidirectional(&file);
+        file.quarantine = job->quarantine;
+        file.metrics = slot;
+        if ( job->sequences && (file.sequences = seqTableCreate()) == NULL ){
+            __atomic_store_n(&job->error, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        poolUse(w->scratch);
+        int r = job->reader ? job->reader(&file, job->paths[task->path], job->ctx)
+                            : job->ranges(&file, job->paths[task->path], task->begin, task->end, job->ctx);
+        poolUse(w->memory);
+        if ( slot ){
+            publishFlux(&file);
+            metricsRetire(slot);
+        }
+        if ( r == 0 ) r = mergeFlux(&w->table, &file);
+        freeFlux(&file);
+        poolReset(w->scratch);
+        if ( r ){
+            __atomic_store_n(&job->error, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    poolUse(NULL);
+    return NULL;
+}
+
+/**
+ * @brief the job of a table: the tables of the tasks are set like it
+ */
+static void batchInit(batchJob* job, char** paths, batchTask* tasks, UInt32 nbTasks, void* ctx, fluxTable* table){
+    memset(job, 0, sizeof(*job));
+    job->paths = paths;
+    job->tasks = tasks;
+    job->nbTasks = nbTasks;
+    job->ctx = ctx;
+    job->expire = table->expire;
+    job->sample = table->sample;
+    job->bidirectional = table->flows.bidirectional;
+    job->sequences = table->sequences != NULL;
+    job->quarantine = table->quarantine;
+    job->metrics = table->metrics ? table->metrics->registry : NULL;
+}
+
+/**
+ * @brief run the tasks of the job with a pool of threads and merge the tables of the threads in table
+ */
+static int batchRun(batchJob* job, int threads, fluxTable* table){
+    if ( threads < 1 ) threads = 1;
+    if ( (UInt32)threads > job->nbTasks ) threads = job->nbTasks > 0 ? (int)job->nbTasks : 1;
+
+    // the tasks dealt in contiguous blocks: a worker reads its chunks in the order of the file
+    batchWorker* workers = (batchWorker*)calloc(threads, sizeof(batchWorker));
+    pthread_t* ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    job->deques = (batchDeque*)calloc(threads, sizeof(batchDeque));
+    job->nbDeques = threads;
+    for (int i=0; job->deques && i<threads; i++){
+        UInt64 first = (UInt64)job->nbTasks * i / threads;
+        UInt64 end = (UInt64)job->nbTasks * (i + 1) / threads;
+        job->deques[i].range = (first << 32) | end;
+    }
+    pool* memory = poolCreate();
+    int nbWorkers = 0;
+    for (int i=0; workers && ids && job->deques && memory && i<threads; i++){
+        batchWorker* w = &workers[nbWorkers];
+        w->job = job;
+        // the tasks of a worker not started are stolen by the others
+        w->index = i;
+        if ( job->bidirectional ) setBidirectional(&w->table);
+        w->memory = poolCreate();
+        w->scratch = poolCreate();
+        if ( w->memory && w->scratch && pthread_create(&ids[nbWorkers], NULL, &batchWorkerThread, w) == 0 ){
+            nbWorkers++;
+        } else {
+            poolDestroy(w->memory);
+            poolDestroy(w->scratch);
+        }
+    }
+    if ( nbWorkers == 0 ) job->error = 1;
+
+    // the tables of the workers are merged in order: the result does not depend on the threads
+    poolUse(memory);
+    for (int i=0; i<nbWorkers; i++){
+        pthread_join(ids[i], NULL);
+        if ( job->error == 0 && mergeFlux(table, &workers[i].table) ) job->error = 1;
+        freeFlux(&workers[i].table);
+        poolDestroy(workers[i].memory);
+        poolDestroy(workers[i].scratch);
+    }
+
+    // the aggregation tables are fed once with the size of each merged flux
+    for (UInt32 id=0; table->nbAggregates && id<table->flows.nb; id++){
+        fromtopacket p;
+        flowStoreGet(&table->flows, id, &p);
+        for (int i=0; i<table->nbAggregates; i++){
+            aggregateUpdate(&table->aggregates[i], &p, packetSize(&p), 1);
+        }
+    }
+
+    // the counters are in the slots of the workers: the slot of the table only has the flux merged
+    if ( table->metrics ){
+        metricsSample s;
+        memset(&s, 0, sizeof(s));
+        s.flows = table->flows.nb + table->flows6.nb;
+        s.nodes = table->tree.nodes + table->tree6.nodes;
+        metricsPublish(table->metrics, &s);
+    }
+
+    free(workers);
+    free(ids);
+    free(job->deques);
+    return job->error;
+}
+
+
+/**
+ * @brief read the files with a pool of threads: each thread reads a file in its own table and merges it
+ * in the table of the thread, then the tables of the threads are merged in table.
+ * A flux read in several files goes from the smallest first sequence number to the biggest last one.
+ * 
+ * The flux are allocated in a new pool, which is the pool of the calling thread on return:
+ * free it with poolDestroy(poolUse(NULL)), and the store with freeFlux, when the table is not used anymore.
+ * 
+ * @param paths the files
+ * @param nbPaths the number of files
+ * @param threads the number of threads
+ * @param reader the function reading a file
+ * @param ctx the context given to reader
+ * @param table the table receiving the flux, empty: its expire and its sampling are used by the tables of the files,
+ * its aggregation tables are fed with the merged flux, the files keep their sequence numbers when it has a seqTable
+ * and write their packets out of order to its quarantine file, the workers publish the counters of their files
+ * in metrics slots of their own when it has a metrics slot
+ * @return int 0, non zero when a file is not read
+ */
+int readFiles(char** paths, int nbPaths, int threads, fileReader reader, void* ctx, fluxTable* table){
+    batchTask* tasks = (batchTask*)malloc((nbPaths > 0 ? nbPaths : 1) * sizeof(batchTask));
+    if ( tasks == NULL ) return 1;
+    for (int i=0; i<nbPaths; i++){
+        tasks[i].path = i;
+        tasks[i].begin = 0;
+        tasks[i].end = 0;
+    }
+    batchJob job;
+    batchInit(&job, paths, tasks, nbPaths, ctx, table);
+    job.reader = reader;
+    int r = batchRun(&job, threads, table);
+    free(tasks);
+    return r;
+}
+
+/**
+ * @brief read the files cut in chunks with a pool of threads: a thread reads a chunk in a table of its own
+ * and merges it in the table of the thread, an idle thread steals the chunks of the others, then the tables
+ * of the threads are merged in table. The order of the sequence numbers is only checked inside a chunk.
+ * 
+ * The flux are allocated as with readFiles.
+ * 
+ * @param paths the files
+ * @param nbPaths the number of files
+ * @param chunk the size of a chunk in bytes, 0 for BATCHCHUNK
+ * @param threads the number of threads
+ * @param reader the function reading the lines starting in a range of a file
+ * @param ctx the context given to reader
+ * @param table the table receiving the flux, empty: as with readFiles, the chunks are its files
+ * @return int 0, non zero when a chunk is not read
+ */
+int readChunks(char** paths, int nbPaths, UInt64 chunk, int threads, rangeReader reader, void* ctx, fluxTable* table){
+    if ( chunk == 0 ) chunk = BATCHCHUNK;
+    UInt32 nbTasks = 0, capacity = 0;
+    batchTask* tasks = NULL;
+    for (int i=0; i<nbPaths; i++){
+        // an empty file or a file not found is a task of its own: its reader says why
+        struct stat st;
+        UInt64 size = stat(paths[i], &st) == 0 ? (UInt64)st.st_size : 0;
+        UInt64 begin = 0;
+        do {
+            if ( nbTasks == capacity ){
+                capacity = capacity ? capacity * 2 : 256;
+                batchTask* t = capacity <= 0x7FFFFFFF ? (batchTask*)realloc(tasks, capacity * sizeof(batchTask)) : NULL;
+                if ( t == NULL ){
+                    free(tasks);
+                    return 1;
+                }
+                tasks = t;
+            }
+            tasks[nbTasks].path = i;
+            tasks[nbTasks].begin = begin;
+            tasks[nbTasks].end = size - begin > chunk ? begin + chunk : size;
+            begin = tasks[nbTasks++].end;
+        } while ( begin < size );
+    }
+    batchJob job;
+    batchInit(&job, paths, tasks, nbTasks, ctx, table);
+    job.ranges = reader;
+    int r = batchRun(&job, threads, table);
+    free(tasks);
+    return r;
+}
+
+
+#ifdef __UNITTEST_BATCH__
+
+static int readTest(fluxTable* table, const char* path, void* ctx){
+    (void)ctx;
+    FILE* fp = fopen(path, "r");
+    if ( fp == NULL ) return 1;
+    char line[256];
+    int r = 0;
+    while ( r == 0 && fgets(line, sizeof(line), fp) ) r = processLine(table, line);
+    fclose(fp);
+    return r;
+}
+
+static int addLine(char* line, void* ctx){
+    return processLine((fluxTable*)ctx, line);
+}
+
+static int readTestRange(fluxTable* table, const char* path, UInt64 begin, UInt64 end, void* ctx){
+    (void)ctx;
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return 1;
+    lineSplitter splitter;
+    splitterInit(&splitter, &addLine, table);
+    int r = readRange(fd, begin, end, &splitter);
+    close(fd);
+    return r;
+}
+
+// the benchmark: the busy time of each thread, given a slot on its first chunk
+#define BENCHTHREADS 4
+#define BENCHLINES 500000
+#define BENCHFLOWS 100000
+#define BENCHREGIONS 16
+
+static double busy[BENCHTHREADS];
+static int nbBusy;
+static __thread int busySlot = -1;
+
+static double cpuTime(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int readBenchRange(fluxTable* table, const char* path, UInt64 begin, UInt64 end, void* ctx){
+    if ( busySlot < 0 ) busySlot = __atomic_fetch_add(&nbBusy, 1, __ATOMIC_RELAXED);
+    double t0 = cpuTime();
+    int r = readTestRange(table, path, begin, end, ctx);
+    busy[busySlot] += cpuTime() - t0;
+    return r;
+}
+
+/**
+ * @brief a log cut in regions of the same number of lines: uniform, each region has the same number of new flux,
+ * zipf, the region r has new flux in proportion to 1 / (r + 1)
+ */
+static void writeBench(const char* path, int zipf){
+    FILE* fp = fopen(path, "w");
+    assert(fp);
+    double weights = 0;
+    for (int r=0; r<BENCHREGIONS; r++) weights += zipf ? 1.0 / (r + 1) : 1.0;
+    int firstFlow = 0;
+    UInt32 random = 12345;
+    for (int r=0; r<BENCHREGIONS; r++){
+        int flows = (int)(BENCHFLOWS * (zipf ? 1.0 / (r + 1) : 1.0) / weights) + 1;
+        for (int i=0; i<BENCHLINES / BENCHREGIONS; i++){
+            random = random * 1103515245 + 12345;
+            int f = firstFlow + (int)((random >> 8) % flows);
+            fprintf(fp, "10.%d.%d.%d:%d,192.168.0.1:80,%d\n", (f >> 16) & 0xFF, (f >> 8) & 0xFF, f & 0xFF, 1000 + (f % 50000), r * BENCHLINES + i);
+        }
+        firstFlow += flows;
+    }
+    fclose(fp);
+}
+
+/**
+ * @brief read the log with threads: the wall time, and the balance of the busy times of the threads
+ * (the efficiency reached with a core per thread)
+ */
+static double bench(char* path, int threads, UInt64 chunk, double* balance){
+    memset(busy, 0, sizeof(busy));
+    nbBusy = 0;
+    fluxTable table;
+    memset(&table, 0, sizeof(table));
+    double t0 = now();
+    assert(readChunks(&path, 1, chunk, threads, &readBenchRange, NULL, &table) == 0);
+    double t = now() - t0;
+    assert(table.lines == BENCHLINES);
+    freeFlux(&table);
+    poolDestroy(poolUse(NULL));
+    double sum = 0, max = 0;
+    for (int i=0; i<nbBusy; i++){
+        sum += busy[i];
+        if ( busy[i] > max ) max = busy[i];
+    }
+    *balance = max > 0 ? sum / (threads * max) : 1;
+    return t;
+}
+
+static void writeFile(const char* path, int first, int nb){
+    FILE* fp = fopen(path, "w");
+    assert(fp);
+    for (int i=0; i<nb; i++){
+        // 100 flux, the flux 0 is in all the files
+        int f = (first + i) % 100;
+        fprintf(fp, "10.0.0.%d:1000,10.0.1.1:80,%d\n", f, 1000 + first + i);
+    }
+    fclose(fp);
+}
+
+int main(){
+    char dir[] = "/tmp/chimere_batch_XXXXXX";
+    assert(mkdtemp(dir));
+    char path[64];
+    // the files are read in any order, the sequence numbers increase with the file number
+    for (int i=0; i<8; i++){
+        snprintf(path, sizeof(path), "%s/log.%d", dir, i);
+        writeFile(path, i * 1000, 1000);
+    }
+    // a packet of log.0 again in log.3: out of order in its file, not after the merge
+    snprintf(path, sizeof(path), "%s/log.3", dir);
+    FILE* fp = fopen(path, "a");
+    assert(fp);
+    fprintf(fp, "10.0.0.0:1000,10.0.1.1:80,1000\n");
+    fclose(fp);
+
+    char* args[] = { dir };
+    char** paths;
+    int nb = listFiles(args, 1, &paths);
+    assert(nb == 8);
+    assert(strcmp(paths[0] + strlen(dir), "/log.0") == 0);
+    assert(strcmp(paths[7] + strlen(dir), "/log.7") == 0);
+
+    fluxTable table;
+    memset(&table, 0, sizeof(table));
+    table.nbAggregates = parseProjections("src", table.aggregates, MAXAGGREGATES);
+    table.sequences = seqTableCreate();
+    char prom[] = "/tmp/chimere_batch_metrics_XXXXXX";
+    int fd = mkstemp(prom);
+    assert(fd >= 0);
+    close(fd);
+    metrics* m = metricsStart(prom);
+    assert(m);
+    table.metrics = metricsClaim(m);
+    assert(readFiles(paths, nb, 3, &readTest, NULL, &table) == 0);
+    assert(table.lines == 8001);
+    assert(table.reordered == 1 && table.repeated == 0);
+
+    // the counters of the workers: a file each time a worker retires its table
+    metricsSample total;
+    metricsTotal(m, &total);
+    assert(total.files == 8 && total.lines == 8001 && total.reordered == 1 && total.flows == 100);
+    assert(metricsStop(m) == 0);
+    unlink(prom);
+
+    // every flux from its first packet in log.0 to its last packet in log.7
+    assert(table.flows.nb == 100);
+    for (UInt32 id=0; id<table.flows.nb; id++){
+        fromtopacket p;
+        flowStoreGet(&table.flows, id, &p);
+        int f = ntohl(p.from) & 0xFF;
+        assert(p.firstPacket == (tcp_seq)(1000 + f));
+        assert(p.lastPacket == (tcp_seq)(1000 + 7900 + f));
+    }
+    UInt64 nbAggregates;
+    aggregate** sorted = sortAggregates(&table.aggregates[0], &nbAggregates);
+    assert(nbAggregates == 100 && sorted[99]->flux == 1 && sorted[99]->size == 7900);
+    free(sorted);
+
+    // the sequence numbers of the files are merged: a packet every 100 sequence numbers
+    seqStats stats;
+    seqStatsOf(table.sequences, 0, &stats);
+    assert(stats.observed == 80 && stats.gaps == 79 && stats.duplicates == 1);
+
+    freeFlux(&table);
+    poolDestroy(poolUse(NULL));
+
+    // the same files cut in chunks of 1000 bytes, stolen by 3 threads
+    memset(&table, 0, sizeof(table));
+    table.sequences = seqTableCreate();
+    assert(readChunks(paths, nb, 1000, 3, &readTestRange, NULL, &table) == 0);
+    assert(table.lines == 8001 && table.flows.nb == 100);
+    for (UInt32 id=0; id<table.flows.nb; id++){
+        fromtopacket p;
+        flowStoreGet(&table.flows, id, &p);
+        int f = ntohl(p.from) & 0xFF;
+        assert(p.firstPacket == (tcp_seq)(1000 + f) && p.lastPacket == (tcp_seq)(1000 + 7900 + f));
+    }
+    seqStatsOf(table.sequences, 0, &stats);
+    assert(stats.observed == 80 && stats.duplicates == 1);
+    freeFlux(&table);
+    poolDestroy(poolUse(NULL));
+    for (int i=0; i<nb; i++) unlink(paths[i]);
+    rmdir(dir);
+    freeFiles(paths, nb);
+    printf("batch: OK\n");
+
+    // the benchmark: a range per thread against chunks of 256 KB stolen by the idle threads
+    char bench1[] = "/tmp/chimere_bench_XXXXXX";
+    fd = mkstemp(bench1);
+    assert(fd >= 0);
+    close(fd);
+    const char* inputs[] = { "uniform", "zipf" };
+    for (int zipf=0; zipf<2; zipf++){
+        writeBench(bench1, zipf);
+        struct stat st;
+        assert(stat(bench1, &st) == 0);
+        double balance;
+        double t1 = bench(bench1, 1, 0, &balance);
+        for (int threads=2; threads<=BENCHTHREADS; threads*=2){
+            UInt64 range = (st.st_size + threads - 1) / threads;
+            double balanceRanges, balanceChunks;
+            double tr = bench(bench1, threads, range, &balanceRanges);
+            double tc = bench(bench1, threads, 256 << 10, &balanceChunks);
+            printf("%-8s %d threads: ranges %5.3f s efficiency %3.0f%% balance %3.0f%% / chunks %5.3f s efficiency %3.0f%% balance %3.0f%%\n",
+                   inputs[zipf], threads, tr, 100 * t1 / (threads * tr), 100 * balanceRanges, tc, 100 * t1 / (threads * tc), 100 * balanceChunks);
+        }
+    }
+    unlink(bench1);
+    return 0;
+}
+
+// gcc -o batch pool.c packet.c radixfixed.c aggregate.c flowstore.c seqmap.c quarantine.c metrics.c shmflux.c query.c flux.c lines.c decompress.c reader.c batch.c -g -D__UNITTEST_BATCH__ -pthread -lrt && ./batch
+
+#endif
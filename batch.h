@@ -0,0 +1,99 @@
+/**
+ * @file batch.h
+ * @author Sebastien Galvagno
+ * @brief Read many logs in parallel and merge their flux
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_BATCH_H__
+#define __SG__CHIMERE_BATCH_H__
+
+#include "SG_Types.h"
+#include "flux.h"
+#include "pool.h"
+
+// the size of a chunk of readChunks by default
+#define BATCHCHUNK (4 << 20)
+
+/**
+ * @brief the function reading a file in a flux table
+ * 
+ * @param table the flux table, empty
+ * @param path the file
+ * @param ctx the context given to readFiles
+ * @return int 0, non zero to stop the batch
+ */
+typedef int (*fileReader)(fluxTable* table, const char* path, void* ctx);
+
+/**
+ * @brief the function reading the lines starting in a range of a file (readRange)
+ * 
+ * @param table the flux table, empty
+ * @param path the file
+ * @param begin the first byte of the range
+ * @param end the byte after the range
+ * @param ctx the context given to readChunks
+ * @return int 0, non zero to stop the batch
+ */
+typedef int (*rangeReader)(fluxTable* table, const char* path, UInt64 begin, UInt64 end, void* ctx);
+
+/**
+ * @brief the files of the arguments: a directory gives its regular files, in the order of their names
+ * 
+ * @param args the files and directories
+ * @param nbArgs the number of arguments
+ * @param paths the files, allocated with malloc, freed with freeFiles
+ * @return int the number of files, -1 on error
+ */
+int listFiles(char** args, int nbArgs, char*** paths);
+
+/**
+ * @brief free the files given by listFiles
+ * 
+ * @param paths the files
+ * @param nbPaths the number of files
+ */
+void freeFiles(char** paths, int nbPaths);
+
+/**
+ * @brief read the files with a pool of threads: each thread reads a file in its own table and merges it
+ * in the table of the thread, then the tables of the threads are merged in table.
+ * A flux read in several files goes from the smallest first sequence number to the biggest last one.
+ * 
+ * The flux are allocated in a new pool, which is the pool of the calling thread on return:
+ * free it with poolDestroy(poolUse(NULL)), and the store with freeFlux, when the table is not used anymore.
+ * 
+ * @param paths the files
+ * @param nbPaths the number of files
+ * @param threads the number of threads
+ * @param reader the function reading a file
+ * @param ctx the context given to reader
+ * @param table the table receiving the flux, empty: its expire and its sampling are used by the tables of the files,
+ * its aggregation tables are fed with the merged flux, the workers publish the counters of their files
+ * in metrics slots of their own when it has a metrics slot
+ * @return int 0, non zero when a file is not read
+ */
+int readFiles(char** paths, int nbPaths, int threads, fileReader reader, void* ctx, fluxTable* table);
+
+/**
+ * @brief read the files cut in chunks with a pool of threads: a thread reads a chunk in a table of its own
+ * and merges it in the table of the thread, an idle thread steals the chunks of the others, then the tables
+ * of the threads are merged in table. The order of the sequence numbers is only checked inside a chunk.
+ * 
+ * The flux are allocated as with readFiles.
+ * 
+ * @param paths the files
+ * @param nbPaths the number of files
+ * @param chunk the size of a chunk in bytes, 0 for BATCHCHUNK
+ * @param threads the number of threads
+ * @param reader the function reading the lines starting in a range of a file
+ * @param ctx the context given to reader
+ * @param table the table receiving the flux, empty: as with readFiles, the chunks are its files
+ * @return int 0, non zero when a chunk is not read
+ */
+int readChunks(char** paths, int nbPaths, UInt64 chunk, int threads, rangeReader reader, void* ctx, fluxTable* table);
+
+#endif
@@ -21,162 +21,818 @@
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 
 #include "SG_Types.h"
 #include "packet.h"
-#include "radix.h"
-#include "list.h"
+#include "radixfixed.h"
+#include "rollup.h"
+#include "aggregate.h"
+#include "pcap.h"
+#include "columnar.h"
+#include "lines.h"
+#include "decompress.h"
+#include "reader.h"
+#include "uring.h"
+#include "flux.h"
+#include "batch.h"
+#include "query.h"
+#include "report.h"
+#include "quarantine.h"
+#include "snapshot.h"
+#include "diff.h"
+#include "metrics.h"
+#include "pool.h"
 
 typedef int bool;
 enum { false, true };
 
-typedef enum { noError = 0, atonError, atoiError } error_t;
+/**
+ * @brief the options of the command line
+ */
+typedef struct {
+    bool follow;        // -f: follow the file as it grows
+    int top;            // -n: number of flux in the periodic report
+    int period;         // -t: emit the top flux every period seconds
+    UInt64 everyLines;  // -l: emit the top flux every everyLines lines
+    UInt32 expire;      // -e: flush the flux idle for expire lines
+    bool query;         // -q: report the flux from a source subnet
+    subnet source;
+    int rollup;         // -r: report the sizes per source prefix or per pair (ROLLUPPAIR)
+    const char* projections; // -k: the aggregation tables fed by the same pass
+    int threads;        // -j: the number of threads
+    const char* path;
+    char** paths;       // the files and directories of the batch
+    int nbPaths;
+    const char* shared; // -m: the shared memory table fed by this process
+    const char* socket; // -s: the Unix socket answering the queries
+    bool sequences;     // -g: report the sequence numbers seen in each flux
+    const char* quarantine; // -x: the file of the packets out of order
+    const char* snapshot; // -w: the snapshot written after the reading
+    const char* before; // -d: the snapshot, log or directory compared to the input
+    const char* metrics; // -p: the file or the :port of the metrics
+    UInt32 sample;      // -S, --sample 1/N: keep 1 flux in sample
+    bool bidirectional; // -b, --bidirectional: the 2 directions of a conversation are one flux
+    bool memory;        // -M: count the memory of each subsystem, reported at exit and on SIGUSR1
+    int uring;          // -u, --uring: read the text files with io_uring, URINGDIRECT with --direct
+    UInt64 chunk;       // -c: the text files are cut in chunks of chunk bytes read by the -j threads
+} options;
+
+// the text files read with io_uring and O_DIRECT
+#define URINGDIRECT 2
+
+/**
+ * @brief the state of the reading of lines: the table fed and the last periodic emission
+ */
+typedef struct {
+    fluxTable* table;
+    const options* opt;
+    time_t lastEmit;    // the time of the last emission
+    UInt64 lastLines;   // the number of lines at the last emission
+    UInt32 count;       // the lines read since the last check of the clock
+    const lineSplitter* splitter; // the bytes read from the input
+    UInt64 bytes;       // the bytes of the table before the splitter
+} ingest;
 
-error_t tryStrtol(UInt32* result, const char *nptr, char **endptr, int base){
-    errno = noError;
-    *result = strtol(nptr, endptr, base);
-    return errno;
+static volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int sig){
+    (void)sig;
+    stopRequested = 1;
+}
+
+static volatile sig_atomic_t memoryRequested = 0;
+
+void onMemorySignal(int sig){
+    (void)sig;
+    memoryRequested = 1;
 }
 
 /**
- * @brief to decode the input stream
+ * @brief print the memory of each subsystem on stderr, asked by SIGUSR1 during the reading
  * 
- * @param buffer the string to decode
- * @return fromtopacket* the data
- */
-fromtopacket* decode(char *buffer){
-    fromtopacket* packet = NULL;
-    char *saveptr;
-    char * from = strtok_r(buffer, ",", &saveptr);
-    char * to = strtok_r(NULL, ",", &saveptr);
-    char * seq = strtok_r(NULL, ",", &saveptr);
-
-    char * ipFrom = strtok_r(from, ":", &saveptr);
-    char * portFrom = strtok_r(NULL, ":", &saveptr);
-
-    char * ipTo = strtok_r(to, ":" , &saveptr);
-    char * portTo = strtok_r(NULL, ":", &saveptr);
-    
-    struct in_addr addrFrom;
-    struct in_addr addrTo;
-    UInt32 iPortfrom, iPortto,iSeq;
-    if ( from && to && seq && ipFrom && portFrom && ipTo && portTo
-        && inet_aton(ipFrom, &addrFrom) != 0 
-        && inet_aton(ipTo, &addrTo) != 0
-        && tryStrtol(&iPortfrom, portFrom, NULL, 10) == noError
-        && tryStrtol(&iPortto, portTo, NULL, 10) == noError
-        && tryStrtol(&iSeq, seq, NULL, 10) == noError
-    ){
-        packet = malloc(sizeof(fromtopacket));
-        if ( packet ){
-            memset(packet, 0, sizeof(fromtopacket));
-            packet->from = addrFrom.s_addr ;
-            packet->to = addrTo.s_addr ;
-            packet->portFrom = (UInt16) iPortfrom ;
-            packet->portTo = (UInt16) iPortto ;
-            packet->firstPacket = iSeq ;
-        }
-    }
-    return packet;
-}
-
-
-/**
- * @brief the function use by the generic list to print the data
+ * @param table the flux table
+ */
+void reportMemory(fluxTable* table){
+    memoryRequested = 0;
+    memReport(stderr, (UInt64)table->flows.nb + table->flows6.nb);
+}
+
+/**
+ * @brief the function printing a flux of the shared memory table
+ */
+int printShared(const fromtopacket* flux, void* ctx){
+    (void)ctx;
+    printPacketSummary((fromtopacket*)flux);
+    return 0;
+}
+
+/**
+ * @brief print the biggest flux, selected by a scan of the store
  * 
- * @param data here data is the packet structure
+ * @param table the flux table
+ * @param top the number of flux to print
  */
-void affiche(void* data){
-    printPacketSummary((fromtopacket*)data);
+void printTop(fluxTable* table, int top){
+    printf("---- top %d after %llu lines ----\n", top, (unsigned long long)table->lines);
+    if ( table->shared ){
+        shmFlush(table->shared);
+        shmTop(table->shared->table, top, &printShared, NULL);
+    } else if ( top > 0 && table->flows.bidirectional ){
+        UInt32* ids = (UInt32*)memAlloc(top * sizeof(UInt32), MEMOTHER);
+        fromtopacket6* flux6 = (fromtopacket6*)memAlloc(top * sizeof(fromtopacket6), MEMOTHER);
+        UInt32 nb = ids ? topConversations(table, top, ids) : 0;
+        UInt32 nb6 = flux6 ? topFlux6(table, top, flux6) : 0;
+        UInt32 i = 0, j = 0;
+        for (int k=0; k<top && (i < nb || j < nb6); k++){
+            if ( j == nb6 || (i < nb && conversationSize(&table->flows, ids[i]) > packetSize6(&flux6[j])) ){
+                char summary[CONVERSATIONSUMMARYSIZE];
+                conversationSummary(&table->flows, ids[i++], summary, sizeof(summary));
+                puts(summary);
+            } else {
+                char summary[PACKET6SUMMARYSIZE];
+                packetSummary6(&flux6[j++], summary, sizeof(summary));
+                puts(summary);
+            }
+        }
+        memFree(ids);
+        memFree(flux6);
+    } else if ( top > 0 ){
+        fromtopacket* flux = (fromtopacket*)memAlloc(top * sizeof(fromtopacket), MEMOTHER);
+        fromtopacket6* flux6 = (fromtopacket6*)memAlloc(top * sizeof(fromtopacket6), MEMOTHER);
+        UInt32 nb = flux ? topFlux(table, top, flux) : 0;
+        UInt32 nb6 = flux6 ? topFlux6(table, top, flux6) : 0;
+        // the 2 families merged, the biggest first: an IPv6 flux before an IPv4 flux of the same size
+        UInt32 i = 0, j = 0;
+        for (int k=0; k<top && (i < nb || j < nb6); k++){
+            if ( j == nb6 || (i < nb && packetSize(&flux[i]) > packetSize6(&flux6[j])) ){
+                affiche(&flux[i++]);
+            } else {
+                char summary[PACKET6SUMMARYSIZE];
+                packetSummary6(&flux6[j++], summary, sizeof(summary));
+                puts(summary);
+            }
+        }
+        memFree(flux);
+        memFree(flux6);
+    }
+    fflush(stdout);
 }
 
 /**
- * @brief the function to compare 2 items of the list - used to sort the list
+ * @brief emit the top flux if the period or the number of lines is reached
  * 
- * @param node1 
- * @param node2 
- * @return int 
-            <0  node1  < node2
-            ==0 node1 == node2
-            >0  node1  > node2
+ * @param table the flux table
+ * @param opt the options
+ * @param lastEmit the time of the last emission
+ * @param lastLines the number of lines at the last emission
  */
-int comparePacket(list* node1, list* node2){
+void emitIfDue(fluxTable* table, const options* opt, time_t* lastEmit, UInt64* lastLines){
+    bool due = false;
+    if ( opt->everyLines && table->lines - *lastLines >= opt->everyLines ) due = true;
+    if ( opt->period && time(NULL) - *lastEmit >= opt->period ) due = true;
+    if ( due ){
+        printTop(table, opt->top);
+        *lastEmit = time(NULL);
+        *lastLines = table->lines;
+    }
+}
 
-    fromtopacket* packet1 = (fromtopacket*)node1->data;
-    fromtopacket* packet2 = (fromtopacket*)node2->data;
+/**
+ * @brief the number of milliseconds to wait before the next periodic emission
+ */
+int nextEmitTimeout(const options* opt, time_t lastEmit){
+    if ( opt->period == 0 ) return -1;
+    time_t remain = lastEmit + opt->period - time(NULL);
+    return remain > 0 ? (int)remain * 1000 : 0;
+}
 
-    int nbPacket1 = packet1->lastPacket ? packet1->lastPacket - packet1->firstPacket : 0;
-    int nbPacket2 = packet2->lastPacket ? packet2->lastPacket - packet2->firstPacket : 0;
+/**
+ * @brief the function called by the line splitter for each line: the line updates the flux table
+ * and the top flux is emitted when it is due
+ * 
+ * @param line the line
+ * @param ctx the ingest state
+ * @return int 0 to continue the reading, 1 on error
+ */
+int splitLine(char* line, void* ctx){
+    ingest* in = (ingest*)ctx;
+    in->table->bytes = in->bytes + in->splitter->bytes;
+    if ( processLine(in->table, line) ) return 1;
+    // the clock is only checked every 1024 lines
+    if ( in->opt->everyLines || (in->opt->period && (++in->count & 0x3FF) == 0) ){
+        emitIfDue(in->table, in->opt, &in->lastEmit, &in->lastLines);
+    }
+    if ( memoryRequested ) reportMemory(in->table);
+    return 0;
+}
 
-    return nbPacket1 - nbPacket2 ;
+/**
+ * @brief the function called by the reader while stdin has no data: the snapshot of the queries
+ * follows the lines read before
+ * 
+ * @param ctx the ingest state
+ */
+void idleLine(void* ctx){
+    ingest* in = (ingest*)ctx;
+    if ( in->table->server ) queryRefresh(in->table->server, in->table);
 }
 
+/**
+ * @brief follow a growing file: read the new lines each time inotify notifies a modification.
+ * The file is reopened when it is rotated (moved or deleted) and read from the start when it is truncated.
+ * 
+ * @return int 0 when stopped by a signal, 1 on error
+ */
+int follow(fluxTable* table, int fd, const options* opt){
+    // a line not finished by the writer stays in the splitter until its end is read
+    lineSplitter splitter;
+    ingest in = { .table = table, .opt = opt, .lastEmit = time(NULL), .lastLines = 0, .count = 0, .splitter = &splitter, .bytes = table->bytes };
+    splitterInit(&splitter, &splitLine, &in);
+    char* buffer = memAlloc(READBUFFER, MEMBUFFERS);
+    if ( buffer == NULL ) return 1;
+
+    int ifd = inotify_init1(IN_CLOEXEC);
+    if ( ifd < 0 ){
+        perror("inotify_init1");
+        memFree(buffer);
+        return 1;
+    }
+    UInt32 mask = IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB;
+    int wd = inotify_add_watch(ifd, opt->path, mask);
+    bool rotated = false;
+    int r = 0;
 
-int main(int argc, char **argv){
-  
-  char buffer[SIZEFROMTOMASK+1];
+    while ( !stopRequested ){
+        ssize_t n;
+        while ( !stopRequested && (n = read(fd, buffer, READBUFFER)) > 0 ){
+            if ( splitLines(&splitter, buffer, n) ){
+                r = 1;
+                break;
+            }
+        }
+        if ( r ) break;
+
+        struct stat st;
+        if ( fstat(fd, &st) == 0 && st.st_size < lseek(fd, 0, SEEK_CUR) ){
+            // truncated: the writer started again from the beginning
+            lseek(fd, 0, SEEK_SET);
+            in.bytes = table->bytes;
+            splitterInit(&splitter, &splitLine, &in);
+            continue;
+        }
+
+        if ( rotated ){
+            int newfd = open(opt->path, O_RDONLY);
+            if ( newfd >= 0 ){
+                close(fd);
+                fd = newfd;
+                in.bytes = table->bytes;
+                splitterInit(&splitter, &splitLine, &in);
+                rotated = false;
+                wd = inotify_add_watch(ifd, opt->path, mask);
+                continue;
+            }
+        }
+
+        // the packets read are visible in the shared table while the file is idle
+        if ( table->shared ) shmFlush(table->shared);
+        publishFlux(table);
+        emitIfDue(table, opt, &in.lastEmit, &in.lastLines);
+        if ( table->server ) queryRefresh(table->server, table);
+        if ( memoryRequested ) reportMemory(table);
 
-    FILE* fp = NULL;
-    if ( argc == 2 ) {
-        fp = fopen(argv[1], "r");
+        struct pollfd pfd = { .fd = ifd, .events = POLLIN };
+        int timeout = nextEmitTimeout(opt, in.lastEmit);
+        // while the file is rotated, try to reopen it every second
+        if ( rotated && (timeout < 0 || timeout > 1000) ) timeout = 1000;
+        // the snapshot of the queries follows an idle file
+        if ( table->server && (timeout < 0 || timeout > QUERYREFRESH) ) timeout = QUERYREFRESH;
+        if ( poll(&pfd, 1, timeout) > 0 ){
+            char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t len = read(ifd, events, sizeof(events));
+            for (char* e = events; len > 0 && e < events + len; ){
+                struct inotify_event* ev = (struct inotify_event*)e;
+                if ( ev->wd == wd && (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) ){
+                    inotify_rm_watch(ifd, wd);
+                    rotated = true;
+                }
+                e += sizeof(struct inotify_event) + ev->len;
+            }
+        }
     }
-    if ( fp == NULL ){
-        fp = stdin;
+
+    if ( splitter.overlong ) fprintf(stderr, "%llu lines longer than %d characters ignored\n", (unsigned long long)splitter.overlong, LINEMAX);
+    memFree(buffer);
+    close(fd);
+    close(ifd);
+    return r;
+}
+
+/**
+ * @brief read a log in the flux table: a snapshot, a capture, a columnar file, a compressed file or text
+ * 
+ * @param table the flux table
+ * @param opt the options
+ * @param path the file, NULL for stdin
+ * @param fd the file (or stdin) opened, read when it is text
+ * @return int 0, 1 on error
+ */
+int readFile(fluxTable* table, const options* opt, const char* path, int fd){
+    if ( path && isSnapshotFile(path) ){
+        if ( readSnapshot(path, table) ){
+            fprintf(stderr, "%s: bad snapshot\n", path);
+            return 1;
+        }
+    } else if ( path && isCaptureFile(path) ){
+        int r = readCapture(path, &processCapture, table);
+        if ( r < 0 ){
+            fprintf(stderr, "%s: bad capture\n", path);
+            return 1;
+        }
+        if ( r ) return 1;
+    } else if ( path && isColumnarFile(path) ){
+        // the blocks out of the subnet are skipped when only the subnet is reported
+        UInt32 minFrom = 0, maxFrom = 0xFFFFFFFF;
+        if ( opt->query && opt->projections == NULL && !opt->period && !opt->everyLines ){
+            minFrom = opt->source.net;
+            maxFrom = opt->source.net | (opt->source.bits ? ~(0xFFFFFFFFu << (32 - opt->source.bits)) : 0xFFFFFFFF);
+        }
+        int r = readColumnar(path, minFrom, maxFrom, &processCapture, table);
+        if ( r < 0 ){
+            fprintf(stderr, "%s: bad columnar file\n", path);
+            return 1;
+        }
+        if ( r ) return 1;
+    } else {
+        lineSplitter splitter;
+        ingest in = { .table = table, .opt = opt, .lastEmit = time(NULL), .lastLines = 0, .count = 0, .splitter = &splitter, .bytes = table->bytes };
+        splitterInit(&splitter, &splitLine, &in);
+        int r;
+        if ( path && compressionOfFile(path) != compressionNone ){
+            // a compressed file is mapped, its zstd frames are decompressed in parallel
+            r = readCompressed(path, opt->threads, &splitter);
+        } else if ( path && opt->uring ){
+            // a text file: several large reads in flight while the lines of a buffer are split
+            r = readUring(path, fd, opt->uring == URINGDIRECT, &splitter);
+        } else {
+            // stdin or a text file: large read() calls, a gzip or zstd pipe is decompressed
+            if ( table->server ) splitter.idle = &idleLine;
+            r = readStream(fd, &splitter);
+        }
+        if ( r < 0 ){
+            fprintf(stderr, "%s: cannot read\n", path ? path : "stdin");
+            return 1;
+        }
+        if ( splitter.overlong ) fprintf(stderr, "%llu lines longer than %d characters ignored\n", (unsigned long long)splitter.overlong, LINEMAX);
+        if ( r ) return 1;
+        return 0;
     }
+    // a binary file is read at once
+    struct stat st;
+    if ( stat(path, &st) == 0 ) table->bytes += st.st_size;
+    return 0;
+}
 
-    node* radixRoot = NULL;
-    list* listFlux = NULL;
-    list* last = NULL;
+#ifdef __SHOW_RADIX__
+/**
+ * @brief print a key of the radix tree and its flux id
+ */
+static int showLeaf(const UInt32* key, void* data, void* ctx){
+    (void)ctx;
+    fprintf(stderr, "key[%08X%08X%08X] - Flux: %u\n", key[0], key[1], key[2], LEAFFLOW(data));
+    return 0;
+}
+#endif
 
-    while ( fgets(buffer, sizeof(buffer), fp) != NULL){
-        if ( *buffer == '\n' ) continue;
+/**
+ * @brief the function reading a file of the batch: the periodic emission is disabled,
+ * the parallelism is given by the files
+ * 
+ * @param table the flux table of the file
+ * @param path the file
+ * @param ctx the options
+ * @return int 0, 1 on error
+ */
+int readBatchFile(fluxTable* table, const char* path, void* ctx){
+    options opt = *(const options*)ctx;
+    opt.period = 0;
+    opt.everyLines = 0;
+    opt.threads = 1;
 
-        fromtopacket* packet = decode(buffer);
-        if ( packet ){
-            char* zflux = fluxString(packet);
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ){
+        perror(path);
+        return 1;
+    }
+    int r = readFile(table, &opt, path, fd);
+    close(fd);
+    return r;
+}
 
-            if ( zflux ){
-                node* n = insert(radixRoot, zflux);
-                if ( radixRoot == NULL) {
-                    radixRoot = n;
-                }
+/**
+ * @brief the function reading a chunk of a file of the batch: the lines starting in the range.
+ * A binary or compressed file is read whole by its first chunk.
+ * 
+ * @param table the flux table of the chunk
+ * @param path the file
+ * @param begin the first byte of the chunk
+ * @param end the byte after the chunk
+ * @param ctx the options
+ * @return int 0, 1 on error
+ */
+int readBatchRange(fluxTable* table, const char* path, UInt64 begin, UInt64 end, void* ctx){
+    if ( isSnapshotFile(path) || isCaptureFile(path) || isColumnarFile(path) || compressionOfFile(path) != compressionNone ){
+        return begin == 0 ? readBatchFile(table, path, ctx) : 0;
+    }
+    options opt = *(const options*)ctx;
+    opt.period = 0;
+    opt.everyLines = 0;
 
-                if ( n->data == NULL ){
-                    list* newflux = insertlist(listFlux, n);                    
-                    if ( newflux ){
-                        newflux->data = (void*) packet;
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ){
+        perror(path);
+        return 1;
+    }
+    lineSplitter splitter;
+    ingest in = { .table = table, .opt = &opt, .lastEmit = time(NULL), .lastLines = 0, .count = 0, .splitter = &splitter, .bytes = table->bytes };
+    splitterInit(&splitter, &splitLine, &in);
+    int r = readRange(fd, begin, end, &splitter);
+    close(fd);
+    if ( r < 0 ){
+        fprintf(stderr, "%s: cannot read\n", path);
+        return 1;
+    }
+    if ( splitter.overlong ) fprintf(stderr, "%llu lines longer than %d characters ignored\n", (unsigned long long)splitter.overlong, LINEMAX);
+    return r ? 1 : 0;
+}
 
-                        n->data = (void*)newflux;
-                            listFlux = newflux;
-                    }
-                }
+/**
+ * @brief read the input in the table: the file followed, the files of a batch or a single input
+ * 
+ * @param table the flux table
+ * @param opt the options
+ * @param batch many files, a directory or a file cut in chunks
+ * @param fd the single input
+ * @return int 0, 1 on error
+ */
+int readInput(fluxTable* table, const options* opt, bool batch, int fd){
+    if ( opt->follow ){
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = &onSignal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+
+        return follow(table, fd, opt);
+    }
+    if ( !batch ) return readFile(table, opt, opt->path, fd);
+
+    char** paths;
+    int nb = listFiles(opt->paths, opt->nbPaths, &paths);
+    if ( nb < 0 ) return 1;
+    int r;
+    if ( opt->chunk ){
+        r = readChunks(paths, nb, opt->chunk, opt->threads, &readBatchRange, (void*)opt, table);
+    } else {
+        r = readFiles(paths, nb, opt->threads, &readBatchFile, (void*)opt, table);
+    }
+    freeFiles(paths, nb);
+    return r;
+}
+
+/**
+ * @brief parse a size in bytes: N, NK, NM or NG
+ * 
+ * @param text the size
+ * @param size the bytes
+ * @return int 0, -1 if it is not a size
+ */
+int parseSize(const char* text, UInt64* size){
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    int shift = 0;
+    if ( *end == 'K' || *end == 'k' ) shift = 10;
+    if ( *end == 'M' || *end == 'm' ) shift = 20;
+    if ( *end == 'G' || *end == 'g' ) shift = 30;
+    if ( shift ) end++;
+    if ( *text < '0' || *text > '9' || *end != '\0' || value == 0 || value > (0xFFFFFFFFFFFFull >> shift) ) return -1;
+    *size = (UInt64)value << shift;
+    return 0;
+}
 
-                else {
-                    list* nodelist = (list*) n->data;
-                    fromtopacket* p = (fromtopacket*)nodelist->data;
-
-                    if (p->lastPacket < packet->firstPacket){
-                        p->lastPacket = packet->firstPacket;
-                    } else {
-                        printf("Packet - Bad sequence number\n");
-                        printPacketStr(p);
-                        printPacketStr(packet);
-                        printf("--------------------\n");
-                        return 1;
-                    }
-
-                    listFlux = moveNode(listFlux, nodelist, &comparePacket);
+/**
+ * @brief parse a sampling: 1/N or N
+ * 
+ * @param text the sampling
+ * @param sample N
+ * @return int 0, -1 if it is not a sampling
+ */
+int parseSample(const char* text, UInt32* sample){
+    const char* n = strncmp(text, "1/", 2) == 0 ? text + 2 : text;
+    char* end;
+    unsigned long long value = strtoull(n, &end, 10);
+    if ( *n < '0' || *n > '9' || *end != '\0' || value < 1 || value > 0xFFFFFFFFull ) return -1;
+    *sample = (UInt32)value;
+    return 0;
+}
+
+void usage(const char* name){
+    fprintf(stderr, "usage: %s [-f] [-n top] [-t seconds] [-l lines] [-e lines] [-q subnet] [-r bits|pair] [-k keys] [-m name] [-s socket] [-j threads] [-g] [-x file] [-w file] [-d before] [-p file|:port] [-S 1/N] [-b] [-M] [-u] [-c size] [file...|directory]\n", name);
+    fprintf(stderr, "  -f          follow the file as it grows (requires a file)\n");
+    fprintf(stderr, "  -n top      number of flux in the periodic report (default 10)\n");
+    fprintf(stderr, "  -t seconds  emit the top flux every seconds\n");
+    fprintf(stderr, "  -l lines    emit the top flux every lines\n");
+    fprintf(stderr, "  -e lines    flush and free the flux not updated during lines\n");
+    fprintf(stderr, "  -q subnet   report the flux from a source subnet (10.1.0.0/16) in the order of the addresses\n");
+    fprintf(stderr, "  -r bits     report the sizes per source prefix (8, 16, 24...) or per (source, destination) pair\n");
+    fprintf(stderr, "  -k keys     also aggregate the sizes per src,dst,sport,dport,pair in the same pass\n");
+    fprintf(stderr, "  -m name     add the flux to the shared memory table /name (created for %d flux), read it with chimeretop\n", SHMCAPACITY);
+    fprintf(stderr, "  -s socket   answer the queries \"top N\", \"flux ip:port,ip:port\" and \"stats\" on the Unix socket\n");
+    fprintf(stderr, "  -j threads  the number of threads reading the files, decompressing a zstd file or sorting the report (default: the number of cpus)\n");
+    fprintf(stderr, "  -g          also report the sequence numbers seen in each IPv4 flux: the holes and the duplicates\n");
+    fprintf(stderr, "  -x file     write the packets out of order to file, in the format of the log (they are counted on stderr)\n");
+    fprintf(stderr, "  -w file     write the flux in the snapshot file, read again like a log\n");
+    fprintf(stderr, "  -d before   print the flux added, removed or changed since before (a snapshot, a log or a directory) instead of the report\n");
+    fprintf(stderr, "  -S 1/N      --sample 1/N: keep the flux whose hash of the addresses and ports is in 1/N, the report ends with the estimates\n");
+    fprintf(stderr, "  -p file     write the metrics of the reading (Prometheus text format) to file every %d seconds, or serve them on http://127.0.0.1:port/metrics with -p :port\n", METRICSPERIOD);
+    fprintf(stderr, "  -b          --bidirectional: the 2 directions of an IPv4 conversation are one flux, reported with the size of each direction\n");
+    fprintf(stderr, "  -M          count the memory of each subsystem: reported on stderr at exit and on SIGUSR1, with its peak and the bytes per flux\n");
+    fprintf(stderr, "  -u          --uring: read the text files with io_uring, %d reads of %d KB in flight; --direct also bypasses the page cache (O_DIRECT)\n", URINGDEPTH, URINGBUFFER >> 10);
+    fprintf(stderr, "  -c size     cut the text files in chunks of size bytes (256K, 4M...) shared by the -j threads, an idle thread steals the chunks of the others\n");
+}
+
+int main(int argc, char **argv){
+
+    options opt = { .follow = false, .top = 10, .period = 0, .everyLines = 0, .expire = 0, .query = false, .rollup = 0, .projections = NULL, .path = NULL };
+    opt.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    static const struct option longOptions[] = { { "sample", required_argument, NULL, 'S' },
+                                                   { "bidirectional", no_argument, NULL, 'b' }, { "uring", no_argument, NULL, 'u' },
+                                                   { "direct", no_argument, NULL, 'U' }, { NULL, 0, NULL, 0 } };
+    int c;
+    while ( (c = getopt_long(argc, argv, "fn:t:l:e:q:r:k:j:m:s:gx:w:d:p:S:bMuc:h", longOptions, NULL)) != -1 ){
+        switch ( c ){
+            case 'f': opt.follow = true; break;
+            case 'n': opt.top = atoi(optarg); break;
+            case 't': opt.period = atoi(optarg); break;
+            case 'l': opt.everyLines = strtoull(optarg, NULL, 10); break;
+            case 'e': opt.expire = (UInt32)strtoul(optarg, NULL, 10); break;
+            case 'q':
+                if ( parseSubnet(optarg, &opt.source) ){
+                    fprintf(stderr, "%s: bad subnet %s\n", argv[0], optarg);
+                    return 1;
                 }
+                opt.query = true;
+                break;
+            case 'k': opt.projections = optarg; break;
+            case 'j': opt.threads = atoi(optarg); break;
+            case 'm': opt.shared = optarg; break;
+            case 's': opt.socket = optarg; break;
+            case 'g': opt.sequences = true; break;
+            case 'x': opt.quarantine = optarg; break;
+            case 'w': opt.snapshot = optarg; break;
+            case 'd': opt.before = optarg; break;
+            case 'p': opt.metrics = optarg; break;
+            case 'b': opt.bidirectional = true; break;
+            case 'M': opt.memory = true; break;
+            case 'u': if ( !opt.uring ) opt.uring = 1; break;
+            case 'U': opt.uring = URINGDIRECT; break;
+            case 'c':
+                if ( parseSize(optarg, &opt.chunk) ){
+                    fprintf(stderr, "%s: bad chunk %s\n", argv[0], optarg);
+                    return 1;
+                }
+                break;
+            case 'S':
+                if ( parseSample(optarg, &opt.sample) ){
+                    fprintf(stderr, "%s: bad sample %s\n", argv[0], optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                opt.rollup = strcmp(optarg, "pair") == 0 ? ROLLUPPAIR : atoi(optarg);
+                if ( opt.rollup <= 0 || opt.rollup > ROLLUPPAIR ){
+                    fprintf(stderr, "%s: bad rollup %s\n", argv[0], optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if ( optind < argc ) opt.path = argv[optind];
+    opt.paths = argv + optind;
+    opt.nbPaths = argc - optind;
 
-                free(zflux);
-            }
+    // many files, a directory or a file cut in chunks: the files are read in parallel and merged
+    struct stat st;
+    bool batch = opt.nbPaths > 1 || (opt.path && stat(opt.path, &st) == 0 && S_ISDIR(st.st_mode)) || (opt.path && opt.chunk);
+    if ( opt.chunk && (opt.follow || opt.shared || opt.socket) ){
+        fprintf(stderr, "%s: -c is not supported with -f, -m or -s, which read a single input in order\n", argv[0]);
+        return 1;
+    }
+    if ( opt.chunk && !opt.path ){
+        fprintf(stderr, "%s: -c cuts files, not stdin\n", argv[0]);
+        return 1;
+    }
+    if ( opt.chunk && opt.uring ){
+        fprintf(stderr, "%s: -c is not supported with -u, the chunks are read with pread\n", argv[0]);
+        return 1;
+    }
+    if ( batch && opt.follow ){
+        fprintf(stderr, "%s: -f follows a single file\n", argv[0]);
+        return 1;
+    }
+    if ( batch && opt.shared ){
+        fprintf(stderr, "%s: -m feeds the shared table from a single input\n", argv[0]);
+        return 1;
+    }
+    if ( opt.sequences && opt.shared ){
+        fprintf(stderr, "%s: -g reports the flux of this process, not of the shared table\n", argv[0]);
+        return 1;
+    }
+    if ( (opt.snapshot || opt.before) && opt.shared ){
+        fprintf(stderr, "%s: -w and -d need the flux of this process, not of the shared table\n", argv[0]);
+        return 1;
+    }
+    if ( opt.socket && (batch || opt.shared) ){
+        fprintf(stderr, "%s: -s queries the table of a single input\n", argv[0]);
+        return 1;
+    }
+    // the other reports and the shared table know a flux in one direction
+    if ( opt.bidirectional && (opt.shared || opt.sequences || opt.projections || opt.query || opt.rollup || opt.socket
+                               || opt.snapshot || opt.before) ){
+        fprintf(stderr, "%s: -b is not supported with -m, -g, -k, -q, -r, -s, -w or -d\n", argv[0]);
+        return 1;
+    }
+
+    // the counters start before the first allocation of a table
+    if ( opt.memory ){
+        memAccounting();
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = &onMemorySignal;
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &sa, NULL);
+    }
+
+    int fd = -1;
+    if ( opt.path && !batch ) {
+        fd = open(opt.path, O_RDONLY);
+    }
+    if ( opt.follow && fd < 0 ){
+        fprintf(stderr, "%s: cannot follow %s\n", argv[0], opt.path ? opt.path : "stdin");
+        return 1;
+    }
+    if ( fd < 0 ){
+        fd = STDIN_FILENO;
+    }
+
+    fluxTable table;
+    memset(&table, 0, sizeof(table));
+    table.expire = opt.expire;
+    table.nextSweep = opt.expire;
+    setSampling(&table, opt.sample);
+    if ( opt.bidirectional ) setBidirectional(&table);
+    if ( opt.projections ){
+        table.nbAggregates = parseProjections(opt.projections, table.aggregates, MAXAGGREGATES);
+        if ( table.nbAggregates < 0 ){
+            fprintf(stderr, "%s: bad keys %s\n", argv[0], opt.projections);
+            return 1;
+        }
+    }
+
+    if ( opt.sequences && (table.sequences = seqTableCreate()) == NULL ){
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    if ( opt.quarantine && (table.quarantine = quarantineOpen(opt.quarantine)) == NULL ){
+        perror(opt.quarantine);
+        return 1;
+    }
+
+    // the counters of the reading, published by the thread of the table and the workers of a batch
+    metrics* exporter = NULL;
+    if ( opt.metrics ){
+        exporter = metricsStart(opt.metrics);
+        if ( exporter == NULL ){
+            fprintf(stderr, "%s: cannot export the metrics to %s\n", argv[0], opt.metrics);
+            return 1;
         }
+        table.metrics = metricsClaim(exporter);
+    }
+
+    shmWriter writer = { .table = NULL, .nb = 0 };
+    if ( opt.shared ){
+        writer.table = shmOpen(opt.shared, SHMCAPACITY);
+        if ( writer.table == NULL ){
+            fprintf(stderr, "%s: cannot open the shared table %s\n", argv[0], opt.shared);
+            return 1;
+        }
+        table.shared = &writer;
+    }
+    if ( opt.socket ){
+        table.server = queryStart(opt.socket);
+        if ( table.server == NULL ){
+            fprintf(stderr, "%s: cannot listen on %s\n", argv[0], opt.socket);
+            return 1;
+        }
+        queryPublish(table.server, &table);
+    }
+
+    // the table compared to the input is read first, like a batch
+    int r = 0;
+    fluxTable before;
+    memset(&before, 0, sizeof(before));
+    setSampling(&before, opt.sample);
+    if ( opt.before ){
+        char** paths;
+        int nb = listFiles((char**)&opt.before, 1, &paths);
+        if ( nb < 0 ){
+            r = 1;
+        } else {
+            r = readFiles(paths, nb, opt.threads, &readBatchFile, &opt, &before);
+            freeFiles(paths, nb);
+        }
+    }
+
+    // an error does not return before the outputs are closed and the socket removed
+    if ( r == 0 ) r = readInput(&table, &opt, batch, fd);
+
+    // the packets out of order do not stop the reading: they are counted
+    if ( table.reordered || table.repeated ){
+        fprintf(stderr, "%llu packets out of order: %llu before the first packet of their flux, %llu inside its range\n",
+                (unsigned long long)(table.reordered + table.repeated), (unsigned long long)table.reordered, (unsigned long long)table.repeated);
+    }
+    if ( table.malformed ) fprintf(stderr, "%llu lines not decoded ignored\n", (unsigned long long)table.malformed);
+    // the workers of a batch have published their files
+    if ( !batch ) publishFlux(&table);
+    if ( metricsStop(exporter) ){
+        fprintf(stderr, "%s: cannot write %s\n", argv[0], opt.metrics);
+        r = 1;
+    }
+    table.metrics = NULL;
+    if ( quarantineClose(table.quarantine) ){
+        fprintf(stderr, "%s: cannot write %s\n", argv[0], opt.quarantine);
+        r = 1;
+    }
+    table.quarantine = NULL;
+    queryStop(table.server);
+    table.server = NULL;
+    if ( r ) return 1;
+
+    if ( opt.shared ){
+        // the report is read in the shared table by chimeretop
+        r = shmFlush(&writer);
+        shmHeader* h = writer.table->header;
+        fprintf(stderr, "%llu lines added to %s: %u flux, %llu dropped\n", (unsigned long long)table.lines, opt.shared,
+                h->nbFlux, (unsigned long long)h->dropped);
+        shmClose(writer.table);
+        if ( opt.memory ) reportMemory(&table);
+        return r ? 1 : 0;
+    }
+
+    if ( opt.snapshot && writeSnapshot(&table, opt.snapshot) ){
+        perror(opt.snapshot);
+        return 1;
+    }
+    if ( opt.before ){
+        if ( printDiff(&before, &table, stdout) ){
+            fprintf(stderr, "%s: cannot write the diff\n", argv[0]);
+            return 1;
+        }
+        if ( opt.memory ) reportMemory(&table);
+        return 0;
     }
 
 #ifdef __SHOW_RADIX__
-    printRadix(radixRoot);
+    radix96Walk(&table.tree, NULL, 0, &showLeaf, NULL);
     printf("----------------------\n");
 #endif
-    printList(listFlux, &affiche);
+    if ( opt.rollup ){
+        printRollup(&table.tree, &table.flows, opt.query ? &opt.source : NULL, opt.rollup, stdout);
+    } else if ( opt.query ){
+        printSubnet(&table.tree, &table.flows, &opt.source, &affiche);
+    } else if ( reportFlux(&table, opt.threads, stdout) ){
+        fprintf(stderr, "%s: cannot write the report\n", argv[0]);
+        return 1;
+    }
+    for (int i=0; i<table.nbAggregates; i++){
+        printAggregates(&table.aggregates[i]);
+    }
+    if ( reportSample(&table, stdout) || reportSequences(&table, stdout) ){
+        fprintf(stderr, "%s: cannot write the report\n", argv[0]);
+        return 1;
+    }
+    // the peak includes the report
+    if ( opt.memory ) reportMemory(&table);
     return 0;
 }
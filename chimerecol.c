@@ -0,0 +1,61 @@
+/**
+ * @file chimerecol.c
+ * @author Sebastien Galvagno
+ * @brief Convert a text log into the binary columnar format read by chimere
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * ./chimerecol log.txt log.col
+ * ./chimerecol log.col < log.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+#include "columnar.h"
+
+int main(int argc, char **argv){
+    if ( argc < 2 || argc > 3 ){
+        fprintf(stderr, "usage: %s [log] columnar\n", argv[0]);
+        return 1;
+    }
+
+    FILE* fp = stdin;
+    if ( argc == 3 ){
+        fp = fopen(argv[1], "r");
+        if ( fp == NULL ){
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    columnarWriter* writer = columnarCreate(argv[argc - 1]);
+    if ( writer == NULL ){
+        perror(argv[argc - 1]);
+        return 1;
+    }
+
+    char buffer[SIZEFROMTOMASK+1];
+    UInt64 lines = 0, packets = 0;
+    while ( fgets(buffer, sizeof(buffer), fp) != NULL ){
+        fromtopacket packet;
+        lines++;
+        if ( *buffer == '\n' || !decodePacket(buffer, &packet) ) continue;
+        if ( columnarWrite(writer, &packet) ){
+            perror(argv[argc - 1]);
+            return 1;
+        }
+        packets++;
+    }
+
+    if ( columnarClose(writer) ){
+        perror(argv[argc - 1]);
+        return 1;
+    }
+    fprintf(stderr, "%llu lines, %llu packets\n", (unsigned long long)lines, (unsigned long long)packets);
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file chimeretop.c
+ * @author Sebastien Galvagno
+ * @brief Print the biggest flux of a shared memory table fed by chimere -m
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * ./chimere -m flux eth0.log & ./chimere -m flux eth1.log &
+ * ./chimeretop flux 20
+ * ./chimeretop -d flux
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+#include "shmflux.h"
+
+static int printFlux(const fromtopacket* flux, void* ctx){
+    (void)ctx;
+    printPacketSummary((fromtopacket*)flux);
+    return 0;
+}
+
+int main(int argc, char **argv){
+    if ( argc == 3 && strcmp(argv[1], "-d") == 0 ){
+        if ( shmRemove(argv[2]) ){
+            perror(argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+    if ( argc < 2 || argc > 3 || argv[1][0] == '-' ){
+        fprintf(stderr, "usage: %s name [top]\n", argv[0]);
+        fprintf(stderr, "       %s -d name    remove the shared table\n", argv[0]);
+        return 1;
+    }
+
+    shmTable* table = shmOpen(argv[1], 1);
+    if ( table == NULL ){
+        fprintf(stderr, "%s: cannot open the shared table %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    int top = argc == 3 ? atoi(argv[2]) : 10;
+    shmHeader* h = table->header;
+    printf("---- top %d of %u flux after %llu lines ----\n", top, h->nbFlux, (unsigned long long)h->lines);
+    shmTop(table, top, &printFlux, NULL);
+    shmClose(table);
+    return 0;
+}
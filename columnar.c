@@ -0,0 +1,283 @@
+/**
+ * @file columnar.c
+ * @author Sebastien Galvagno
+ * @brief Binary columnar log format
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __UNITTEST_COLUMNAR__
+#include <assert.h>
+#endif
+
+#include "columnar.h"
+
+// the number of packets converted from the columns at once
+#define COLUMNARBATCH 256
+
+/**
+ * @brief the size of the columns of a block, padded to 8 bytes
+ */
+static size_t blockSize(UInt32 count){
+    size_t size = (size_t)count * (3 * sizeof(UInt32) + 2 * sizeof(UInt16));
+    return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief create a columnar file
+ * 
+ * @param path the file
+ * @return columnarWriter* the writer, NULL on error
+ */
+columnarWriter* columnarCreate(const char* path){
+    columnarWriter* writer = (columnarWriter*)malloc(sizeof(columnarWriter));
+    if ( writer == NULL ) return NULL;
+    writer->count = 0;
+    writer->fp = fopen(path, "wb");
+    if ( writer->fp == NULL ){
+        free(writer);
+        return NULL;
+    }
+
+    columnarHeader header;
+    memcpy(header.magic, COLUMNARMAGIC, sizeof(header.magic));
+    header.version = 1;
+    header.blockSize = COLUMNARBLOCK;
+    if ( fwrite(&header, sizeof(header), 1, writer->fp) != 1 ){
+        fclose(writer->fp);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+#define MINMAX(column, min, max) \
+    min = max = column[0]; \
+    for (UInt32 i=1; i<count; i++){ \
+        if ( column[i] < min ) min = column[i]; \
+        if ( column[i] > max ) max = column[i]; \
+    }
+
+/**
+ * @brief write the current block: its header and its columns
+ */
+static int flushBlock(columnarWriter* writer){
+    UInt32 count = writer->count;
+    if ( count == 0 ) return 0;
+
+    columnarBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.count = count;
+    MINMAX(writer->from, header.minFrom, header.maxFrom);
+    MINMAX(writer->to, header.minTo, header.maxTo);
+    MINMAX(writer->seq, header.minSeq, header.maxSeq);
+    MINMAX(writer->portFrom, header.minPortFrom, header.maxPortFrom);
+    MINMAX(writer->portTo, header.minPortTo, header.maxPortTo);
+
+    static const UInt8 padding[8] = { 0 };
+    size_t columns = (size_t)count * (3 * sizeof(UInt32) + 2 * sizeof(UInt16));
+    int ok = fwrite(&header, sizeof(header), 1, writer->fp) == 1
+        && fwrite(writer->from, sizeof(UInt32), count, writer->fp) == count
+        && fwrite(writer->to, sizeof(UInt32), count, writer->fp) == count
+        && fwrite(writer->seq, sizeof(UInt32), count, writer->fp) == count
+        && fwrite(writer->portFrom, sizeof(UInt16), count, writer->fp) == count
+        && fwrite(writer->portTo, sizeof(UInt16), count, writer->fp) == count
+        && fwrite(padding, 1, blockSize(count) - columns, writer->fp) == blockSize(count) - columns;
+    writer->count = 0;
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief add a packet to the file
+ * 
+ * @param writer the writer
+ * @param packet the packet
+ * @return int 0 on success, -1 on a write error
+ */
+int columnarWrite(columnarWriter* writer, const fromtopacket* packet){
+    UInt32 i = writer->count++;
+    writer->from[i] = ntohl(packet->from);
+    writer->to[i] = ntohl(packet->to);
+    writer->seq[i] = packet->firstPacket;
+    writer->portFrom[i] = packet->portFrom;
+    writer->portTo[i] = packet->portTo;
+    return writer->count == COLUMNARBLOCK ? flushBlock(writer) : 0;
+}
+
+/**
+ * @brief write the last block and close the file
+ * 
+ * @param writer the writer
+ * @return int 0 on success, -1 on a write error
+ */
+int columnarClose(columnarWriter* writer){
+    int r = flushBlock(writer);
+    if ( fclose(writer->fp) != 0 ) r = -1;
+    free(writer);
+    return r;
+}
+
+/**
+ * @brief test whether a file is a columnar file
+ * 
+ * @param path the file
+ * @return int 1 for a columnar file, 0 otherwise
+ */
+int isColumnarFile(const char* path){
+    char magic[8];
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return 0;
+    ssize_t size = read(fd, magic, sizeof(magic));
+    close(fd);
+    return size == sizeof(magic) && memcmp(magic, COLUMNARMAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * @brief give the packets of a block to fn, converted from the columns by batches:
+ * each loop only reads one contiguous column
+ */
+static int readBlock(const columnarBlockHeader* header, packetFn fn, void* ctx){
+    UInt32 count = header->count;
+    const UInt32* from = (const UInt32*)(header + 1);
+    const UInt32* to = from + count;
+    const UInt32* seq = to + count;
+    const UInt16* portFrom = (const UInt16*)(seq + count);
+    const UInt16* portTo = portFrom + count;
+
+    fromtopacket batch[COLUMNARBATCH];
+    memset(batch, 0, sizeof(batch));
+
+    for (UInt32 start=0; start<count; start+=COLUMNARBATCH){
+        UInt32 nb = count - start < COLUMNARBATCH ? count - start : COLUMNARBATCH;
+        for (UInt32 i=0; i<nb; i++) batch[i].from = htonl(from[start + i]);
+        for (UInt32 i=0; i<nb; i++) batch[i].to = htonl(to[start + i]);
+        for (UInt32 i=0; i<nb; i++) batch[i].firstPacket = seq[start + i];
+        for (UInt32 i=0; i<nb; i++) batch[i].portFrom = portFrom[start + i];
+        for (UInt32 i=0; i<nb; i++) batch[i].portTo = portTo[start + i];
+
+        for (UInt32 i=0; i<nb; i++){
+            int r = fn(&batch[i], ctx);
+            if ( r ) return r;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief read the packets of a columnar file - the file is mapped in memory
+ * 
+ * The blocks without a source address between minFrom and maxFrom (host order) are skipped
+ * using their header, the packets of the other blocks are all given to fn.
+ * 
+ * @param path the file
+ * @param minFrom the lowest source address of the blocks to read
+ * @param maxFrom the highest source address of the blocks to read
+ * @param fn the function called for each packet
+ * @param ctx the context given to fn
+ * @return int 0 at the end of the file, the non zero return of fn, -1 on error
+ */
+int readColumnar(const char* path, UInt32 minFrom, UInt32 maxFrom, packetFn fn, void* ctx){
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return -1;
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(columnarHeader) ){
+        close(fd);
+        return -1;
+    }
+
+    UInt8* data = (UInt8*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( data == MAP_FAILED ) return -1;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    int r = 0;
+    size_t size = st.st_size;
+    const columnarHeader* header = (const columnarHeader*)data;
+    if ( memcmp(header->magic, COLUMNARMAGIC, sizeof(header->magic)) != 0 || header->version != 1 ) r = -1;
+
+    size_t offset = sizeof(columnarHeader);
+    while ( r == 0 && offset < size ){
+        const columnarBlockHeader* block = (const columnarBlockHeader*)(data + offset);
+        if ( size - offset < sizeof(columnarBlockHeader)
+            || block->count > header->blockSize
+            || size - offset - sizeof(columnarBlockHeader) < blockSize(block->count) ){
+            r = -1;
+            break;
+        }
+        if ( block->maxFrom >= minFrom && block->minFrom <= maxFrom ){
+            r = readBlock(block, fn, ctx);
+        }
+        offset += sizeof(columnarBlockHeader) + blockSize(block->count);
+    }
+
+    munmap(data, size);
+    return r;
+}
+
+
+#ifdef __UNITTEST_COLUMNAR__
+
+static UInt64 nbPackets, sumSeq;
+static UInt32 lastFrom;
+
+int check(const fromtopacket* packet, void* ctx){
+    (void)ctx;
+    nbPackets++;
+    sumSeq += packet->firstPacket;
+    lastFrom = ntohl(packet->from);
+    assert(packet->portFrom == (UInt16)packet->firstPacket);
+    assert(packet->portTo == 80);
+    return 0;
+}
+
+int main(){
+    const char* path = "/tmp/chimere_columnar_test.col";
+    columnarWriter* writer = columnarCreate(path);
+    assert(writer != NULL);
+
+    // 2 full blocks and a partial one, the source address is the block number
+    UInt64 total = 2 * COLUMNARBLOCK + 10, expected = 0;
+    for (UInt64 i=0; i<total; i++){
+        fromtopacket packet;
+        memset(&packet, 0, sizeof(packet));
+        packet.from = htonl(0x0A000000 + (UInt32)(i / COLUMNARBLOCK));
+        packet.to = htonl(0xC0A80001);
+        packet.firstPacket = (UInt32)i;
+        packet.portFrom = (UInt16)i;
+        packet.portTo = 80;
+        expected += i;
+        assert(columnarWrite(writer, &packet) == 0);
+    }
+    assert(columnarClose(writer) == 0);
+    assert(isColumnarFile(path));
+
+    assert(readColumnar(path, 0, 0xFFFFFFFF, &check, NULL) == 0);
+    assert(nbPackets == total);
+    assert(sumSeq == expected);
+
+    // only the block of 10.0.0.1
+    nbPackets = 0;
+    assert(readColumnar(path, 0x0A000001, 0x0A000001, &check, NULL) == 0);
+    assert(nbPackets == COLUMNARBLOCK);
+    assert(lastFrom == 0x0A000001);
+
+    unlink(path);
+    return 0;
+}
+
+// gcc -o columnar columnar.c -g -D__UNITTEST_COLUMNAR__ && ./columnar
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file columnar.h
+ * @author Sebastien Galvagno
+ * @brief Binary columnar log format
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The file is a header and blocks of at most COLUMNARBLOCK packets. A block is its header
+ * (the number of packets, the minimum and the maximum of each column) and the columns:
+ * from[], to[], seq[] (32 bits), portFrom[], portTo[] (16 bits), padded to 8 bytes.
+ * The addresses are in host order so the minimum and the maximum are address ranges.
+ * The integers are written in the byte order of the host (little endian).
+ */
+#ifndef __SG__CHIMERE_COLUMNAR_H__
+#define __SG__CHIMERE_COLUMNAR_H__
+
+#include <stdio.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+
+#define COLUMNARMAGIC "CHIMCOL1"
+#define COLUMNARBLOCK 65536
+
+typedef struct {
+    char magic[8];
+    UInt32 version;
+    UInt32 blockSize;
+} columnarHeader;
+
+typedef struct {
+    UInt32 count;
+    UInt32 minFrom, maxFrom;
+    UInt32 minTo, maxTo;
+    UInt32 minSeq, maxSeq;
+    UInt16 minPortFrom, maxPortFrom;
+    UInt16 minPortTo, maxPortTo;
+    UInt32 reserved; // the blocks are aligned on 8 bytes
+} columnarBlockHeader;
+
+/**
+ * @brief a writer: the columns of the current block
+ */
+typedef struct {
+    FILE* fp;
+    UInt32 count;
+    UInt32 from[COLUMNARBLOCK];
+    UInt32 to[COLUMNARBLOCK];
+    UInt32 seq[COLUMNARBLOCK];
+    UInt16 portFrom[COLUMNARBLOCK];
+    UInt16 portTo[COLUMNARBLOCK];
+} columnarWriter;
+
+/**
+ * @brief create a columnar file
+ * 
+ * @param path the file
+ * @return columnarWriter* the writer, NULL on error
+ */
+columnarWriter* columnarCreate(const char* path);
+
+/**
+ * @brief add a packet to the file
+ * 
+ * @param writer the writer
+ * @param packet the packet
+ * @return int 0 on success, -1 on a write error
+ */
+int columnarWrite(columnarWriter* writer, const fromtopacket* packet);
+
+/**
+ * @brief write the last block and close the file
+ * 
+ * @param writer the writer
+ * @return int 0 on success, -1 on a write error
+ */
+int columnarClose(columnarWriter* writer);
+
+/**
+ * @brief test whether a file is a columnar file
+ * 
+ * @param path the file
+ * @return int 1 for a columnar file, 0 otherwise
+ */
+int isColumnarFile(const char* path);
+
+/**
+ * @brief read the packets of a columnar file - the file is mapped in memory
+ * 
+ * The blocks without a source address between minFrom and maxFrom (host order) are skipped
+ * using their header, the packets of the other blocks are all given to fn.
+ * 
+ * @param path the file
+ * @param minFrom the lowest source address of the blocks to read
+ * @param maxFrom the highest source address of the blocks to read
+ * @param fn the function called for each packet
+ * @param ctx the context given to fn
+ * @return int 0 at the end of the file, the non zero return of fn, -1 on error
+ */
+int readColumnar(const char* path, UInt32 minFrom, UInt32 maxFrom, packetFn fn, void* ctx);
+
+#endif
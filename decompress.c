@@ -0,0 +1,586 @@
+/**
+ * @file decompress.c
+ * @author Sebastien Galvagno
+ * @brief In-process decompression of gzip and zstd logs
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * Built with -DHAVE_ZLIB -lz and -DHAVE_ZSTD -lzstd when the libraries are available (see script.sh).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef __UNITTEST_DECOMPRESS__
+#include <assert.h>
+#endif
+
+#include "decompress.h"
+#include "pool.h"
+
+/**
+ * @brief the compression of a buffer, given by its magic number
+ * 
+ * @param data the first bytes of the file
+ * @param size the size of the buffer
+ * @return compression 
+ */
+compression detectCompression(const UInt8* data, size_t size){
+    if ( size >= 2 && data[0] == 0x1F && data[1] == 0x8B ) return compressionGzip;
+    if ( size >= 4 && data[0] == 0x28 && data[1] == 0xB5 && data[2] == 0x2F && data[3] == 0xFD ) return compressionZstd;
+    return compressionNone;
+}
+
+/**
+ * @brief the compression of a file, given by its magic number
+ * 
+ * @param path the file
+ * @return compression 
+ */
+compression compressionOfFile(const char* path){
+    UInt8 magic[4];
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return compressionNone;
+    ssize_t size = read(fd, magic, sizeof(magic));
+    close(fd);
+    return size > 0 ? detectCompression(magic, size) : compressionNone;
+}
+
+
+#ifdef HAVE_ZLIB
+/**
+ * @brief decompress the gzip members of a file, one after the other
+ */
+static int readGzip(const UInt8* data, size_t size, lineSplitter* splitter){
+    char* out = (char*)memAlloc(DECOMPRESSBUFFER, MEMBUFFERS);
+    if ( out == NULL ) return -1;
+
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    // 15 + 32: the largest window, gzip or zlib header detected
+    if ( inflateInit2(&z, 15 + 32) != Z_OK ){
+        memFree(out);
+        return -1;
+    }
+
+    int r = 0;
+    size_t offset = 0;
+    while ( r == 0 ){
+        // avail_in is 32 bits: the file is given by slices of 1 GB
+        if ( z.avail_in == 0 && offset < size ){
+            size_t slice = size - offset < (1u << 30) ? size - offset : (1u << 30);
+            z.next_in = (Bytef*)(data + offset);
+            z.avail_in = (uInt)slice;
+            offset += slice;
+        }
+
+        z.next_out = (Bytef*)out;
+        z.avail_out = DECOMPRESSBUFFER;
+        int status = inflate(&z, Z_NO_FLUSH);
+        if ( status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR ){
+            fprintf(stderr, "gzip: %s\n", z.msg ? z.msg : "bad data");
+            r = -1;
+            break;
+        }
+
+        r = splitLines(splitter, out, DECOMPRESSBUFFER - z.avail_out);
+        if ( status == Z_STREAM_END ){
+            if ( z.avail_in == 0 && offset == size ) break;
+            inflateReset(&z); // the next member
+        } else if ( status == Z_BUF_ERROR && z.avail_in == 0 && offset == size ){
+            fprintf(stderr, "gzip: truncated file\n");
+            r = -1;
+        }
+    }
+
+    inflateEnd(&z);
+    memFree(out);
+    return r;
+}
+#endif
+
+
+#ifdef HAVE_ZSTD
+/**
+ * @brief a decompression slot: a frame and its decompressed data, the buffer is reused for the next frames
+ */
+typedef struct {
+    size_t frame;
+    char* dst;
+    size_t capacity;
+    size_t size;
+    int ready;
+    int error;
+} zstdSlot;
+
+/**
+ * @brief the frames of a zstd file decompressed by a pool of threads.
+ * At most nbSlots frames are decompressed in advance of the reader.
+ */
+typedef struct {
+    const UInt8* data;
+    size_t* frames;     // the offset of each frame, nbFrames+1 values
+    size_t nbFrames;
+    zstdSlot* slots;
+    size_t nbSlots;
+    size_t next;        // the next frame to decompress
+    size_t consumed;    // the number of frames split in lines
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} zstdJob;
+
+/**
+ * @brief decompress a frame in a slot, the buffer grows when needed
+ */
+static int decompressFrame(ZSTD_DCtx* dctx, const UInt8* src, size_t srcSize, zstdSlot* slot){
+    unsigned long long contentSize = ZSTD_getFrameContentSize(src, srcSize);
+    if ( contentSize == ZSTD_CONTENTSIZE_ERROR ) return -1;
+
+    if ( contentSize != ZSTD_CONTENTSIZE_UNKNOWN ){
+        if ( contentSize > slot->capacity ){
+            char* dst = (char*)memRealloc(slot->dst, contentSize, MEMBUFFERS);
+            if ( dst == NULL ) return -1;
+            slot->dst = dst;
+            slot->capacity = contentSize;
+        }
+        size_t size = ZSTD_decompressDCtx(dctx, slot->dst, slot->capacity, src, srcSize);
+        if ( ZSTD_isError(size) ) return -1;
+        slot->size = size;
+        return 0;
+    }
+
+    // the size is not in the frame header: streaming decompression
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    ZSTD_inBuffer in = { src, srcSize, 0 };
+    slot->size = 0;
+    for (;;){
+        if ( slot->capacity - slot->size < DECOMPRESSBUFFER ){
+            char* dst = (char*)memRealloc(slot->dst, slot->capacity + DECOMPRESSBUFFER, MEMBUFFERS);
+            if ( dst == NULL ) return -1;
+            slot->dst = dst;
+            slot->capacity += DECOMPRESSBUFFER;
+        }
+        ZSTD_outBuffer out = { slot->dst, slot->capacity, slot->size };
+        size_t status = ZSTD_decompressStream(dctx, &out, &in);
+        if ( ZSTD_isError(status) ) return -1;
+        slot->size = out.pos;
+        if ( status == 0 ) return 0;
+        if ( in.pos == in.size && out.pos < out.size ) return -1; // truncated frame
+    }
+}
+
+static void* zstdWorker(void* arg){
+    zstdJob* job = (zstdJob*)arg;
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+
+    pthread_mutex_lock(&job->lock);
+    for (;;){
+        while ( !job->stop && job->next < job->nbFrames && job->next - job->consumed >= job->nbSlots ){
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
+        if ( job->stop || job->next >= job->nbFrames ) break;
+
+        size_t frame = job->next++;
+        zstdSlot* slot = &job->slots[frame % job->nbSlots];
+        pthread_mutex_unlock(&job->lock);
+
+        const UInt8* src = job->data + job->frames[frame];
+        size_t srcSize = job->frames[frame + 1] - job->frames[frame];
+        int error = dctx == NULL || decompressFrame(dctx, src, srcSize, slot) != 0;
+
+        pthread_mutex_lock(&job->lock);
+        slot->frame = frame;
+        slot->error = error;
+        slot->ready = 1;
+        pthread_cond_broadcast(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    if ( dctx ) ZSTD_freeDCtx(dctx);
+    return NULL;
+}
+
+/**
+ * @brief decompress the frames of a zstd file in parallel, the lines are split in the order of the frames
+ */
+static int readZstd(const UInt8* data, size_t size, int threads, lineSplitter* splitter){
+    zstdJob job;
+    memset(&job, 0, sizeof(job));
+    job.data = data;
+
+    // the frame boundaries are given by the frame headers, without decompression
+    size_t capacity = 64;
+    job.frames = (size_t*)malloc(capacity * sizeof(size_t));
+    size_t offset = 0;
+    while ( job.frames && offset < size ){
+        size_t frameSize = ZSTD_findFrameCompressedSize(data + offset, size - offset);
+        if ( ZSTD_isError(frameSize) ){
+            fprintf(stderr, "zstd: %s\n", ZSTD_getErrorName(frameSize));
+            free(job.frames);
+            return -1;
+        }
+        if ( job.nbFrames + 2 > capacity ){
+            capacity *= 2;
+            size_t* frames = (size_t*)realloc(job.frames, capacity * sizeof(size_t));
+            if ( frames == NULL ) break;
+            job.frames = frames;
+        }
+        job.frames[job.nbFrames++] = offset;
+        offset += frameSize;
+    }
+    if ( job.frames == NULL || offset < size ){
+        free(job.frames);
+        return -1;
+    }
+    job.frames[job.nbFrames] = offset;
+
+    if ( threads < 1 ) threads = 1;
+    if ( (size_t)threads > job.nbFrames ) threads = job.nbFrames ? (int)job.nbFrames : 1;
+    job.nbSlots = 2 * threads;
+    job.slots = (zstdSlot*)calloc(job.nbSlots, sizeof(zstdSlot));
+    pthread_t* workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if ( job.slots == NULL || workers == NULL ){
+        free(job.slots);
+        free(workers);
+        free(job.frames);
+        return -1;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    int nbWorkers = 0;
+    for (int i=0; i<threads; i++){
+        if ( pthread_create(&workers[nbWorkers], NULL, &zstdWorker, &job) == 0 ) nbWorkers++;
+    }
+
+    int r = nbWorkers ? 0 : -1;
+    for (size_t frame=0; r == 0 && frame<job.nbFrames; frame++){
+        zstdSlot* slot = &job.slots[frame % job.nbSlots];
+        pthread_mutex_lock(&job.lock);
+        while ( !(slot->ready && slot->frame == frame) ){
+            pthread_cond_wait(&job.cond, &job.lock);
+        }
+        pthread_mutex_unlock(&job.lock);
+
+        if ( slot->error ){
+            fprintf(stderr, "zstd: bad frame %zu\n", frame);
+            r = -1;
+        } else {
+            r = splitLines(splitter, slot->dst, slot->size);
+        }
+
+        pthread_mutex_lock(&job.lock);
+        slot->ready = 0;
+        job.consumed++;
+        pthread_cond_broadcast(&job.cond);
+        pthread_mutex_unlock(&job.lock);
+    }
+
+    pthread_mutex_lock(&job.lock);
+    job.stop = 1;
+    pthread_cond_broadcast(&job.cond);
+    pthread_mutex_unlock(&job.lock);
+    for (int i=0; i<nbWorkers; i++) pthread_join(workers[i], NULL);
+
+    for (size_t i=0; i<job.nbSlots; i++) memFree(job.slots[i].dst);
+    free(job.slots);
+    free(workers);
+    free(job.frames);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.cond);
+    return r;
+}
+#endif
+
+
+#ifdef HAVE_ZLIB
+/**
+ * @brief decompress a gzip stream: the first bytes are given, the rest is read from fd
+ */
+static int readGzipStream(int fd, const UInt8* head, size_t headSize, lineSplitter* splitter){
+    char* in = (char*)memAlloc(DECOMPRESSBUFFER, MEMBUFFERS);
+    char* out = (char*)memAlloc(DECOMPRESSBUFFER, MEMBUFFERS);
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if ( in == NULL || out == NULL || inflateInit2(&z, 15 + 32) != Z_OK ){
+        memFree(in);
+        memFree(out);
+        return -1;
+    }
+
+    int r = 0, eof = 0, ended = 0;
+    z.next_in = (Bytef*)head;
+    z.avail_in = (uInt)headSize;
+    while ( r == 0 ){
+        if ( z.avail_in == 0 && !eof ){
+            ssize_t n = read(fd, in, DECOMPRESSBUFFER);
+            if ( n < 0 ){
+                r = -1;
+                break;
+            }
+            eof = n == 0;
+            z.next_in = (Bytef*)in;
+            z.avail_in = (uInt)n;
+        }
+        // the last member ended with the previous read
+        if ( ended && z.avail_in == 0 && eof ) break;
+        ended = 0;
+
+        z.next_out = (Bytef*)out;
+        z.avail_out = DECOMPRESSBUFFER;
+        int status = inflate(&z, Z_NO_FLUSH);
+        if ( status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR ){
+            fprintf(stderr, "gzip: %s\n", z.msg ? z.msg : "bad data");
+            r = -1;
+            break;
+        }
+
+        r = splitLines(splitter, out, DECOMPRESSBUFFER - z.avail_out);
+        if ( status == Z_STREAM_END ){
+            if ( z.avail_in == 0 && eof ) break;
+            ended = 1;
+            inflateReset(&z); // the next member, or the end of the stream on the next read
+        } else if ( status == Z_BUF_ERROR && z.avail_in == 0 && eof ){
+            fprintf(stderr, "gzip: truncated stream\n");
+            r = -1;
+        }
+    }
+
+    inflateEnd(&z);
+    memFree(in);
+    memFree(out);
+    return r;
+}
+#endif
+
+
+#ifdef HAVE_ZSTD
+/**
+ * @brief decompress a zstd stream: the first bytes are given, the rest is read from fd.
+ * The frames of a pipe are not known in advance, they are decompressed by this thread.
+ */
+static int readZstdStream(int fd, const UInt8* head, size_t headSize, lineSplitter* splitter){
+    char* buffer = (char*)memAlloc(DECOMPRESSBUFFER, MEMBUFFERS);
+    char* out = (char*)memAlloc(DECOMPRESSBUFFER, MEMBUFFERS);
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if ( buffer == NULL || out == NULL || dctx == NULL ){
+        memFree(buffer);
+        memFree(out);
+        if ( dctx ) ZSTD_freeDCtx(dctx);
+        return -1;
+    }
+
+    int r = 0, flushing = 0;
+    size_t status = 0;
+    ZSTD_inBuffer in = { head, headSize, 0 };
+    while ( r == 0 ){
+        // the input is read when the output of the previous input is flushed
+        if ( in.pos == in.size && !flushing ){
+            ssize_t n = read(fd, buffer, DECOMPRESSBUFFER);
+            if ( n < 0 ) r = -1;
+            if ( n <= 0 ) break;
+            in.src = buffer;
+            in.size = n;
+            in.pos = 0;
+        }
+
+        ZSTD_outBuffer output = { out, DECOMPRESSBUFFER, 0 };
+        status = ZSTD_decompressStream(dctx, &output, &in);
+        if ( ZSTD_isError(status) ){
+            fprintf(stderr, "zstd: %s\n", ZSTD_getErrorName(status));
+            r = -1;
+            break;
+        }
+        flushing = output.pos == output.size;
+        r = splitLines(splitter, out, output.pos);
+    }
+    if ( r == 0 && status != 0 ){
+        fprintf(stderr, "zstd: truncated stream\n");
+        r = -1;
+    }
+
+    ZSTD_freeDCtx(dctx);
+    memFree(buffer);
+    memFree(out);
+    return r;
+}
+#endif
+
+
+/**
+ * @brief read a compressed stream (a pipe): the first bytes, already read to detect the compression, are given,
+ * the rest of the stream is read from fd. The stream is decompressed in reusable buffers
+ * and the lines are split in place in these buffers.
+ * 
+ * @param fd the stream
+ * @param head the first bytes of the stream
+ * @param headSize the number of bytes in head
+ * @param splitter the line splitter
+ * @return int 0 at the end of the stream, the non zero return of the line function, -1 on error
+ */
+int readCompressedStream(int fd, const UInt8* head, size_t headSize, lineSplitter* splitter){
+    int r = -1;
+    switch ( detectCompression(head, headSize) ){
+#ifdef HAVE_ZLIB
+        case compressionGzip:
+            r = readGzipStream(fd, head, headSize, splitter);
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case compressionZstd:
+            r = readZstdStream(fd, head, headSize, splitter);
+            break;
+#endif
+        default:
+            fprintf(stderr, "compression not supported by this build\n");
+            break;
+    }
+    (void)fd;
+
+    if ( r == 0 ) r = splitEnd(splitter);
+    return r;
+}
+
+/**
+ * @brief read a compressed file: the file is mapped in memory, decompressed in reusable buffers
+ * and the lines are split in place in these buffers.
+ * The frames of a zstd file are decompressed in parallel, the lines are given in the order of the file.
+ * 
+ * @param path the file
+ * @param threads the number of threads decompressing the zstd frames
+ * @param splitter the line splitter
+ * @return int 0 at the end of the file, the non zero return of the line function, -1 on error
+ */
+int readCompressed(const char* path, int threads, lineSplitter* splitter){
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return -1;
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 || st.st_size == 0 ){
+        close(fd);
+        return -1;
+    }
+
+    const UInt8* data = (const UInt8*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( data == MAP_FAILED ) return -1;
+    madvise((void*)data, st.st_size, MADV_SEQUENTIAL);
+
+    int r = -1;
+    switch ( detectCompression(data, st.st_size) ){
+#ifdef HAVE_ZLIB
+        case compressionGzip:
+            r = readGzip(data, st.st_size, splitter);
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case compressionZstd:
+            r = readZstd(data, st.st_size, threads, splitter);
+            break;
+#endif
+        default:
+            fprintf(stderr, "%s: compression not supported by this build\n", path);
+            break;
+    }
+    (void)threads;
+
+    if ( r == 0 ) r = splitEnd(splitter);
+    munmap((void*)data, st.st_size);
+    return r;
+}
+
+
+#ifdef __UNITTEST_DECOMPRESS__
+
+static UInt64 nbLines, sumSeq;
+
+int count(char* line, void* ctx){
+    (void)ctx;
+    char* comma = strrchr(line, ',');
+    assert(comma != NULL);
+    sumSeq += strtoull(comma + 1, NULL, 10);
+    nbLines++;
+    return 0;
+}
+
+#define NBLINES 200000
+
+static char* text(size_t* size){
+    char* txt = malloc(NBLINES * 40);
+    size_t len = 0;
+    for (int i=0; i<NBLINES; i++){
+        len += sprintf(txt + len, "10.0.%d.%d:%d,192.168.0.1:80,%d\n", (i >> 8) & 0xFF, i & 0xFF, 1000 + i % 1000, i);
+    }
+    *size = len;
+    return txt;
+}
+
+static void check(const char* path, int threads){
+    lineSplitter splitter;
+    splitterInit(&splitter, &count, NULL);
+    nbLines = sumSeq = 0;
+    assert(readCompressed(path, threads, &splitter) == 0);
+    assert(nbLines == NBLINES);
+    assert(sumSeq == (UInt64)NBLINES * (NBLINES - 1) / 2);
+}
+
+int main(){
+    size_t size;
+    char* txt = text(&size);
+
+#ifdef HAVE_ZLIB
+    // 2 gzip members
+    const char* gz = "/tmp/chimere_decompress_test.gz";
+    gzFile f = gzopen(gz, "wb");
+    gzwrite(f, txt, size / 2 + 7);
+    gzclose(f);
+    f = gzopen(gz, "ab");
+    gzwrite(f, txt + size / 2 + 7, size - size / 2 - 7);
+    gzclose(f);
+    assert(compressionOfFile(gz) == compressionGzip);
+    check(gz, 1);
+    unlink(gz);
+#endif
+
+#ifdef HAVE_ZSTD
+    // 7 frames cut in the middle of the lines
+    const char* zst = "/tmp/chimere_decompress_test.zst";
+    FILE* fp = fopen(zst, "wb");
+    size_t part = size / 7 + 1;
+    char* dst = malloc(ZSTD_compressBound(part));
+    for (size_t offset=0; offset<size; offset+=part){
+        size_t len = size - offset < part ? size - offset : part;
+        size_t z = ZSTD_compress(dst, ZSTD_compressBound(part), txt + offset, len, 1);
+        fwrite(dst, 1, z, fp);
+    }
+    fclose(fp);
+    free(dst);
+    assert(compressionOfFile(zst) == compressionZstd);
+    check(zst, 1);
+    check(zst, 4);
+    unlink(zst);
+#endif
+
+    free(txt);
+    return 0;
+}
+
+// gcc -o decompress pool.c lines.c decompress.c -g -D__UNITTEST_DECOMPRESS__ -DHAVE_ZLIB -DHAVE_ZSTD -lz -lzstd -pthread && ./decompress
+
+#endif
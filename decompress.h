@@ -0,0 +1,65 @@
+/**
+ * @file decompress.h
+ * @author Sebastien Galvagno
+ * @brief In-process decompression of gzip and zstd logs
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_DECOMPRESS_H__
+#define __SG__CHIMERE_DECOMPRESS_H__
+
+#include <stddef.h>
+
+#include "SG_Types.h"
+#include "lines.h"
+
+// the size of a decompression buffer
+#define DECOMPRESSBUFFER (1 << 20)
+
+typedef enum { compressionNone = 0, compressionGzip, compressionZstd } compression;
+
+/**
+ * @brief the compression of a buffer, given by its magic number
+ * 
+ * @param data the first bytes of the file
+ * @param size the size of the buffer
+ * @return compression 
+ */
+compression detectCompression(const UInt8* data, size_t size);
+
+/**
+ * @brief the compression of a file, given by its magic number
+ * 
+ * @param path the file
+ * @return compression 
+ */
+compression compressionOfFile(const char* path);
+
+/**
+ * @brief read a compressed file: the file is mapped in memory, decompressed in reusable buffers
+ * and the lines are split in place in these buffers.
+ * The frames of a zstd file are decompressed in parallel, the lines are given in the order of the file.
+ * 
+ * @param path the file
+ * @param threads the number of threads decompressing the zstd frames
+ * @param splitter the line splitter
+ * @return int 0 at the end of the file, the non zero return of the line function, -1 on error
+ */
+int readCompressed(const char* path, int threads, lineSplitter* splitter);
+
+/**
+ * @brief read a compressed stream (a pipe): the first bytes, already read to detect the compression, are given,
+ * the rest of the stream is read from fd. The lines are split in place in the decompression buffer.
+ * 
+ * @param fd the stream
+ * @param head the first bytes of the stream
+ * @param headSize the number of bytes in head
+ * @param splitter the line splitter
+ * @return int 0 at the end of the stream, the non zero return of the line function, -1 on error
+ */
+int readCompressedStream(int fd, const UInt8* head, size_t headSize, lineSplitter* splitter);
+
+#endif
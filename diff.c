@@ -0,0 +1,240 @@
+/**
+ * @file diff.c
+ * @author Sebastien Galvagno
+ * @brief The flux added, removed or changed between two flux tables, by a merge of their radix trees
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The radix trees of both tables are on the same fixed width keys and their cursors give the keys in
+ * the same order: the diff is the merge of two sorted lists, linear in the number of flux, without
+ * sorting or searching.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __UNITTEST_DIFF__
+#include <assert.h>
+#endif
+
+#include "diff.h"
+
+static int compareKeys(const UInt32* a, const UInt32* b, int words){
+    for (int i=0; i<words; i++){
+        if ( a[i] != b[i] ) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static int diffStore(const fluxTable* before, const fluxTable* after, diffFn fn, void* ctx, diffCounts* counts){
+    radix96Cursor a, b;
+    const UInt32 *keyA = NULL, *keyB = NULL;
+    void *dataA = NULL, *dataB = NULL;
+    radix96CursorStart(&a, &before->tree);
+    radix96CursorStart(&b, &after->tree);
+    int hasA = radix96CursorNext(&a, &keyA, &dataA);
+    int hasB = radix96CursorNext(&b, &keyB, &dataB);
+    int r = 0;
+    while ( r == 0 && (hasA || hasB) ){
+        int c = !hasB ? -1 : !hasA ? 1 : compareKeys(keyA, keyB, FLUXKEYWORDS);
+        fromtopacket p, q;
+        if ( c <= 0 ) flowStoreGet(&before->flows, LEAFFLOW(dataA), &p);
+        if ( c >= 0 ) flowStoreGet(&after->flows, LEAFFLOW(dataB), &q);
+        if ( c < 0 ){
+            counts->removed++;
+            r = fn(DIFFREMOVED, &p, NULL, ctx);
+        } else if ( c > 0 ){
+            counts->added++;
+            r = fn(DIFFADDED, NULL, &q, ctx);
+        } else if ( p.firstPacket != q.firstPacket || p.lastPacket != q.lastPacket ){
+            counts->changed++;
+            r = fn(DIFFCHANGED, &p, &q, ctx);
+        } else {
+            counts->same++;
+        }
+        if ( c <= 0 ) hasA = radix96CursorNext(&a, &keyA, &dataA);
+        if ( c >= 0 ) hasB = radix96CursorNext(&b, &keyB, &dataB);
+    }
+    return r;
+}
+
+static int diffStore6(const fluxTable* before, const fluxTable* after, diffFn6 fn, void* ctx, diffCounts* counts){
+    // the cursors of the IPv6 trees are big: 2 x 145 levels
+    radix288Cursor* a = (radix288Cursor*)malloc(sizeof(radix288Cursor));
+    radix288Cursor* b = (radix288Cursor*)malloc(sizeof(radix288Cursor));
+    if ( a == NULL || b == NULL ){
+        free(a);
+        free(b);
+        return -1;
+    }
+    const UInt32 *keyA = NULL, *keyB = NULL;
+    void *dataA = NULL, *dataB = NULL;
+    radix288CursorStart(a, &before->tree6);
+    radix288CursorStart(b, &after->tree6);
+    int hasA = radix288CursorNext(a, &keyA, &dataA);
+    int hasB = radix288CursorNext(b, &keyB, &dataB);
+    int r = 0;
+    while ( r == 0 && (hasA || hasB) ){
+        int c = !hasB ? -1 : !hasA ? 1 : compareKeys(keyA, keyB, FLUX6KEYWORDS);
+        const fromtopacket6* p = c <= 0 ? &before->flows6.flows[LEAFFLOW(dataA)] : NULL;
+        const fromtopacket6* q = c >= 0 ? &after->flows6.flows[LEAFFLOW(dataB)] : NULL;
+        if ( c < 0 ){
+            counts->removed++;
+            r = fn(DIFFREMOVED, p, NULL, ctx);
+        } else if ( c > 0 ){
+            counts->added++;
+            r = fn(DIFFADDED, NULL, q, ctx);
+        } else if ( p->firstPacket != q->firstPacket || p->lastPacket != q->lastPacket ){
+            counts->changed++;
+            r = fn(DIFFCHANGED, p, q, ctx);
+        } else {
+            counts->same++;
+        }
+        if ( c <= 0 ) hasA = radix288CursorNext(a, &keyA, &dataA);
+        if ( c >= 0 ) hasB = radix288CursorNext(b, &keyB, &dataB);
+    }
+    free(a);
+    free(b);
+    return r;
+}
+
+/**
+ * @brief compare two tables in one pass: the cursors of their radix trees are read side by side,
+ * the IPv4 flux then the IPv6 flux
+ *
+ * @param before the first table
+ * @param after the second table
+ * @param fn the function called for the IPv4 flux
+ * @param fn6 the function called for the IPv6 flux
+ * @param ctx the context given to fn and fn6
+ * @param counts the counts, or NULL
+ * @return int 0, the non zero return of fn or fn6, -1 if out of memory
+ */
+int diffFlux(const fluxTable* before, const fluxTable* after, diffFn fn, diffFn6 fn6, void* ctx, diffCounts* counts){
+    diffCounts local;
+    if ( counts == NULL ) counts = &local;
+    memset(counts, 0, sizeof(diffCounts));
+    int r = diffStore(before, after, fn, ctx, counts);
+    return r ? r : diffStore6(before, after, fn6, ctx, counts);
+}
+
+static const char* changeName(int change){
+    return change == DIFFADDED ? "Added" : change == DIFFREMOVED ? "Removed" : "Changed";
+}
+
+static int printChange(int change, const fromtopacket* before, const fromtopacket* after, void* ctx){
+    char summary[PACKETSUMMARYSIZE];
+    packetSummary(after ? after : before, summary, sizeof(summary));
+    long long delta = (long long)(after ? packetSize(after) : 0) - (long long)(before ? packetSize(before) : 0);
+    return fprintf((FILE*)ctx, "%s %s / Delta : %+lld\n", changeName(change), summary, delta) < 0 ? -1 : 0;
+}
+
+static int printChange6(int change, const fromtopacket6* before, const fromtopacket6* after, void* ctx){
+    char summary[PACKET6SUMMARYSIZE];
+    packetSummary6(after ? after : before, summary, sizeof(summary));
+    long long delta = (long long)(after ? packetSize6(after) : 0) - (long long)(before ? packetSize6(before) : 0);
+    return fprintf((FILE*)ctx, "%s %s / Delta : %+lld\n", changeName(change), summary, delta) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief print the diff of two tables: a line per flux added, removed or changed, in the order of the keys,
+ * with the size in the second table (the first one for a removed flux) and its growth, then the counts
+ *
+ * @param before the first table
+ * @param after the second table
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int printDiff(const fluxTable* before, const fluxTable* after, FILE* out){
+    diffCounts counts;
+    if ( diffFlux(before, after, &printChange, &printChange6, out, &counts) ) return -1;
+    return fprintf(out, "---- diff: %llu added, %llu removed, %llu changed, %llu unchanged ----\n",
+                   (unsigned long long)counts.added, (unsigned long long)counts.removed,
+                   (unsigned long long)counts.changed, (unsigned long long)counts.same) < 0 ? -1 : 0;
+}
+
+
+#ifdef __UNITTEST_DIFF__
+
+static void feed(fluxTable* table, const char** lines, int nb){
+    char line[64];
+    for (int i=0; i<nb; i++){
+        snprintf(line, sizeof(line), "%s", lines[i]);
+        assert(processLine(table, line) == 0);
+    }
+}
+
+static int countOnly(int change, const fromtopacket* before, const fromtopacket* after, void* ctx){
+    (void)change; (void)before; (void)after; (void)ctx;
+    return 0;
+}
+
+static int countOnly6(int change, const fromtopacket6* before, const fromtopacket6* after, void* ctx){
+    (void)change; (void)before; (void)after; (void)ctx;
+    return 0;
+}
+
+int main(){
+    fluxTable before, after;
+    memset(&before, 0, sizeof(before));
+    memset(&after, 0, sizeof(after));
+    const char* yesterday[] = { "10.0.0.1:1000,10.0.0.9:80,100", "10.0.0.1:1000,10.0.0.9:80,150",
+                                "10.0.0.2:1000,10.0.0.9:80,100", "10.0.0.3:1000,10.0.0.9:80,100",
+                                "[2001:db8::1]:1,[::1]:80,5" };
+    const char* today[] = { "10.0.0.1:1000,10.0.0.9:80,100", "10.0.0.1:1000,10.0.0.9:80,180",
+                            "10.0.0.3:1000,10.0.0.9:80,100", "10.0.0.4:1000,10.0.0.9:80,100", "10.0.0.4:1000,10.0.0.9:80,120",
+                            "[2001:db8::1]:1,[::1]:80,5", "[2001:db8::1]:1,[::1]:80,9" };
+    feed(&before, yesterday, 5);
+    feed(&after, today, 7);
+
+    char* report;
+    size_t size;
+    FILE* out = open_memstream(&report, &size);
+    assert(printDiff(&before, &after, out) == 0);
+    fclose(out);
+    assert(strcmp(report, "Changed Flux 10.0.0.1:1000,10.0.0.9:80 / Taille : 80 / Delta : +30\n"
+                          "Removed Flux 10.0.0.2:1000,10.0.0.9:80 / Taille : 0 / Delta : +0\n"
+                          "Added Flux 10.0.0.4:1000,10.0.0.9:80 / Taille : 20 / Delta : +20\n"
+                          "Changed Flux [2001:db8::1]:1,[::1]:80 / Taille : 4 / Delta : +4\n"
+                          "---- diff: 1 added, 1 removed, 2 changed, 1 unchanged ----\n") == 0);
+    free(report);
+
+    // a table compared to itself
+    diffCounts counts;
+    assert(diffFlux(&after, &after, &countOnly, &countOnly6, NULL, &counts) == 0);
+    assert(counts.same == 4 && counts.added + counts.removed + counts.changed == 0);
+
+    // many flux: the merge follows the order of the keys of both trees
+    fluxTable big1, big2;
+    memset(&big1, 0, sizeof(big1));
+    memset(&big2, 0, sizeof(big2));
+    char line[64];
+    UInt64 added = 0, removed = 0, same = 0;
+    for (int i=0; i<200000; i++){
+        // processLine cuts the line: it is written again for the second table
+        for (int t=0; t<2; t++){
+            if ( t == 0 ? i % 3 == 0 : i % 5 == 0 ) continue;
+            snprintf(line, sizeof(line), "10.%d.%d.%d:%d,10.0.0.1:80,%d", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF, 1000 + i % 3, i % 50);
+            assert(processLine(t == 0 ? &big1 : &big2, line) == 0);
+        }
+        added += i % 3 == 0 && i % 5;
+        removed += i % 3 && i % 5 == 0;
+        same += i % 3 && i % 5;
+    }
+    assert(diffFlux(&big1, &big2, &countOnly, NULL, NULL, &counts) == 0);
+    assert(counts.added == added && counts.removed == removed && counts.same == same && counts.changed == 0);
+    freeFlux(&big1);
+    freeFlux(&big2);
+
+    freeFlux(&before);
+    freeFlux(&after);
+    printf("diff: OK\n");
+    return 0;
+}
+
+// gcc -o diff pool.c packet.c radixfixed.c aggregate.c flowstore.c seqmap.c quarantine.c metrics.c shmflux.c query.c flux.c diff.c -g -D__UNITTEST_DIFF__ -pthread -lrt && ./diff
+
+#endif
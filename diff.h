@@ -0,0 +1,76 @@
+/**
+ * @file diff.h
+ * @author Sebastien Galvagno
+ * @brief The flux added, removed or changed between two flux tables, by a merge of their radix trees
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef __SG__CHIMERE_DIFF_H__
+#define __SG__CHIMERE_DIFF_H__
+
+#include <stdio.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+#include "flux.h"
+
+// the change of a flux
+#define DIFFADDED 1     // only in the second table
+#define DIFFREMOVED 2   // only in the first table
+#define DIFFCHANGED 3   // in both tables, with other sequence numbers
+
+/**
+ * @brief the counts of a diff
+ */
+typedef struct {
+    UInt64 added;
+    UInt64 removed;
+    UInt64 changed;
+    UInt64 same;
+} diffCounts;
+
+/**
+ * @brief the function called for each IPv4 flux added, removed or changed, in the order of the keys
+ *
+ * @param change DIFFADDED, DIFFREMOVED or DIFFCHANGED
+ * @param before the flux in the first table, NULL when added
+ * @param after the flux in the second table, NULL when removed
+ * @param ctx the context of the diff
+ * @return int 0 to continue, non zero to stop the diff
+ */
+typedef int (*diffFn)(int change, const fromtopacket* before, const fromtopacket* after, void* ctx);
+
+/**
+ * @brief the function called for each IPv6 flux added, removed or changed, as diffFn
+ */
+typedef int (*diffFn6)(int change, const fromtopacket6* before, const fromtopacket6* after, void* ctx);
+
+/**
+ * @brief compare two tables in one pass: the cursors of their radix trees are read side by side,
+ * the IPv4 flux then the IPv6 flux
+ *
+ * @param before the first table
+ * @param after the second table
+ * @param fn the function called for the IPv4 flux
+ * @param fn6 the function called for the IPv6 flux
+ * @param ctx the context given to fn and fn6
+ * @param counts the counts, or NULL
+ * @return int 0, the non zero return of fn or fn6, -1 if out of memory
+ */
+int diffFlux(const fluxTable* before, const fluxTable* after, diffFn fn, diffFn6 fn6, void* ctx, diffCounts* counts);
+
+/**
+ * @brief print the diff of two tables: a line per flux added, removed or changed, in the order of the keys,
+ * with the size in the second table (the first one for a removed flux) and its growth, then the counts
+ *
+ * @param before the first table
+ * @param after the second table
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int printDiff(const fluxTable* before, const fluxTable* after, FILE* out);
+
+#endif
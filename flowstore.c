@@ -0,0 +1,474 @@
+/**
+ * @file flowstore.c
+ * @author Sebastien Galvagno
+ * @brief The flux of a table in columns, indexed by the flux id held by the radix leaf
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * A flux is 24 bytes in 7 columns, instead of a fromtopacket and a list node allocated each.
+ * The scans (sizes, threshold, idle flux) are loops over dense arrays, vectorized by the compiler:
+ * the ids are kept dense by moving the last flux in the place of a removed one.
+ * A bidirectional store has 3 more columns, 9 bytes, for the range of the packets back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __UNITTEST_FLOWSTORE__
+#include <assert.h>
+#endif
+
+#include "flowstore.h"
+#include "pool.h"
+
+// the first capacity of the columns
+#define FLOWCAPACITY 1024
+// the flux counted before a selection
+#define FLOWBLOCK 64
+
+static int growColumn(void** column, UInt32 capacity, size_t size){
+    void* p = memRealloc(*column, capacity * size, MEMFLOWS);
+    if ( p == NULL ) return -1;
+    *column = p;
+    return 0;
+}
+
+/**
+ * @brief add a flux to the store
+ * 
+ * @param store the store
+ * @param packet the flux, its last sequence number equal to the first one for a single packet
+ * @return UInt32 the flux id, FLOWNONE if out of memory
+ */
+UInt32 flowStoreAdd(flowStore* store, const fromtopacket* packet){
+    if ( store->nb == store->capacity ){
+        if ( store->capacity >= FLOWNONE / 2 ) return FLOWNONE;
+        UInt32 capacity = store->capacity ? store->capacity * 2 : FLOWCAPACITY;
+        // a column grown stays grown when another one fails: the capacity is the smallest one
+        if ( growColumn((void**)&store->from, capacity, sizeof(UInt32))
+             || growColumn((void**)&store->to, capacity, sizeof(UInt32))
+             || growColumn((void**)&store->portFrom, capacity, sizeof(UInt16))
+             || growColumn((void**)&store->portTo, capacity, sizeof(UInt16))
+             || growColumn((void**)&store->first, capacity, sizeof(tcp_seq))
+             || growColumn((void**)&store->last, capacity, sizeof(tcp_seq))
+             || growColumn((void**)&store->lastUpdate, capacity, sizeof(UInt32)) ){
+            return FLOWNONE;
+        }
+        if ( store->bidirectional
+             && (growColumn((void**)&store->backFirst, capacity, sizeof(tcp_seq))
+                 || growColumn((void**)&store->backLast, capacity, sizeof(tcp_seq))
+                 || growColumn((void**)&store->directions, capacity, sizeof(UInt8))) ){
+            return FLOWNONE;
+        }
+        store->capacity = capacity;
+    }
+    UInt32 id = store->nb++;
+    store->from[id] = packet->from;
+    store->to[id] = packet->to;
+    store->portFrom[id] = packet->portFrom;
+    store->portTo[id] = packet->portTo;
+    store->first[id] = packet->firstPacket;
+    store->last[id] = packet->lastPacket;
+    store->lastUpdate[id] = packet->lastUpdate;
+    if ( store->bidirectional ){
+        store->backFirst[id] = 0;
+        store->backLast[id] = 0;
+        store->directions[id] = FLOWFORWARD;
+    }
+    return id;
+}
+
+/**
+ * @brief add a packet to a conversation of a bidirectional store: the first packet of a direction
+ * starts its range
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ * @param seq the sequence number of the packet
+ * @param backward the packet goes from the higher endpoint to the lower one
+ * @return int SEQINORDER, SEQREORDERED or SEQREPEATED as seqExtend
+ */
+int flowStoreExtend(flowStore* store, UInt32 id, tcp_seq seq, int backward){
+    tcp_seq* first = backward ? &store->backFirst[id] : &store->first[id];
+    tcp_seq* last = backward ? &store->backLast[id] : &store->last[id];
+    UInt8 direction = backward ? FLOWBACKWARD : FLOWFORWARD;
+    if ( store->directions[id] & direction ) return seqExtend(first, last, seq);
+    store->directions[id] |= direction;
+    *first = seq;
+    *last = seq;
+    return SEQINORDER;
+}
+
+/**
+ * @brief exchange the 2 directions of a conversation of a bidirectional store: a conversation added
+ * with its first packet going backward
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ */
+void flowStoreReverse(flowStore* store, UInt32 id){
+    tcp_seq first = store->first[id], last = store->last[id];
+    store->first[id] = store->backFirst[id];
+    store->last[id] = store->backLast[id];
+    store->backFirst[id] = first;
+    store->backLast[id] = last;
+    UInt8 d = store->directions[id];
+    store->directions[id] = (UInt8)((d & FLOWFORWARD ? FLOWBACKWARD : 0) | (d & FLOWBACKWARD ? FLOWFORWARD : 0));
+}
+
+/**
+ * @brief read a flux of the store
+ * 
+ * @param store the store
+ * @param id the flux id
+ * @param packet the flux
+ */
+void flowStoreGet(const flowStore* store, UInt32 id, fromtopacket* packet){
+    packet->from = store->from[id];
+    packet->to = store->to[id];
+    packet->portFrom = store->portFrom[id];
+    packet->portTo = store->portTo[id];
+    packet->firstPacket = store->first[id];
+    packet->lastPacket = store->last[id];
+    packet->lastUpdate = store->lastUpdate[id];
+}
+
+/**
+ * @brief remove a flux: the last flux of the store takes its id
+ * 
+ * @param store the store
+ * @param id the flux id
+ * @return UInt32 the previous id of the flux moved to id, FLOWNONE when no flux is moved
+ */
+UInt32 flowStoreRemove(flowStore* store, UInt32 id){
+    UInt32 moved = --store->nb;
+    if ( moved == id ) return FLOWNONE;
+    store->from[id] = store->from[moved];
+    store->to[id] = store->to[moved];
+    store->portFrom[id] = store->portFrom[moved];
+    store->portTo[id] = store->portTo[moved];
+    store->first[id] = store->first[moved];
+    store->last[id] = store->last[moved];
+    store->lastUpdate[id] = store->lastUpdate[moved];
+    if ( store->bidirectional ){
+        store->backFirst[id] = store->backFirst[moved];
+        store->backLast[id] = store->backLast[moved];
+        store->directions[id] = store->directions[moved];
+    }
+    return moved;
+}
+
+/**
+ * @brief the sizes of all the flux (packetSize), in the order of the ids: the sizes of the 2 directions
+ * of a conversation are added
+ * 
+ * @param store the store
+ * @param sizes the sizes, store->nb items
+ */
+void flowStoreSizes(const flowStore* store, UInt32* sizes){
+    const tcp_seq* restrict first = store->first;
+    const tcp_seq* restrict last = store->last;
+    UInt32* restrict out = sizes;
+    UInt32 nb = store->nb;
+    for (UInt32 i=0; i<nb; i++){
+        out[i] = last[i] - first[i];
+    }
+    if ( !store->bidirectional ) return;
+    // a direction not seen has a range 0 to 0
+    const tcp_seq* restrict backFirst = store->backFirst;
+    const tcp_seq* restrict backLast = store->backLast;
+    for (UInt32 i=0; i<nb; i++){
+        out[i] += backLast[i] - backFirst[i];
+    }
+}
+
+/**
+ * @brief the flux of a size greater or equal to a threshold
+ * 
+ * @param sizes the sizes given by flowStoreSizes
+ * @param nb the number of sizes
+ * @param threshold the smallest size
+ * @param ids the ids of the flux, nb items
+ * @return UInt32 the number of flux
+ */
+UInt32 flowStoreAbove(const UInt32* sizes, UInt32 nb, UInt32 threshold, UInt32* ids){
+    UInt32 k = 0, i = 0;
+    for (; i + FLOWBLOCK <= nb; i += FLOWBLOCK){
+        // a vectorized count first: most of the blocks have no flux above the threshold of a top
+        UInt32 hits = 0;
+        for (UInt32 j=0; j<FLOWBLOCK; j++) hits += sizes[i + j] >= threshold;
+        if ( hits == 0 ) continue;
+        // without branch: the id is always written, kept when the flux is selected
+        for (UInt32 j=i; j<i + FLOWBLOCK; j++){
+            ids[k] = j;
+            k += sizes[j] >= threshold;
+        }
+    }
+    for (; i<nb; i++){
+        ids[k] = i;
+        k += sizes[i] >= threshold;
+    }
+    return k;
+}
+
+/**
+ * @brief the size of the nth biggest flux: an histogram of the 16 high bits of the sizes,
+ * then of the 16 low bits of the sizes in the bucket of the nth flux
+ * 
+ * @param sizes the sizes given by flowStoreSizes
+ * @param nb the number of sizes
+ * @param nth the rank of the flux, 1 for the biggest, at most nb
+ * @return UInt32 the size, 0 if out of memory
+ */
+UInt32 flowStoreThreshold(const UInt32* sizes, UInt32 nb, UInt32 nth){
+    UInt32* counts = (UInt32*)calloc(1 << 16, sizeof(UInt32));
+    if ( counts == NULL ) return 0;
+
+    for (UInt32 i=0; i<nb; i++) counts[sizes[i] >> 16]++;
+    UInt32 high = 0xFFFF;
+    for (; counts[high] < nth; high--) nth -= counts[high];
+
+    memset(counts, 0, (1 << 16) * sizeof(UInt32));
+    for (UInt32 i=0; i<nb; i++){
+        if ( sizes[i] >> 16 == high ) counts[sizes[i] & 0xFFFF]++;
+    }
+    UInt32 low = 0xFFFF;
+    for (; counts[low] < nth; low--) nth -= counts[low];
+
+    free(counts);
+    return high << 16 | low;
+}
+
+/**
+ * @brief the flux not updated during expire lines
+ * 
+ * @param store the store
+ * @param line the current line
+ * @param expire the number of lines
+ * @param ids the ids of the flux, store->nb items
+ * @return UInt32 the number of flux
+ */
+UInt32 flowStoreIdle(const flowStore* store, UInt32 line, UInt32 expire, UInt32* ids){
+    const UInt32* lastUpdate = store->lastUpdate;
+    UInt32 nb = store->nb, k = 0, i = 0;
+    for (; i + FLOWBLOCK <= nb; i += FLOWBLOCK){
+        UInt32 hits = 0;
+        for (UInt32 j=0; j<FLOWBLOCK; j++) hits += line - lastUpdate[i + j] >= expire;
+        if ( hits == 0 ) continue;
+        for (UInt32 j=i; j<i + FLOWBLOCK; j++){
+            ids[k] = j;
+            k += line - lastUpdate[j] >= expire;
+        }
+    }
+    for (; i<nb; i++){
+        ids[k] = i;
+        k += line - lastUpdate[i] >= expire;
+    }
+    return k;
+}
+
+/**
+ * @brief free the columns: the store is empty
+ * 
+ * @param store the store
+ */
+void flowStoreFree(flowStore* store){
+    memFree(store->from);
+    memFree(store->to);
+    memFree(store->portFrom);
+    memFree(store->portTo);
+    memFree(store->first);
+    memFree(store->last);
+    memFree(store->lastUpdate);
+    memFree(store->backFirst);
+    memFree(store->backLast);
+    memFree(store->directions);
+    memset(store, 0, sizeof(flowStore));
+}
+
+
+/**
+ * @brief add an IPv6 flux to the store
+ * 
+ * @param store the store
+ * @param packet the first packet of the flux
+ * @return UInt32 the flux id, FLOWNONE if out of memory
+ */
+UInt32 flowStore6Add(flowStore6* store, const fromtopacket6* packet){
+    if ( store->nb == store->capacity ){
+        if ( store->capacity >= FLOWNONE / 2 ) return FLOWNONE;
+        UInt32 capacity = store->capacity ? store->capacity * 2 : FLOWCAPACITY;
+        if ( growColumn((void**)&store->flows, capacity, sizeof(fromtopacket6)) ) return FLOWNONE;
+        store->capacity = capacity;
+    }
+    UInt32 id = store->nb++;
+    store->flows[id] = *packet;
+    return id;
+}
+
+/**
+ * @brief remove an IPv6 flux: the last flux of the store takes its id
+ * 
+ * @param store the store
+ * @param id the flux id
+ * @return UInt32 the previous id of the flux moved to id, FLOWNONE when no flux is moved
+ */
+UInt32 flowStore6Remove(flowStore6* store, UInt32 id){
+    UInt32 moved = --store->nb;
+    if ( moved == id ) return FLOWNONE;
+    store->flows[id] = store->flows[moved];
+    return moved;
+}
+
+/**
+ * @brief the sizes of all the IPv6 flux (packetSize6), in the order of the ids
+ * 
+ * @param store the store
+ * @param sizes the sizes, store->nb items
+ */
+void flowStore6Sizes(const flowStore6* store, UInt32* sizes){
+    for (UInt32 i=0; i<store->nb; i++){
+        sizes[i] = packetSize6(&store->flows[i]);
+    }
+}
+
+/**
+ * @brief the IPv6 flux not updated during expire lines
+ * 
+ * @param store the store
+ * @param line the current line
+ * @param expire the number of lines
+ * @param ids the ids of the flux, store->nb items
+ * @return UInt32 the number of flux
+ */
+UInt32 flowStore6Idle(const flowStore6* store, UInt32 line, UInt32 expire, UInt32* ids){
+    UInt32 k = 0;
+    for (UInt32 i=0; i<store->nb; i++){
+        ids[k] = i;
+        k += line - store->flows[i].lastUpdate >= expire;
+    }
+    return k;
+}
+
+/**
+ * @brief free the IPv6 flux: the store is empty
+ * 
+ * @param store the store
+ */
+void flowStore6Free(flowStore6* store){
+    memFree(store->flows);
+    memset(store, 0, sizeof(flowStore6));
+}
+
+
+#ifdef __UNITTEST_FLOWSTORE__
+
+#define NBFLUX 100000
+
+static int compareDesc(const void* a, const void* b){
+    UInt32 x = *(const UInt32*)a, y = *(const UInt32*)b;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+int main(){
+    flowStore store;
+    memset(&store, 0, sizeof(store));
+    srand(3);
+    for (UInt32 i=0; i<NBFLUX; i++){
+        fromtopacket p = { .from = i, .to = ~i, .portFrom = i & 0xFFFF, .portTo = 80,
+                           .firstPacket = 1000, .lastPacket = 1000 + (i % 10 ? (rand() % 100000) * (i % 3 ? 1 : 997) : 0), .lastUpdate = i };
+        assert(flowStoreAdd(&store, &p) == i);
+    }
+    fromtopacket p;
+    flowStoreGet(&store, 12345, &p);
+    assert(p.from == 12345 && p.to == ~12345u && p.portFrom == 12345 && p.lastUpdate == 12345);
+
+    UInt32* sizes = (UInt32*)malloc(NBFLUX * sizeof(UInt32));
+    UInt32* sorted = (UInt32*)malloc(NBFLUX * sizeof(UInt32));
+    UInt32* ids = (UInt32*)malloc(NBFLUX * sizeof(UInt32));
+    flowStoreSizes(&store, sizes);
+    for (UInt32 i=0; i<NBFLUX; i++){
+        flowStoreGet(&store, i, &p);
+        assert(sizes[i] == packetSize(&p));
+    }
+
+    // the threshold of the top against a sort
+    memcpy(sorted, sizes, NBFLUX * sizeof(UInt32));
+    qsort(sorted, NBFLUX, sizeof(UInt32), &compareDesc);
+    UInt32 ranks[] = { 1, 2, 10, 1000, 50000, NBFLUX };
+    for (size_t r=0; r<sizeof(ranks) / sizeof(ranks[0]); r++){
+        UInt32 t = flowStoreThreshold(sizes, NBFLUX, ranks[r]);
+        assert(t == sorted[ranks[r] - 1]);
+        UInt32 nb = flowStoreAbove(sizes, NBFLUX, t, ids);
+        assert(nb >= ranks[r]);
+        for (UInt32 i=0; i<nb; i++) assert(sizes[ids[i]] >= t);
+    }
+
+    // the ids stay dense
+    assert(flowStoreIdle(&store, NBFLUX, NBFLUX - 99, ids) == 100);
+    for (int i=99; i>=0; i--){
+        UInt32 moved = flowStoreRemove(&store, ids[i]);
+        assert(moved == FLOWNONE || moved == store.nb);
+    }
+    assert(store.nb == NBFLUX - 100);
+    for (UInt32 i=0; i<store.nb; i++) assert(store.lastUpdate[i] >= 100);
+    assert(flowStoreRemove(&store, store.nb - 1) == FLOWNONE);
+
+    flowStoreFree(&store);
+
+    // the conversations: a range per direction, the sizes added
+    store.bidirectional = 1;
+    fromtopacket c = { .from = 1, .to = 2, .portFrom = 1000, .portTo = 80, .firstPacket = 5000, .lastPacket = 5000, .lastUpdate = 1 };
+    assert(flowStoreAdd(&store, &c) == 0 && store.directions[0] == FLOWFORWARD);
+    assert(flowStoreExtend(&store, 0, 5100, 0) == SEQINORDER);
+    assert(flowStoreExtend(&store, 0, 90000, 1) == SEQINORDER && store.backFirst[0] == 90000 && store.backLast[0] == 90000);
+    assert(flowStoreExtend(&store, 0, 90040, 1) == SEQINORDER && flowStoreExtend(&store, 0, 90010, 1) == SEQREPEATED);
+    // the first packet went backward
+    assert(flowStoreAdd(&store, &c) == 1);
+    flowStoreReverse(&store, 1);
+    assert(store.directions[1] == FLOWBACKWARD && store.first[1] == 0 && store.last[1] == 0 && store.backFirst[1] == 5000);
+    assert(flowStoreExtend(&store, 1, 7000, 0) == SEQINORDER && store.first[1] == 7000);
+    assert(flowStoreExtend(&store, 1, 5300, 1) == SEQINORDER);
+    flowStoreSizes(&store, sizes);
+    assert(sizes[0] == 100 + 40 && sizes[1] == 300);
+    assert(flowStoreRemove(&store, 0) == 1 && store.backFirst[0] == 5000 && store.directions[0] == (FLOWFORWARD | FLOWBACKWARD));
+    // a direction wraps around to 0: "..90, 0" and "..90, ..95, 0, ..92" have the size 6
+    c.firstPacket = c.lastPacket = 4294967290u;
+    assert(flowStoreAdd(&store, &c) == 1 && flowStoreExtend(&store, 1, 0, 0) == SEQINORDER);
+    assert(flowStoreExtend(&store, 1, 4294967290u, 1) == SEQINORDER && flowStoreExtend(&store, 1, 4294967295u, 1) == SEQINORDER);
+    assert(flowStoreExtend(&store, 1, 0, 1) == SEQINORDER && flowStoreExtend(&store, 1, 4294967292u, 1) == SEQREPEATED);
+    flowStoreSizes(&store, sizes);
+    assert(store.last[1] == 0 && store.backLast[1] == 0 && sizes[1] == 6 + 6);
+    flowStoreFree(&store);
+
+    // the IPv6 flux
+    flowStore6 store6;
+    memset(&store6, 0, sizeof(store6));
+    for (int i=0; i<3000; i++){
+        fromtopacket6 p6;
+        memset(&p6, 0, sizeof(p6));
+        p6.from[3] = i;
+        p6.lastUpdate = i;
+        p6.firstPacket = i;
+        p6.lastPacket = 2 * i;
+        assert(flowStore6Add(&store6, &p6) == (UInt32)i);
+    }
+    flowStore6Sizes(&store6, sizes);
+    assert(sizes[0] == 0 && sizes[2999] == 2999);
+    assert(flowStore6Idle(&store6, 3000, 2991, ids) == 10);
+    assert(flowStore6Remove(&store6, 0) == 2999 && store6.flows[0].from[3] == 2999);
+    assert(flowStore6Remove(&store6, store6.nb - 1) == FLOWNONE && store6.nb == 2998);
+    flowStore6Free(&store6);
+    free(sizes);
+    free(sorted);
+    free(ids);
+    printf("flowstore: OK\n");
+    return 0;
+}
+
+// gcc -o flowstore pool.c packet.c flowstore.c -g -D__UNITTEST_FLOWSTORE__ && ./flowstore
+
+#endif
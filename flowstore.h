@@ -0,0 +1,204 @@
+/**
+ * @file flowstore.h
+ * @author Sebastien Galvagno
+ * @brief The flux of a table in columns, indexed by the flux id held by the radix leaf
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_FLOWSTORE_H__
+#define __SG__CHIMERE_FLOWSTORE_H__
+
+#include <stdint.h>
+#include "SG_Types.h"
+#include "packet.h"
+
+// no flux
+#define FLOWNONE 0xFFFFFFFFu
+// the size of a flux in the columns
+#define FLOWBYTES (3 * sizeof(UInt32) + 2 * sizeof(UInt16) + 2 * sizeof(tcp_seq))
+// the directions of a conversation seen in a bidirectional store
+#define FLOWFORWARD 1
+#define FLOWBACKWARD 2
+// the data of a radix leaf for a flux id, never NULL
+#define FLOWLEAF(id) ((void*)(uintptr_t)((id) + 1))
+// the flux id of the data of a radix leaf
+#define LEAFFLOW(data) ((UInt32)((uintptr_t)(data) - 1))
+
+/**
+ * @brief the flux in columns: the flux id is the index in the columns. The ids are dense,
+ * a removed flux is replaced by the last one.
+ * 
+ * A bidirectional store holds conversations: the endpoints are in the canonical order (canonicalPacket),
+ * first and last are the range of the packets from the lower endpoint, backFirst and backLast the range
+ * of the packets back, directions the ranges seen (FLOWFORWARD, FLOWBACKWARD). These 3 columns are
+ * only allocated in a bidirectional store.
+ */
+typedef struct {
+    UInt32* from;
+    UInt32* to;
+    UInt16* portFrom;
+    UInt16* portTo;
+    tcp_seq* first;
+    tcp_seq* last;
+    UInt32* lastUpdate;
+    tcp_seq* backFirst;
+    tcp_seq* backLast;
+    UInt8* directions;
+    UInt32 nb;
+    UInt32 capacity;
+    int bidirectional;  // set before the first flux
+} flowStore;
+
+/**
+ * @brief the IPv6 flux in rows: a table has few of them next to the IPv4 columns, the ids are dense as well
+ */
+typedef struct {
+    fromtopacket6* flows;
+    UInt32 nb;
+    UInt32 capacity;
+} flowStore6;
+
+/**
+ * @brief add a flux to the store
+ * 
+ * @param store the store
+ * @param packet the first packet of the flux
+ * @return UInt32 the flux id, FLOWNONE if out of memory
+ */
+UInt32 flowStoreAdd(flowStore* store, const fromtopacket* packet);
+
+/**
+ * @brief add a packet to a conversation of a bidirectional store: the first packet of a direction
+ * starts its range
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ * @param seq the sequence number of the packet
+ * @param backward the packet goes from the higher endpoint to the lower one
+ * @return int SEQINORDER, SEQREORDERED or SEQREPEATED as seqExtend
+ */
+int flowStoreExtend(flowStore* store, UInt32 id, tcp_seq seq, int backward);
+
+/**
+ * @brief exchange the 2 directions of a conversation of a bidirectional store: a conversation added
+ * with its first packet going backward
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ */
+void flowStoreReverse(flowStore* store, UInt32 id);
+
+/**
+ * @brief read a flux of the store
+ * 
+ * @param store the store
+ * @param id the flux id
+ * @param packet the flux
+ */
+void flowStoreGet(const flowStore* store, UInt32 id, fromtopacket* packet);
+
+/**
+ * @brief remove a flux: the last flux of the store takes its id
+ * 
+ * @param store the store
+ * @param id the flux id
+ * @return UInt32 the previous id of the flux moved to id, FLOWNONE when no flux is moved
+ */
+UInt32 flowStoreRemove(flowStore* store, UInt32 id);
+
+/**
+ * @brief the sizes of all the flux (packetSize), in the order of the ids: the sizes of the 2 directions
+ * of a conversation are added
+ * 
+ * @param store the store
+ * @param sizes the sizes, store->nb items
+ */
+void flowStoreSizes(const flowStore* store, UInt32* sizes);
+
+/**
+ * @brief the flux of a size greater or equal to a threshold
+ * 
+ * @param sizes the sizes given by flowStoreSizes
+ * @param nb the number of sizes
+ * @param threshold the smallest size
+ * @param ids the ids of the flux, nb items
+ * @return UInt32 the number of flux
+ */
+UInt32 flowStoreAbove(const UInt32* sizes, UInt32 nb, UInt32 threshold, UInt32* ids);
+
+/**
+ * @brief the size of the nth biggest flux
+ * 
+ * @param sizes the sizes given by flowStoreSizes
+ * @param nb the number of sizes
+ * @param nth the rank of the flux, 1 for the biggest, at most nb
+ * @return UInt32 the size, 0 if out of memory
+ */
+UInt32 flowStoreThreshold(const UInt32* sizes, UInt32 nb, UInt32 nth);
+
+/**
+ * @brief the flux not updated during expire lines
+ * 
+ * @param store the store
+ * @param line the current line
+ * @param expire the number of lines
+ * @param ids the ids of the flux, store->nb items
+ * @return UInt32 the number of flux
+ */
+UInt32 flowStoreIdle(const flowStore* store, UInt32 line, UInt32 expire, UInt32* ids);
+
+/**
+ * @brief free the columns: the store is empty
+ * 
+ * @param store the store
+ */
+void flowStoreFree(flowStore* store);
+
+/**
+ * @brief add an IPv6 flux to the store
+ * 
+ * @param store the store
+ * @param packet the first packet of the flux
+ * @return UInt32 the flux id, FLOWNONE if out of memory
+ */
+UInt32 flowStore6Add(flowStore6* store, const fromtopacket6* packet);
+
+/**
+ * @brief remove an IPv6 flux: the last flux of the store takes its id
+ * 
+ * @param store the store
+ * @param id the flux id
+ * @return UInt32 the previous id of the flux moved to id, FLOWNONE when no flux is moved
+ */
+UInt32 flowStore6Remove(flowStore6* store, UInt32 id);
+
+/**
+ * @brief the sizes of all the IPv6 flux (packetSize6), in the order of the ids
+ * 
+ * @param store the store
+ * @param sizes the sizes, store->nb items
+ */
+void flowStore6Sizes(const flowStore6* store, UInt32* sizes);
+
+/**
+ * @brief the IPv6 flux not updated during expire lines
+ * 
+ * @param store the store
+ * @param line the current line
+ * @param expire the number of lines
+ * @param ids the ids of the flux, store->nb items
+ * @return UInt32 the number of flux
+ */
+UInt32 flowStore6Idle(const flowStore6* store, UInt32 line, UInt32 expire, UInt32* ids);
+
+/**
+ * @brief free the IPv6 flux: the store is empty
+ * 
+ * @param store the store
+ */
+void flowStore6Free(flowStore6* store);
+
+#endif
@@ -0,0 +1,756 @@
+/**
+ * @file flux.c
+ * @author Sebastien Galvagno
+ * @brief The flux table: the radix tree to find a flux and the store of the flux
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#ifdef __UNITTEST_FLUX__
+#include <assert.h>
+#endif
+
+#include "flux.h"
+#include "pool.h"
+#include "query.h"
+
+/**
+ * @brief print a flux: the function given to printSubnet and used by the periodic top
+ * 
+ * @param data here data is the packet structure
+ */
+void affiche(void* data){
+    printPacketSummary((fromtopacket*)data);
+}
+
+/**
+ * @brief compare the keys of 2 flux: the addresses and the ports, in the order of the radix keys
+ * 
+ * @param packet1 
+ * @param packet2 
+ * @return int <0, 0 or >0
+ */
+int compareFluxKey(const fromtopacket* packet1, const fromtopacket* packet2){
+    UInt32 from1 = ntohl(packet1->from), from2 = ntohl(packet2->from);
+    if ( from1 != from2 ) return from1 < from2 ? -1 : 1;
+    UInt32 to1 = ntohl(packet1->to), to2 = ntohl(packet2->to);
+    if ( to1 != to2 ) return to1 < to2 ? -1 : 1;
+    if ( packet1->portFrom != packet2->portFrom ) return packet1->portFrom < packet2->portFrom ? -1 : 1;
+    if ( packet1->portTo != packet2->portTo ) return packet1->portTo < packet2->portTo ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief compare 2 flux by size, the flux of the same size in the order of their keys:
+ * the order of the report does not depend on the order of the reading
+ * 
+ * @param packet1 
+ * @param packet2 
+ * @return int <0, 0 or >0
+ */
+int compareFlux(const fromtopacket* packet1, const fromtopacket* packet2){
+    UInt32 size1 = packetSize(packet1), size2 = packetSize(packet2);
+    if ( size1 != size2 ) return size1 < size2 ? -1 : 1;
+    return compareFluxKey(packet1, packet2);
+}
+
+/**
+ * @brief compare 2 IPv6 flux by size, the flux of the same size in the order of their keys
+ * 
+ * @param packet1 
+ * @param packet2 
+ * @return int <0, 0 or >0
+ */
+int compareFlux6(const fromtopacket6* packet1, const fromtopacket6* packet2){
+    UInt32 size1 = packetSize6(packet1), size2 = packetSize6(packet2);
+    if ( size1 != size2 ) return size1 < size2 ? -1 : 1;
+    UInt32 key1[FLUX6KEYWORDS], key2[FLUX6KEYWORDS];
+    fluxKey6(packet1, key1);
+    fluxKey6(packet2, key2);
+    for (int i=0; i<FLUX6KEYWORDS; i++){
+        if ( key1[i] != key2[i] ) return key1[i] < key2[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compareEntry(const void* a, const void* b){
+    return compareFlux((const fromtopacket*)a, (const fromtopacket*)b);
+}
+
+static int compareEntry6(const void* a, const void* b){
+    return compareFlux6((const fromtopacket6*)a, (const fromtopacket6*)b);
+}
+
+/**
+ * @brief the biggest flux, the biggest first: a scan of the sizes finds the size of the last one,
+ * the flux of this size or bigger are sorted - the reverse order of compareFlux
+ * 
+ * @param table the flux table
+ * @param top the number of flux
+ * @param flux the flux, top items
+ * @return UInt32 the number of flux
+ */
+UInt32 topFlux(const fluxTable* table, UInt32 top, fromtopacket* flux){
+    const flowStore* store = &table->flows;
+    if ( top > store->nb ) top = store->nb;
+    if ( top == 0 ) return 0;
+
+    UInt32* sizes = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    UInt32* ids = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    fromtopacket* selected = NULL;
+    UInt32 nb = 0;
+    if ( sizes && ids ){
+        flowStoreSizes(store, sizes);
+        nb = flowStoreAbove(sizes, store->nb, flowStoreThreshold(sizes, store->nb, top), ids);
+        selected = (fromtopacket*)memAlloc(nb * sizeof(fromtopacket), MEMOTHER);
+    }
+    if ( selected ){
+        for (UInt32 i=0; i<nb; i++) flowStoreGet(store, ids[i], &selected[i]);
+        // the flux of the size of the last one can be more than needed: the biggest keys are kept
+        qsort(selected, nb, sizeof(fromtopacket), &compareEntry);
+        for (UInt32 i=0; i<top; i++) flux[i] = selected[nb - 1 - i];
+    }
+    memFree(sizes);
+    memFree(ids);
+    memFree(selected);
+    return selected ? top : 0;
+}
+
+/**
+ * @brief the biggest IPv6 flux, the biggest first: the same selection as topFlux on the rows of the
+ * IPv6 store - the reverse order of compareFlux6
+ * 
+ * @param table the flux table
+ * @param top the number of flux
+ * @param flux the flux, top items
+ * @return UInt32 the number of flux
+ */
+UInt32 topFlux6(const fluxTable* table, UInt32 top, fromtopacket6* flux){
+    const flowStore6* store = &table->flows6;
+    if ( top > store->nb ) top = store->nb;
+    if ( top == 0 ) return 0;
+
+    UInt32* sizes = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    UInt32* ids = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    fromtopacket6* selected = NULL;
+    UInt32 nb = 0;
+    if ( sizes && ids ){
+        flowStore6Sizes(store, sizes);
+        nb = flowStoreAbove(sizes, store->nb, flowStoreThreshold(sizes, store->nb, top), ids);
+        selected = (fromtopacket6*)memAlloc(nb * sizeof(fromtopacket6), MEMOTHER);
+    }
+    if ( selected ){
+        for (UInt32 i=0; i<nb; i++) selected[i] = store->flows[ids[i]];
+        qsort(selected, nb, sizeof(fromtopacket6), &compareEntry6);
+        for (UInt32 i=0; i<top; i++) flux[i] = selected[nb - 1 - i];
+    }
+    memFree(sizes);
+    memFree(ids);
+    memFree(selected);
+    return selected ? top : 0;
+}
+
+/**
+ * @brief a conversation to sort: its size and its key
+ */
+typedef struct {
+    UInt32 size;
+    UInt32 id;
+    fromtopacket flux;
+} conversationEntry;
+
+static int compareConversation(const void* a, const void* b){
+    const conversationEntry* c1 = (const conversationEntry*)a;
+    const conversationEntry* c2 = (const conversationEntry*)b;
+    if ( c1->size != c2->size ) return c1->size < c2->size ? -1 : 1;
+    return compareFluxKey(&c1->flux, &c2->flux);
+}
+
+/**
+ * @brief the size of a conversation of a bidirectional store: the sizes of its 2 directions
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ * @return UInt32 the size
+ */
+UInt32 conversationSize(const flowStore* store, UInt32 id){
+    // a direction not seen has a range 0 to 0
+    return (store->last[id] - store->first[id]) + (store->backLast[id] - store->backFirst[id]);
+}
+
+/**
+ * @brief write the summary of a conversation of a bidirectional store "Flux ip:port,ip:port / Taille : size
+ * / Aller : size / Retour : size": the lower endpoint first, the size of the 2 directions then of each one
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ * @param buffer the buffer, CONVERSATIONSUMMARYSIZE bytes are enough
+ * @param size the size of the buffer
+ * @return int the length of the summary
+ */
+int conversationSummary(const flowStore* store, UInt32 id, char* buffer, size_t size){
+    fromtopacket p;
+    flowStoreGet(store, id, &p);
+    UInt32 forward = packetSize(&p);
+    UInt32 back = conversationSize(store, id) - forward;
+    char ipFrom[INET_ADDRSTRLEN], ipTo[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &p.from, ipFrom, sizeof(ipFrom));
+    inet_ntop(AF_INET, &p.to, ipTo, sizeof(ipTo));
+    return snprintf(buffer, size, "Flux %s:%u,%s:%u / Taille : %u / Aller : %u / Retour : %u",
+                    ipFrom, p.portFrom, ipTo, p.portTo, forward + back, forward, back);
+}
+
+/**
+ * @brief sort conversations of a bidirectional store from the smallest to the biggest, the size of
+ * the 2 directions, the conversations of the same size in the order of their keys
+ * 
+ * @param store the bidirectional store
+ * @param ids the ids of the conversations, sorted
+ * @param nb the number of ids
+ * @return int 0, -1 if out of memory
+ */
+int sortConversations(const flowStore* store, UInt32* ids, UInt32 nb){
+    if ( nb == 0 ) return 0;
+    UInt32* sizes = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    conversationEntry* entries = (conversationEntry*)memAlloc(nb * sizeof(conversationEntry), MEMOTHER);
+    if ( sizes == NULL || entries == NULL ){
+        memFree(sizes);
+        memFree(entries);
+        return -1;
+    }
+    flowStoreSizes(store, sizes);
+    for (UInt32 i=0; i<nb; i++){
+        entries[i].size = sizes[ids[i]];
+        entries[i].id = ids[i];
+        flowStoreGet(store, ids[i], &entries[i].flux);
+    }
+    qsort(entries, nb, sizeof(conversationEntry), &compareConversation);
+    for (UInt32 i=0; i<nb; i++) ids[i] = entries[i].id;
+    memFree(sizes);
+    memFree(entries);
+    return 0;
+}
+
+/**
+ * @brief the biggest conversations of a bidirectional table, the biggest first, as topFlux
+ * 
+ * @param table the flux table
+ * @param top the number of conversations
+ * @param ids the ids of the conversations, top items
+ * @return UInt32 the number of conversations
+ */
+UInt32 topConversations(const fluxTable* table, UInt32 top, UInt32* ids){
+    const flowStore* store = &table->flows;
+    if ( top > store->nb ) top = store->nb;
+    if ( top == 0 ) return 0;
+
+    UInt32* sizes = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    UInt32* selected = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    int r = -1;
+    if ( sizes && selected ){
+        flowStoreSizes(store, sizes);
+        UInt32 nb = flowStoreAbove(sizes, store->nb, flowStoreThreshold(sizes, store->nb, top), selected);
+        r = sortConversations(store, selected, nb);
+        for (UInt32 i=0; r == 0 && i<top; i++) ids[i] = selected[nb - 1 - i];
+    }
+    memFree(sizes);
+    memFree(selected);
+    return r ? 0 : top;
+}
+
+/**
+ * @brief flush the IPv4 flux not updated during the last expire lines
+ */
+static void expireStore(fluxTable* table){
+    flowStore* store = &table->flows;
+    if ( store->nb == 0 ) return;
+    UInt32* ids = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    if ( ids == NULL ) return;
+    UInt32 nb = flowStoreIdle(store, (UInt32)table->lines, table->expire, ids);
+    fromtopacket* expired = nb ? (fromtopacket*)memAlloc(nb * sizeof(fromtopacket), MEMOTHER) : NULL;
+    if ( expired == NULL ){
+        memFree(ids);
+        return;
+    }
+    if ( store->bidirectional ){
+        // the conversations are sorted by a copy of their ids: the ids stay in their order for the removal
+        UInt32* sorted = (UInt32*)memAlloc(nb * sizeof(UInt32), MEMOTHER);
+        if ( sorted ){
+            memcpy(sorted, ids, nb * sizeof(UInt32));
+            sortConversations(store, sorted, nb);
+        }
+        for (UInt32 i=0; i<nb; i++){
+            char summary[CONVERSATIONSUMMARYSIZE];
+            conversationSummary(store, sorted ? sorted[i] : ids[i], summary, sizeof(summary));
+            printf("Expired %s\n", summary);
+        }
+        memFree(sorted);
+    } else {
+        for (UInt32 i=0; i<nb; i++) flowStoreGet(store, ids[i], &expired[i]);
+        qsort(expired, nb, sizeof(fromtopacket), &compareEntry);
+        for (UInt32 i=0; i<nb; i++){
+            printf("Expired ");
+            printPacketSummary(&expired[i]);
+        }
+    }
+
+    // the sequence numbers in the batch refer to the ids before the removals
+    if ( table->sequences ) seqFlush(table->sequences);
+
+    // from the last id: the flux moved in the place of a removed one is not expired
+    for (UInt32 i=nb; i-- > 0; ){
+        fromtopacket p;
+        UInt32 key[FLUXKEYWORDS];
+        flowStoreGet(store, ids[i], &p);
+        fluxKey(&p, key);
+        radix96Remove(&table->tree, key);
+        if ( table->server ) queryChanged(table->server, &p, 0);
+
+        UInt32 moved = flowStoreRemove(store, ids[i]);
+        if ( table->sequences ) seqRemove(table->sequences, ids[i], moved);
+        if ( moved != FLOWNONE ){
+            // the leaf of the moved flux holds its new id
+            flowStoreGet(store, ids[i], &p);
+            fluxKey(&p, key);
+            void** data = radix96Find(&table->tree, key);
+            if ( data ) *data = FLOWLEAF(ids[i]);
+        }
+    }
+    memFree(expired);
+    memFree(ids);
+}
+
+/**
+ * @brief flush the IPv6 flux not updated during the last expire lines
+ */
+static void expireStore6(fluxTable* table){
+    flowStore6* store = &table->flows6;
+    if ( store->nb == 0 ) return;
+    UInt32* ids = (UInt32*)memAlloc(store->nb * sizeof(UInt32), MEMOTHER);
+    if ( ids == NULL ) return;
+    UInt32 nb = flowStore6Idle(store, (UInt32)table->lines, table->expire, ids);
+    fromtopacket6* expired = nb ? (fromtopacket6*)memAlloc(nb * sizeof(fromtopacket6), MEMOTHER) : NULL;
+    if ( expired == NULL ){
+        memFree(ids);
+        return;
+    }
+    for (UInt32 i=0; i<nb; i++) expired[i] = store->flows[ids[i]];
+    qsort(expired, nb, sizeof(fromtopacket6), &compareEntry6);
+    for (UInt32 i=0; i<nb; i++){
+        char summary[PACKET6SUMMARYSIZE];
+        packetSummary6(&expired[i], summary, sizeof(summary));
+        printf("Expired %s\n", summary);
+    }
+
+    for (UInt32 i=nb; i-- > 0; ){
+        UInt32 key[FLUX6KEYWORDS];
+        fluxKey6(&store->flows[ids[i]], key);
+        radix288Remove(&table->tree6, key);
+        if ( flowStore6Remove(store, ids[i]) != FLOWNONE ){
+            fluxKey6(&store->flows[ids[i]], key);
+            void** data = radix288Find(&table->tree6, key);
+            if ( data ) *data = FLOWLEAF(ids[i]);
+        }
+    }
+    memFree(expired);
+    memFree(ids);
+}
+
+/**
+ * @brief flush the flux not updated during the last expire lines: the flux are printed from the smallest
+ * to the biggest, the IPv4 flux then the IPv6 flux, removed from the radix trees and the stores
+ * 
+ * @param table the flux table
+ */
+void expireFlux(fluxTable* table){
+    expireStore(table);
+    expireStore6(table);
+}
+
+/**
+ * @brief publish the counters of the table in its metrics slot, if any
+ * 
+ * @param table the flux table
+ */
+void publishFlux(const fluxTable* table){
+    if ( table->metrics == NULL ) return;
+    metricsSample s = { .lines = table->lines, .bytes = table->bytes, .malformed = table->malformed,
+                        .reordered = table->reordered, .repeated = table->repeated, .files = 0,
+                        .flows = table->flows.nb + table->flows6.nb, .nodes = table->tree.nodes + table->tree6.nodes };
+    metricsPublish(table->metrics, &s);
+}
+
+/**
+ * @brief the periodic work after a packet: the snapshot of the queries and the sweep of the idle flux
+ */
+static void afterPacket(fluxTable* table){
+    // the snapshot of the queries is checked every 1024 lines
+    if ( table->server && (table->lines & 0x3FF) == 0 ) queryRefresh(table->server, table);
+
+    // a sweep every expire/2 lines: a flux is flushed after expire to 1.5 expire idle lines
+    if ( table->expire && table->lines >= table->nextSweep ){
+        expireFlux(table);
+        table->nextSweep = table->lines + (table->expire > 1 ? table->expire / 2 : 1);
+    }
+}
+
+/**
+ * @brief update the flux table with a packet, or give it to the shared memory table
+ * 
+ * @param table the flux table
+ * @param packet the packet, read only: a stack copy is made only for a conversation or a new flux
+ * @return int 0 if the packet is accepted, even out of order, 1 if the shared memory table fails
+ */
+int processPacket(fluxTable* table, const fromtopacket* packet){
+    table->lines++;
+    // the metrics are published every 1024 lines, with a shared memory table too
+    if ( table->metrics && (table->lines & 0x3FF) == 0 ) publishFlux(table);
+    if ( table->shared ) return shmAdd(table->shared, packet) ? 1 : 0;
+    flowStore* store = &table->flows;
+    // a conversation: the 2 directions under the key of the lower endpoint first
+    fromtopacket canonical;
+    int backward = 0;
+    if ( store->bidirectional ){
+        canonical = *packet;
+        backward = canonicalPacket(&canonical);
+        packet = &canonical;
+    }
+    UInt32 key[FLUXKEYWORDS];
+    fluxKey(packet, key);
+    void** data = radix96Insert(&table->tree, key);
+    if ( data == NULL ) return 0;
+
+    if ( *data == NULL ){
+        // a packet is a range of a single sequence number
+        fromtopacket flux = *packet;
+        flux.lastPacket = flux.firstPacket;
+        flux.lastUpdate = (UInt32)table->lines;
+        UInt32 id = flowStoreAdd(store, &flux);
+        if ( id != FLOWNONE ){
+            *data = FLOWLEAF(id);
+            if ( table->server ) queryChanged(table->server, packet, 0);
+            if ( backward ) flowStoreReverse(store, id);
+            if ( table->sequences ) seqAdd(table->sequences, id, packet->firstPacket);
+
+            for (int i=0; i<table->nbAggregates; i++){
+                aggregateUpdate(&table->aggregates[i], packet, 0, 1);
+            }
+        }
+    }
+
+    else {
+        UInt32 id = LEAFFLOW(*data);
+        // a retransmission is kept too: it is counted as a duplicate
+        if ( table->sequences ) seqAdd(table->sequences, id, packet->firstPacket);
+
+        UInt32 size = store->last[id] - store->first[id];
+        int order = store->bidirectional ? flowStoreExtend(store, id, packet->firstPacket, backward)
+                                         : seqExtend(&store->first[id], &store->last[id], packet->firstPacket);
+        if ( table->server ) queryChanged(table->server, packet, store->lastUpdate[id]);
+        store->lastUpdate[id] = (UInt32)table->lines;
+        if ( order != SEQINORDER ){
+            if ( order == SEQREORDERED ) table->reordered++;
+            else table->repeated++;
+            // the packet is written in its direction
+            if ( backward ) reversePacket(&canonical);
+            if ( table->quarantine ) quarantinePacket(table->quarantine, packet);
+        }
+
+        if ( order != SEQREPEATED && table->nbAggregates ){
+            fromtopacket p;
+            flowStoreGet(store, id, &p);
+            for (int i=0; i<table->nbAggregates; i++){
+                aggregateUpdate(&table->aggregates[i], &p, packetSize(&p) - size, 0);
+            }
+        }
+    }
+
+    afterPacket(table);
+    return 0;
+}
+
+/**
+ * @brief update the flux table with an IPv6 packet: the IPv6 flux have their own radix tree on 288 bits keys
+ * and their own store, the shared memory table only has IPv4 flux
+ * 
+ * @param table the flux table
+ * @param packet the packet
+ * @return int 0: a packet out of order is counted
+ */
+int processPacket6(fluxTable* table, const fromtopacket6* packet){
+    table->lines++;
+    if ( table->metrics && (table->lines & 0x3FF) == 0 ) publishFlux(table);
+    if ( table->shared ) return 0;
+    UInt32 key[FLUX6KEYWORDS];
+    fluxKey6(packet, key);
+    void** data = radix288Insert(&table->tree6, key);
+    if ( data == NULL ) return 0;
+
+    flowStore6* store = &table->flows6;
+    if ( *data == NULL ){
+        fromtopacket6 flux = *packet;
+        flux.lastPacket = flux.firstPacket;
+        flux.lastUpdate = (UInt32)table->lines;
+        UInt32 id = flowStore6Add(store, &flux);
+        if ( id != FLOWNONE ) *data = FLOWLEAF(id);
+    } else {
+        fromtopacket6* flux = &store->flows[LEAFFLOW(*data)];
+        int order = seqExtend(&flux->firstPacket, &flux->lastPacket, packet->firstPacket);
+        flux->lastUpdate = (UInt32)table->lines;
+        if ( order != SEQINORDER ){
+            if ( order == SEQREORDERED ) table->reordered++;
+            else table->repeated++;
+            if ( table->quarantine ) quarantinePacket6(table->quarantine, packet);
+        }
+    }
+    afterPacket(table);
+    return 0;
+}
+
+/**
+ * @brief count the 2 directions of a conversation as one flux: the packets are added under the key of their
+ * lower endpoint (canonicalPacket), each flux keeps the range of each direction. Only the IPv4 flux are
+ * conversations, the aggregates and the sequence numbers do not know the directions.
+ * Set on an empty table.
+ * 
+ * @param table the flux table
+ */
+void setBidirectional(fluxTable* table){
+    table->flows.bidirectional = 1;
+}
+
+/**
+ * @brief keep 1 flux in n: a flux is kept when the hash of its key is at most SAMPLELIMIT(n), the decision
+ * is taken after the decoding of a packet, before any allocation. The flux kept have their exact size
+ * and the same flux are kept by every run.
+ * 
+ * @param table the flux table
+ * @param n 1 in n, 0 or 1 to keep all the flux
+ */
+void setSampling(fluxTable* table, UInt32 n){
+    table->sample = n;
+    table->sampleLimit = SAMPLELIMIT(n);
+}
+
+/**
+ * @brief the packet is not in the sample: it is only counted
+ */
+static inline int sampledOut(fluxTable* table, const fromtopacket* packet){
+    if ( table->sample <= 1 ) return 0;
+    // the 2 directions of a conversation are kept together
+    fromtopacket canonical = *packet;
+    if ( table->flows.bidirectional ) canonicalPacket(&canonical);
+    UInt32 key[FLUXKEYWORDS];
+    fluxKey(&canonical, key);
+    if ( fluxHash(key, FLUXKEYWORDS) <= table->sampleLimit ) return 0;
+    table->sampledOut++;
+    return 1;
+}
+
+static inline int sampledOut6(fluxTable* table, const fromtopacket6* packet){
+    if ( table->sample <= 1 ) return 0;
+    UInt32 key[FLUX6KEYWORDS];
+    fluxKey6(packet, key);
+    if ( fluxHash(key, FLUX6KEYWORDS) <= table->sampleLimit ) return 0;
+    table->sampledOut++;
+    return 1;
+}
+
+/**
+ * @brief decode a line, IPv4 or IPv6 in brackets, and update the flux table
+ * 
+ * @param table the flux table
+ * @param buffer the line to decode
+ * @return int 0 if the line is accepted or ignored, 1 if the shared memory table fails
+ */
+int processLine(fluxTable* table, char* buffer){
+    if ( *buffer == '\n' || *buffer == '\0' ) return 0;
+    // an IPv6 address is in brackets
+    if ( *buffer == '[' ){
+        fromtopacket6 packet;
+        if ( !decodePacket6(buffer, &packet) ){
+            table->malformed++;
+            return 0;
+        }
+        return sampledOut6(table, &packet) ? 0 : processPacket6(table, &packet);
+    }
+
+    fromtopacket packet;
+    if ( !decodePacket(buffer, &packet) ){
+        table->malformed++;
+        return 0;
+    }
+    return sampledOut(table, &packet) ? 0 : processPacket(table, &packet);
+}
+
+/**
+ * @brief the function called by the capture and columnar readers for each packet
+ * 
+ * @param packet the packet read in the file
+ * @param ctx the flux table
+ * @return int 0 to continue the reading, 1 if the shared memory table fails
+ */
+int processCapture(const fromtopacket* packet, void* ctx){
+    return sampledOut((fluxTable*)ctx, packet) ? 0 : processPacket((fluxTable*)ctx, packet);
+}
+
+/**
+ * @brief the range of sequence numbers of two parts of a flux: from the smallest first
+ * sequence number to the biggest last one, in serial number arithmetic
+ */
+static void mergeRange(tcp_seq* intoFirst, tcp_seq* intoLast, tcp_seq fromFirst, tcp_seq fromLast){
+    tcp_seq first = SEQBEFORE(fromFirst, *intoFirst) ? fromFirst : *intoFirst;
+    tcp_seq last = SEQAFTER(fromLast, *intoLast) ? fromLast : *intoLast;
+    *intoFirst = first;
+    *intoLast = last;
+}
+
+/**
+ * @brief add a flux to the table: a flux already in the table goes from the smallest first
+ * sequence number to the biggest last one
+ * 
+ * @param table the flux table
+ * @param flux the flux
+ * @return UInt32 the id of the flux in the table, FLOWNONE if out of memory
+ */
+UInt32 addFlux(fluxTable* table, const fromtopacket* flux){
+    UInt32 key[FLUXKEYWORDS];
+    fluxKey(flux, key);
+    void** data = radix96Insert(&table->tree, key);
+    if ( data == NULL ) return FLOWNONE;
+
+    if ( *data == NULL ){
+        UInt32 added = flowStoreAdd(&table->flows, flux);
+        if ( added != FLOWNONE ) *data = FLOWLEAF(added);
+        if ( added != FLOWNONE && table->server ) queryChanged(table->server, flux, 0);
+        return added;
+    }
+    UInt32 merged = LEAFFLOW(*data);
+    mergeRange(&table->flows.first[merged], &table->flows.last[merged], flux->firstPacket, flux->lastPacket);
+    if ( table->server ) queryChanged(table->server, flux, 0);
+    return merged;
+}
+
+/**
+ * @brief add an IPv6 flux to the table, as addFlux
+ * 
+ * @param table the flux table
+ * @param flux the flux
+ * @return UInt32 the id of the flux in the IPv6 store, FLOWNONE if out of memory
+ */
+UInt32 addFlux6(fluxTable* table, const fromtopacket6* flux){
+    UInt32 key[FLUX6KEYWORDS];
+    fluxKey6(flux, key);
+    void** data = radix288Insert(&table->tree6, key);
+    if ( data == NULL ) return FLOWNONE;
+
+    if ( *data == NULL ){
+        UInt32 added = flowStore6Add(&table->flows6, flux);
+        if ( added != FLOWNONE ) *data = FLOWLEAF(added);
+        return added;
+    }
+    fromtopacket6* merged = &table->flows6.flows[LEAFFLOW(*data)];
+    mergeRange(&merged->firstPacket, &merged->lastPacket, flux->firstPacket, flux->lastPacket);
+    return LEAFFLOW(*data);
+}
+
+/**
+ * @brief merge a direction of a conversation: a direction seen in one of the conversations only is copied
+ */
+static void mergeDirection(flowStore* into, UInt32 id, UInt8 direction, UInt8 seen, tcp_seq first, tcp_seq last){
+    if ( !(seen & direction) ) return;
+    tcp_seq* intoFirst = direction == FLOWBACKWARD ? &into->backFirst[id] : &into->first[id];
+    tcp_seq* intoLast = direction == FLOWBACKWARD ? &into->backLast[id] : &into->last[id];
+    if ( into->directions[id] & direction ){
+        mergeRange(intoFirst, intoLast, first, last);
+    } else {
+        *intoFirst = first;
+        *intoLast = last;
+        into->directions[id] |= direction;
+    }
+}
+
+/**
+ * @brief add a conversation of a bidirectional store to a bidirectional table, each direction as addFlux
+ * 
+ * @param table the bidirectional flux table
+ * @param from the bidirectional store of the conversation
+ * @param id the id of the conversation in from
+ * @return UInt32 the id of the conversation in the table, FLOWNONE if out of memory
+ */
+UInt32 addConversation(fluxTable* table, const flowStore* from, UInt32 id){
+    fromtopacket p;
+    flowStoreGet(from, id, &p);
+    UInt32 key[FLUXKEYWORDS];
+    fluxKey(&p, key);
+    void** data = radix96Insert(&table->tree, key);
+    if ( data == NULL ) return FLOWNONE;
+
+    flowStore* store = &table->flows;
+    UInt32 merged;
+    if ( *data == NULL ){
+        merged = flowStoreAdd(store, &p);
+        if ( merged == FLOWNONE ) return FLOWNONE;
+        *data = FLOWLEAF(merged);
+        store->directions[merged] = 0;
+    } else {
+        merged = LEAFFLOW(*data);
+    }
+    mergeDirection(store, merged, FLOWFORWARD, from->directions[id], p.firstPacket, p.lastPacket);
+    mergeDirection(store, merged, FLOWBACKWARD, from->directions[id], from->backFirst[id], from->backLast[id]);
+    return merged;
+}
+
+/**
+ * @brief merge a flux table in another one: a flux of both tables goes from the smallest first
+ * sequence number to the biggest last one. The flux are read in the order of their ids, from is not modified
+ * but the batch of its sequence numbers is flushed: their maps are merged too. The conversations of
+ * a bidirectional table are merged by direction in a bidirectional table.
+ * 
+ * @param into the table receiving the flux
+ * @param from the merged table
+ * @return int 0, -1 if out of memory
+ */
+int mergeFlux(fluxTable* into, const fluxTable* from){
+    into->lines += from->lines;
+    into->reordered += from->reordered;
+    into->repeated += from->repeated;
+    into->bytes += from->bytes;
+    into->malformed += from->malformed;
+    into->sampledOut += from->sampledOut;
+    if ( from->sequences ){
+        seqFlush(from->sequences);
+        if ( into->sequences == NULL ) into->sequences = seqTableCreate();
+        if ( into->sequences == NULL ) return -1;
+    }
+    for (UInt32 id=0; id<from->flows.nb; id++){
+        fromtopacket p;
+        flowStoreGet(&from->flows, id, &p);
+        UInt32 merged = from->flows.bidirectional ? addConversation(into, &from->flows, id) : addFlux(into, &p);
+        if ( merged == FLOWNONE ) return -1;
+        if ( from->sequences && seqMerge(into->sequences, merged, from->sequences, id) ) return -1;
+    }
+    for (UInt32 id=0; id<from->flows6.nb; id++){
+        if ( addFlux6(into, &from->flows6.flows[id]) == FLOWNONE ) return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief free the stores and the sequence numbers of the flux table - the radix trees are freed with their pool
+ * 
+ * @param table the flux table
+ */
+void freeFlux(fluxTable* table){
+    flowStoreFree(&table->flows);
+    flowStore6Free(&table->flows6);
+    seqTableFree(table->sequences);
+    table->sequences = NULL;
+}
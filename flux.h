@@ -0,0 +1,277 @@
+/**
+ * @file flux.h
+ * @author Sebastien Galvagno
+ * @brief The flux table: the radix tree to find a flux and the store of the flux
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_FLUX_H__
+#define __SG__CHIMERE_FLUX_H__
+
+#include "SG_Types.h"
+#include "packet.h"
+#include "radixfixed.h"
+#include "aggregate.h"
+#include "shmflux.h"
+#include "flowstore.h"
+#include "seqmap.h"
+#include "quarantine.h"
+#include "metrics.h"
+
+// the summary of a conversation, conversationSummary
+#define CONVERSATIONSUMMARYSIZE 128
+
+/**
+ * @brief the in-memory flux table: the radix tree to find a flux and the store of the flux
+ * 
+ * tree: the radix tree on the binary keys of the flux (fluxKey), the leaf of a flux holds its id in the store (FLOWLEAF)
+ * flows: the flux in columns, the conversations of a bidirectional table (setBidirectional)
+ * tree6, flows6: the IPv6 flux, apart so that the IPv4 flux keep their keys of 96 bits
+ * sequences: the sequence numbers seen in each IPv4 flux, by flux id, NULL when they are not kept
+ */
+typedef struct {
+    radix96Tree tree;
+    flowStore flows;
+    radix288Tree tree6; // the IPv6 flux: keys of 288 bits (fluxKey6) and a store of their own
+    flowStore6 flows6;
+    UInt64 lines;
+    UInt32 expire;      // a flux not updated during expire lines is flushed, 0 to keep all the flux
+    UInt64 nextSweep;   // the line of the next search of the expired flux
+    aggregateTable aggregates[MAXAGGREGATES]; // the tables fed with the growth of the flux
+    int nbAggregates;
+    shmWriter* shared;  // the packets go to a shared memory table instead of this table
+    struct queryServer* server; // the snapshots of the table read by the queries
+    seqTable* sequences; // the sequence numbers of the IPv4 flux, allocated with seqTableCreate
+    UInt64 reordered;   // the packets before the first packet of their flux: the flux grows backwards
+    UInt64 repeated;    // the packets inside the range of their flux
+    quarantine* quarantine; // the file of the packets out of order, NULL for none
+    UInt64 bytes;       // the bytes read, given by the reader
+    UInt64 malformed;   // the lines not decoded
+    metricsSlot* metrics; // the slot of the thread feeding the table, published every 1024 lines, NULL for none
+    UInt32 sample;      // 1 flux in sample is kept (setSampling), 0 or 1 to keep all the flux
+    UInt64 sampleLimit; // the biggest hash of a flux kept, SAMPLELIMIT(sample)
+    UInt64 sampledOut;  // the lines of the flux not kept
+} fluxTable;
+
+/**
+ * @brief print a flux: the function given to printSubnet and used by the periodic top
+ * 
+ * @param data here data is the packet structure
+ */
+void affiche(void* data);
+
+/**
+ * @brief compare the keys of 2 flux: the addresses and the ports, in the order of the radix keys
+ * 
+ * @param packet1 
+ * @param packet2 
+ * @return int <0, 0 or >0
+ */
+int compareFluxKey(const fromtopacket* packet1, const fromtopacket* packet2);
+
+/**
+ * @brief compare 2 flux by size, the flux of the same size in the order of their keys:
+ * the order of the report does not depend on the order of the reading
+ * 
+ * @param packet1 
+ * @param packet2 
+ * @return int <0, 0 or >0
+ */
+int compareFlux(const fromtopacket* packet1, const fromtopacket* packet2);
+
+/**
+ * @brief compare 2 IPv6 flux by size, the flux of the same size in the order of their keys
+ * 
+ * @param packet1 
+ * @param packet2 
+ * @return int <0, 0 or >0
+ */
+int compareFlux6(const fromtopacket6* packet1, const fromtopacket6* packet2);
+
+/**
+ * @brief the biggest flux, the biggest first: a scan of the sizes finds the size of the last one,
+ * the flux of this size or bigger are sorted - the reverse order of compareFlux
+ * 
+ * @param table the flux table
+ * @param top the number of flux
+ * @param flux the flux, top items
+ * @return UInt32 the number of flux
+ */
+UInt32 topFlux(const fluxTable* table, UInt32 top, fromtopacket* flux);
+
+/**
+ * @brief the biggest IPv6 flux, the biggest first - the reverse order of compareFlux6
+ * 
+ * @param table the flux table
+ * @param top the number of flux
+ * @param flux the flux, top items
+ * @return UInt32 the number of flux
+ */
+UInt32 topFlux6(const fluxTable* table, UInt32 top, fromtopacket6* flux);
+
+/**
+ * @brief the size of a conversation of a bidirectional store: the sizes of its 2 directions
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ * @return UInt32 the size
+ */
+UInt32 conversationSize(const flowStore* store, UInt32 id);
+
+/**
+ * @brief write the summary of a conversation of a bidirectional store "Flux ip:port,ip:port / Taille : size
+ * / Aller : size / Retour : size": the lower endpoint first, the size of the 2 directions then of each one
+ * 
+ * @param store the bidirectional store
+ * @param id the flux id
+ * @param buffer the buffer, CONVERSATIONSUMMARYSIZE bytes are enough
+ * @param size the size of the buffer
+ * @return int the length of the summary
+ */
+int conversationSummary(const flowStore* store, UInt32 id, char* buffer, size_t size);
+
+/**
+ * @brief sort conversations of a bidirectional store from the smallest to the biggest, the size of
+ * the 2 directions, the conversations of the same size in the order of their keys
+ * 
+ * @param store the bidirectional store
+ * @param ids the ids of the conversations, sorted
+ * @param nb the number of ids
+ * @return int 0, -1 if out of memory
+ */
+int sortConversations(const flowStore* store, UInt32* ids, UInt32 nb);
+
+/**
+ * @brief the biggest conversations of a bidirectional table, the biggest first, as topFlux
+ * 
+ * @param table the flux table
+ * @param top the number of conversations
+ * @param ids the ids of the conversations, top items
+ * @return UInt32 the number of conversations
+ */
+UInt32 topConversations(const fluxTable* table, UInt32 top, UInt32* ids);
+
+/**
+ * @brief flush the flux not updated during the last expire lines: the flux are printed from the smallest
+ * to the biggest, the IPv4 flux then the IPv6 flux, removed from the radix trees and the stores
+ * 
+ * @param table the flux table
+ */
+void expireFlux(fluxTable* table);
+
+/**
+ * @brief update the flux table with a packet, or give it to the shared memory table
+ * 
+ * @param table the flux table
+ * @param packet the packet, read only: a stack copy is made only for a conversation or a new flux
+ * @return int 0 if the packet is accepted, even out of order, 1 if the shared memory table fails
+ */
+int processPacket(fluxTable* table, const fromtopacket* packet);
+
+/**
+ * @brief update the flux table with an IPv6 packet: the IPv6 flux have their own radix tree on 288 bits keys
+ * and their own store, the shared memory table only has IPv4 flux
+ * 
+ * @param table the flux table
+ * @param packet the packet
+ * @return int 0: a packet out of order is counted
+ */
+int processPacket6(fluxTable* table, const fromtopacket6* packet);
+
+/**
+ * @brief count the 2 directions of a conversation as one flux: the packets are added under the key of their
+ * lower endpoint (canonicalPacket), each flux keeps the range of each direction. Only the IPv4 flux are
+ * conversations, the aggregates and the sequence numbers do not know the directions.
+ * Set on an empty table.
+ * 
+ * @param table the flux table
+ */
+void setBidirectional(fluxTable* table);
+
+/**
+ * @brief keep 1 flux in n: a flux is kept when the hash of its key is at most SAMPLELIMIT(n), the decision
+ * is taken after the decoding of a packet, before any allocation. The flux kept have their exact size
+ * and the same flux are kept by every run.
+ * 
+ * @param table the flux table
+ * @param n 1 in n, 0 or 1 to keep all the flux
+ */
+void setSampling(fluxTable* table, UInt32 n);
+
+/**
+ * @brief decode a line, IPv4 or IPv6 in brackets, and update the flux table
+ * 
+ * @param table the flux table
+ * @param buffer the line to decode
+ * @return int 0 if the line is accepted or ignored, 1 if the shared memory table fails
+ */
+int processLine(fluxTable* table, char* buffer);
+
+/**
+ * @brief the function called by the capture and columnar readers for each packet
+ * 
+ * @param packet the packet read in the file
+ * @param ctx the flux table
+ * @return int 0 to continue the reading, 1 if the shared memory table fails
+ */
+int processCapture(const fromtopacket* packet, void* ctx);
+
+/**
+ * @brief add a flux to the table: a flux already in the table goes from the smallest first
+ * sequence number to the biggest last one
+ * 
+ * @param table the flux table
+ * @param flux the flux
+ * @return UInt32 the id of the flux in the table, FLOWNONE if out of memory
+ */
+UInt32 addFlux(fluxTable* table, const fromtopacket* flux);
+
+/**
+ * @brief add an IPv6 flux to the table, as addFlux
+ * 
+ * @param table the flux table
+ * @param flux the flux
+ * @return UInt32 the id of the flux in the IPv6 store, FLOWNONE if out of memory
+ */
+UInt32 addFlux6(fluxTable* table, const fromtopacket6* flux);
+
+/**
+ * @brief add a conversation of a bidirectional store to a bidirectional table, each direction as addFlux
+ * 
+ * @param table the bidirectional flux table
+ * @param from the bidirectional store of the conversation
+ * @param id the id of the conversation in from
+ * @return UInt32 the id of the conversation in the table, FLOWNONE if out of memory
+ */
+UInt32 addConversation(fluxTable* table, const flowStore* from, UInt32 id);
+
+/**
+ * @brief merge a flux table in another one: a flux of both tables goes from the smallest first
+ * sequence number to the biggest last one. The flux are read in the order of their ids, from is not modified
+ * but the batch of its sequence numbers is flushed: their maps are merged too. The conversations of
+ * a bidirectional table are merged by direction in a bidirectional table.
+ * 
+ * @param into the table receiving the flux
+ * @param from the merged table
+ * @return int 0, -1 if out of memory
+ */
+int mergeFlux(fluxTable* into, const fluxTable* from);
+
+/**
+ * @brief publish the counters of the table in its metrics slot, if any
+ * 
+ * @param table the flux table
+ */
+void publishFlux(const fluxTable* table);
+
+/**
+ * @brief free the stores and the sequence numbers of the flux table - the radix trees are freed with their pool
+ * 
+ * @param table the flux table
+ */
+void freeFlux(fluxTable* table);
+
+#endif
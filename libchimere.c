@@ -0,0 +1,307 @@
+/**
+ * @file libchimere.c
+ * @author Sebastien Galvagno
+ * @brief The flux engine as a library: an opaque context fed with lines or packets
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The radix tree and the flux of a context are allocated in its pool:
+ * each call sets the pool of the thread and restores the previous one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __UNITTEST_LIBCHIMERE__
+#include <assert.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#endif
+
+#include "libchimere.h"
+#include "flux.h"
+#include "lines.h"
+#include "pool.h"
+
+struct chimere {
+    fluxTable table;
+    lineSplitter splitter;
+    pool* memory;
+};
+
+static int feedLine(char* line, void* ctx){
+    return processLine((fluxTable*)ctx, line);
+}
+
+/**
+ * @brief create an empty context
+ * 
+ * @return chimere* NULL if out of memory
+ */
+chimere* chimereCreate(void){
+    chimere* c = (chimere*)calloc(1, sizeof(chimere));
+    if ( c == NULL ) return NULL;
+    c->memory = poolCreate();
+    if ( c->memory == NULL ){
+        free(c);
+        return NULL;
+    }
+    splitterInit(&c->splitter, &feedLine, &c->table);
+    return c;
+}
+
+/**
+ * @brief feed a buffer of lines - the ends of line are replaced by NUL.
+ * A line at the end of the buffer is completed by the next buffer.
+ * 
+ * @param c the context
+ * @param data the lines
+ * @param size the size of the buffer
+ * @return int 0 - the packets out of order are counted, see chimereOutOfOrder
+ */
+int chimereFeed(chimere* c, char* data, size_t size){
+    pool* previous = poolUse(c->memory);
+    int r = splitLines(&c->splitter, data, size);
+    poolUse(previous);
+    return r;
+}
+
+/**
+ * @brief the end of the lines: the last line, without end of line, is read
+ * 
+ * @param c the context
+ * @return int 0 - the packets out of order are counted, see chimereOutOfOrder
+ */
+int chimereFeedEnd(chimere* c){
+    pool* previous = poolUse(c->memory);
+    int r = splitEnd(&c->splitter);
+    poolUse(previous);
+    return r;
+}
+
+/**
+ * @brief feed decoded packets
+ * 
+ * @param c the context
+ * @param packets the packets
+ * @param nb the number of packets
+ * @return int 0 - the packets out of order are counted, see chimereOutOfOrder
+ */
+int chimereFeedPackets(chimere* c, const fromtopacket* packets, size_t nb){
+    pool* previous = poolUse(c->memory);
+    int r = 0;
+    for (size_t i=0; r == 0 && i<nb; i++){
+        r = processCapture(&packets[i], &c->table);
+    }
+    poolUse(previous);
+    return r;
+}
+
+/**
+ * @brief the biggest flux, the biggest first - a scan of the flux
+ * 
+ * @param c the context
+ * @param top the number of flux
+ * @param fn the function called for each flux
+ * @param ctx the context given to fn
+ * @return int the number of flux given to fn
+ */
+int chimereTop(chimere* c, int top, chimereFluxFn fn, void* ctx){
+    if ( top <= 0 ) return 0;
+    fromtopacket* flux = (fromtopacket*)malloc(top * sizeof(fromtopacket));
+    if ( flux == NULL ) return 0;
+    int nb = (int)topFlux(&c->table, top, flux);
+    for (int i=0; i<nb; i++){
+        if ( fn(&flux[i], ctx) ){
+            nb = i + 1;
+            break;
+        }
+    }
+    free(flux);
+    return nb;
+}
+
+/**
+ * @brief the walk of chimereIterate
+ */
+typedef struct {
+    const flowStore* store;
+    chimereFluxFn fn;
+    void* ctx;
+    UInt64 nb;
+} iterateWalk;
+
+static int iterateLeaf(const UInt32* key, void* data, void* ctx){
+    (void)key;
+    iterateWalk* w = (iterateWalk*)ctx;
+    fromtopacket flux;
+    flowStoreGet(w->store, LEAFFLOW(data), &flux);
+    w->nb++;
+    return w->fn(&flux, w->ctx);
+}
+
+/**
+ * @brief all the flux, in the order of the addresses and ports
+ * 
+ * @param c the context
+ * @param fn the function called for each flux
+ * @param ctx the context given to fn
+ * @return UInt64 the number of flux given to fn
+ */
+UInt64 chimereIterate(chimere* c, chimereFluxFn fn, void* ctx){
+    iterateWalk w = {&c->table.flows, fn, ctx, 0};
+    radix96Walk(&c->table.tree, NULL, 0, &iterateLeaf, &w);
+    return w.nb;
+}
+
+/**
+ * @brief the number of packets read since the creation or the reset
+ * 
+ * @param c the context
+ * @return UInt64 
+ */
+UInt64 chimereLines(const chimere* c){
+    return c->table.lines;
+}
+
+/**
+ * @brief the number of packets out of order since the creation or the reset: before the first packet
+ * of their flux (the flux grows backwards) or inside its range (a retransmission)
+ * 
+ * @param c the context
+ * @return UInt64 
+ */
+UInt64 chimereOutOfOrder(const chimere* c){
+    return c->table.reordered + c->table.repeated;
+}
+
+/**
+ * @brief the memory reserved by the context
+ * 
+ * @param c the context
+ * @return UInt64 the size in bytes
+ */
+UInt64 chimereMemory(const chimere* c){
+    return c->memory->capacity + (UInt64)c->table.flows.capacity * FLOWBYTES
+           + (UInt64)c->table.flows6.capacity * sizeof(fromtopacket6);
+}
+
+/**
+ * @brief forget all the flux: the memory is kept for the next log, nothing is freed
+ * 
+ * @param c the context
+ */
+void chimereReset(chimere* c){
+    flowStore flows = c->table.flows;
+    flowStore6 flows6 = c->table.flows6;
+    poolReset(c->memory);
+    memset(&c->table, 0, sizeof(c->table));
+    // the columns of the stores are kept for the next log
+    flows.nb = 0;
+    flows6.nb = 0;
+    c->table.flows = flows;
+    c->table.flows6 = flows6;
+    splitterInit(&c->splitter, &feedLine, &c->table);
+}
+
+/**
+ * @brief free the context and its memory
+ * 
+ * @param c the context
+ */
+void chimereDestroy(chimere* c){
+    if ( c == NULL ) return;
+    freeFlux(&c->table);
+    poolDestroy(c->memory);
+    free(c);
+}
+
+
+#ifdef __UNITTEST_LIBCHIMERE__
+
+static int printFlux(const fromtopacket* flux, void* ctx){
+    UInt32* previous = (UInt32*)ctx;
+    printPacketSummary((fromtopacket*)flux);
+    // the top is sorted by size
+    assert(packetSize(flux) <= *previous);
+    *previous = packetSize(flux);
+    return 0;
+}
+
+static int checkOrder(const fromtopacket* flux, void* ctx){
+    UInt64* previous = (UInt64*)ctx;
+    UInt64 key = (UInt64)ntohl(flux->from) << 32 | ntohl(flux->to);
+    assert(key >= *previous);
+    *previous = key;
+    return 0;
+}
+
+static UInt64 feedLog(chimere* c, int nbFlux, int nbLines){
+    char buffer[4096];
+    size_t len = 0;
+    for (int i=0; i<nbLines; i++){
+        int f = i % nbFlux;
+        len += sprintf(buffer + len, "10.%d.%d.1:%d,192.168.0.1:80,%d\n", f >> 8, f & 0xFF, 1000 + f, 1000 + i * (1 + f % 7));
+        // the buffers end in the middle of a line
+        if ( len > sizeof(buffer) - 64 ){
+            assert(chimereFeed(c, buffer, len - 10) == 0);
+            memmove(buffer, buffer + len - 10, 10);
+            len = 10;
+        }
+    }
+    assert(chimereFeed(c, buffer, len) == 0);
+    assert(chimereFeedEnd(c) == 0);
+    return chimereLines(c);
+}
+
+int main(){
+    chimere* c = chimereCreate();
+    assert(c);
+    assert(feedLog(c, 1000, 20000) == 20000);
+
+    UInt32 size = 0xFFFFFFFF;
+    assert(chimereTop(c, 5, &printFlux, &size) == 5);
+    UInt64 key = 0;
+    assert(chimereIterate(c, &checkOrder, &key) == 1000);
+
+    // the same log after a reset: the memory is reused
+    UInt64 memory = chimereMemory(c);
+    for (int i=0; i<10; i++){
+        chimereReset(c);
+        assert(chimereLines(c) == 0);
+        assert(chimereTop(c, 5, &printFlux, &size) == 0);
+        assert(feedLog(c, 1000, 20000) == 20000);
+        assert(chimereMemory(c) == memory);
+    }
+    key = 0;
+    assert(chimereIterate(c, &checkOrder, &key) == 1000);
+
+    // decoded packets
+    chimereReset(c);
+    fromtopacket packets[2];
+    memset(packets, 0, sizeof(packets));
+    packets[0].from = packets[1].from = htonl(0x0A000001);
+    packets[0].to = packets[1].to = htonl(0x0A000002);
+    packets[0].firstPacket = 10;
+    packets[1].firstPacket = 110;
+    assert(chimereFeedPackets(c, packets, 2) == 0);
+    size = 0xFFFFFFFF;
+    assert(chimereTop(c, 5, &printFlux, &size) == 1);
+    assert(size == 100);
+    // a packet out of order is counted, the flux keeps its range
+    assert(chimereFeedPackets(c, packets, 1) == 0);
+    assert(chimereOutOfOrder(c) == 1);
+    size = 0xFFFFFFFF;
+    assert(chimereTop(c, 5, &printFlux, &size) == 1);
+    assert(size == 100);
+
+    chimereDestroy(c);
+    printf("libchimere: OK\n");
+    return 0;
+}
+
+// gcc -o libchimere packet.c radixfixed.c aggregate.c pool.c lines.c flowstore.c seqmap.c quarantine.c metrics.c shmflux.c query.c flux.c libchimere.c -g -D__UNITTEST_LIBCHIMERE__ -pthread -lrt && ./libchimere
+
+#endif
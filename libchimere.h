@@ -0,0 +1,134 @@
+/**
+ * @file libchimere.h
+ * @author Sebastien Galvagno
+ * @brief The flux engine as a library: an opaque context fed with lines or packets
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * chimere* c = chimereCreate();
+ * chimereFeed(c, buffer, size);      // as many times as needed, the lines can cross the buffers
+ * chimereFeedEnd(c);
+ * chimereTop(c, 10, &fn, ctx);
+ * chimereReset(c);                   // the next log, the memory is reused
+ * chimereDestroy(c);
+ * 
+ * A context is used by one thread at a time.
+ */
+#ifndef __SG__CHIMERE_LIBCHIMERE_H__
+#define __SG__CHIMERE_LIBCHIMERE_H__
+
+#include <stddef.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+
+typedef struct chimere chimere;
+
+/**
+ * @brief the function called for each flux by chimereTop and chimereIterate
+ * 
+ * @param flux the flux: the addresses and ports, the first and last sequence numbers (see packetSize())
+ * @param ctx the context given to the call
+ * @return int 0 to continue
+ */
+typedef int (*chimereFluxFn)(const fromtopacket* flux, void* ctx);
+
+/**
+ * @brief create an empty context
+ * 
+ * @return chimere* NULL if out of memory
+ */
+chimere* chimereCreate(void);
+
+/**
+ * @brief feed a buffer of lines - the ends of line are replaced by NUL.
+ * A line at the end of the buffer is completed by the next buffer.
+ * 
+ * @param c the context
+ * @param data the lines
+ * @param size the size of the buffer
+ * @return int 0 - the packets out of order are counted, see chimereOutOfOrder
+ */
+int chimereFeed(chimere* c, char* data, size_t size);
+
+/**
+ * @brief the end of the lines: the last line, without end of line, is read
+ * 
+ * @param c the context
+ * @return int 0 - the packets out of order are counted, see chimereOutOfOrder
+ */
+int chimereFeedEnd(chimere* c);
+
+/**
+ * @brief feed decoded packets
+ * 
+ * @param c the context
+ * @param packets the packets
+ * @param nb the number of packets
+ * @return int 0 - the packets out of order are counted, see chimereOutOfOrder
+ */
+int chimereFeedPackets(chimere* c, const fromtopacket* packets, size_t nb);
+
+/**
+ * @brief the biggest flux, the biggest first - a scan of the flux
+ * 
+ * @param c the context
+ * @param top the number of flux
+ * @param fn the function called for each flux
+ * @param ctx the context given to fn
+ * @return int the number of flux given to fn
+ */
+int chimereTop(chimere* c, int top, chimereFluxFn fn, void* ctx);
+
+/**
+ * @brief all the flux, in the order of the addresses and ports
+ * 
+ * @param c the context
+ * @param fn the function called for each flux
+ * @param ctx the context given to fn
+ * @return UInt64 the number of flux given to fn
+ */
+UInt64 chimereIterate(chimere* c, chimereFluxFn fn, void* ctx);
+
+/**
+ * @brief the number of packets read since the creation or the reset
+ * 
+ * @param c the context
+ * @return UInt64 
+ */
+UInt64 chimereLines(const chimere* c);
+
+/**
+ * @brief the number of packets out of order since the creation or the reset: before the first packet
+ * of their flux (the flux grows backwards) or inside its range (a retransmission)
+ * 
+ * @param c the context
+ * @return UInt64 
+ */
+UInt64 chimereOutOfOrder(const chimere* c);
+
+/**
+ * @brief the memory reserved by the context
+ * 
+ * @param c the context
+ * @return UInt64 the size in bytes
+ */
+UInt64 chimereMemory(const chimere* c);
+
+/**
+ * @brief forget all the flux: the memory is kept for the next log, nothing is freed
+ * 
+ * @param c the context
+ */
+void chimereReset(chimere* c);
+
+/**
+ * @brief free the context and its memory
+ * 
+ * @param c the context
+ */
+void chimereDestroy(chimere* c);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file lines.c
+ * @author Sebastien Galvagno
+ * @brief Split buffers of text in lines, in place
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __UNITTEST_LINES__
+#include <assert.h>
+#endif
+
+#include "lines.h"
+
+/**
+ * @brief initialise a line splitter
+ * 
+ * @param splitter the splitter
+ * @param fn the function called for each line
+ * @param ctx the context given to fn
+ */
+void splitterInit(lineSplitter* splitter, lineFn fn, void* ctx){
+    splitter->carryLen = 0;
+    splitter->skipping = 0;
+    splitter->overlong = 0;
+    splitter->bytes = 0;
+    splitter->fn = fn;
+    splitter->idle = NULL;
+    splitter->ctx = ctx;
+}
+
+/**
+ * @brief keep the beginning of a line for the next buffer
+ */
+static void keep(lineSplitter* splitter, const char* data, size_t size){
+    if ( splitter->skipping ) return;
+    if ( splitter->carryLen + size > LINEMAX ){
+        splitter->skipping = 1;
+        splitter->overlong++;
+        splitter->carryLen = 0;
+        return;
+    }
+    memcpy(splitter->carry + splitter->carryLen, data, size);
+    splitter->carryLen += size;
+}
+
+/**
+ * @brief split the lines of a buffer - the ends of line are replaced by NUL
+ * 
+ * @param splitter the splitter
+ * @param data the buffer
+ * @param size the size of the buffer
+ * @return int 0, or the non zero return of fn
+ */
+int splitLines(lineSplitter* splitter, char* data, size_t size){
+    char* end = data + size;
+    char* line = data;
+    splitter->bytes += size;
+
+    // the end of the line begun in the previous buffer
+    if ( splitter->carryLen || splitter->skipping ){
+        char* eol = (char*)memchr(line, '\n', size);
+        if ( eol == NULL ){
+            keep(splitter, line, size);
+            return 0;
+        }
+        keep(splitter, line, eol - line);
+        line = eol + 1;
+        if ( !splitter->skipping ){
+            splitter->carry[splitter->carryLen] = '\0';
+            splitter->carryLen = 0;
+            int r = splitter->fn(splitter->carry, splitter->ctx);
+            if ( r ) return r;
+        }
+        splitter->skipping = 0;
+    }
+
+    char* eol;
+    while ( line < end && (eol = (char*)memchr(line, '\n', end - line)) != NULL ){
+        if ( eol - line > LINEMAX ){
+            splitter->overlong++;
+        } else {
+            *eol = '\0';
+            int r = splitter->fn(line, splitter->ctx);
+            if ( r ) return r;
+        }
+        line = eol + 1;
+    }
+
+    if ( line < end ) keep(splitter, line, end - line);
+    return 0;
+}
+
+/**
+ * @brief give the last line, without end of line, at the end of the input
+ * 
+ * @param splitter the splitter
+ * @return int 0, or the non zero return of fn
+ */
+int splitEnd(lineSplitter* splitter){
+    int r = 0;
+    if ( splitter->carryLen && !splitter->skipping ){
+        splitter->carry[splitter->carryLen] = '\0';
+        r = splitter->fn(splitter->carry, splitter->ctx);
+    }
+    splitter->carryLen = 0;
+    splitter->skipping = 0;
+    return r;
+}
+
+
+#ifdef __UNITTEST_LINES__
+
+static char lines[16][LINEMAX+1];
+static int nbLines;
+
+int store(char* line, void* ctx){
+    (void)ctx;
+    strcpy(lines[nbLines++], line);
+    return 0;
+}
+
+void split(lineSplitter* splitter, const char* text){
+    char buffer[1024];
+    strcpy(buffer, text);
+    splitLines(splitter, buffer, strlen(buffer));
+}
+
+int main(){
+    lineSplitter splitter;
+    splitterInit(&splitter, &store, NULL);
+
+    // lines across buffers
+    split(&splitter, "1.2.3.4:80,5.6.7.8:90,100\n1.2.3.4:80,5.6");
+    split(&splitter, ".7.8:90,");
+    split(&splitter, "150\n\n9.9.9.9:1,8.8.8.8:2,5");
+    splitEnd(&splitter);
+    assert(nbLines == 4);
+    assert(strcmp(lines[0], "1.2.3.4:80,5.6.7.8:90,100") == 0);
+    assert(strcmp(lines[1], "1.2.3.4:80,5.6.7.8:90,150") == 0);
+    assert(strcmp(lines[2], "") == 0);
+    assert(strcmp(lines[3], "9.9.9.9:1,8.8.8.8:2,5") == 0);
+    assert(splitter.bytes == strlen("1.2.3.4:80,5.6.7.8:90,100\n1.2.3.4:80,5.6.7.8:90,150\n\n9.9.9.9:1,8.8.8.8:2,5"));
+
+    // an over-long line, in one buffer then across buffers, is dropped
+    nbLines = 0;
+    char longLine[LINEMAX + 10];
+    memset(longLine, 'X', sizeof(longLine) - 1);
+    longLine[sizeof(longLine) - 1] = '\0';
+    char text[1024];
+    snprintf(text, sizeof(text), "a\n%s\nb\n", longLine);
+    split(&splitter, text);
+    split(&splitter, "c\n");
+    split(&splitter, longLine);
+    split(&splitter, longLine);
+    split(&splitter, "\nd\n");
+    splitEnd(&splitter);
+    assert(nbLines == 4);
+    assert(strcmp(lines[0], "a") == 0);
+    assert(strcmp(lines[1], "b") == 0);
+    assert(strcmp(lines[2], "c") == 0);
+    assert(strcmp(lines[3], "d") == 0);
+    assert(splitter.overlong == 2);
+    return 0;
+}
+
+// gcc -o lines lines.c -g -D__UNITTEST_LINES__ && ./lines
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ * @file lines.h
+ * @author Sebastien Galvagno
+ * @brief Split buffers of text in lines, in place
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_LINES_H__
+#define __SG__CHIMERE_LINES_H__
+
+#include <stddef.h>
+
+#include "SG_Types.h"
+
+// the longest line accepted, a longer line is dropped (and counted) instead of being split
+#define LINEMAX 256
+
+/**
+ * @brief the function called for each line
+ * 
+ * @param line the line, NUL terminated, without its end of line - it can be modified
+ * @param ctx the context given to the splitter
+ * @return int 0 to continue
+ */
+typedef int (*lineFn)(char* line, void* ctx);
+
+/**
+ * @brief the function called while a stream has no data
+ * 
+ * @param ctx the context given to the splitter
+ */
+typedef void (*idleFn)(void* ctx);
+
+/**
+ * @brief a line splitter: the lines are split in the buffers given by the reader,
+ * only a line across two buffers is copied
+ */
+typedef struct {
+    char carry[LINEMAX+1]; // the beginning of the line at the end of the previous buffer
+    size_t carryLen;
+    int skipping;          // the end of an over-long line is skipped
+    UInt64 overlong;       // the number of over-long lines dropped
+    UInt64 bytes;          // the bytes given to the splitter
+    lineFn fn;
+    idleFn idle;           // called by readStream every READIDLE ms without data, NULL for none
+    void* ctx;
+} lineSplitter;
+
+/**
+ * @brief initialise a line splitter
+ * 
+ * @param splitter the splitter
+ * @param fn the function called for each line
+ * @param ctx the context given to fn
+ */
+void splitterInit(lineSplitter* splitter, lineFn fn, void* ctx);
+
+/**
+ * @brief split the lines of a buffer - the ends of line are replaced by NUL
+ * 
+ * @param splitter the splitter
+ * @param data the buffer
+ * @param size the size of the buffer
+ * @return int 0, or the non zero return of fn
+ */
+int splitLines(lineSplitter* splitter, char* data, size_t size);
+
+/**
+ * @brief give the last line, without end of line, at the end of the input
+ * 
+ * @param splitter the splitter
+ * @return int 0, or the non zero return of fn
+ */
+int splitEnd(lineSplitter* splitter);
+
+#endif
@@ -0,0 +1,485 @@
+/**
+ * @file metrics.c
+ * @author Sebastien Galvagno
+ * @brief The counters of the ingestion exported in the Prometheus text format, to a file or on a local HTTP port
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Each ingesting thread publishes the counters of its table in a slot of its own, every 1024 lines:
+ * the slot is a sequence lock, the thread makes its version odd, writes and makes it even again,
+ * the exporter copies a slot until it reads the same even version before and after. The thread never
+ * waits and never shares a cache line, the exporter sums the slots.
+ *
+ * curl -s http://127.0.0.1:9100/metrics
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#ifdef __UNITTEST_METRICS__
+#include <assert.h>
+#endif
+
+#include "metrics.h"
+
+// the fields of a sample, read and written one by one
+#define METRICSFIELDS (sizeof(metricsSample) / sizeof(UInt64))
+
+struct metrics {
+    metricsSlot slots[METRICSSLOTS];
+    int nbSlots;            // the slots claimed, taken atomically
+    char path[PATH_MAX];    // the file, empty for the HTTP server
+    int listenFd;           // the HTTP server, -1 for a file
+    int stopPipe[2];
+    pthread_t thread;
+    struct timespec start;
+    // the rates, computed by the exporter thread at each period
+    metricsSample previous;
+    struct timespec previousTime;
+    double linesPerSecond;
+    double bytesPerSecond;
+    int error;              // the last write of the file failed
+};
+
+static double elapsedSince(const struct timespec* t){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) + (now.tv_nsec - t->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief the slot of a new thread
+ *
+ * @param m the metrics
+ * @return metricsSlot* NULL when the METRICSSLOTS slots are taken
+ */
+metricsSlot* metricsClaim(metrics* m){
+    if ( m == NULL ) return NULL;
+    int i = __atomic_fetch_add(&m->nbSlots, 1, __ATOMIC_RELAXED);
+    if ( i >= METRICSSLOTS ){
+        __atomic_store_n(&m->nbSlots, METRICSSLOTS, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return &m->slots[i];
+}
+
+static void writeSlot(metricsSlot* slot, const metricsSample* sample){
+    const UInt64* from = (const UInt64*)sample;
+    UInt64* to = (UInt64*)&slot->value;
+    UInt64 version = slot->version;
+    __atomic_store_n(&slot->version, version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i=0; i<METRICSFIELDS; i++) __atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->version, version + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief publish the counters of the table fed by the thread, added to the counters of its tables retired:
+ * called by the thread of the slot only, it never waits
+ *
+ * @param slot the slot of the thread
+ * @param sample the counters of its table
+ */
+void metricsPublish(metricsSlot* slot, const metricsSample* sample){
+    metricsSample s = *sample;
+    s.lines += slot->base.lines;
+    s.bytes += slot->base.bytes;
+    s.malformed += slot->base.malformed;
+    s.reordered += slot->base.reordered;
+    s.repeated += slot->base.repeated;
+    s.files += slot->base.files;
+    writeSlot(slot, &s);
+}
+
+/**
+ * @brief the table of the thread is done (a file of a batch): its counters stay in the slot and count a file,
+ * its gauges are cleared, the next samples are added to them
+ *
+ * @param slot the slot of the thread
+ */
+void metricsRetire(metricsSlot* slot){
+    slot->base = slot->value;
+    slot->base.files++;
+    slot->base.flows = 0;
+    slot->base.nodes = 0;
+    writeSlot(slot, &slot->base);
+}
+
+static void readSlot(metricsSlot* slot, metricsSample* sample){
+    UInt64* to = (UInt64*)sample;
+    const UInt64* from = (const UInt64*)&slot->value;
+    for (;;){
+        UInt64 version = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+        if ( version & 1 ) continue;
+        for (size_t i=0; i<METRICSFIELDS; i++) to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ( __atomic_load_n(&slot->version, __ATOMIC_RELAXED) == version ) return;
+    }
+}
+
+/**
+ * @brief the sum of the counters of the threads
+ *
+ * @param m the metrics
+ * @param total the sum
+ */
+void metricsTotal(metrics* m, metricsSample* total){
+    memset(total, 0, sizeof(metricsSample));
+    int nb = __atomic_load_n(&m->nbSlots, __ATOMIC_RELAXED);
+    for (int i=0; i<nb && i<METRICSSLOTS; i++){
+        metricsSample s;
+        readSlot(&m->slots[i], &s);
+        UInt64* sum = (UInt64*)total;
+        const UInt64* add = (const UInt64*)&s;
+        for (size_t k=0; k<METRICSFIELDS; k++) sum[k] += add[k];
+    }
+}
+
+/**
+ * @brief the resident memory of the process, 0 if unknown
+ */
+static UInt64 residentMemory(void){
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if ( fp == NULL ) return 0;
+    unsigned long long size, resident;
+    int n = fscanf(fp, "%llu %llu", &size, &resident);
+    fclose(fp);
+    return n == 2 ? (UInt64)resident * (UInt64)sysconf(_SC_PAGESIZE) : 0;
+}
+
+/**
+ * @brief the rates since the previous period
+ */
+static void updateRates(metrics* m){
+    metricsSample now;
+    metricsTotal(m, &now);
+    double seconds = elapsedSince(&m->previousTime);
+    if ( seconds > 0 ){
+        m->linesPerSecond = (now.lines - m->previous.lines) / seconds;
+        m->bytesPerSecond = (now.bytes - m->previous.bytes) / seconds;
+    }
+    m->previous = now;
+    clock_gettime(CLOCK_MONOTONIC, &m->previousTime);
+}
+
+static size_t put(char* text, size_t size, size_t len, const char* name, const char* type, const char* help, const char* value){
+    if ( len >= size ) return len;
+    int n = snprintf(text + len, size - len, "# HELP %s %s\n# TYPE %s %s\n%s %s\n", name, help, name, type, name, value);
+    return n < 0 ? len : len + n;
+}
+
+/**
+ * @brief the text of the metrics, in the Prometheus text format
+ */
+static size_t render(metrics* m, char* text, size_t size){
+    metricsSample t;
+    metricsTotal(m, &t);
+    char value[64];
+    size_t len = 0;
+#define COUNT(name, type, help, v) \
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)(v)); \
+    len = put(text, size, len, name, type, help, value);
+#define RATE(name, help, v) \
+    snprintf(value, sizeof(value), "%.1f", (double)(v)); \
+    len = put(text, size, len, name, "gauge", help, value);
+    COUNT("chimere_lines_total", "counter", "The packets decoded.", t.lines)
+    COUNT("chimere_bytes_total", "counter", "The bytes read.", t.bytes)
+    COUNT("chimere_malformed_lines_total", "counter", "The lines not decoded.", t.malformed)
+    COUNT("chimere_packets_reordered_total", "counter", "The packets before the first packet of their flux.", t.reordered)
+    COUNT("chimere_packets_repeated_total", "counter", "The packets inside the range of their flux.", t.repeated)
+    COUNT("chimere_files_total", "counter", "The files of the batch read.", t.files)
+    RATE("chimere_lines_per_second", "The packets decoded per second during the last period.", m->linesPerSecond)
+    RATE("chimere_bytes_per_second", "The bytes read per second during the last period.", m->bytesPerSecond)
+    COUNT("chimere_flows", "gauge", "The flux of the tables being fed.", t.flows)
+    COUNT("chimere_radix_nodes", "gauge", "The nodes of the radix trees being fed.", t.nodes)
+    COUNT("chimere_resident_memory_bytes", "gauge", "The resident memory of the process.", residentMemory())
+    COUNT("chimere_threads", "gauge", "The threads publishing their counters.", __atomic_load_n(&m->nbSlots, __ATOMIC_RELAXED))
+    RATE("chimere_elapsed_seconds", "The seconds since the start.", elapsedSince(&m->start))
+#undef COUNT
+#undef RATE
+    return len < size ? len : size - 1;
+}
+
+/**
+ * @brief write the file of the metrics: a temporary file renamed, a reader never sees half a file
+ */
+static void writeFile(metrics* m){
+    char text[METRICSTEXT];
+    char tmp[PATH_MAX + 8];
+    size_t len = render(m, text, sizeof(text));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", m->path);
+    FILE* fp = fopen(tmp, "w");
+    int r = fp && fwrite(text, 1, len, fp) == len ? 0 : -1;
+    if ( fp && fclose(fp) != 0 ) r = -1;
+    if ( r == 0 && rename(tmp, m->path) != 0 ) r = -1;
+    m->error = r;
+}
+
+static int sendAll(int fd, const char* data, size_t size){
+    while ( size ){
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief answer a request of the HTTP server: GET /metrics or GET /, one request per connection
+ */
+static void answer(metrics* m){
+    int fd = accept(m->listenFd, NULL, NULL);
+    if ( fd < 0 ) return;
+    // a client which does not send its request does not block the exporter
+    struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char request[1024];
+    size_t len = 0;
+    ssize_t n;
+    request[0] = '\0';
+    while ( len < sizeof(request) - 1 && (n = recv(fd, request + len, sizeof(request) - 1 - len, 0)) > 0 ){
+        len += n;
+        request[len] = '\0';
+        if ( strstr(request, "\r\n\r\n") || strstr(request, "\n\n") ) break;
+    }
+
+    char text[METRICSTEXT];
+    char header[256];
+    int found = strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0;
+    size_t size = found ? render(m, text, sizeof(text)) : (size_t)snprintf(text, sizeof(text), "not found\n");
+    int h = snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     found ? "200 OK" : "404 Not Found", found ? "text/plain; version=0.0.4" : "text/plain", size);
+    if ( sendAll(fd, header, h) == 0 ) sendAll(fd, text, size);
+    close(fd);
+}
+
+static void* exporterThread(void* arg){
+    metrics* m = (metrics*)arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    next.tv_sec += METRICSPERIOD;
+
+    for (;;){
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long remain = (next.tv_sec - now.tv_sec) * 1000LL + (next.tv_nsec - now.tv_nsec) / 1000000;
+        struct pollfd fds[2] = { { .fd = m->stopPipe[0], .events = POLLIN }, { .fd = m->listenFd, .events = POLLIN } };
+        int n = poll(fds, m->listenFd >= 0 ? 2 : 1, remain > 0 ? (int)remain : 0);
+        if ( n < 0 && errno != EINTR ) break;
+        if ( n > 0 && fds[0].revents ) break;
+        if ( n > 0 && (fds[1].revents & POLLIN) ) answer(m);
+
+        if ( remain <= 0 ){
+            updateRates(m);
+            if ( m->listenFd < 0 ) writeFile(m);
+            next.tv_sec += METRICSPERIOD;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief the HTTP server on 127.0.0.1:port
+ */
+static int listenOn(const char* port){
+    char* end;
+    long p = strtol(port, &end, 10);
+    if ( *port == '\0' || *end != '\0' || p <= 0 || p > 65535 ) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((UInt16)p);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int on = 1;
+    if ( fd >= 0 ) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if ( fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0 ){
+        if ( fd >= 0 ) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief start the thread exporting the metrics every METRICSPERIOD seconds:
+ * a file written then renamed, or ":port" for an HTTP server on 127.0.0.1 answering GET /metrics
+ *
+ * @param target the file or ":port"
+ * @return metrics* NULL on error
+ */
+metrics* metricsStart(const char* target){
+    metrics* m = (metrics*)calloc(1, sizeof(metrics));
+    if ( m == NULL ) return NULL;
+    for (int i=0; i<METRICSSLOTS; i++) m->slots[i].registry = m;
+    clock_gettime(CLOCK_MONOTONIC, &m->start);
+    m->previousTime = m->start;
+    m->listenFd = -1;
+
+    if ( *target == ':' ){
+        m->listenFd = listenOn(target + 1);
+        if ( m->listenFd < 0 ){
+            free(m);
+            return NULL;
+        }
+    } else {
+        if ( strlen(target) >= sizeof(m->path) ){
+            free(m);
+            return NULL;
+        }
+        strcpy(m->path, target);
+        // the file exists from the start
+        writeFile(m);
+    }
+
+    if ( m->error || pipe(m->stopPipe) != 0 ){
+        if ( m->listenFd >= 0 ) close(m->listenFd);
+        free(m);
+        return NULL;
+    }
+    if ( pthread_create(&m->thread, NULL, &exporterThread, m) != 0 ){
+        if ( m->listenFd >= 0 ) close(m->listenFd);
+        close(m->stopPipe[0]);
+        close(m->stopPipe[1]);
+        free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/**
+ * @brief stop the thread: the file is written a last time with the final counters
+ *
+ * @param m the metrics
+ * @return int 0, -1 if the file could not be written
+ */
+int metricsStop(metrics* m){
+    if ( m == NULL ) return 0;
+    if ( write(m->stopPipe[1], "", 1) != 1 ) pthread_cancel(m->thread);
+    pthread_join(m->thread, NULL);
+    close(m->stopPipe[0]);
+    close(m->stopPipe[1]);
+    updateRates(m);
+    if ( m->listenFd >= 0 ) close(m->listenFd);
+    else writeFile(m);
+    int r = m->error;
+    free(m);
+    return r;
+}
+
+
+#ifdef __UNITTEST_METRICS__
+
+#define ROUNDS 1000000
+
+typedef struct {
+    metricsSlot* slot;
+    int stop;
+} writerJob;
+
+// a writer keeps bytes == 10 * lines in its samples: a torn read would break it
+static void* writerThread(void* arg){
+    writerJob* job = (writerJob*)arg;
+    metricsSample s;
+    memset(&s, 0, sizeof(s));
+    for (UInt64 i=1; i<=ROUNDS; i++){
+        s.lines = i % 1000;
+        s.bytes = 10 * s.lines;
+        s.flows = i;
+        metricsPublish(job->slot, &s);
+        // a file of 1000 lines done
+        if ( s.lines == 999 ) metricsRetire(job->slot);
+    }
+    return NULL;
+}
+
+static char* readAll(const char* path, char* text, size_t size){
+    FILE* fp = fopen(path, "r");
+    assert(fp);
+    size_t n = fread(text, 1, size - 1, fp);
+    text[n] = '\0';
+    fclose(fp);
+    return text;
+}
+
+int main(){
+    const char* path = "/tmp/chimere_metrics_test.prom";
+    metrics* m = metricsStart(path);
+    assert(m);
+    char text[METRICSTEXT];
+    assert(strstr(readAll(path, text, sizeof(text)), "chimere_lines_total 0\n"));
+
+    // the counters of 4 threads summed while they are written
+    writerJob jobs[4];
+    pthread_t ids[4];
+    for (int i=0; i<4; i++){
+        jobs[i].slot = metricsClaim(m);
+        assert(jobs[i].slot);
+        pthread_create(&ids[i], NULL, &writerThread, &jobs[i]);
+    }
+    UInt64 reads = 0, lastFiles = 0;
+    for (int running = 4; running; ){
+        metricsSample t;
+        metricsTotal(m, &t);
+        assert(t.bytes == 10 * t.lines);
+        assert(t.files >= lastFiles);
+        lastFiles = t.files;
+        reads++;
+        running = 0;
+        for (int i=0; i<4; i++) running += __atomic_load_n(&jobs[i].slot->value.flows, __ATOMIC_RELAXED) != ROUNDS;
+    }
+    for (int i=0; i<4; i++) pthread_join(ids[i], NULL);
+    metricsSample t;
+    metricsTotal(m, &t);
+    // each thread: 1000 files of 999 lines, and 1000 x 1000 - 1000 x 999 lines of the last file
+    assert(t.files == 4 * (ROUNDS / 1000) && t.lines == 4 * ((ROUNDS / 1000) * 999) && t.flows == 4 * ROUNDS);
+    printf("%llu totals read during the writes\n", (unsigned long long)reads);
+
+    assert(metricsStop(m) == 0);
+    readAll(path, text, sizeof(text));
+    snprintf(text + sizeof(text) / 2, sizeof(text) / 2, "chimere_lines_total %llu\n", (unsigned long long)t.lines);
+    assert(strstr(text, text + sizeof(text) / 2));
+    assert(strstr(text, "# TYPE chimere_lines_total counter\n"));
+    assert(strstr(text, "chimere_threads 4\n"));
+    unlink(path);
+
+    // the HTTP server
+    m = metricsStart(":39100");
+    assert(m);
+    metricsSlot* slot = metricsClaim(m);
+    metricsSample s = { .lines = 42, .bytes = 420 };
+    metricsPublish(slot, &s);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(39100), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    assert(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    const char* get = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    assert(write(fd, get, strlen(get)) == (ssize_t)strlen(get));
+    size_t len = 0;
+    ssize_t n;
+    while ( (n = read(fd, text + len, sizeof(text) - 1 - len)) > 0 ) len += n;
+    text[len] = '\0';
+    close(fd);
+    assert(strncmp(text, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    assert(strstr(text, "\nchimere_lines_total 42\n") && strstr(text, "\nchimere_bytes_total 420\n"));
+    assert(metricsStop(m) == 0);
+
+    printf("metrics: OK\n");
+    return 0;
+}
+
+// gcc -o metrics metrics.c -g -D__UNITTEST_METRICS__ -pthread && ./metrics
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file metrics.h
+ * @author Sebastien Galvagno
+ * @brief The counters of the ingestion exported in the Prometheus text format, to a file or on a local HTTP port
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef __SG__CHIMERE_METRICS_H__
+#define __SG__CHIMERE_METRICS_H__
+
+#include <stddef.h>
+
+#include "SG_Types.h"
+
+// the seconds between two exports, and between two computations of the rates
+#define METRICSPERIOD 5
+// the threads publishing their counters
+#define METRICSSLOTS 256
+// the biggest text of the metrics
+#define METRICSTEXT 4096
+
+/**
+ * @brief the counters of a thread: the counters only grow, flows and nodes are gauges
+ */
+typedef struct {
+    UInt64 lines;       // the packets decoded
+    UInt64 bytes;       // the bytes read
+    UInt64 malformed;   // the lines not decoded
+    UInt64 reordered;   // the packets before the first packet of their flux
+    UInt64 repeated;    // the packets inside the range of their flux
+    UInt64 files;       // the files of a batch read, counted by metricsRetire
+    UInt64 flows;       // the flux of the table fed by the thread
+    UInt64 nodes;       // the nodes of its radix trees
+} metricsSample;
+
+struct metrics;
+
+/**
+ * @brief the counters of a thread, on a cache line of their own: written by their thread only,
+ * read by the exporter without lock (the version is odd while the thread writes)
+ */
+typedef struct {
+    UInt64 version;
+    metricsSample value;    // the counters read by the exporter
+    metricsSample base;     // the counters of the tables retired, only used by the thread
+    struct metrics* registry;
+} __attribute__((aligned(64))) metricsSlot;
+
+typedef struct metrics metrics;
+
+/**
+ * @brief start the thread exporting the metrics every METRICSPERIOD seconds:
+ * a file written then renamed, or ":port" for an HTTP server on 127.0.0.1 answering GET /metrics
+ *
+ * @param target the file or ":port"
+ * @return metrics* NULL on error
+ */
+metrics* metricsStart(const char* target);
+
+/**
+ * @brief the slot of a new thread
+ *
+ * @param m the metrics
+ * @return metricsSlot* NULL when the METRICSSLOTS slots are taken
+ */
+metricsSlot* metricsClaim(metrics* m);
+
+/**
+ * @brief publish the counters of the table fed by the thread, added to the counters of its tables retired:
+ * called by the thread of the slot only, it never waits
+ *
+ * @param slot the slot of the thread
+ * @param sample the counters of its table
+ */
+void metricsPublish(metricsSlot* slot, const metricsSample* sample);
+
+/**
+ * @brief the table of the thread is done (a file of a batch): its counters stay in the slot and count a file,
+ * its gauges are cleared, the next samples are added to them
+ *
+ * @param slot the slot of the thread
+ */
+void metricsRetire(metricsSlot* slot);
+
+/**
+ * @brief the sum of the counters of the threads
+ *
+ * @param m the metrics
+ * @param total the sum
+ */
+void metricsTotal(metrics* m, metricsSample* total);
+
+/**
+ * @brief stop the thread: the file is written a last time with the final counters
+ *
+ * @param m the metrics
+ * @return int 0, -1 if the file could not be written
+ */
+int metricsStop(metrics* m);
+
+#endif
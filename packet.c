@@ -13,8 +13,229 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 
 #include "packet.h"
+#include "pool.h"
+
+typedef enum { noError = 0, atonError, atoiError } error_t;
+
+error_t tryStrtol(UInt32* result, const char *nptr, char **endptr, int base){
+    errno = noError;
+    *result = strtol(nptr, endptr, base);
+    return errno;
+}
+
+/**
+ * @brief decode a line of the input stream "ip:port,ip:port,seq" - the buffer is modified
+ * 
+ * @param buffer the string to decode
+ * @param packet the data
+ * @return int 1 if the line is decoded, 0 otherwise
+ */
+int decodePacket(char *buffer, fromtopacket* packet){
+    char *saveptr;
+    char * from = strtok_r(buffer, ",", &saveptr);
+    char * to = strtok_r(NULL, ",", &saveptr);
+    char * seq = strtok_r(NULL, ",", &saveptr);
+
+    char * ipFrom = strtok_r(from, ":", &saveptr);
+    char * portFrom = strtok_r(NULL, ":", &saveptr);
+
+    char * ipTo = strtok_r(to, ":" , &saveptr);
+    char * portTo = strtok_r(NULL, ":", &saveptr);
+    
+    struct in_addr addrFrom;
+    struct in_addr addrTo;
+    UInt32 iPortfrom, iPortto,iSeq;
+    if ( from && to && seq && ipFrom && portFrom && ipTo && portTo
+        && inet_aton(ipFrom, &addrFrom) != 0 
+        && inet_aton(ipTo, &addrTo) != 0
+        && tryStrtol(&iPortfrom, portFrom, NULL, 10) == noError
+        && tryStrtol(&iPortto, portTo, NULL, 10) == noError
+        && tryStrtol(&iSeq, seq, NULL, 10) == noError
+    ){
+        memset(packet, 0, sizeof(fromtopacket));
+        packet->from = addrFrom.s_addr ;
+        packet->to = addrTo.s_addr ;
+        packet->portFrom = (UInt16) iPortfrom ;
+        packet->portTo = (UInt16) iPortto ;
+        packet->firstPacket = iSeq ;
+        return 1;
+    }
+    return 0;
+}
+
+static inline int hexDigit(unsigned char c){
+    if ( (unsigned)(c - '0') < 10 ) return c - '0';
+    c |= 0x20;
+    if ( (unsigned)(c - 'a') < 6 ) return c - 'a' + 10;
+    return -1;
+}
+
+/**
+ * @brief parse a decimal number of 10 digits at most
+ * 
+ * @return const char* the first character after the number, NULL without digit
+ */
+static const char* parseDecimal(const char* str, UInt32* value){
+    UInt32 v = 0;
+    const char* start = str;
+    while ( (unsigned)(*str - '0') < 10 && str - start < 10 ){
+        v = v * 10 + (*str - '0');
+        str++;
+    }
+    *value = v;
+    return str == start ? NULL : str;
+}
+
+/**
+ * @brief parse the dotted quad at the end of an IPv6 address
+ */
+static const char* parseQuad(const char* str, UInt32* addr){
+    UInt32 v = 0;
+    for (int i=0; i<4; i++){
+        UInt32 byte;
+        const char* end = parseDecimal(str, &byte);
+        if ( end == NULL || end - str > 3 || byte > 255 ) return NULL;
+        v = v << 8 | byte;
+        str = end;
+        if ( i < 3 ){
+            if ( *str != '.' ) return NULL;
+            str++;
+        }
+    }
+    *addr = v;
+    return str;
+}
+
+/**
+ * @brief parse an IPv6 address "2001:db8::1", "::ffff:10.0.0.1" - without inet_pton
+ * 
+ * @param str the address
+ * @param addr the address, 4 words in host order
+ * @return const char* the first character after the address, NULL if it is not an address
+ */
+const char* parseIPv6(const char* str, UInt32* addr){
+    UInt16 groups[8];
+    int nb = 0, gap = -1;
+    if ( str[0] == ':' ){
+        if ( str[1] != ':' ) return NULL;
+        gap = 0;
+        str += 2;
+    }
+    while ( nb < 8 ){
+        const char* start = str;
+        UInt32 v = 0;
+        int d;
+        while ( str - start < 4 && (d = hexDigit(*str)) >= 0 ){
+            v = v << 4 | d;
+            str++;
+        }
+        if ( str == start ){
+            // "::" may end the address, a single ':' is followed by a group
+            if ( gap == nb ) break;
+            return NULL;
+        }
+        if ( *str == '.' ){
+            // the last 32 bits in dotted quad
+            UInt32 quad;
+            if ( nb > 6 || (str = parseQuad(start, &quad)) == NULL ) return NULL;
+            groups[nb++] = quad >> 16;
+            groups[nb++] = quad & 0xFFFF;
+            break;
+        }
+        groups[nb++] = v;
+        if ( *str != ':' ) break;
+        if ( str[1] == ':' ){
+            if ( gap >= 0 ) return NULL;
+            gap = nb;
+            str += 2;
+        } else {
+            str++;
+        }
+    }
+    if ( gap < 0 ? nb != 8 : nb > 7 ) return NULL;
+
+    // the groups after the gap go to the end
+    UInt16 full[8] = {0};
+    int tail = gap < 0 ? 0 : nb - gap;
+    memcpy(full, groups, (nb - tail) * sizeof(UInt16));
+    memcpy(full + 8 - tail, groups + nb - tail, tail * sizeof(UInt16));
+    for (int i=0; i<4; i++) addr[i] = (UInt32)full[2 * i] << 16 | full[2 * i + 1];
+    return str;
+}
+
+/**
+ * @brief parse "[ip]:port"
+ */
+static const char* parseEndpoint6(const char* str, UInt32* addr, UInt16* port){
+    UInt32 p;
+    if ( *str++ != '[' ) return NULL;
+    str = parseIPv6(str, addr);
+    if ( str == NULL || str[0] != ']' || str[1] != ':' ) return NULL;
+    str = parseDecimal(str + 2, &p);
+    if ( str == NULL || p > 0xFFFF ) return NULL;
+    *port = (UInt16)p;
+    return str;
+}
+
+/**
+ * @brief decode a line of the input stream "[ip]:port,[ip]:port,seq" with IPv6 addresses
+ * 
+ * @param buffer the string to decode
+ * @param packet the data
+ * @return int 1 if the line is decoded, 0 otherwise
+ */
+int decodePacket6(const char *buffer, fromtopacket6* packet){
+    memset(packet, 0, sizeof(fromtopacket6));
+    const char* str = parseEndpoint6(buffer, packet->from, &packet->portFrom);
+    if ( str == NULL || *str++ != ',' ) return 0;
+    str = parseEndpoint6(str, packet->to, &packet->portTo);
+    if ( str == NULL || *str++ != ',' ) return 0;
+    return parseDecimal(str, &packet->firstPacket) != NULL;
+}
+
+/**
+ * @brief the size of the flux: the number of sequence numbers between the first and the last packet
+ * 
+ * @param packet 
+ * @return UInt32 the size, 0 for a single packet
+ */
+UInt32 packetSize(const fromtopacket* packet){
+    return packet->lastPacket - packet->firstPacket;
+}
+
+/**
+ * @brief the size of an IPv6 flux, as packetSize
+ * 
+ * @param packet 
+ * @return UInt32 the size, 0 for a single packet
+ */
+UInt32 packetSize6(const fromtopacket6* packet){
+    return packet->lastPacket - packet->firstPacket;
+}
+
+/**
+ * @brief add a sequence number to the range of a flux, in serial number arithmetic: the range only
+ * grows, a packet out of order does not stop the reading
+ * 
+ * @param first the first sequence number of the flux
+ * @param last the last sequence number of the flux, first for a single packet: 0 is a sequence number as another
+ * @param seq the sequence number of the packet
+ * @return int SEQINORDER, SEQREORDERED or SEQREPEATED
+ */
+int seqExtend(tcp_seq* first, tcp_seq* last, tcp_seq seq){
+    if ( SEQAFTER(seq, *last) ){
+        *last = seq;
+        return SEQINORDER;
+    }
+    if ( SEQBEFORE(seq, *first) ){
+        *first = seq;
+        return SEQREORDERED;
+    }
+    return SEQREPEATED;
+}
 
 /**
  * @brief print the flux summary to show result
@@ -22,21 +243,75 @@
  * @param packet 
  */
 void printPacketSummary(fromtopacket* packet){
-        struct in_addr addr;
+        char summary[PACKETSUMMARYSIZE];
+        packetSummary(packet, summary, sizeof(summary));
+        puts(summary);
+}
 
-        addr.s_addr = packet->from; 
-        char* ip = inet_ntoa(addr);
-        char ipFrom[strlen(IPV4MASK)+1];
-        strncpy(ipFrom, ip, sizeof(ipFrom));
+/**
+ * @brief write the flux summary "Flux ip:port,ip:port / Taille : size" in a buffer
+ * 
+ * @param packet the flux
+ * @param buffer the buffer, PACKETSUMMARYSIZE bytes are enough
+ * @param size the size of the buffer
+ * @return int the length of the summary
+ */
+int packetSummary(const fromtopacket* packet, char* buffer, size_t size){
+        char ipFrom[INET_ADDRSTRLEN], ipTo[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &packet->from, ipFrom, sizeof(ipFrom));
+        inet_ntop(AF_INET, &packet->to, ipTo, sizeof(ipTo));
+        return snprintf(buffer, size, "Flux %s:%u,%s:%u / Taille : %u", ipFrom, packet->portFrom, ipTo, packet->portTo, packetSize(packet));
+}
 
-        addr.s_addr   = packet->to;
-        ip   = inet_ntoa(addr);
-        char ipTo[strlen(IPV4MASK)+1];
-        strncpy(ipTo, ip, sizeof(ipTo));
+static void formatIPv6(const UInt32* addr, char* str){
+    UInt32 net[4];
+    for (int i=0; i<4; i++) net[i] = htonl(addr[i]);
+    inet_ntop(AF_INET6, net, str, INET6_ADDRSTRLEN);
+}
 
-        int size = packet->lastPacket ? packet->lastPacket - packet->firstPacket : 0;
+/**
+ * @brief write the summary of an IPv6 flux "Flux [ip]:port,[ip]:port / Taille : size" in a buffer
+ * 
+ * @param packet the flux
+ * @param buffer the buffer, PACKET6SUMMARYSIZE bytes are enough
+ * @param size the size of the buffer
+ * @return int the length of the summary
+ */
+int packetSummary6(const fromtopacket6* packet, char* buffer, size_t size){
+        char ipFrom[INET6_ADDRSTRLEN], ipTo[INET6_ADDRSTRLEN];
+        formatIPv6(packet->from, ipFrom);
+        formatIPv6(packet->to, ipTo);
+        return snprintf(buffer, size, "Flux [%s]:%u,[%s]:%u / Taille : %u", ipFrom, packet->portFrom, ipTo, packet->portTo, packetSize6(packet));
+}
 
-        printf("Flux %s:%u,%s:%u / Taille : %u\n" , ipFrom, packet->portFrom, ipTo, packet->portTo, size);
+/**
+ * @brief the line of the log of a packet: "ip:port,ip:port,seq"
+ * 
+ * @param packet the packet, the sequence number in firstPacket
+ * @param buffer the line, without end of line
+ * @param size the size of the buffer, PACKETLINESIZE
+ * @return int the length of the line
+ */
+int packetLine(const fromtopacket* packet, char* buffer, size_t size){
+    char ipFrom[INET_ADDRSTRLEN], ipTo[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &packet->from, ipFrom, sizeof(ipFrom));
+    inet_ntop(AF_INET, &packet->to, ipTo, sizeof(ipTo));
+    return snprintf(buffer, size, "%s:%u,%s:%u,%u", ipFrom, packet->portFrom, ipTo, packet->portTo, packet->firstPacket);
+}
+
+/**
+ * @brief the line of the log of an IPv6 packet: "[ip]:port,[ip]:port,seq"
+ * 
+ * @param packet the packet, the sequence number in firstPacket
+ * @param buffer the line, without end of line
+ * @param size the size of the buffer, PACKETLINESIZE
+ * @return int the length of the line
+ */
+int packetLine6(const fromtopacket6* packet, char* buffer, size_t size){
+    char ipFrom[INET6_ADDRSTRLEN], ipTo[INET6_ADDRSTRLEN];
+    formatIPv6(packet->from, ipFrom);
+    formatIPv6(packet->to, ipTo);
+    return snprintf(buffer, size, "[%s]:%u,[%s]:%u,%u", ipFrom, packet->portFrom, ipTo, packet->portTo, packet->firstPacket);
 }
 
 /**
@@ -79,27 +354,84 @@ void printPacketStr(fromtopacket* packet){
 }
 
 
-// IPv4 4 bytes + 2 bytes then 8 + 4 characters
-#define FLUXHEXASIZE 2*(8+4)
 /**
- * @brief generate an hexadecimal string of the packet structure
+ * @brief the binary key of a flux, in the order of the report: the source address, the destination
+ * address in host order then the source port and the destination port
  * 
  * @param packet 
- * @return char* the hexadecimal string
+ * @param key the key, FLUXKEYWORDS words
  */
-char * fluxString(fromtopacket* packet){
+void fluxKey(const fromtopacket* packet, UInt32* key){
+    key[0] = ntohl(packet->from);
+    key[1] = ntohl(packet->to);
+    key[2] = (UInt32)packet->portFrom << 16 | packet->portTo;
+}
 
-    char str[FLUXHEXASIZE+1];
-    memset(str,0,FLUXHEXASIZE+1);
+/**
+ * @brief the binary key of an IPv6 flux: the source address, the destination address then the ports
+ * 
+ * @param packet 
+ * @param key the key, FLUX6KEYWORDS words
+ */
+void fluxKey6(const fromtopacket6* packet, UInt32* key){
+    memcpy(key, packet->from, 4 * sizeof(UInt32));
+    memcpy(key + 4, packet->to, 4 * sizeof(UInt32));
+    key[8] = (UInt32)packet->portFrom << 16 | packet->portTo;
+}
 
-    snprintf(str, FLUXHEXASIZE+1, "%X%X%X%X", packet->from, packet->to, packet->portFrom, packet->portTo);
+/**
+ * @brief exchange the source and the destination of a packet
+ * 
+ * @param packet 
+ */
+void reversePacket(fromtopacket* packet){
+    UInt32 address = packet->from;
+    packet->from = packet->to;
+    packet->to = address;
+    UInt16 port = packet->portFrom;
+    packet->portFrom = packet->portTo;
+    packet->portTo = port;
+}
+
+/**
+ * @brief put the lower endpoint (address in host order, then port) first: the 2 directions
+ * of a conversation have the same key
+ * 
+ * @param packet 
+ * @return int 1 if the endpoints are exchanged, the packet goes back to the lower endpoint
+ */
+int canonicalPacket(fromtopacket* packet){
+    UInt32 from = ntohl(packet->from), to = ntohl(packet->to);
+    if ( from < to || (from == to && packet->portFrom <= packet->portTo) ) return 0;
+    reversePacket(packet);
+    return 1;
+}
 
-    return strdup(str);
+/**
+ * @brief the hash of a flux key: it only depends on the values of the key, the same on every host
+ * 
+ * @param key the key
+ * @param words the words of the key, FLUXKEYWORDS or FLUX6KEYWORDS
+ * @return UInt64 the hash
+ */
+UInt64 fluxHash(const UInt32* key, int words){
+    // a multiply and a shift per word, the finalizer of murmur3 at the end
+    UInt64 h = 0x9E3779B97F4A7C15ull ^ (UInt64)words;
+    for (int i=0; i<words; i++){
+        h = (h ^ key[i]) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
 }
 
 
 #ifdef __UNITTEST_PACKET__
 
+#include <time.h>
+
 fromtopacket * initPacket(UInt32 from, UInt32 to, UInt16 portFrom, UInt16 portTo){
 
     fromtopacket* packet = malloc(sizeof(fromtopacket));
@@ -116,22 +448,148 @@ fromtopacket * initPacket(UInt32 from, UInt32 to, UInt16 portFrom, UInt16 portTo
 
  int main(){
 
-    fromtopacket* packet = initPacket(0x12AB34CD, 0x56EF7890, 0xDCBA, 0x4321);
-    char * fluxstr =  "12AB34CD56EF7890DCBA4321";
-
-    char* flux = fluxString(packet);
+    fromtopacket* packet = initPacket(htonl(0x12AB34CD), htonl(0x56EF7890), 0xDCBA, 0x4321);
+    UInt32 key[FLUXKEYWORDS];
+    fluxKey(packet, key);
     free(packet);
+    if ( key[0] != 0x12AB34CD || key[1] != 0x56EF7890 || key[2] != 0xDCBA4321 ){
+        printf("Error fluxKey!\n");
+    }
 
-    printf("orig: %s\n",fluxstr);
-    printf("calc: %s\n",flux);
+    // the IPv6 addresses, compared with inet_pton
+    const char* valid[] = { "::", "::1", "1::", "2001:db8::8a2e:370:7334", "2001:DB8:0:0:1:0:0:1",
+                            "fe80::1:2:3:4:5:6", "::ffff:10.0.0.1", "1:2:3:4:5:6:7:8", "64:ff9b::192.0.2.33" };
+    for (size_t i=0; i<sizeof(valid)/sizeof(valid[0]); i++){
+        UInt32 addr[4], net[4];
+        const char* end = parseIPv6(valid[i], addr);
+        inet_pton(AF_INET6, valid[i], net);
+        for (int w=0; w<4; w++) net[w] = ntohl(net[w]);
+        if ( end == NULL || *end != '\0' || memcmp(addr, net, sizeof(addr)) != 0 ){
+            printf("Error %s\n", valid[i]);
+        }
+    }
+    const char* invalid[] = { ":", ":1", "1:", "1::2::3", "12345::", "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7", "::1.2.3", "::256.0.0.1", "g::" };
+    for (size_t i=0; i<sizeof(invalid)/sizeof(invalid[0]); i++){
+        UInt32 addr[4];
+        const char* end = parseIPv6(invalid[i], addr);
+        if ( end && *end == '\0' ){
+            printf("Error %s accepted\n", invalid[i]);
+        }
+    }
 
-    if ( strcmp(fluxstr,flux) != 0 ){
+    fromtopacket6 packet6;
+    char summary[PACKET6SUMMARYSIZE];
+    if ( !decodePacket6("[2001:db8::1]:443,[2001:db8::2]:51000,1000\n", &packet6) || packet6.firstPacket != 1000 ){
+        printf("Error decodePacket6\n");
+    }
+    packet6.lastPacket = 1010;
+    packetSummary6(&packet6, summary, sizeof(summary));
+    printf("calc: %s\n", summary);
+    if ( strcmp(summary, "Flux [2001:db8::1]:443,[2001:db8::2]:51000 / Taille : 10") != 0 ){
         printf("Error not equal!\n");
-    } else {
-        printf("String are equal\n")
+    }
+    if ( decodePacket6("[2001:db8::1]:443,10.0.0.1:80,1000", &packet6) || decodePacket6("[2001:db8::1]:70000,[::1]:80,1", &packet6) ){
+        printf("Error decodePacket6 accepted\n");
+    }
+    char line6[PACKETLINESIZE];
+    decodePacket6("[2001:db8::1]:443,[2001:db8::2]:51000,1000", &packet6);
+    packetLine6(&packet6, line6, sizeof(line6));
+    if ( strcmp(line6, "[2001:db8::1]:443,[2001:db8::2]:51000,1000") != 0 ){
+        printf("Error packetLine6 %s\n", line6);
     }
 
-    free(flux);
+    // the range of a flux across the wraparound of the sequence numbers
+    tcp_seq first = 0xFFFFFF00, last = 0xFFFFFF00;
+    if ( seqExtend(&first, &last, 0x10) != SEQINORDER || last != 0x10 || packetSize(&(fromtopacket){ .firstPacket = first, .lastPacket = last }) != 0x110
+         || seqExtend(&first, &last, 0xFFFFFFF0) != SEQREPEATED || seqExtend(&first, &last, 0xFFFFFE00) != SEQREORDERED
+         || first != 0xFFFFFE00 || last != 0x10 ){
+        printf("Error seqExtend\n");
+    }
+    first = 1000;
+    last = 1000;
+    if ( seqExtend(&first, &last, 1000) != SEQREPEATED || seqExtend(&first, &last, 900) != SEQREORDERED || first != 900 || last != 1000 ){
+        printf("Error seqExtend single packet\n");
+    }
+    // 0 is a sequence number as another after the wraparound, not a single packet
+    const tcp_seq wrapped[][4] = { { 4294967290u, 0 }, { 4294967290u, 4294967295u, 0, 4294967292u } };
+    const int nbWrapped[] = { 2, 4 };
+    for (int w=0; w<2; w++){
+        fromtopacket flux = { .firstPacket = wrapped[w][0], .lastPacket = wrapped[w][0] };
+        for (int i=1; i<nbWrapped[w]; i++) seqExtend(&flux.firstPacket, &flux.lastPacket, wrapped[w][i]);
+        if ( flux.firstPacket != 4294967290u || flux.lastPacket != 0 || packetSize(&flux) != 6 ){
+            printf("Error seqExtend wraparound to 0: %u\n", packetSize(&flux));
+        }
+    }
+
+    // a sampling of 1 in 8 keeps about 1/8 of the flux, and only flux kept with 1 in 4
+    int kept8 = 0, notNested = 0;
+    for (UInt32 i=0; i<100000; i++){
+        UInt32 key[FLUXKEYWORDS] = { 0x0A000000 + i, 0xC0A80001, (UInt32)(1024 + i % 7) << 16 | 80 };
+        UInt64 h = fluxHash(key, FLUXKEYWORDS);
+        kept8 += h <= SAMPLELIMIT(8);
+        notNested += h <= SAMPLELIMIT(8) && h > SAMPLELIMIT(4);
+    }
+    printf("sampling 1/8: %d flux of 100000\n", kept8);
+    if ( kept8 < 12000 || kept8 > 13000 || notNested ){
+        printf("Error fluxHash\n");
+    }
+    // the hash is part of the sampling: the same flux are kept on every host and by every version
+    UInt32 hashed[FLUXKEYWORDS] = { 0x0A000001, 0x0A000002, 1000 << 16 | 80 };
+    if ( fluxHash(hashed, FLUXKEYWORDS) != 0x3FCBFA1E54A5F717ull ){
+        printf("Error fluxHash %016llX\n", (unsigned long long)fluxHash(hashed, FLUXKEYWORDS));
+    }
+
+    // the 2 directions of a conversation have the same key
+    fromtopacket forward, back;
+    strcpy(line6, "10.0.0.2:80,10.0.0.1:1000,1");
+    decodePacket(line6, &back);
+    strcpy(line6, "10.0.0.1:1000,10.0.0.2:80,1");
+    decodePacket(line6, &forward);
+    if ( canonicalPacket(&forward) || !canonicalPacket(&back) || back.from != forward.from || back.portTo != 80 ){
+        printf("Error canonicalPacket\n");
+    }
+    strcpy(line6, "10.0.0.1:443,10.0.0.1:80,1");
+    decodePacket(line6, &back);
+    if ( !canonicalPacket(&back) || back.portFrom != 80 || canonicalPacket(&back) ){
+        printf("Error canonicalPacket same address\n");
+    }
+
+    // the decoding time of the 2 families
+    char line[128];
+    fromtopacket p4;
+    clock_t t0 = clock();
+    for (int i=0; i<1000000; i++){
+        strcpy(line, "81.26.188.26:4401,66.20.226.152:45791,91");
+        decodePacket(line, &p4);
+    }
+    clock_t t1 = clock();
+    for (int i=0; i<1000000; i++){
+        strcpy(line, "[2001:db8:85a3::8a2e:370:7334]:4401,[2001:db8::ff00:42:8329]:45791,91");
+        decodePacket6(line, &packet6);
+    }
+    clock_t t2 = clock();
+    printf("decode IPv4 %.0f ns, IPv6 %.0f ns\n", (t1 - t0) * 1e9 / CLOCKS_PER_SEC / 1000000, (t2 - t1) * 1e9 / CLOCKS_PER_SEC / 1000000);
+
+    // an IPv4 line before the IPv6 support: the IPv4 decoder only, after: the family is chosen
+    // on the first character as processLine does
+    double before = 0, after = 0;
+    for (int round=0; round<3; round++){
+        t0 = clock();
+        for (int i=0; i<1000000; i++){
+            strcpy(line, "81.26.188.26:4401,66.20.226.152:45791,91");
+            decodePacket(line, &p4);
+        }
+        t1 = clock();
+        for (int i=0; i<1000000; i++){
+            strcpy(line, "81.26.188.26:4401,66.20.226.152:45791,91");
+            if ( *line == '[' ) decodePacket6(line, &packet6);
+            else decodePacket(line, &p4);
+        }
+        t2 = clock();
+        before += (t1 - t0) * 1e9 / CLOCKS_PER_SEC / 3000000;
+        after += (t2 - t1) * 1e9 / CLOCKS_PER_SEC / 3000000;
+    }
+    printf("decode IPv4 before %.0f ns, after %.0f ns (%+.1f%%)\n", before, after, (after - before) * 100 / before);
  }
  #endif
  
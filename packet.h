@@ -11,6 +11,8 @@
 #ifndef __SG__CHIMERE_PACKET_H__
 #define __SG__CHIMERE_PACKET_H__
 
+#include <stddef.h>
+
 #include "SG_Types.h"
 
 #define IPV4MASK "XXX.XXX.XXX.XXX"
@@ -25,17 +27,112 @@
 //   min seq_tcp = 0
 #define SIZEFROMTOMASKMIN strlen(FROMTOMASKMIN)+1
 
+// IPv4 4 bytes + 2 bytes then 8 + 4 characters
+#define FLUXHEXASIZE 2*(8+4)
+// the words of the binary key of a flux
+#define FLUXKEYWORDS 3
+
+// "Flux " FROMTOMASK "/ Taille : " INT32MASK
+#define PACKETSUMMARYSIZE 80
+// "Flux [ip]:port,[ip]:port / Taille : " INT32MASK, an IPv6 address is 45 characters at most
+#define PACKET6SUMMARYSIZE 144
+// the words of the binary key of an IPv6 flux: 2 addresses of 128 bits and the ports
+#define FLUX6KEYWORDS 9
+
 typedef UInt32 tcp_seq;
 
+// the serial number arithmetic of the TCP sequence numbers (RFC 1982): a is before b when b is
+// less than 2^31 ahead, so a flux goes on across the wraparound at 2^32
+#define SEQBEFORE(a, b) ((SInt32)((tcp_seq)(a) - (tcp_seq)(b)) < 0)
+#define SEQAFTER(a, b) SEQBEFORE(b, a)
+
+// the place of a sequence number in the range of its flux (seqExtend)
+#define SEQINORDER 0    // after the last packet: the range grows
+#define SEQREORDERED 1  // before the first packet: the range grows backwards
+#define SEQREPEATED 2   // inside the range: a retransmission or a packet late
+
+// a flux is kept by a sampling of 1 in n when the hash of its key is at most SAMPLELIMIT(n):
+// the flux kept with 1/2n are kept with 1/n too
+#define SAMPLELIMIT(n) ((n) > 1 ? (UInt64)-1 / (n) : (UInt64)-1)
+
+// "[ip]:port,[ip]:port," INT32MASK, a line of the log
+#define PACKETLINESIZE 112
+
 typedef struct {
   UInt32 from;
   UInt32 to;
   UInt16 portFrom;
   UInt16 portTo;
   tcp_seq firstPacket;
-  tcp_seq lastPacket; 
+  tcp_seq lastPacket; // equal to firstPacket for a single packet, unused for a packet read from the log
+  UInt32 lastUpdate; // the line of the last update - used to expire the idle flux
 } fromtopacket;
 
+/**
+ * @brief an IPv6 flux: the addresses are 4 words in host order, the most significant first
+ */
+typedef struct {
+  UInt32 from[4];
+  UInt32 to[4];
+  UInt16 portFrom;
+  UInt16 portTo;
+  tcp_seq firstPacket;
+  tcp_seq lastPacket;
+  UInt32 lastUpdate;
+} fromtopacket6;
+
+/**
+ * @brief the function called for each packet read by a reader (capture, columnar file)
+ * 
+ * @param packet the packet, the sequence number in firstPacket
+ * @param ctx the context given to the reader
+ * @return int 0 to continue the reading
+ */
+typedef int (*packetFn)(const fromtopacket* packet, void* ctx);
+
+/**
+ * @brief decode a line of the input stream "ip:port,ip:port,seq" - the buffer is modified
+ * 
+ * @param buffer the string to decode
+ * @param packet the data
+ * @return int 1 if the line is decoded, 0 otherwise
+ */
+int decodePacket(char *buffer, fromtopacket* packet);
+
+/**
+ * @brief parse an IPv6 address "2001:db8::1", "::ffff:10.0.0.1" - without inet_pton
+ * 
+ * @param str the address
+ * @param addr the address, 4 words in host order
+ * @return const char* the first character after the address, NULL if it is not an address
+ */
+const char* parseIPv6(const char* str, UInt32* addr);
+
+/**
+ * @brief decode a line of the input stream "[ip]:port,[ip]:port,seq" with IPv6 addresses
+ * 
+ * @param buffer the string to decode
+ * @param packet the data
+ * @return int 1 if the line is decoded, 0 otherwise
+ */
+int decodePacket6(const char *buffer, fromtopacket6* packet);
+
+/**
+ * @brief the size of the flux: the number of sequence numbers between the first and the last packet
+ * 
+ * @param packet 
+ * @return UInt32 the size, 0 for a single packet
+ */
+UInt32 packetSize(const fromtopacket* packet);
+
+/**
+ * @brief the size of an IPv6 flux, as packetSize
+ * 
+ * @param packet 
+ * @return UInt32 the size, 0 for a single packet
+ */
+UInt32 packetSize6(const fromtopacket6* packet);
+
 /**
  * @brief print the flux summary to show result
  * 
@@ -43,6 +140,26 @@ typedef struct {
  */
 void printPacketSummary(fromtopacket* packet);
 
+/**
+ * @brief write the flux summary "Flux ip:port,ip:port / Taille : size" in a buffer
+ * 
+ * @param packet the flux
+ * @param buffer the buffer, PACKETSUMMARYSIZE bytes are enough
+ * @param size the size of the buffer
+ * @return int the length of the summary
+ */
+int packetSummary(const fromtopacket* packet, char* buffer, size_t size);
+
+/**
+ * @brief write the summary of an IPv6 flux "Flux [ip]:port,[ip]:port / Taille : size" in a buffer
+ * 
+ * @param packet the flux
+ * @param buffer the buffer, PACKET6SUMMARYSIZE bytes are enough
+ * @param size the size of the buffer
+ * @return int the length of the summary
+ */
+int packetSummary6(const fromtopacket6* packet, char* buffer, size_t size);
+
 /**
  * @brief print a packet structure
  * 
@@ -58,12 +175,77 @@ void printPacketStr(fromtopacket* packet);
 char * PacketStr(fromtopacket* packet);
 
 /**
- * @brief generate an hexadecimal string of the packet structure
+ * @brief add a sequence number to the range of a flux, in serial number arithmetic: the range only
+ * grows, a packet out of order does not stop the reading
+ * 
+ * @param first the first sequence number of the flux
+ * @param last the last sequence number of the flux, first for a single packet: 0 is a sequence number as another
+ * @param seq the sequence number of the packet
+ * @return int SEQINORDER, SEQREORDERED or SEQREPEATED
+ */
+int seqExtend(tcp_seq* first, tcp_seq* last, tcp_seq seq);
+
+/**
+ * @brief the line of the log of a packet: "ip:port,ip:port,seq"
+ * 
+ * @param packet the packet, the sequence number in firstPacket
+ * @param buffer the line, without end of line
+ * @param size the size of the buffer, PACKETLINESIZE
+ * @return int the length of the line
+ */
+int packetLine(const fromtopacket* packet, char* buffer, size_t size);
+
+/**
+ * @brief the line of the log of an IPv6 packet: "[ip]:port,[ip]:port,seq"
+ * 
+ * @param packet the packet, the sequence number in firstPacket
+ * @param buffer the line, without end of line
+ * @param size the size of the buffer, PACKETLINESIZE
+ * @return int the length of the line
+ */
+int packetLine6(const fromtopacket6* packet, char* buffer, size_t size);
+
+/**
+ * @brief the binary key of a flux, in the order of the report: the source address, the destination
+ * address in host order then the source port and the destination port
  * 
  * @param packet 
- * @return char* the hexadecimal string
+ * @param key the key, FLUXKEYWORDS words
+ */
+void fluxKey(const fromtopacket* packet, UInt32* key);
+
+/**
+ * @brief the binary key of an IPv6 flux: the source address, the destination address then the ports
+ * 
+ * @param packet 
+ * @param key the key, FLUX6KEYWORDS words
+ */
+void fluxKey6(const fromtopacket6* packet, UInt32* key);
+
+/**
+ * @brief exchange the source and the destination of a packet
+ * 
+ * @param packet 
+ */
+void reversePacket(fromtopacket* packet);
+
+/**
+ * @brief put the lower endpoint (address in host order, then port) first: the 2 directions
+ * of a conversation have the same key
+ * 
+ * @param packet 
+ * @return int 1 if the endpoints are exchanged, the packet goes back to the lower endpoint
+ */
+int canonicalPacket(fromtopacket* packet);
+
+/**
+ * @brief the hash of a flux key: it only depends on the values of the key, the same on every host
+ * 
+ * @param key the key
+ * @param words the words of the key, FLUXKEYWORDS or FLUX6KEYWORDS
+ * @return UInt64 the hash
  */
-char * fluxString(fromtopacket* packet);
+UInt64 fluxHash(const UInt32* key, int words);
 
 #endif
 ;
@@ -0,0 +1,358 @@
+/**
+ * @file pcap.c
+ * @author Sebastien Galvagno
+ * @brief pcap and pcapng capture reader
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * A reader without libpcap: the file is mapped in memory and the IPv4/TCP headers are read in place.
+ * Link layers: Ethernet (with VLAN tags), raw IPv4, BSD loopback, Linux cooked (SLL and SLL2).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __UNITTEST_PCAP__
+#include <assert.h>
+#include <arpa/inet.h>
+#endif
+
+#include "pcap.h"
+
+#define PCAPMAGIC       0xA1B2C3D4  // timestamps in microseconds
+#define PCAPMAGICNANO   0xA1B23C4D  // timestamps in nanoseconds
+#define PCAPNGSHB       0x0A0D0D0A  // section header block
+#define PCAPNGBYTEORDER 0x1A2B3C4D
+#define PCAPNGIDB       1           // interface description block
+#define PCAPNGPB        2           // obsolete packet block
+#define PCAPNGSPB       3           // simple packet block
+#define PCAPNGEPB       6           // enhanced packet block
+
+#define LINKNULL        0
+#define LINKETHERNET    1
+#define LINKRAW         101
+#define LINKSLL         113
+#define LINKIPV4        228
+#define LINKSLL2        276
+
+#define ETHERIPV4       0x0800
+#define ETHERVLAN       0x8100
+#define ETHERQINQ       0x88A8
+#define IPPROTOTCP      6
+
+// the maximum number of interfaces of a pcapng section
+#define MAXINTERFACES   64
+
+static UInt16 be16(const UInt8* p){ return (UInt16)(p[0] << 8 | p[1]); }
+static UInt32 be32(const UInt8* p){ return (UInt32)p[0] << 24 | (UInt32)p[1] << 16 | (UInt32)p[2] << 8 | p[3]; }
+static UInt16 le16(const UInt8* p){ return (UInt16)(p[1] << 8 | p[0]); }
+static UInt32 le32(const UInt8* p){ return (UInt32)p[3] << 24 | (UInt32)p[2] << 16 | (UInt32)p[1] << 8 | p[0]; }
+
+// the integers of the file headers are written in the byte order of the writer
+static UInt32 rd32(const UInt8* p, int swapped){ return swapped ? be32(p) : le32(p); }
+static UInt16 rd16(const UInt8* p, int swapped){ return swapped ? be16(p) : le16(p); }
+
+/**
+ * @brief decode the IPv4 and TCP headers
+ * 
+ * @param ip the IPv4 header
+ * @param size the captured size from the IPv4 header
+ * @param packet the packet
+ * @return int 1 for a TCP segment, 0 otherwise
+ */
+static int decodeIPv4(const UInt8* ip, size_t size, fromtopacket* packet){
+    if ( size < 20 || (ip[0] >> 4) != 4 ) return 0;
+    size_t ihl = (size_t)(ip[0] & 0x0F) * 4;
+    if ( ihl < 20 || size < ihl + 8 ) return 0;
+    if ( ip[9] != IPPROTOTCP ) return 0;
+    if ( be16(ip + 6) & 0x1FFF ) return 0; // a fragment without the TCP header
+
+    const UInt8* tcp = ip + ihl;
+    memset(packet, 0, sizeof(fromtopacket));
+    memcpy(&packet->from, ip + 12, 4);
+    memcpy(&packet->to, ip + 16, 4);
+    packet->portFrom = be16(tcp);
+    packet->portTo = be16(tcp + 2);
+    packet->firstPacket = be32(tcp + 4);
+    return 1;
+}
+
+/**
+ * @brief decode a frame of a link layer
+ * 
+ * @param link the link type
+ * @param frame the frame
+ * @param size the captured size
+ * @param packet the packet
+ * @return int 1 for an IPv4/TCP packet, 0 otherwise
+ */
+static int decodeFrame(UInt32 link, const UInt8* frame, size_t size, fromtopacket* packet){
+    switch ( link ){
+        case LINKETHERNET: {
+            size_t offset = 12;
+            if ( size < 14 ) return 0;
+            UInt16 type = be16(frame + offset);
+            while ( (type == ETHERVLAN || type == ETHERQINQ) && size >= offset + 6 ){
+                offset += 4;
+                type = be16(frame + offset);
+            }
+            if ( type != ETHERIPV4 ) return 0;
+            return decodeIPv4(frame + offset + 2, size - offset - 2, packet);
+        }
+        case LINKRAW:
+        case LINKIPV4:
+            return decodeIPv4(frame, size, packet);
+        case LINKNULL:
+            // the address family in the byte order of the capturing host
+            if ( size < 4 || (le32(frame) != 2 && be32(frame) != 2) ) return 0;
+            return decodeIPv4(frame + 4, size - 4, packet);
+        case LINKSLL:
+            if ( size < 16 || be16(frame + 14) != ETHERIPV4 ) return 0;
+            return decodeIPv4(frame + 16, size - 16, packet);
+        case LINKSLL2:
+            if ( size < 20 || be16(frame) != ETHERIPV4 ) return 0;
+            return decodeIPv4(frame + 20, size - 20, packet);
+    }
+    return 0;
+}
+
+/**
+ * @brief read a classic pcap capture
+ */
+static int readPcap(const UInt8* data, size_t size, packetFn fn, void* ctx){
+    if ( size < 24 ) return -1;
+    UInt32 magic = le32(data);
+    int swapped = magic != PCAPMAGIC && magic != PCAPMAGICNANO;
+    UInt32 link = rd32(data + 20, swapped) & 0x0FFFFFFF; // the upper bits are the FCS flags
+
+    size_t offset = 24;
+    while ( offset + 16 <= size ){
+        UInt32 captured = rd32(data + offset + 8, swapped);
+        offset += 16;
+        if ( captured > size - offset ) return -1;
+
+        fromtopacket packet;
+        if ( decodeFrame(link, data + offset, captured, &packet) ){
+            int r = fn(&packet, ctx);
+            if ( r ) return r;
+        }
+        offset += captured;
+    }
+    return 0;
+}
+
+/**
+ * @brief read a pcapng capture: the sections, their interfaces and their packet blocks
+ */
+static int readPcapng(const UInt8* data, size_t size, packetFn fn, void* ctx){
+    UInt32 links[MAXINTERFACES];
+    int nbInterfaces = 0;
+    int swapped = 0;
+
+    size_t offset = 0;
+    while ( offset + 12 <= size ){
+        const UInt8* block = data + offset;
+        UInt32 type = le32(block);
+
+        if ( type == PCAPNGSHB ){
+            // the byte order magic gives the byte order of the section
+            if ( offset + 12 > size ) return -1;
+            swapped = le32(block + 8) != PCAPNGBYTEORDER;
+            if ( swapped && be32(block + 8) != PCAPNGBYTEORDER ) return -1;
+            nbInterfaces = 0;
+        } else {
+            type = rd32(block, swapped);
+        }
+
+        UInt32 length = rd32(block + 4, swapped);
+        if ( length < 12 || (length & 3) || length > size - offset ) return -1;
+
+        fromtopacket packet;
+        int found = 0;
+        switch ( type ){
+            case PCAPNGIDB:
+                if ( length >= 20 && nbInterfaces < MAXINTERFACES ){
+                    links[nbInterfaces++] = rd16(block + 8, swapped);
+                }
+                break;
+            case PCAPNGEPB: {
+                if ( length < 32 ) return -1;
+                UInt32 interface = rd32(block + 8, swapped);
+                UInt32 captured = rd32(block + 20, swapped);
+                if ( captured > length - 32 ) return -1;
+                if ( interface < (UInt32)nbInterfaces ){
+                    found = decodeFrame(links[interface], block + 28, captured, &packet);
+                }
+                break;
+            }
+            case PCAPNGPB: {
+                if ( length < 32 ) return -1;
+                UInt32 interface = rd16(block + 8, swapped);
+                UInt32 captured = rd32(block + 20, swapped);
+                if ( captured > length - 32 ) return -1;
+                if ( interface < (UInt32)nbInterfaces ){
+                    found = decodeFrame(links[interface], block + 28, captured, &packet);
+                }
+                break;
+            }
+            case PCAPNGSPB: {
+                if ( length < 16 ) return -1;
+                // the captured size is the smallest of the original size and of the block
+                UInt32 captured = rd32(block + 8, swapped);
+                if ( captured > length - 16 ) captured = length - 16;
+                if ( nbInterfaces > 0 ){
+                    found = decodeFrame(links[0], block + 12, captured, &packet);
+                }
+                break;
+            }
+        }
+        if ( found ){
+            int r = fn(&packet, ctx);
+            if ( r ) return r;
+        }
+        offset += length;
+    }
+    return 0;
+}
+
+/**
+ * @brief test whether a buffer begins with the magic number of a pcap or pcapng capture
+ * 
+ * @param data the first bytes of the file
+ * @param size the size of the buffer
+ * @return int 1 for a capture, 0 otherwise
+ */
+int isCapture(const UInt8* data, size_t size){
+    if ( size < 4 ) return 0;
+    UInt32 magic = le32(data);
+    return magic == PCAPMAGIC || magic == PCAPMAGICNANO
+        || be32(data) == PCAPMAGIC || be32(data) == PCAPMAGICNANO
+        || magic == PCAPNGSHB;
+}
+
+/**
+ * @brief test whether a file is a pcap or pcapng capture
+ * 
+ * @param path the file
+ * @return int 1 for a capture, 0 otherwise
+ */
+int isCaptureFile(const char* path){
+    UInt8 magic[4];
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return 0;
+    ssize_t size = read(fd, magic, sizeof(magic));
+    close(fd);
+    return size == sizeof(magic) && isCapture(magic, sizeof(magic));
+}
+
+/**
+ * @brief read the IPv4/TCP packets of a capture in memory
+ * 
+ * @param data the capture
+ * @param size the size of the capture
+ * @param fn the function called for each packet
+ * @param ctx the context given to fn
+ * @return int 0 at the end of the capture, the non zero return of fn, -1 on a bad capture
+ */
+int readCaptureBuffer(const UInt8* data, size_t size, packetFn fn, void* ctx){
+    if ( !isCapture(data, size) ) return -1;
+    if ( le32(data) == PCAPNGSHB ) return readPcapng(data, size, fn, ctx);
+    return readPcap(data, size, fn, ctx);
+}
+
+/**
+ * @brief read the IPv4/TCP packets of a pcap or pcapng file - the file is mapped in memory
+ * 
+ * @param path the file
+ * @param fn the function called for each packet
+ * @param ctx the context given to fn
+ * @return int 0 at the end of the capture, the non zero return of fn, -1 on error
+ */
+int readCapture(const char* path, packetFn fn, void* ctx){
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return -1;
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 || st.st_size == 0 ){
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( data == MAP_FAILED ) return -1;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    int r = readCaptureBuffer((const UInt8*)data, st.st_size, fn, ctx);
+    munmap(data, st.st_size);
+    return r;
+}
+
+
+#ifdef __UNITTEST_PCAP__
+
+/*
+ * samples/sample.pcap and samples/sample.pcapng have the packets of samples/sample.txt,
+ * the pcapng one with a VLAN tag, a simple packet block, and the UDP and IPv6 packets to ignore.
+ */
+
+static int nbPackets;
+static fromtopacket packets[16];
+
+int store(const fromtopacket* packet, void* ctx){
+    (void)ctx;
+    if ( nbPackets < 16 ) packets[nbPackets] = *packet;
+    nbPackets++;
+    return 0;
+}
+
+void test_sample(const char* path){
+    printf("-----%s--------------\n", path);
+    nbPackets = 0;
+    assert(isCaptureFile(path));
+    assert(readCapture(path, &store, NULL) == 0);
+    assert(nbPackets == 5);
+
+    struct in_addr addr;
+    inet_aton("10.0.0.1", &addr);
+    assert(packets[0].from == addr.s_addr);
+    inet_aton("192.168.1.2", &addr);
+    assert(packets[0].to == addr.s_addr);
+    assert(packets[0].portFrom == 40000 && packets[0].portTo == 80);
+    assert(packets[0].firstPacket == 1000);
+    assert(packets[1].firstPacket == 1500);
+    assert(packets[4].portFrom == 443 && packets[4].firstPacket == 4000000000u);
+    for (int i=0; i<nbPackets; i++) printPacketStr(&packets[i]);
+}
+
+int stop(const fromtopacket* packet, void* ctx){
+    (void)packet;
+    (void)ctx;
+    return 2;
+}
+
+int main(){
+    test_sample("samples/sample.pcap");
+    test_sample("samples/sample.pcapng");
+
+    assert(readCapture("samples/sample.pcap", &stop, NULL) == 2);
+    assert(!isCaptureFile("samples/sample.txt"));
+
+    // a truncated capture
+    UInt8 truncated[24 + 16] = { 0xD4, 0xC3, 0xB2, 0xA1 };
+    truncated[20] = LINKETHERNET;
+    truncated[24 + 8] = 100;
+    assert(readCaptureBuffer(truncated, sizeof(truncated), &store, NULL) == -1);
+    return 0;
+}
+
+// gcc -o pcap pool.c packet.c pcap.c -g -D__UNITTEST_PCAP__ && ./pcap
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * @file pcap.h
+ * @author Sebastien Galvagno
+ * @brief pcap and pcapng capture reader
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_PCAP_H__
+#define __SG__CHIMERE_PCAP_H__
+
+#include <stddef.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+
+/**
+ * @brief test whether a buffer begins with the magic number of a pcap or pcapng capture
+ * 
+ * @param data the first bytes of the file
+ * @param size the size of the buffer
+ * @return int 1 for a capture, 0 otherwise
+ */
+int isCapture(const UInt8* data, size_t size);
+
+/**
+ * @brief test whether a file is a pcap or pcapng capture
+ * 
+ * @param path the file
+ * @return int 1 for a capture, 0 otherwise
+ */
+int isCaptureFile(const char* path);
+
+/**
+ * @brief read the IPv4/TCP packets of a capture in memory
+ * 
+ * @param data the capture
+ * @param size the size of the capture
+ * @param fn the function called for each packet
+ * @param ctx the context given to fn
+ * @return int 0 at the end of the capture, the non zero return of fn, -1 on a bad capture
+ */
+int readCaptureBuffer(const UInt8* data, size_t size, packetFn fn, void* ctx);
+
+/**
+ * @brief read the IPv4/TCP packets of a pcap or pcapng file - the file is mapped in memory
+ * 
+ * @param path the file
+ * @param fn the function called for each packet
+ * @param ctx the context given to fn
+ * @return int 0 at the end of the capture, the non zero return of fn, -1 on error
+ */
+int readCapture(const char* path, packetFn fn, void* ctx);
+
+#endif
@@ -0,0 +1,469 @@
+/**
+ * @file pool.c
+ * @author Sebastien Galvagno
+ * @brief Memory pool of the flux tables, reset without freeing
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The radix trees and the aggregates allocate through poolAlloc: without a pool it is malloc,
+ * with a pool the blocks are cut in large chunks. The pool of a thread is chosen by poolUse,
+ * the library sets the pool of its context around each call.
+ *
+ * Each block has a tag, the subsystem it is counted in: the header of a block holds its size class, its tag
+ * and its size, so a free knows what to count. A pool keeps the bytes of each tag of its blocks, a reset
+ * forgets them all at once. The counters of memAccounting are shared by the threads: they are atomic,
+ * only updated once the accounting is on.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __UNITTEST_POOL__
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#include "pool.h"
+
+// the header of a block: its size class, its tag and its size, a block is aligned on 8 bytes
+#define POOLHEADER 8
+#define POOLBIG POOLCLASSES
+#define POOLHEAD(class, tag, size) ((UInt64)(class) | (UInt64)(tag) << 8 | (UInt64)(size) << 16)
+#define HEADCLASS(h) ((h) & 0xFF)
+#define HEADTAG(h) ((h) >> 8 & 0xFF)
+#define HEADSIZE(h) ((h) >> 16)
+// the header of a block of memAlloc, its size and its tag: the alignment of malloc is kept
+#define MEMHEADER 16
+
+static __thread pool* current = NULL;
+
+static int accounting = 0;
+static memStats counters;
+static const char* memTagNames[MEMTAGS] = { "other", "radix", "flows", "sequences", "buffers" };
+
+static void raisePeak(UInt64* peak, UInt64 value){
+    UInt64 p = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while ( value > p && !__atomic_compare_exchange_n(peak, &p, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
+
+static void memCount(UInt64 tag, UInt64 bytes){
+    if ( !accounting ) return;
+    raisePeak(&counters.peak[tag], __atomic_add_fetch(&counters.current[tag], bytes, __ATOMIC_RELAXED));
+    raisePeak(&counters.totalPeak, __atomic_add_fetch(&counters.total, bytes, __ATOMIC_RELAXED));
+}
+
+static void memUncount(UInt64 tag, UInt64 bytes){
+    if ( !accounting ) return;
+    __atomic_sub_fetch(&counters.current[tag], bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&counters.total, bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief the blocks of a pool are forgotten: their bytes are not counted anymore
+ */
+static void forgetBlocks(pool* p){
+    for (int t=0; t<MEMTAGS; t++){
+        memUncount(t, p->tagged[t]);
+        p->tagged[t] = 0;
+    }
+}
+
+/**
+ * @brief create an empty pool
+ * 
+ * @return pool* NULL if out of memory
+ */
+pool* poolCreate(void){
+    return (pool*)calloc(1, sizeof(pool));
+}
+
+/**
+ * @brief forget all the blocks of the pool, the chunks are kept for the next allocations
+ * 
+ * @param p the pool
+ */
+void poolReset(pool* p){
+    while ( p->chunks ){
+        poolChunk* c = p->chunks;
+        p->chunks = c->next;
+        c->used = 0;
+        c->next = p->spare;
+        p->spare = c;
+    }
+    memset(p->freeBlocks, 0, sizeof(p->freeBlocks));
+    forgetBlocks(p);
+}
+
+static void freeChunks(poolChunk* c){
+    while ( c ){
+        poolChunk* next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+/**
+ * @brief free the pool and its chunks
+ * 
+ * @param p the pool
+ */
+void poolDestroy(pool* p){
+    if ( p == NULL ) return;
+    if ( current == p ) current = NULL;
+    forgetBlocks(p);
+    if ( accounting ) __atomic_sub_fetch(&counters.reserved, p->capacity, __ATOMIC_RELAXED);
+    freeChunks(p->chunks);
+    freeChunks(p->spare);
+    free(p);
+}
+
+/**
+ * @brief the pool of the allocations of this thread - NULL to use malloc
+ * 
+ * @param p the pool, or NULL
+ * @return pool* the previous pool of this thread
+ */
+pool* poolUse(pool* p){
+    pool* previous = current;
+    current = p;
+    return previous;
+}
+
+/**
+ * @brief cut a block in the current chunk, a spare or a new chunk is taken when it is full
+ */
+static char* cut(pool* p, size_t size){
+    poolChunk* c = p->chunks;
+    if ( c == NULL || c->size - c->used < size ){
+        c = p->spare;
+        if ( c && c->size >= size ){
+            p->spare = c->next;
+        } else {
+            size_t chunk = size > POOLCHUNK ? size : POOLCHUNK;
+            c = (poolChunk*)malloc(sizeof(poolChunk) + chunk);
+            if ( c == NULL ) return NULL;
+            c->size = chunk;
+            p->capacity += chunk;
+            if ( accounting ) __atomic_add_fetch(&counters.reserved, chunk, __ATOMIC_RELAXED);
+        }
+        c->used = 0;
+        c->next = p->chunks;
+        p->chunks = c;
+    }
+    char* block = (char*)(c + 1) + c->used;
+    c->used += size;
+    return block;
+}
+
+/**
+ * @brief allocate a block as poolAlloc, counted in the subsystem tag
+ * 
+ * @param size the size of the block
+ * @param tag the subsystem
+ * @return void* NULL if out of memory
+ */
+void* poolAllocTag(size_t size, memTag tag){
+    pool* p = current;
+    char* b;
+    if ( p == NULL ){
+        // malloc: the header is kept for the free
+        b = (char*)malloc(size + POOLHEADER);
+        if ( b == NULL ) return NULL;
+        *(UInt64*)b = POOLHEAD(POOLBIG, tag, size + POOLHEADER);
+        memCount(tag, size + POOLHEADER);
+        return b + POOLHEADER;
+    }
+
+    size_t block = (size + POOLHEADER + POOLGRAIN - 1) & ~(size_t)(POOLGRAIN - 1);
+    size_t class = block / POOLGRAIN - 1;
+    if ( class < POOLCLASSES && p->freeBlocks[class] ){
+        b = (char*)p->freeBlocks[class];
+        p->freeBlocks[class] = *(void**)(b + POOLHEADER);
+    } else {
+        b = cut(p, block);
+        if ( b == NULL ) return NULL;
+    }
+    // a big block is not reused before the reset of the pool
+    *(UInt64*)b = POOLHEAD(class < POOLCLASSES ? class : POOLBIG, tag, block);
+    p->tagged[tag] += block;
+    memCount(tag, block);
+    return b + POOLHEADER;
+}
+
+/**
+ * @brief allocate a block in the pool of this thread, with malloc when there is no pool.
+ * A block is freed with poolFree under the same pool.
+ * 
+ * @param size the size of the block
+ * @return void* NULL if out of memory
+ */
+void* poolAlloc(size_t size){
+    return poolAllocTag(size, MEMOTHER);
+}
+
+/**
+ * @brief free a block allocated by poolAlloc
+ * 
+ * @param ptr the block, or NULL
+ */
+void poolFree(void* ptr){
+    if ( ptr == NULL ) return;
+    pool* p = current;
+    char* b = (char*)ptr - POOLHEADER;
+    UInt64 h = *(UInt64*)b;
+    memUncount(HEADTAG(h), HEADSIZE(h));
+    if ( p == NULL ){
+        free(b);
+        return;
+    }
+
+    p->tagged[HEADTAG(h)] -= HEADSIZE(h);
+    UInt64 class = HEADCLASS(h);
+    if ( class >= POOLCLASSES ) return;
+    *(void**)ptr = p->freeBlocks[class];
+    p->freeBlocks[class] = b;
+}
+
+/**
+ * @brief count a block in another subsystem: a block kept by another subsystem
+ * 
+ * @param ptr the block of poolAlloc
+ * @param tag the subsystem
+ */
+void poolRetag(void* ptr, memTag tag){
+    UInt64* h = (UInt64*)((char*)ptr - POOLHEADER);
+    UInt64 size = HEADSIZE(*h), previous = HEADTAG(*h);
+    memUncount(previous, size);
+    memCount(tag, size);
+    if ( current ){
+        current->tagged[previous] -= size;
+        current->tagged[tag] += size;
+    }
+    *h = POOLHEAD(HEADCLASS(*h), tag, size);
+}
+
+/**
+ * @brief copy a string in a block of the pool of this thread
+ * 
+ * @param str the string
+ * @return char* NULL if out of memory
+ */
+char* poolStrdup(const char* str){
+    return poolStrdupTag(str, MEMOTHER);
+}
+
+/**
+ * @brief copy a string as poolStrdup, counted in the subsystem tag
+ * 
+ * @param str the string
+ * @param tag the subsystem
+ * @return char* NULL if out of memory
+ */
+char* poolStrdupTag(const char* str, memTag tag){
+    size_t len = strlen(str) + 1;
+    char* s = (char*)poolAllocTag(len, tag);
+    if ( s ) memcpy(s, str, len);
+    return s;
+}
+
+/**
+ * @brief count the bytes of each subsystem from now on: called before the first allocation, the counters
+ * are shared by the threads. Without it the blocks only keep their tag.
+ */
+void memAccounting(void){
+    accounting = 1;
+}
+
+/**
+ * @brief allocate a block with malloc, counted in the subsystem tag: for the blocks that outlive
+ * the pools or grow (the stores, the buffers)
+ * 
+ * @param size the size of the block
+ * @param tag the subsystem
+ * @return void* NULL if out of memory
+ */
+void* memAlloc(size_t size, memTag tag){
+    UInt64* b = (UInt64*)malloc(size + MEMHEADER);
+    if ( b == NULL ) return NULL;
+    b[0] = size + MEMHEADER;
+    b[1] = tag;
+    memCount(tag, b[0]);
+    return (char*)b + MEMHEADER;
+}
+
+/**
+ * @brief allocate a block of nb items set to zero, as calloc, counted in the subsystem tag
+ * 
+ * @param nb the number of items
+ * @param size the size of an item
+ * @param tag the subsystem
+ * @return void* NULL if out of memory
+ */
+void* memCalloc(size_t nb, size_t size, memTag tag){
+    if ( size && nb > ((size_t)-1 - MEMHEADER) / size ) return NULL;
+    void* p = memAlloc(nb * size, tag);
+    if ( p ) memset(p, 0, nb * size);
+    return p;
+}
+
+/**
+ * @brief resize a block of memAlloc, as realloc
+ * 
+ * @param ptr the block, or NULL for a new block
+ * @param size the new size
+ * @param tag the subsystem
+ * @return void* NULL if out of memory, the block is not freed
+ */
+void* memRealloc(void* ptr, size_t size, memTag tag){
+    if ( ptr == NULL ) return memAlloc(size, tag);
+    UInt64* b = (UInt64*)((char*)ptr - MEMHEADER);
+    UInt64 previous = b[0], previousTag = b[1];
+    b = (UInt64*)realloc(b, size + MEMHEADER);
+    if ( b == NULL ) return NULL;
+    memUncount(previousTag, previous);
+    b[0] = size + MEMHEADER;
+    b[1] = tag;
+    memCount(tag, b[0]);
+    return (char*)b + MEMHEADER;
+}
+
+/**
+ * @brief free a block of memAlloc
+ * 
+ * @param ptr the block, or NULL
+ */
+void memFree(void* ptr){
+    if ( ptr == NULL ) return;
+    UInt64* b = (UInt64*)((char*)ptr - MEMHEADER);
+    memUncount(b[1], b[0]);
+    free(b);
+}
+
+/**
+ * @brief read the counters of the subsystems
+ * 
+ * @param stats the counters
+ */
+void memRead(memStats* stats){
+    for (int t=0; t<MEMTAGS; t++){
+        stats->current[t] = __atomic_load_n(&counters.current[t], __ATOMIC_RELAXED);
+        stats->peak[t] = __atomic_load_n(&counters.peak[t], __ATOMIC_RELAXED);
+    }
+    stats->total = __atomic_load_n(&counters.total, __ATOMIC_RELAXED);
+    stats->totalPeak = __atomic_load_n(&counters.totalPeak, __ATOMIC_RELAXED);
+    stats->reserved = __atomic_load_n(&counters.reserved, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief print the bytes of each subsystem, the current bytes and the peak, and the bytes per flux
+ * 
+ * @param out the output
+ * @param flows the number of flux, 0 to skip the bytes per flux
+ * @return int 0, -1 on error
+ */
+int memReport(FILE* out, UInt64 flows){
+    memStats s;
+    memRead(&s);
+    int r = fprintf(out, "---- memory ----\n");
+    for (int t=0; r >= 0 && t<MEMTAGS; t++){
+        r = fprintf(out, "%-10s: %llu bytes / peak %llu\n", memTagNames[t], (unsigned long long)s.current[t], (unsigned long long)s.peak[t]);
+    }
+    if ( r >= 0 ) r = fprintf(out, "%-10s: %llu bytes / peak %llu", "total", (unsigned long long)s.total, (unsigned long long)s.totalPeak);
+    if ( r >= 0 && flows ) r = fprintf(out, " / %llu bytes per flux", (unsigned long long)(s.total / flows));
+    if ( r >= 0 ) r = fprintf(out, "\n%-10s: %llu bytes in the chunks of the pools\n", "reserved", (unsigned long long)s.reserved);
+    return r < 0 ? -1 : 0;
+}
+
+
+#ifdef __UNITTEST_POOL__
+
+int main(){
+    memAccounting();
+    memStats stats;
+
+    // without a pool: malloc
+    char* s = poolStrdup("malloc");
+    assert(strcmp(s, "malloc") == 0);
+    poolFree(s);
+    char* key = poolStrdupTag("0A000001", MEMSEQUENCES);
+    memRead(&stats);
+    assert(stats.current[MEMSEQUENCES] == 9 + POOLHEADER && stats.current[MEMOTHER] == 0 && stats.total == 9 + POOLHEADER);
+    poolFree(key);
+
+    pool* p = poolCreate();
+    assert(poolUse(p) == NULL);
+
+    // a freed block is reused for the same size
+    void* a = poolAlloc(24);
+    void* b = poolAlloc(100);
+    assert(a && b && a != b);
+    assert(((size_t)a & 7) == 0 && ((size_t)b & 7) == 0);
+    poolFree(a);
+    assert(poolAlloc(20) == a);
+    assert(poolAlloc(24) != a);
+
+    // several chunks, a block bigger than a chunk
+    for (int i=0; i<100000; i++){
+        char* t = poolStrdup("0A0000010000000200500001");
+        assert(t && strcmp(t, "0A0000010000000200500001") == 0);
+    }
+    void* big = poolAlloc(3 * POOLCHUNK);
+    assert(big);
+    memset(big, 1, 3 * POOLCHUNK);
+    poolFree(big);
+    UInt64 capacity = p->capacity;
+    assert(capacity >= 100000 * 32 + 3 * POOLCHUNK);
+
+    // a reset reuses the chunks
+    poolReset(p);
+    for (int i=0; i<100000; i++) assert(poolStrdup("0A0000010000000200500001"));
+    assert(poolAlloc(3 * POOLCHUNK));
+    assert(p->capacity == capacity);
+
+    // the blocks of each tag, forgotten by a reset
+    poolReset(p);
+    void* node = poolAllocTag(40, MEMRADIX);
+    void* flow = poolAllocTag(24, MEMFLOWS);
+    memRead(&stats);
+    assert(stats.current[MEMRADIX] == 48 && stats.current[MEMFLOWS] == 32 && stats.reserved == capacity);
+    poolFree(flow);
+    assert(poolAllocTag(20, MEMSEQUENCES) == flow);
+    memRead(&stats);
+    assert(stats.current[MEMFLOWS] == 0 && stats.peak[MEMFLOWS] == 32 && stats.current[MEMSEQUENCES] == 32);
+    poolFree(node);
+    poolReset(p);
+    memRead(&stats);
+    assert(stats.total == 0 && stats.current[MEMSEQUENCES] == 0 && stats.totalPeak >= 100000 * 32 + 3 * POOLCHUNK);
+
+    assert(poolUse(NULL) == p);
+    poolDestroy(p);
+    memRead(&stats);
+    assert(stats.reserved == 0);
+
+    // the blocks of malloc, resized
+    UInt32* column = (UInt32*)memAlloc(1024 * sizeof(UInt32), MEMFLOWS);
+    column[1023] = 7;
+    column = (UInt32*)memRealloc(column, 4096 * sizeof(UInt32), MEMFLOWS);
+    assert(column && column[1023] == 7 && ((size_t)column & 15) == 0);
+    memRead(&stats);
+    assert(stats.current[MEMFLOWS] == 4096 * sizeof(UInt32) + MEMHEADER && stats.peak[MEMFLOWS] == stats.current[MEMFLOWS]);
+    memFree(column);
+    // the blocks set to zero, not tagged
+    UInt64* zeros = (UInt64*)memCalloc(100, sizeof(UInt64), MEMOTHER);
+    assert(zeros && zeros[0] == 0 && zeros[99] == 0);
+    memRead(&stats);
+    assert(stats.current[MEMOTHER] == 100 * sizeof(UInt64) + MEMHEADER);
+    assert(memCalloc((size_t)-1 / 2, 4, MEMOTHER) == NULL);
+    memFree(zeros);
+    memRead(&stats);
+    assert(stats.total == 0);
+    memReport(stdout, 0);
+    printf("pool: OK\n");
+    return 0;
+}
+
+// gcc -o pool pool.c -g -D__UNITTEST_POOL__ && ./pool
+
+#endif
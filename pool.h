@@ -0,0 +1,204 @@
+/**
+ * @file pool.h
+ * @author Sebastien Galvagno
+ * @brief Memory pool of the flux tables, reset without freeing
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_POOL_H__
+#define __SG__CHIMERE_POOL_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "SG_Types.h"
+
+// the size of a chunk of the pool
+#define POOLCHUNK (1 << 20)
+// the blocks are rounded to POOLGRAIN bytes, a freed block is kept in the list of its size
+#define POOLGRAIN 16
+#define POOLCLASSES 32
+
+/**
+ * @brief the subsystems of the memory accounting: a block is counted in the subsystem of its tag
+ */
+typedef enum {
+    MEMOTHER,       // the blocks not tagged: the selections of the tops, the snapshots of the queries, the report
+    MEMRADIX,       // the nodes and the leaves of the radix trees
+    MEMFLOWS,       // the columns and the rows of the flux stores
+    MEMSEQUENCES,   // the maps of the sequence numbers
+    MEMBUFFERS,     // the buffers of the reading
+    MEMTAGS
+} memTag;
+
+/**
+ * @brief the bytes of each subsystem: current and peak, the blocks with their header
+ */
+typedef struct {
+    UInt64 current[MEMTAGS];
+    UInt64 peak[MEMTAGS];
+    UInt64 total;       // all the subsystems
+    UInt64 totalPeak;
+    UInt64 reserved;    // the chunks of the pools, the blocks of the pools are cut in them
+} memStats;
+
+typedef struct poolChunk {
+    struct poolChunk* next;
+    size_t used;
+    size_t size;
+} poolChunk;
+
+/**
+ * @brief a pool: the blocks are cut in chunks, a freed block is reused for the same size.
+ * A reset keeps the chunks and forgets the blocks.
+ */
+typedef struct pool {
+    poolChunk* chunks;              // the chunks, the current one first
+    poolChunk* spare;               // the chunks kept by a reset, not used yet
+    void* freeBlocks[POOLCLASSES];  // the freed blocks of each size
+    UInt64 capacity;                // the size of the chunks
+    UInt64 tagged[MEMTAGS];         // the bytes of the blocks of each tag, forgotten by a reset
+} pool;
+
+/**
+ * @brief create an empty pool
+ * 
+ * @return pool* NULL if out of memory
+ */
+pool* poolCreate(void);
+
+/**
+ * @brief forget all the blocks of the pool, the chunks are kept for the next allocations
+ * 
+ * @param p the pool
+ */
+void poolReset(pool* p);
+
+/**
+ * @brief free the pool and its chunks
+ * 
+ * @param p the pool
+ */
+void poolDestroy(pool* p);
+
+/**
+ * @brief the pool of the allocations of this thread - NULL to use malloc
+ * 
+ * @param p the pool, or NULL
+ * @return pool* the previous pool of this thread
+ */
+pool* poolUse(pool* p);
+
+/**
+ * @brief allocate a block in the pool of this thread, with malloc when there is no pool.
+ * A block is freed with poolFree under the same pool.
+ * 
+ * @param size the size of the block
+ * @return void* NULL if out of memory
+ */
+void* poolAlloc(size_t size);
+
+/**
+ * @brief allocate a block as poolAlloc, counted in the subsystem tag
+ * 
+ * @param size the size of the block
+ * @param tag the subsystem
+ * @return void* NULL if out of memory
+ */
+void* poolAllocTag(size_t size, memTag tag);
+
+/**
+ * @brief count a block in another subsystem: a block kept by another subsystem
+ * 
+ * @param ptr the block of poolAlloc
+ * @param tag the subsystem
+ */
+void poolRetag(void* ptr, memTag tag);
+
+/**
+ * @brief free a block allocated by poolAlloc
+ * 
+ * @param ptr the block, or NULL
+ */
+void poolFree(void* ptr);
+
+/**
+ * @brief copy a string in a block of the pool of this thread
+ * 
+ * @param str the string
+ * @return char* NULL if out of memory
+ */
+char* poolStrdup(const char* str);
+
+/**
+ * @brief copy a string as poolStrdup, counted in the subsystem tag
+ * 
+ * @param str the string
+ * @param tag the subsystem
+ * @return char* NULL if out of memory
+ */
+char* poolStrdupTag(const char* str, memTag tag);
+
+/**
+ * @brief count the bytes of each subsystem from now on: called before the first allocation, the counters
+ * are shared by the threads. Without it the blocks only keep their tag.
+ */
+void memAccounting(void);
+
+/**
+ * @brief allocate a block with malloc, counted in the subsystem tag: for the blocks that outlive
+ * the pools or grow (the stores, the buffers)
+ * 
+ * @param size the size of the block
+ * @param tag the subsystem
+ * @return void* NULL if out of memory
+ */
+void* memAlloc(size_t size, memTag tag);
+
+/**
+ * @brief allocate a block of nb items set to zero, as calloc, counted in the subsystem tag
+ * 
+ * @param nb the number of items
+ * @param size the size of an item
+ * @param tag the subsystem
+ * @return void* NULL if out of memory
+ */
+void* memCalloc(size_t nb, size_t size, memTag tag);
+
+/**
+ * @brief resize a block of memAlloc, as realloc
+ * 
+ * @param ptr the block, or NULL for a new block
+ * @param size the new size
+ * @param tag the subsystem
+ * @return void* NULL if out of memory, the block is not freed
+ */
+void* memRealloc(void* ptr, size_t size, memTag tag);
+
+/**
+ * @brief free a block of memAlloc
+ * 
+ * @param ptr the block, or NULL
+ */
+void memFree(void* ptr);
+
+/**
+ * @brief read the counters of the subsystems
+ * 
+ * @param stats the counters
+ */
+void memRead(memStats* stats);
+
+/**
+ * @brief print the bytes of each subsystem, the current bytes and the peak, and the bytes per flux
+ * 
+ * @param out the output
+ * @param flows the number of flux, 0 to skip the bytes per flux
+ * @return int 0, -1 on error
+ */
+int memReport(FILE* out, UInt64 flows);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file quarantine.c
+ * @author Sebastien Galvagno
+ * @brief The packets out of order, written to a file by a buffered writer shared by the threads
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * A packet out of order does not stop the reading: its flux keeps the widest range and the line
+ * goes to the quarantine file, to be checked or read again later. The lines are rare, a lock per line
+ * is cheap; the file is written by blocks of 64 KB.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __UNITTEST_QUARANTINE__
+#include <assert.h>
+#endif
+
+#include "quarantine.h"
+
+/**
+ * @brief create or truncate the quarantine file
+ *
+ * @param path the file
+ * @return quarantine* NULL on error
+ */
+quarantine* quarantineOpen(const char* path){
+    quarantine* q = (quarantine*)malloc(sizeof(quarantine));
+    if ( q == NULL ) return NULL;
+    q->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( q->fd < 0 ){
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    q->used = 0;
+    q->lines = 0;
+    q->error = 0;
+    return q;
+}
+
+/**
+ * @brief write the buffer - under the lock
+ */
+static void flushBuffer(quarantine* q){
+    size_t done = 0;
+    while ( !q->error && done < q->used ){
+        ssize_t n = write(q->fd, q->buffer + done, q->used - done);
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) q->error = 1;
+        else done += (size_t)n;
+    }
+    q->used = 0;
+}
+
+static void addLine(quarantine* q, const char* line, int len){
+    pthread_mutex_lock(&q->lock);
+    if ( q->used + len + 1 > QUARANTINEBUFFER ) flushBuffer(q);
+    memcpy(q->buffer + q->used, line, len);
+    q->used += len;
+    q->buffer[q->used++] = '\n';
+    q->lines++;
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * @brief add the line of a packet out of order, in the format of the log
+ *
+ * @param q the quarantine file
+ * @param packet the packet, the sequence number in firstPacket
+ */
+void quarantinePacket(quarantine* q, const fromtopacket* packet){
+    char line[PACKETLINESIZE];
+    addLine(q, line, packetLine(packet, line, sizeof(line)));
+}
+
+/**
+ * @brief add the line of an IPv6 packet out of order
+ *
+ * @param q the quarantine file
+ * @param packet the packet, the sequence number in firstPacket
+ */
+void quarantinePacket6(quarantine* q, const fromtopacket6* packet){
+    char line[PACKETLINESIZE];
+    addLine(q, line, packetLine6(packet, line, sizeof(line)));
+}
+
+/**
+ * @brief write the buffer, close the file and free the writer
+ *
+ * @param q the quarantine file, or NULL
+ * @return int 0, -1 if a write failed
+ */
+int quarantineClose(quarantine* q){
+    if ( q == NULL ) return 0;
+    flushBuffer(q);
+    int r = q->error || close(q->fd) ? -1 : 0;
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+    return r;
+}
+
+
+#ifdef __UNITTEST_QUARANTINE__
+
+int main(){
+    char path[] = "/tmp/chimere_quarantine_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    quarantine* q = quarantineOpen(path);
+    assert(q);
+    fromtopacket p;
+    memset(&p, 0, sizeof(p));
+    char line[] = "10.0.0.1:1000,10.0.0.2:80,4294967295";
+    assert(decodePacket(line, &p));
+    // more lines than the buffer
+    for (int i=0; i<5000; i++) quarantinePacket(q, &p);
+    fromtopacket6 p6;
+    assert(decodePacket6("[::1]:1,[2001:db8::2]:80,7", &p6));
+    quarantinePacket6(q, &p6);
+    assert(q->lines == 5001);
+    assert(quarantineClose(q) == 0);
+
+    FILE* fp = fopen(path, "r");
+    assert(fp);
+    char read[PACKETLINESIZE];
+    int nb = 0;
+    while ( fgets(read, sizeof(read), fp) ){
+        assert(strcmp(read, nb < 5000 ? "10.0.0.1:1000,10.0.0.2:80,4294967295\n" : "[::1]:1,[2001:db8::2]:80,7\n") == 0);
+        nb++;
+    }
+    fclose(fp);
+    assert(nb == 5001);
+    unlink(path);
+    printf("quarantine: OK\n");
+    return 0;
+}
+
+// gcc -o quarantine pool.c packet.c quarantine.c -g -D__UNITTEST_QUARANTINE__ -pthread && ./quarantine
+
+#endif
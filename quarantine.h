@@ -0,0 +1,66 @@
+/**
+ * @file quarantine.h
+ * @author Sebastien Galvagno
+ * @brief The packets out of order, written to a file by a buffered writer shared by the threads
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef __SG__CHIMERE_QUARANTINE_H__
+#define __SG__CHIMERE_QUARANTINE_H__
+
+#include <pthread.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+
+// the lines kept before a write
+#define QUARANTINEBUFFER (64 * 1024)
+
+/**
+ * @brief the quarantine file: the lines are copied in the buffer under the lock, written when it is full
+ */
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+    char buffer[QUARANTINEBUFFER];
+    size_t used;
+    UInt64 lines;       // the lines written or in the buffer
+    int error;          // a write failed: the next lines are dropped
+} quarantine;
+
+/**
+ * @brief create or truncate the quarantine file
+ *
+ * @param path the file
+ * @return quarantine* NULL on error
+ */
+quarantine* quarantineOpen(const char* path);
+
+/**
+ * @brief add the line of a packet out of order, in the format of the log
+ *
+ * @param q the quarantine file
+ * @param packet the packet, the sequence number in firstPacket
+ */
+void quarantinePacket(quarantine* q, const fromtopacket* packet);
+
+/**
+ * @brief add the line of an IPv6 packet out of order
+ *
+ * @param q the quarantine file
+ * @param packet the packet, the sequence number in firstPacket
+ */
+void quarantinePacket6(quarantine* q, const fromtopacket6* packet);
+
+/**
+ * @brief write the buffer, close the file and free the writer
+ *
+ * @param q the quarantine file, or NULL
+ * @return int 0, -1 if a write failed
+ */
+int quarantineClose(quarantine* q);
+
+#endif
@@ -0,0 +1,684 @@
+/**
+ * @file query.c
+ * @author Sebastien Galvagno
+ * @brief Answer the queries of a Unix socket on snapshots of the flux table
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The radix tree and the store are modified in place by the ingesting thread: the queries read
+ * a snapshot instead, published with a pointer swap. A snapshot replaced is freed by the ingesting
+ * thread once the server thread has left it (epochs): the server never takes a lock, never waits for
+ * a snapshot, and the ingesting thread never waits. A snapshot is only rebuilt when the previous one has been read,
+ * every QUERYREFRESH ms, from the ingestion or from the idle reader.
+ *
+ * A snapshot does not copy the table: it shares the base of the previous one, a copy of the table in the
+ * order of the keys, and copies the flux changed since then (queryChanged), merged with the previous changes.
+ * Its top is the top of the previous snapshot and of the flux changed, the flux only grow: the table
+ * is read again when a flux of the top is removed. The base is copied again when the changes reach
+ * 1/8 of the table.
+ * 
+ * echo "top 20" | nc -U /tmp/chimere.sock
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __UNITTEST_QUERY__
+#include <assert.h>
+#endif
+
+#include "query.h"
+#include "pool.h"
+
+// the longest query line
+#define QUERYLINE 128
+
+typedef struct {
+    int fd;
+    char line[QUERYLINE];
+    size_t len;
+} queryClient;
+
+struct queryServer {
+    int listenFd;
+    int stopPipe[2];
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    pthread_t thread;
+    snapshot* current;      // the snapshot read by the queries, swapped atomically
+    UInt64 epoch;           // incremented at each retirement
+    UInt64 readerEpoch;     // the epoch seen by the server thread while it reads a snapshot, 0 otherwise
+    int wanted;             // the current snapshot has been read, or a client is connected
+    snapshot* retired;      // the snapshots replaced, only used by the ingesting thread
+    UInt64 lastPublish;     // the time of the last publication, in ms
+    UInt64 mark;            // the lines of the table at the last publication
+    fromtopacket* changed;  // the flux changed since the last publication, only used by the ingesting thread
+    UInt32 nbChanged;
+    UInt32 maxChanged;      // the changes noted before a full copy
+    int rebuild;            // the next snapshot is a full copy
+    char* answer;           // the buffer of the answers
+    size_t answerSize;
+};
+
+static UInt64 nowMs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UInt64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void snapshotFree(snapshot* s){
+    if ( s == NULL ) return;
+    if ( s->base && --s->base->shared == 0 ){
+        memFree(s->base->byKey);
+        memFree(s->base);
+    }
+    memFree(s->changes);
+    memFree(s->top);
+    memFree(s);
+}
+
+static int compareKey(const void* a, const void* b){
+    return compareFluxKey((const fromtopacket*)a, (const fromtopacket*)b);
+}
+
+static int compareChangeKey(const void* key, const void* change){
+    return compareFluxKey((const fromtopacket*)key, &((const snapshotChange*)change)->flux);
+}
+
+// the biggest flux first, the reverse order of compareFlux
+static int compareTop(const void* a, const void* b){
+    return compareFlux((const fromtopacket*)b, (const fromtopacket*)a);
+}
+
+/**
+ * @brief the copy of the flux in the order of the keys
+ */
+typedef struct {
+    snapshotBase* base;
+    const flowStore* store;
+    UInt32 capacity;
+} snapshotWalk;
+
+static int snapshotLeaf(const UInt32* key, void* data, void* ctx){
+    (void)key;
+    snapshotWalk* w = (snapshotWalk*)ctx;
+    snapshotBase* b = w->base;
+    if ( b->nbFlux == w->capacity ){
+        w->capacity *= 2;
+        fromtopacket* byKey = (fromtopacket*)memRealloc(b->byKey, w->capacity * sizeof(fromtopacket), MEMOTHER);
+        if ( byKey == NULL ) return -1;
+        b->byKey = byKey;
+    }
+    flowStoreGet(w->store, LEAFFLOW(data), &b->byKey[b->nbFlux++]);
+    return 0;
+}
+
+/**
+ * @brief copy the table: a new base with a walk of the radix tree, and the biggest flux
+ */
+static snapshot* snapshotOf(fluxTable* table){
+    snapshot* s = (snapshot*)memCalloc(1, sizeof(snapshot), MEMOTHER);
+    if ( s == NULL ) return NULL;
+    s->lines = table->lines;
+    s->nbFlux = table->flows.nb;
+
+    UInt32 capacity = table->flows.nb + 1024;
+    s->base = (snapshotBase*)memCalloc(1, sizeof(snapshotBase), MEMOTHER);
+    if ( s->base ){
+        s->base->shared = 1;
+        s->base->byKey = (fromtopacket*)memAlloc(capacity * sizeof(fromtopacket), MEMOTHER);
+    }
+    s->top = (fromtopacket*)memAlloc(QUERYTOP * sizeof(fromtopacket), MEMOTHER);
+    if ( s->base == NULL || s->base->byKey == NULL || s->top == NULL ){
+        snapshotFree(s);
+        return NULL;
+    }
+
+    snapshotWalk w = {s->base, &table->flows, capacity};
+    if ( radix96Walk(&table->tree, NULL, 0, &snapshotLeaf, &w) ){
+        snapshotFree(s);
+        return NULL;
+    }
+    s->nbTop = topFlux(table, QUERYTOP, s->top);
+    return s;
+}
+
+/**
+ * @brief the next snapshot: the base of the previous one and the flux changed since it, read in the table
+ */
+static snapshot* snapshotUpdate(queryServer* server, fluxTable* table, const snapshot* previous){
+    // the flux changed, once, in the order of the keys
+    qsort(server->changed, server->nbChanged, sizeof(fromtopacket), &compareKey);
+    snapshotChange* fresh = (snapshotChange*)memAlloc((server->nbChanged + 1) * sizeof(snapshotChange), MEMOTHER);
+    snapshot* s = (snapshot*)memCalloc(1, sizeof(snapshot), MEMOTHER);
+    fromtopacket* candidates = (fromtopacket*)memAlloc((previous->nbTop + server->nbChanged + 1) * sizeof(fromtopacket), MEMOTHER);
+    if ( s ){
+        s->changes = (snapshotChange*)memAlloc((previous->nbChanges + server->nbChanged + 1) * sizeof(snapshotChange), MEMOTHER);
+        s->top = (fromtopacket*)memAlloc(QUERYTOP * sizeof(fromtopacket), MEMOTHER);
+    }
+    if ( fresh == NULL || s == NULL || candidates == NULL || s->changes == NULL || s->top == NULL ){
+        memFree(fresh);
+        memFree(candidates);
+        snapshotFree(s);
+        return NULL;
+    }
+    s->lines = table->lines;
+    s->nbFlux = table->flows.nb;
+    s->base = previous->base;
+    s->base->shared++;
+
+    UInt32 nbFresh = 0;
+    for (UInt32 i=0; i<server->nbChanged; i++){
+        if ( nbFresh && compareFluxKey(&fresh[nbFresh - 1].flux, &server->changed[i]) == 0 ) continue;
+        UInt32 key[FLUXKEYWORDS];
+        fluxKey(&server->changed[i], key);
+        void** data = radix96Find(&table->tree, key);
+        snapshotChange* c = &fresh[nbFresh++];
+        c->removed = data == NULL;
+        if ( data ) flowStoreGet(&table->flows, LEAFFLOW(*data), &c->flux);
+        else c->flux = server->changed[i];
+    }
+
+    // the previous changes and the new ones, the new ones replace the previous ones
+    UInt32 i = 0, j = 0;
+    while ( i < previous->nbChanges || j < nbFresh ){
+        int cmp = i == previous->nbChanges ? 1 : j == nbFresh ? -1 : compareFluxKey(&previous->changes[i].flux, &fresh[j].flux);
+        if ( cmp < 0 ) s->changes[s->nbChanges++] = previous->changes[i++];
+        else {
+            if ( cmp == 0 ) i++;
+            s->changes[s->nbChanges++] = fresh[j++];
+        }
+    }
+
+    // the top: the previous top and the flux changed
+    int topRemoved = 0;
+    UInt32 nb = 0;
+    for (UInt32 t=0; t<previous->nbTop; t++){
+        const snapshotChange* c = (const snapshotChange*)bsearch(&previous->top[t], fresh, nbFresh, sizeof(snapshotChange), &compareChangeKey);
+        if ( c == NULL ) candidates[nb++] = previous->top[t];
+        else if ( c->removed ) topRemoved = 1;
+    }
+    for (UInt32 f=0; f<nbFresh; f++){
+        if ( !fresh[f].removed ) candidates[nb++] = fresh[f].flux;
+    }
+    if ( topRemoved ){
+        s->nbTop = topFlux(table, QUERYTOP, s->top);
+    } else {
+        qsort(candidates, nb, sizeof(fromtopacket), &compareTop);
+        s->nbTop = nb < QUERYTOP ? nb : QUERYTOP;
+        memcpy(s->top, candidates, s->nbTop * sizeof(fromtopacket));
+    }
+    memFree(fresh);
+    memFree(candidates);
+    return s;
+}
+
+/**
+ * @brief free the retired snapshots the server thread cannot read anymore
+ */
+static void reclaim(queryServer* server){
+    UInt64 reader = __atomic_load_n(&server->readerEpoch, __ATOMIC_SEQ_CST);
+    snapshot** link = &server->retired;
+    while ( *link ){
+        snapshot* s = *link;
+        // the reader entered after the retirement: it has read the new pointer
+        if ( reader == 0 || reader > s->epoch ){
+            *link = s->retired;
+            snapshotFree(s);
+        } else {
+            link = &s->retired;
+        }
+    }
+}
+
+/**
+ * @brief publish a snapshot of the table now
+ * 
+ * @param server the server
+ * @param table the flux table
+ * @return int 0, -1 if out of memory
+ */
+int queryPublish(queryServer* server, fluxTable* table){
+    snapshot* current = __atomic_load_n(&server->current, __ATOMIC_SEQ_CST);
+    snapshot* s = current && !server->rebuild ? snapshotUpdate(server, table, current) : snapshotOf(table);
+    if ( s == NULL ){
+        server->rebuild = 1;
+        return -1;
+    }
+
+    // the changes noted before the next full copy
+    UInt32 maxChanged = QUERYDELTA + s->base->nbFlux / 8;
+    maxChanged = s->nbChanges < maxChanged ? maxChanged - s->nbChanges : 0;
+    if ( maxChanged > server->maxChanged ){
+        fromtopacket* changed = (fromtopacket*)memRealloc(server->changed, maxChanged * sizeof(fromtopacket), MEMOTHER);
+        if ( changed ) server->changed = changed;
+        else maxChanged = 0;
+    }
+    server->maxChanged = maxChanged;
+    server->nbChanged = 0;
+    server->rebuild = maxChanged == 0;
+    server->mark = table->lines;
+
+    snapshot* old = __atomic_exchange_n(&server->current, s, __ATOMIC_SEQ_CST);
+    if ( old ){
+        old->epoch = __atomic_fetch_add(&server->epoch, 1, __ATOMIC_SEQ_CST);
+        old->retired = server->retired;
+        server->retired = old;
+    }
+    reclaim(server);
+    server->lastPublish = nowMs();
+    return 0;
+}
+
+/**
+ * @brief note a flux added, grown or removed: the next snapshot copies the flux changed only.
+ * Called by the ingesting thread, a flux is noted once between two snapshots.
+ * 
+ * @param server the server
+ * @param flux the flux, its key is read
+ * @param lastUpdate the line of its previous update, 0 for a flux added or removed
+ */
+void queryChanged(queryServer* server, const fromtopacket* flux, UInt32 lastUpdate){
+    if ( server->rebuild ) return;
+    // updated after the last publication: already noted
+    if ( lastUpdate && (SInt32)(lastUpdate - (UInt32)server->mark) > 0 ) return;
+    if ( server->nbChanged == server->maxChanged ){
+        server->rebuild = 1;
+        return;
+    }
+    server->changed[server->nbChanged++] = *flux;
+}
+
+/**
+ * @brief publish a new snapshot of the table when the current one has been read and is older than QUERYREFRESH:
+ * called by the ingesting thread, it never waits for the queries
+ * 
+ * @param server the server
+ * @param table the flux table
+ */
+void queryRefresh(queryServer* server, fluxTable* table){
+    if ( !__atomic_load_n(&server->wanted, __ATOMIC_RELAXED) ){
+        if ( server->retired ) reclaim(server);
+        return;
+    }
+    if ( nowMs() - server->lastPublish < QUERYREFRESH ) return;
+    // nothing changed since the current snapshot
+    if ( server->current && !server->rebuild && server->nbChanged == 0 ) return;
+    __atomic_store_n(&server->wanted, 0, __ATOMIC_RELAXED);
+    queryPublish(server, table);
+}
+
+/**
+ * @brief answer a query from the current snapshot
+ * 
+ * @return size_t the length of the answer
+ */
+static size_t answerQuery(queryServer* server, char* query, snapshot* s){
+    char* out = server->answer;
+    size_t size = server->answerSize, len = 0;
+
+    if ( s == NULL ){
+        len += snprintf(out + len, size - len, "no snapshot yet\n");
+    } else if ( strncmp(query, "top", 3) == 0 ){
+        int top = query[3] ? atoi(query + 3) : 10;
+        if ( top < 0 ) top = 0;
+        if ( (UInt32)top > s->nbTop ) top = s->nbTop;
+        len += snprintf(out + len, size - len, "---- top %d after %llu lines ----\n", top, (unsigned long long)s->lines);
+        for (int i=0; i<top; i++){
+            len += packetSummary(&s->top[i], out + len, size - len);
+            out[len++] = '\n';
+        }
+    } else if ( strncmp(query, "flux ", 5) == 0 ){
+        // the key is decoded as a line without sequence number
+        char line[QUERYLINE + 4];
+        snprintf(line, sizeof(line), "%s,0", query + 5);
+        fromtopacket key;
+        const fromtopacket* found = NULL;
+        if ( decodePacket(line, &key) ){
+            // a flux changed since the base, or the base
+            const snapshotChange* c = s->nbChanges ? (const snapshotChange*)bsearch(&key, s->changes, s->nbChanges, sizeof(snapshotChange), &compareChangeKey) : NULL;
+            if ( c ) found = c->removed ? NULL : &c->flux;
+            else found = (const fromtopacket*)bsearch(&key, s->base->byKey, s->base->nbFlux, sizeof(fromtopacket), &compareKey);
+        }
+        if ( found ){
+            len += packetSummary(found, out + len, size - len);
+            out[len++] = '\n';
+        } else {
+            len += snprintf(out + len, size - len, "unknown flux\n");
+        }
+    } else if ( strcmp(query, "stats") == 0 ){
+        len += snprintf(out + len, size - len, "lines %llu flux %u\n", (unsigned long long)s->lines, s->nbFlux);
+    } else {
+        len += snprintf(out + len, size - len, "queries: top N | flux ip:port,ip:port | stats\n");
+    }
+    len += snprintf(out + len, size - len, "end\n");
+    return len;
+}
+
+static int writeAll(int fd, const char* data, size_t size){
+    while ( size ){
+        ssize_t n = write(fd, data, size);
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief answer the complete lines received from a client
+ * 
+ * @return int 0, -1 when the client is closed
+ */
+static int readClient(queryServer* server, queryClient* c){
+    ssize_t n = read(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len);
+    if ( n <= 0 ) return -1;
+    c->len += n;
+
+    char* start = c->line;
+    char* end;
+    while ( (end = memchr(start, '\n', c->line + c->len - start)) != NULL ){
+        *end = '\0';
+        if ( end > start && end[-1] == '\r' ) end[-1] = '\0';
+
+        // answered at once from the last snapshot: enter the epoch, then read the pointer
+        __atomic_store_n(&server->readerEpoch, __atomic_load_n(&server->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+        snapshot* s = __atomic_load_n(&server->current, __ATOMIC_SEQ_CST);
+        size_t len = answerQuery(server, start, s);
+        __atomic_store_n(&server->readerEpoch, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&server->wanted, 1, __ATOMIC_RELAXED);
+
+        if ( writeAll(c->fd, server->answer, len) ) return -1;
+        start = end + 1;
+    }
+    c->len -= start - c->line;
+    memmove(c->line, start, c->len);
+    // a line longer than QUERYLINE is dropped
+    if ( c->len == sizeof(c->line) - 1 ) c->len = 0;
+    return 0;
+}
+
+static void* serverThread(void* arg){
+    queryServer* server = (queryServer*)arg;
+    queryClient clients[QUERYCLIENTS];
+    struct pollfd fds[QUERYCLIENTS + 2];
+    int nbClients = 0;
+
+    for (;;){
+        fds[0].fd = server->stopPipe[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = server->listenFd;
+        fds[1].events = nbClients < QUERYCLIENTS ? POLLIN : 0;
+        for (int i=0; i<nbClients; i++){
+            fds[i + 2].fd = clients[i].fd;
+            fds[i + 2].events = POLLIN;
+        }
+        if ( poll(fds, nbClients + 2, -1) < 0 ){
+            if ( errno == EINTR ) continue;
+            break;
+        }
+        if ( fds[0].revents ) break;
+
+        for (int i=nbClients-1; i>=0; i--){
+            if ( fds[i + 2].revents && readClient(server, &clients[i]) ){
+                close(clients[i].fd);
+                clients[i] = clients[--nbClients];
+            }
+        }
+        if ( fds[1].revents & POLLIN ){
+            int fd = accept(server->listenFd, NULL, NULL);
+            if ( fd >= 0 ){
+                clients[nbClients].fd = fd;
+                clients[nbClients].len = 0;
+                __atomic_store_n(&server->wanted, 1, __ATOMIC_RELAXED);
+                nbClients++;
+            }
+        }
+    }
+
+    for (int i=0; i<nbClients; i++) close(clients[i].fd);
+    return NULL;
+}
+
+/**
+ * @brief start the thread answering the queries of the socket path:
+ * "top N", "flux ip:port,ip:port" and "stats", one query per line, each answer ends by "end"
+ * 
+ * @param path the path of the Unix socket
+ * @return queryServer* NULL on error
+ */
+queryServer* queryStart(const char* path){
+    queryServer* server = (queryServer*)memCalloc(1, sizeof(queryServer), MEMOTHER);
+    if ( server == NULL ) return NULL;
+    if ( strlen(path) >= sizeof(server->path) ){
+        memFree(server);
+        return NULL;
+    }
+    strcpy(server->path, path);
+    server->epoch = 1;
+    server->rebuild = 1;
+    server->answerSize = (QUERYTOP + 2) * PACKETSUMMARYSIZE;
+    server->answer = (char*)memAlloc(server->answerSize, MEMOTHER);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    server->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // a socket left by a process stopped before its end
+    unlink(path);
+    if ( server->answer == NULL || server->listenFd < 0
+         || bind(server->listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+         || listen(server->listenFd, QUERYCLIENTS) != 0
+         || pipe(server->stopPipe) != 0 ){
+        if ( server->listenFd >= 0 ) close(server->listenFd);
+        memFree(server->answer);
+        memFree(server);
+        return NULL;
+    }
+    if ( pthread_create(&server->thread, NULL, &serverThread, server) != 0 ){
+        close(server->listenFd);
+        close(server->stopPipe[0]);
+        close(server->stopPipe[1]);
+        unlink(path);
+        memFree(server->answer);
+        memFree(server);
+        return NULL;
+    }
+    return server;
+}
+
+/**
+ * @brief stop the thread, remove the socket and free the snapshots
+ * 
+ * @param server the server
+ */
+void queryStop(queryServer* server){
+    if ( server == NULL ) return;
+    if ( write(server->stopPipe[1], "", 1) != 1 ) pthread_cancel(server->thread);
+    pthread_join(server->thread, NULL);
+    close(server->listenFd);
+    close(server->stopPipe[0]);
+    close(server->stopPipe[1]);
+    unlink(server->path);
+
+    snapshotFree(server->current);
+    while ( server->retired ){
+        snapshot* s = server->retired;
+        server->retired = s->retired;
+        snapshotFree(s);
+    }
+    memFree(server->changed);
+    memFree(server->answer);
+    memFree(server);
+}
+
+
+#ifdef __UNITTEST_QUERY__
+
+#define NBFLUX 5000
+
+static int connectTo(const char* path){
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    assert(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+/**
+ * @brief send a query and read its answer until "end"
+ */
+static char* ask(int fd, const char* query, char* answer, size_t size){
+    assert(write(fd, query, strlen(query)) == (ssize_t)strlen(query));
+    size_t len = 0;
+    for (;;){
+        ssize_t n = read(fd, answer + len, size - 1 - len);
+        assert(n > 0);
+        len += n;
+        answer[len] = '\0';
+        if ( len >= 4 && strcmp(answer + len - 4, "end\n") == 0 ) return answer;
+    }
+}
+
+static void feed(fluxTable* table, int from, int to, int round){
+    char line[64];
+    for (int f=from; f<to; f++){
+        snprintf(line, sizeof(line), "10.0.%d.%d:%d,192.168.0.1:80,%d", f >> 8, f & 0xFF, 1000 + f, 1000 + round * (1 + f % 50));
+        assert(processLine(table, line) == 0);
+    }
+}
+
+typedef struct {
+    const char* path;
+    int queries;
+} clientJob;
+
+static void* clientThread(void* arg){
+    clientJob* job = (clientJob*)arg;
+    int fd = connectTo(job->path);
+    char answer[(QUERYTOP + 2) * PACKETSUMMARYSIZE];
+    for (int i=0; i<job->queries; i++){
+        ask(fd, i & 1 ? "top 50\n" : "flux 10.0.0.7:1007,192.168.0.1:80\n", answer, sizeof(answer));
+    }
+    close(fd);
+    return NULL;
+}
+
+int main(){
+    const char* path = "/tmp/chimere_query_test.sock";
+    fluxTable table;
+    memset(&table, 0, sizeof(table));
+    feed(&table, 0, NBFLUX, 0);
+    feed(&table, 0, NBFLUX, 1);
+
+    queryServer* server = queryStart(path);
+    assert(server);
+    // the table notes its changes for the snapshots
+    table.server = server;
+    int fd = connectTo(path);
+    char answer[(QUERYTOP + 2) * PACKETSUMMARYSIZE];
+    assert(strcmp(ask(fd, "stats\n", answer, sizeof(answer)), "no snapshot yet\nend\n") == 0);
+
+    assert(queryPublish(server, &table) == 0);
+    assert(strcmp(ask(fd, "stats\n", answer, sizeof(answer)), "lines 10000 flux 5000\nend\n") == 0);
+    ask(fd, "top 2\n", answer, sizeof(answer));
+    assert(strcmp(answer, "---- top 2 after 10000 lines ----\n"
+                          "Flux 10.0.19.135:5999,192.168.0.1:80 / Taille : 50\n"
+                          "Flux 10.0.19.85:5949,192.168.0.1:80 / Taille : 50\nend\n") == 0);
+    ask(fd, "flux 10.0.0.7:1007,192.168.0.1:80\n", answer, sizeof(answer));
+    assert(strcmp(answer, "Flux 10.0.0.7:1007,192.168.0.1:80 / Taille : 8\nend\n") == 0);
+    ask(fd, "flux 10.0.0.7:1008,192.168.0.1:80\n", answer, sizeof(answer));
+    assert(strcmp(answer, "unknown flux\nend\n") == 0);
+
+    // the round trip of a point lookup
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i=0; i<1000; i++) ask(fd, "flux 10.0.0.7:1007,192.168.0.1:80\n", answer, sizeof(answer));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1000 / 1e3;
+    printf("round trip: %.1f us\n", us);
+    assert(us < 1000);
+
+    // the ingestion goes on while a client queries: the snapshots are replaced and reclaimed
+    clientJob job = { .path = path, .queries = 20000 };
+    pthread_t client;
+    pthread_create(&client, NULL, &clientThread, &job);
+    for (int round=2; round<200; round++){
+        feed(&table, 0, NBFLUX, round);
+        server->lastPublish = 0;
+        queryRefresh(server, &table);
+    }
+    pthread_join(client, NULL);
+    queryPublish(server, &table);
+    ask(fd, "flux 10.0.0.7:1007,192.168.0.1:80\n", answer, sizeof(answer));
+    assert(strcmp(answer, "Flux 10.0.0.7:1007,192.168.0.1:80 / Taille : 1592\nend\n") == 0);
+
+    // the snapshots made of the changes give the answers of a full copy: flux added, grown and removed
+    const char* path2 = "/tmp/chimere_query_test2.sock";
+    fluxTable small;
+    memset(&small, 0, sizeof(small));
+    queryServer* server2 = queryStart(path2);
+    assert(server2);
+    small.server = server2;
+    int fd2 = connectTo(path2);
+    feed(&small, 0, 200, 0);
+    assert(queryPublish(server2, &small) == 0 && server2->current->nbChanges == 0);
+    snapshotBase* base = server2->current->base;
+    // the new flux are the top, then the others grow
+    feed(&small, 200, 210, 0);
+    feed(&small, 200, 210, 100);
+    assert(queryPublish(server2, &small) == 0);
+    feed(&small, 0, 200, 1);
+    assert(queryPublish(server2, &small) == 0 && server2->current->nbChanges == 210);
+    // the flux of the top are removed: the top is read in the table again
+    small.expire = 200;
+    expireFlux(&small);
+    small.expire = 0;
+    feed(&small, 0, 5, 2);
+    assert(queryPublish(server2, &small) == 0 && server2->current->base == base && server2->current->nbTop == 200);
+    static char incremental[4][(QUERYTOP + 2) * PACKETSUMMARYSIZE];
+    const char* queries[4] = { "top 1000\n", "stats\n", "flux 10.0.0.7:1007,192.168.0.1:80\n", "flux 10.0.0.201:1201,192.168.0.1:80\n" };
+    for (int q=0; q<4; q++) ask(fd2, queries[q], incremental[q], sizeof(incremental[q]));
+    assert(strcmp(incremental[1], "lines 425 flux 200\nend\n") == 0 && strcmp(incremental[3], "unknown flux\nend\n") == 0);
+    assert(strcmp(incremental[2], "Flux 10.0.0.7:1007,192.168.0.1:80 / Taille : 8\nend\n") == 0);
+    server2->rebuild = 1;
+    assert(queryPublish(server2, &small) == 0 && server2->current->nbChanges == 0);
+    for (int q=0; q<4; q++) assert(strcmp(ask(fd2, queries[q], answer, sizeof(answer)), incremental[q]) == 0);
+    close(fd2);
+    queryStop(server2);
+
+    // the first query of a client is answered at once, from the last snapshot
+    int first = connectTo(path);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ask(first, "stats\n", answer, sizeof(answer));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3;
+    printf("first query: %.1f us\n", us);
+    assert(us < 1000 * QUERYREFRESH / 2);
+    close(first);
+
+    close(fd);
+    queryStop(server);
+    printf("query: OK\n");
+    return 0;
+}
+
+// gcc -o query pool.c packet.c radixfixed.c aggregate.c flowstore.c seqmap.c quarantine.c metrics.c shmflux.c flux.c query.c -g -D__UNITTEST_QUERY__ -pthread -lrt && ./query
+
+#endif
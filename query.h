@@ -0,0 +1,105 @@
+/**
+ * @file query.h
+ * @author Sebastien Galvagno
+ * @brief Answer the queries of a Unix socket on snapshots of the flux table
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_QUERY_H__
+#define __SG__CHIMERE_QUERY_H__
+
+#include "SG_Types.h"
+#include "packet.h"
+#include "flux.h"
+
+// the biggest flux kept in a snapshot for the top queries
+#define QUERYTOP 1000
+// a snapshot is refreshed at most every QUERYREFRESH milliseconds, when it has been read
+#define QUERYREFRESH 100
+// the clients connected at the same time
+#define QUERYCLIENTS 16
+// the flux changed kept in the snapshots before a full copy: QUERYDELTA and 1/8 of the table
+#define QUERYDELTA 4096
+
+/**
+ * @brief the flux of the table in the order of the keys at a full copy, shared by the snapshots which follow it
+ */
+typedef struct {
+    UInt32 nbFlux;
+    fromtopacket* byKey;    // the flux in the order of the radix keys
+    UInt32 shared;          // the snapshots reading it
+} snapshotBase;
+
+/**
+ * @brief a flux changed since the base: added, grown or removed
+ */
+typedef struct {
+    fromtopacket flux;
+    UInt32 removed;
+} snapshotChange;
+
+/**
+ * @brief a read-only copy of the flux table: a base and the flux changed since it, and the biggest flux
+ */
+typedef struct snapshot {
+    UInt64 lines;
+    UInt32 nbFlux;
+    snapshotBase* base;
+    UInt32 nbChanges;
+    snapshotChange* changes; // the flux changed since the base, in the order of the radix keys
+    UInt32 nbTop;
+    fromtopacket* top;      // the biggest flux, the biggest first
+    struct snapshot* retired; // the list of the snapshots waiting for the end of their readers
+    UInt64 epoch;           // the epoch of the retirement
+} snapshot;
+
+typedef struct queryServer queryServer;
+
+/**
+ * @brief start the thread answering the queries of the socket path:
+ * "top N", "flux ip:port,ip:port" and "stats", one query per line, each answer ends by "end"
+ * 
+ * @param path the path of the Unix socket
+ * @return queryServer* NULL on error
+ */
+queryServer* queryStart(const char* path);
+
+/**
+ * @brief note a flux added, grown or removed: the next snapshot copies the flux changed only.
+ * Called by the ingesting thread, a flux is noted once between two snapshots.
+ * 
+ * @param server the server
+ * @param flux the flux, its key is read
+ * @param lastUpdate the line of its previous update, 0 for a flux added or removed
+ */
+void queryChanged(queryServer* server, const fromtopacket* flux, UInt32 lastUpdate);
+
+/**
+ * @brief publish a new snapshot of the table when the current one has been read and is older than QUERYREFRESH:
+ * called by the ingesting thread, it never waits for the queries
+ * 
+ * @param server the server
+ * @param table the flux table
+ */
+void queryRefresh(queryServer* server, fluxTable* table);
+
+/**
+ * @brief publish a snapshot of the table now
+ * 
+ * @param server the server
+ * @param table the flux table
+ * @return int 0, -1 if out of memory
+ */
+int queryPublish(queryServer* server, fluxTable* table);
+
+/**
+ * @brief stop the thread, remove the socket and free the snapshots
+ * 
+ * @param server the server
+ */
+void queryStop(queryServer* server);
+
+#endif
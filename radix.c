@@ -18,8 +18,8 @@
 #endif
 
 #include "radix.h"
-#include "packet.h"
-#include "list.h"
+#include "flowstore.h"
+#include "pool.h"
 
 
 
@@ -45,22 +45,22 @@ typedef struct {
  * @return split* 
  */
 split* newSplit( const char* prefix, const char* suffix1, const char* suffix2){
-    split * s = (split*)malloc(sizeof(split));
+    split * s = (split*)poolAllocTag(sizeof(split), MEMOTHER);
     if (s == NULL) return NULL;
     s->prefix = s->suffix1 = s->suffix2 = NULL;
-    if ( prefix) s->prefix = strdup(prefix);
-    if ( suffix1 ) s->suffix1 = strdup(suffix1);
-    if ( suffix2 ) s->suffix2 = strdup(suffix2);
+    if ( prefix) s->prefix = poolStrdupTag(prefix, MEMOTHER);
+    if ( suffix1 ) s->suffix1 = poolStrdupTag(suffix1, MEMOTHER);
+    if ( suffix2 ) s->suffix2 = poolStrdupTag(suffix2, MEMOTHER);
     return s;
 }
 
 
 void freeSplit(split* s){
     if (s == NULL) return;
-    if (s->prefix)  free(s->prefix);
-    if (s->suffix1) free(s->suffix1);
-    if (s->suffix2) free(s->suffix2);
-    free(s);
+    if (s->prefix)  poolFree(s->prefix);
+    if (s->suffix1) poolFree(s->suffix1);
+    if (s->suffix2) poolFree(s->suffix2);
+    poolFree(s);
 }
 
 
@@ -98,9 +98,8 @@ split* keycmp( const char * key1, const char * key2){
             if ( c2 == '\0' ){
                 return newSplit(key1, NULL, NULL);
             } else {
-                int size = !invert ? key1 - pkey1 : key2 - pkey1;
-                char * a = !invert ? strndup(key1, size) : strndup(key2, size);
-                return !invert ? newSplit(a, NULL, pkey2) : newSplit(a, pkey2, NULL) ;
+                // the shorter key is the prefix of the other one
+                return !invert ? newSplit(key1, NULL, pkey2) : newSplit(key2, pkey2, NULL) ;
             }
         }
         pkey1++;
@@ -110,10 +109,12 @@ split* keycmp( const char * key1, const char * key2){
     pkey1--;
     pkey2--;
     int size = ( !invert ? pkey1 - key1 : pkey1 - key2 );
-    char* a = !invert ? strndup(key1, size) : strndup(key2, size);
+    char* a = (char*)poolAllocTag(size + 1, MEMOTHER);
     if ( a ){
+        memcpy(a, !invert ? key1 : key2, size);
+        a[size] = '\0';
         split* key = !invert ? newSplit(a, pkey1, pkey2) : newSplit(a ,pkey2, pkey1) ;
-        free(a);
+        poolFree(a);
         return key;
     }
     return NULL;
@@ -179,15 +180,14 @@ int convert(char c){
  * @return node* 
  */
 node* newNode(const char* key){
-    node* n = (node*)malloc(sizeof(node));
+    node* n = (node*)poolAllocTag(sizeof(node), MEMRADIX);
     if ( n == NULL) return NULL;
-    n->key = strdup(key);
+    n->key = poolStrdupTag(key, MEMRADIX);
     n->data = NULL;
-    memset(n->children, 0, RADIXBASE);
+    memset(n->children, 0, sizeof(n->children));
     return n;
 }
 
-
 /**
  * @brief insert a key in a radix tree - generating a new node or return the existing
  * 
@@ -201,48 +201,42 @@ node* insert(node * n, char * key){
     }
 
     split* s = keycmp(n->key, key);
+    if ( s == NULL ) return NULL;
 #ifdef __UNITTEST_RADIX__
     printSplit(s);
 #endif
 
-    n->key = s->prefix;
-     
+    node* leaf = n;
     if ( s->suffix1 ){
-        int i = convert(s->suffix1[0]);
-        if ( n->children[i] == NULL ){
-            node* new = newNode(s->suffix1);
-            if ( new ){
-                for(int j=0; j<RADIXBASE; j++){
-                    new->children[j] = n->children[j];
-                    n->children[j] = NULL;
-                }
-                n->children[i] = new;
-                new->data = n->data; // the child is getting the data
-                n->data = NULL; // n become a gateway (no data)
-                if ( s->suffix2 == NULL ) return new;
-            }
-        } else {
-            node* next = n->children[i];
-            node* leaf = insert(n->children[i], s->suffix1);
-            n->children[i] = next;
-            if ( s->suffix2 == NULL ) return leaf;
+        // n is split: the end of its key, its children and its data go to a new child
+        node* new = newNode(s->suffix1);
+        if ( new == NULL ){
+            freeSplit(s);
+            return NULL;
         }
+        memcpy(new->children, n->children, sizeof(n->children));
+        memset(n->children, 0, sizeof(n->children));
+        n->children[convert(s->suffix1[0])] = new;
+        new->data = n->data; // the child is getting the data
+        n->data = NULL; // n become a gateway (no data)
+
+        poolFree(n->key);
+        n->key = s->prefix;
+        s->prefix = NULL;
+        poolRetag(n->key, MEMRADIX);
     }
 
     if ( s->suffix2 ){  
         int i = convert(s->suffix2[0]);
         if ( n->children[i] == NULL ){
-            n->children[i] = newNode(s->suffix2);
-            return n->children[i];
+            leaf = n->children[i] = newNode(s->suffix2);
         } else {
-            node* next = n->children[i];
-            node* leaf = insert(n->children[i], s->suffix2);
-            n->children[i] = next;
-            return leaf;
+            leaf = insert(n->children[i], s->suffix2);
         }
     }
 
-    return n;
+    freeSplit(s);
+    return leaf;
 }
 
 
@@ -258,13 +252,12 @@ void printRadixExt(node* n, int index, int tab){
     char * sp = space(tab);
     if (sp==NULL) return;
 
-    char * flux = NULL;
-    if ( n->data && ((list*)n->data)->data){
-        flux = PacketStr((fromtopacket*)((list*)n->data)->data);
+    // the leaf of a flux holds its id in the store of the table
+    if ( n->data ){
+        fprintf(stderr, "%skey[%0X]: %s - Flux: %u\n", sp, index, n->key ? n->key : "NULL", LEAFFLOW(n->data));
+    } else {
+        fprintf(stderr, "%skey[%0X]: %s\n", sp, index, n->key ? n->key : "NULL");
     }
-
-    fprintf(stderr, "%skey[%0X]: %s%s%s\n", sp, index, n->key ? n->key : "NULL" , flux ? " - Flux: " : "", flux?flux:"");
-    free(flux);
     if ( n->data == NULL ) {  }
     //free(sp);
     for (int i=0; i<RADIXBASE; i++) {
@@ -580,7 +573,28 @@ void test_radix_root(){
     assertChar((char*)root->children[0xA]->children[0x2]->data, "3rd");
 }
 
+void test_memory(){
+    printf("-----Memory----------------\n");
+    memStats before, after;
+    memRead(&before);
+    node* root = NULL;
+    char key[FLUXHEXASIZE + 1];
+    for (int i=0; i<1000; i++){
+        snprintf(key, sizeof(key), "0A%06X0000000200500001", (i * 7919) & 0xFFFFFF);
+        node* n = insert(root, key);
+        if ( root == NULL ) root = n;
+        n->data = key;
+    }
+    memRead(&after);
+    // the splits of the insertions are freed, the nodes and their keys stay in the tree
+    assert(after.current[MEMOTHER] == before.current[MEMOTHER] && after.peak[MEMOTHER] > before.current[MEMOTHER]);
+    assert(after.current[MEMRADIX] > before.current[MEMRADIX]);
+    printf("1000 keys: %llu bytes of nodes and keys\n", (unsigned long long)(after.current[MEMRADIX] - before.current[MEMRADIX]));
+}
+
 int main(){
+    memAccounting();
+    test_memory();
     test_Split();
     radix_test();
 
@@ -590,6 +604,6 @@ int main(){
     return 0;
 }
 
-// gcc -o radix packet.o list.o radix.c -g -D__UNITTEST_RADIX__ -D__UNITTEST__ && ./radix
+// gcc -o radix pool.o packet.o radix.c -g -D__UNITTEST_RADIX__ -D__UNITTEST__ && ./radix
 
 #endif
@@ -0,0 +1,266 @@
+/**
+ * @file radixfixed.h
+ * @author Sebastien Galvagno
+ * @brief Radix trees generated for a fixed key width and fan-out
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * RADIXFIXED_DECLARE(name, words) declares the tree nameTree on keys of words 32 bits words,
+ * RADIXFIXED_DEFINE(name, words, bits) generates its functions for a fan-out of 2^bits children (bits: 2, 4 or 8).
+ * The digits are read from the most significant bits of the first word: the walk is in the order of the keys.
+ *
+ * A key is a leaf as long as no other key shares its prefix: the depth is the length of the
+ * distinct prefix, not the width of the key. The width and the fan-out are constants: the digits
+ * are shifts and masks of constants, the descent loop is unrolled by the compiler.
+ *
+ * A cursor gives the keys in order one by one: two trees on the same keys are read side by side
+ * like two sorted lists.
+ */
+#ifndef __SG__CHIMERE_RADIXFIXED_H__
+#define __SG__CHIMERE_RADIXFIXED_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "SG_Types.h"
+#include "pool.h"
+
+/**
+ * @brief the function called for each key of a walk
+ *
+ * @param key the key
+ * @param data the data of the key
+ * @param ctx the context of the walk
+ * @return int 0 to continue, non zero to stop the walk
+ */
+typedef int (*radixFixedFn)(const UInt32* key, void* data, void* ctx);
+
+// the digit of a key at a level
+#define RADIXFIXED_DIGIT(key, level, bits) \
+    (((key)[((level) * (bits)) / 32] >> (32 - (bits) - ((level) * (bits)) % 32)) & ((1u << (bits)) - 1))
+
+// a child is a node, or a leaf with the lowest bit set
+#define RADIXFIXED_ISLEAF(p) ((uintptr_t)(p) & 1)
+#define RADIXFIXED_LEAF(p) ((void*)((uintptr_t)(p) & ~(uintptr_t)1))
+
+#define RADIXFIXED_DECLARE(NAME, WORDS) \
+typedef struct { \
+    void* root; \
+    UInt64 nodes; \
+    UInt64 leaves; \
+} NAME##Tree; \
+/* the data of the key, NULL for a new key - NULL if out of memory */ \
+void** NAME##Insert(NAME##Tree* tree, const UInt32* key); \
+/* the data of the key, NULL when the key is not in the tree */ \
+void** NAME##Find(const NAME##Tree* tree, const UInt32* key); \
+/* remove a key: a node left with a single leaf is replaced by the leaf */ \
+void NAME##Remove(NAME##Tree* tree, const UInt32* key); \
+/* the keys beginning with the first bits of prefix (rounded down to a digit), in order */ \
+int NAME##Walk(const NAME##Tree* tree, const UInt32* prefix, int bits, radixFixedFn fn, void* ctx); \
+/* the keys in order, one by one: the path from the root, the next child of each node */ \
+typedef struct { \
+    void* path[(WORDS) * 16 + 1]; \
+    int next[(WORDS) * 16 + 1]; \
+    int depth; \
+} NAME##Cursor; \
+/* start a cursor on the first key - the tree is not modified until the end of the cursor */ \
+void NAME##CursorStart(NAME##Cursor* cursor, const NAME##Tree* tree); \
+/* the next key and its data, 0 after the last key */ \
+int NAME##CursorNext(NAME##Cursor* cursor, const UInt32** key, void** data); \
+/* the memory of the nodes and the leaves */ \
+UInt64 NAME##Memory(const NAME##Tree* tree); \
+/* free the nodes and the leaves */ \
+void NAME##Free(NAME##Tree* tree);
+
+#define RADIXFIXED_DEFINE(NAME, WORDS, BITS) \
+typedef struct { \
+    UInt32 key[WORDS]; \
+    void* data; \
+} NAME##Leaf; \
+typedef struct { \
+    void* child[1 << (BITS)]; \
+} NAME##Node; \
+\
+enum { NAME##Depth = (WORDS) * 32 / (BITS) }; \
+\
+static inline int NAME##Equal(const UInt32* a, const UInt32* b){ \
+    UInt32 diff = 0; \
+    for (int i=0; i<(WORDS); i++) diff |= a[i] ^ b[i]; \
+    return diff == 0; \
+} \
+\
+static NAME##Leaf* NAME##NewLeaf(NAME##Tree* tree, const UInt32* key){ \
+    NAME##Leaf* leaf = (NAME##Leaf*)poolAllocTag(sizeof(NAME##Leaf), MEMRADIX); \
+    if ( leaf == NULL ) return NULL; \
+    memcpy(leaf->key, key, sizeof(leaf->key)); \
+    leaf->data = NULL; \
+    tree->leaves++; \
+    return leaf; \
+} \
+\
+void** NAME##Insert(NAME##Tree* tree, const UInt32* key){ \
+    void** slot = &tree->root; \
+    for (int level=0; level<=NAME##Depth; level++){ \
+        void* p = *slot; \
+        if ( p == NULL ){ \
+            NAME##Leaf* leaf = NAME##NewLeaf(tree, key); \
+            if ( leaf == NULL ) return NULL; \
+            *slot = (void*)((uintptr_t)leaf | 1); \
+            return &leaf->data; \
+        } \
+        if ( RADIXFIXED_ISLEAF(p) ){ \
+            NAME##Leaf* leaf = (NAME##Leaf*)RADIXFIXED_LEAF(p); \
+            if ( NAME##Equal(leaf->key, key) ) return &leaf->data; \
+            /* the leaf goes down one level: the next digit may separate the keys */ \
+            NAME##Node* n = (NAME##Node*)poolAllocTag(sizeof(NAME##Node), MEMRADIX); \
+            if ( n == NULL ) return NULL; \
+            memset(n, 0, sizeof(NAME##Node)); \
+            n->child[RADIXFIXED_DIGIT(leaf->key, level, BITS)] = p; \
+            *slot = n; \
+            tree->nodes++; \
+            p = n; \
+        } \
+        slot = &((NAME##Node*)p)->child[RADIXFIXED_DIGIT(key, level, BITS)]; \
+    } \
+    return NULL; \
+} \
+\
+void** NAME##Find(const NAME##Tree* tree, const UInt32* key){ \
+    void* p = tree->root; \
+    _Pragma("GCC unroll 16") \
+    for (int level=0; level<NAME##Depth; level++){ \
+        if ( p == NULL || RADIXFIXED_ISLEAF(p) ) break; \
+        p = ((NAME##Node*)p)->child[RADIXFIXED_DIGIT(key, level, BITS)]; \
+    } \
+    if ( p == NULL ) return NULL; \
+    NAME##Leaf* leaf = (NAME##Leaf*)RADIXFIXED_LEAF(p); \
+    return NAME##Equal(leaf->key, key) ? &leaf->data : NULL; \
+} \
+\
+void NAME##Remove(NAME##Tree* tree, const UInt32* key){ \
+    void** path[NAME##Depth + 1]; \
+    void** slot = &tree->root; \
+    int level = 0; \
+    while ( *slot && !RADIXFIXED_ISLEAF(*slot) ){ \
+        path[level] = slot; \
+        slot = &((NAME##Node*)*slot)->child[RADIXFIXED_DIGIT(key, level, BITS)]; \
+        level++; \
+    } \
+    if ( *slot == NULL ) return; \
+    NAME##Leaf* leaf = (NAME##Leaf*)RADIXFIXED_LEAF(*slot); \
+    if ( !NAME##Equal(leaf->key, key) ) return; \
+    poolFree(leaf); \
+    tree->leaves--; \
+    *slot = NULL; \
+    /* the nodes left empty or with a single leaf go away, from the bottom */ \
+    while ( level-- > 0 ){ \
+        NAME##Node* n = (NAME##Node*)*path[level]; \
+        void* single = NULL; \
+        int nb = 0; \
+        for (int i=0; i<(1 << (BITS)); i++){ \
+            if ( n->child[i] ){ \
+                single = n->child[i]; \
+                nb++; \
+            } \
+        } \
+        if ( nb > 1 || (nb == 1 && !RADIXFIXED_ISLEAF(single)) ) break; \
+        *path[level] = single; \
+        poolFree(n); \
+        tree->nodes--; \
+    } \
+} \
+\
+static int NAME##WalkNode(void* p, radixFixedFn fn, void* ctx){ \
+    if ( p == NULL ) return 0; \
+    if ( RADIXFIXED_ISLEAF(p) ){ \
+        NAME##Leaf* leaf = (NAME##Leaf*)RADIXFIXED_LEAF(p); \
+        return fn(leaf->key, leaf->data, ctx); \
+    } \
+    NAME##Node* n = (NAME##Node*)p; \
+    for (int i=0; i<(1 << (BITS)); i++){ \
+        int r = NAME##WalkNode(n->child[i], fn, ctx); \
+        if ( r ) return r; \
+    } \
+    return 0; \
+} \
+\
+int NAME##Walk(const NAME##Tree* tree, const UInt32* prefix, int bits, radixFixedFn fn, void* ctx){ \
+    void* p = tree->root; \
+    int digits = prefix ? bits / (BITS) : 0; \
+    for (int level=0; level<digits && p; level++){ \
+        if ( RADIXFIXED_ISLEAF(p) ){ \
+            /* a single key below this level: it has the prefix or not */ \
+            const UInt32* key = ((NAME##Leaf*)RADIXFIXED_LEAF(p))->key; \
+            for (int l=level; l<digits; l++){ \
+                if ( RADIXFIXED_DIGIT(key, l, BITS) != RADIXFIXED_DIGIT(prefix, l, BITS) ) return 0; \
+            } \
+            break; \
+        } \
+        p = ((NAME##Node*)p)->child[RADIXFIXED_DIGIT(prefix, level, BITS)]; \
+    } \
+    return NAME##WalkNode(p, fn, ctx); \
+} \
+\
+void NAME##CursorStart(NAME##Cursor* cursor, const NAME##Tree* tree){ \
+    cursor->depth = 0; \
+    if ( tree->root == NULL ) return; \
+    cursor->path[0] = tree->root; \
+    cursor->next[0] = 0; \
+    cursor->depth = 1; \
+} \
+\
+int NAME##CursorNext(NAME##Cursor* cursor, const UInt32** key, void** data){ \
+    while ( cursor->depth > 0 ){ \
+        int d = cursor->depth - 1; \
+        void* p = cursor->path[d]; \
+        if ( RADIXFIXED_ISLEAF(p) ){ \
+            NAME##Leaf* leaf = (NAME##Leaf*)RADIXFIXED_LEAF(p); \
+            cursor->depth--; \
+            *key = leaf->key; \
+            *data = leaf->data; \
+            return 1; \
+        } \
+        NAME##Node* n = (NAME##Node*)p; \
+        int i = cursor->next[d]; \
+        while ( i < (1 << (BITS)) && n->child[i] == NULL ) i++; \
+        if ( i == (1 << (BITS)) ){ \
+            cursor->depth--; \
+            continue; \
+        } \
+        cursor->next[d] = i + 1; \
+        cursor->path[d + 1] = n->child[i]; \
+        cursor->next[d + 1] = 0; \
+        cursor->depth++; \
+    } \
+    return 0; \
+} \
+\
+UInt64 NAME##Memory(const NAME##Tree* tree){ \
+    return tree->nodes * sizeof(NAME##Node) + tree->leaves * sizeof(NAME##Leaf); \
+} \
+\
+static void NAME##FreeNode(void* p){ \
+    if ( p == NULL ) return; \
+    if ( !RADIXFIXED_ISLEAF(p) ){ \
+        NAME##Node* n = (NAME##Node*)p; \
+        for (int i=0; i<(1 << (BITS)); i++) NAME##FreeNode(n->child[i]); \
+    } \
+    poolFree(RADIXFIXED_LEAF(p)); \
+} \
+\
+void NAME##Free(NAME##Tree* tree){ \
+    NAME##FreeNode(tree->root); \
+    memset(tree, 0, sizeof(NAME##Tree)); \
+}
+
+// the flux key: source, destination, source port and destination port
+RADIXFIXED_DECLARE(radix96, 3)
+// the aggregation keys: an address or a port
+RADIXFIXED_DECLARE(radix32, 1)
+// the aggregation keys: a pair of addresses
+RADIXFIXED_DECLARE(radix64, 2)
+// the IPv6 flux key: 2 addresses of 128 bits and the ports
+RADIXFIXED_DECLARE(radix288, 9)
+
+#endif
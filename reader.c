@@ -0,0 +1,423 @@
+/**
+ * @file reader.c
+ * @author Sebastien Galvagno
+ * @brief Read a stream with large read() calls
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * No stdio: a read() fills a whole buffer (or what the pipe has) and the lines are found with memchr,
+ * without a lock per line. The reader thread empties the pipe while the lines are parsed,
+ * so the writer of the pipe is not blocked by the parser.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __UNITTEST_READER__
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#endif
+
+#include "reader.h"
+#include "decompress.h"
+#include "pool.h"
+
+typedef struct {
+    char* data;
+    size_t size;
+    int full;
+} readSlot;
+
+typedef struct {
+    int fd;
+    readSlot slots[READRING];
+    int eof;
+    int error;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} readRing;
+
+static ssize_t readFull(int fd, char* data, size_t size){
+    ssize_t n;
+    do {
+        n = read(fd, data, size);
+    } while ( n < 0 && errno == EINTR );
+    return n;
+}
+
+/**
+ * @brief the reader thread: the slots are filled in order, slot 0 is filled before the thread starts.
+ * It is cancelled only in read(), never with the lock of the ring
+ */
+static void* readerThread(void* arg){
+    readRing* ring = (readRing*)arg;
+    int i = 1 % READRING;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    for (;;){
+        readSlot* slot = &ring->slots[i];
+        pthread_mutex_lock(&ring->lock);
+        while ( slot->full && !ring->stop ) pthread_cond_wait(&ring->cond, &ring->lock);
+        int stop = ring->stop;
+        pthread_mutex_unlock(&ring->lock);
+        if ( stop ) break;
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        ssize_t n = readFull(ring->fd, slot->data, READBUFFER);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        pthread_mutex_lock(&ring->lock);
+        if ( n <= 0 ){
+            ring->eof = 1;
+            ring->error = n < 0;
+        } else {
+            slot->size = n;
+            slot->full = 1;
+        }
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+        if ( n <= 0 ) break;
+
+        i = (i + 1) % READRING;
+    }
+    return NULL;
+}
+
+/**
+ * @brief read a stream (a pipe, a file) until its end: a reader thread fills a ring of large
+ * buffers with read() while the lines of the previous buffers are split in place.
+ * A gzip or zstd stream is detected on the first buffer and decompressed. The idle function of the splitter
+ * is called every READIDLE ms while a plain stream has no data.
+ * 
+ * @param fd the stream
+ * @param splitter the line splitter
+ * @return int 0 at the end of the stream, the non zero return of the line function, -1 on error
+ */
+int readStream(int fd, lineSplitter* splitter){
+    readRing ring;
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = fd;
+
+    int r = 0;
+    for (int i=0; i<READRING; i++){
+        ring.slots[i].data = (char*)memAlloc(READBUFFER, MEMBUFFERS);
+        if ( ring.slots[i].data == NULL ) r = -1;
+    }
+
+    // the first bytes give the compression
+    size_t size = 0;
+    while ( r == 0 && size < 4 ){
+        ssize_t n = readFull(fd, ring.slots[0].data + size, READBUFFER - size);
+        if ( n < 0 ) r = -1;
+        if ( n <= 0 ) break;
+        size += n;
+    }
+
+    if ( r == 0 && detectCompression((UInt8*)ring.slots[0].data, size) != compressionNone ){
+        r = readCompressedStream(fd, (UInt8*)ring.slots[0].data, size, splitter);
+        for (int i=0; i<READRING; i++) memFree(ring.slots[i].data);
+        return r;
+    }
+
+    ring.slots[0].size = size;
+    ring.slots[0].full = size > 0;
+    ring.eof = size == 0;
+
+    pthread_t reader;
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.cond, NULL);
+    int started = r == 0 && !ring.eof && pthread_create(&reader, NULL, &readerThread, &ring) == 0;
+    if ( r == 0 && !ring.eof && !started ) r = -1;
+
+    for (int i=0; r == 0; i=(i+1)%READRING){
+        readSlot* slot = &ring.slots[i];
+        pthread_mutex_lock(&ring.lock);
+        while ( !slot->full && !ring.eof ){
+            if ( splitter->idle == NULL ){
+                pthread_cond_wait(&ring.cond, &ring.lock);
+                continue;
+            }
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += READIDLE * 1000000L;
+            if ( until.tv_nsec >= 1000000000L ){
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            if ( pthread_cond_timedwait(&ring.cond, &ring.lock, &until) == ETIMEDOUT ){
+                pthread_mutex_unlock(&ring.lock);
+                splitter->idle(splitter->ctx);
+                pthread_mutex_lock(&ring.lock);
+            }
+        }
+        int full = slot->full;
+        pthread_mutex_unlock(&ring.lock);
+        if ( !full ) break;
+
+        r = splitLines(splitter, slot->data, slot->size);
+
+        pthread_mutex_lock(&ring.lock);
+        slot->full = 0;
+        pthread_cond_broadcast(&ring.cond);
+        pthread_mutex_unlock(&ring.lock);
+    }
+
+    if ( started ){
+        pthread_mutex_lock(&ring.lock);
+        ring.stop = 1;
+        int eof = ring.eof;
+        pthread_cond_broadcast(&ring.cond);
+        pthread_mutex_unlock(&ring.lock);
+        // stopped before the end of the stream: the reader can be blocked in read()
+        if ( !eof ) pthread_cancel(reader);
+        pthread_join(reader, NULL);
+    }
+    if ( r == 0 && ring.error ) r = -1;
+    if ( r == 0 ) r = splitEnd(splitter);
+
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.cond);
+    for (int i=0; i<READRING; i++) memFree(ring.slots[i].data);
+    return r;
+}
+
+static ssize_t readAt(int fd, char* data, size_t size, UInt64 offset){
+    ssize_t n;
+    do {
+        n = pread(fd, data, size, (off_t)offset);
+    } while ( n < 0 && errno == EINTR );
+    return n;
+}
+
+/**
+ * @brief read the lines of a file starting in a range of bytes, with pread(): a line belongs to the range
+ * where it starts, the line before begin is skipped and the last line is read past end until its end of line.
+ * The ranges following each other give each line of the file once.
+ * 
+ * @param fd the file
+ * @param begin the first byte of the range
+ * @param end the byte after the range
+ * @param splitter the line splitter
+ * @return int 0 at the end of the range, the non zero return of the line function, -1 on error
+ */
+int readRange(int fd, UInt64 begin, UInt64 end, lineSplitter* splitter){
+    // a small range has a small buffer: the range and the end of its last line
+    size_t capacity = end > begin && end - begin < READBUFFER - (LINEMAX + 1) ? (size_t)(end - begin) + LINEMAX + 1 : READBUFFER;
+    char* buffer = (char*)memAlloc(capacity, MEMBUFFERS);
+    if ( buffer == NULL ) return -1;
+    int r = 0;
+
+    // the line across begin belongs to the previous range: the first line starts after the end of line from begin - 1,
+    // found in the length of a line but for an over-long line
+    UInt64 pos = begin;
+    for (UInt64 at = begin - 1; begin > 0; ){
+        ssize_t n = readAt(fd, buffer, LINEMAX + 1, at);
+        if ( n < 0 ) r = -1;
+        if ( n <= 0 ){
+            pos = end;
+            break;
+        }
+        char* eol = (char*)memchr(buffer, '\n', n);
+        if ( eol ){
+            pos = at + (eol - buffer) + 1;
+            break;
+        }
+        at += n;
+    }
+
+    // the lines starting before end, the last one up to its end of line
+    int done = r != 0 || pos >= end;
+    while ( !done ){
+        // the read stops at the end of the range and the length of a line after it
+        UInt64 want = (pos < end ? end - pos : 0) + LINEMAX + 1;
+        ssize_t n = readAt(fd, buffer, want < capacity ? (size_t)want : capacity, pos);
+        if ( n < 0 ) r = -1;
+        if ( n <= 0 ) break;
+        size_t size = n;
+        if ( pos + size >= end ){
+            size_t from = pos + 1 >= end ? 0 : end - 1 - pos;
+            char* eol = (char*)memchr(buffer + from, '\n', size - from);
+            if ( eol ){
+                size = eol - buffer + 1;
+                done = 1;
+            }
+        }
+        r = splitLines(splitter, buffer, size);
+        if ( r ) break;
+        pos += size;
+    }
+    if ( r == 0 ) r = splitEnd(splitter);
+    memFree(buffer);
+    return r;
+}
+
+
+#ifdef __UNITTEST_READER__
+
+static UInt64 nbLines, sumSeq;
+
+int count(char* line, void* ctx){
+    (void)ctx;
+    char* comma = strrchr(line, ',');
+    assert(comma != NULL);
+    sumSeq += strtoull(comma + 1, NULL, 10);
+    nbLines++;
+    return 0;
+}
+
+void countIdle(void* ctx){
+    (*(UInt64*)ctx)++;
+}
+
+int stopAt(char* line, void* ctx){
+    (void)line;
+    return ++nbLines == *(UInt64*)ctx ? 3 : 0;
+}
+
+int stopLate(char* line, void* ctx){
+    (void)line;
+    (void)ctx;
+    // the reader fills the ring meanwhile and waits for a free slot
+    usleep(200000);
+    return 3;
+}
+
+#define NBLINES 300000
+
+int main(){
+    // a pipe written by a child process in small writes, the lines across the buffers
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pid_t pid = fork();
+    if ( pid == 0 ){
+        close(fds[0]);
+        char line[64];
+        for (int i=0; i<NBLINES; i++){
+            int len = sprintf(line, "10.0.%d.%d:%d,192.168.0.1:80,%d\n", (i >> 8) & 0xFF, i & 0xFF, 1000 + i % 1000, i);
+            // the last line without end of line
+            if ( i == NBLINES - 1 ) len--;
+            if ( write(fds[1], line, len) != len ) _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+
+    lineSplitter splitter;
+    splitterInit(&splitter, &count, NULL);
+    assert(readStream(fds[0], &splitter) == 0);
+    close(fds[0]);
+    assert(nbLines == NBLINES);
+    assert(sumSeq == (UInt64)NBLINES * (NBLINES - 1) / 2);
+
+    // stopped by the line function, the reader is blocked on the pipe
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], "a,1\nb,2\nc,3\nd,4\n", 16) == 16);
+    UInt64 stop = 2;
+    nbLines = 0;
+    splitterInit(&splitter, &stopAt, &stop);
+    assert(readStream(fds[0], &splitter) == 3);
+    assert(nbLines == 2);
+    close(fds[0]);
+    close(fds[1]);
+
+    // stopped while the reader waits for a free slot: it is stopped without the lock of the ring
+    assert(pipe(fds) == 0);
+    pid = fork();
+    if ( pid == 0 ){
+        close(fds[0]);
+        char block[4096];
+        for (size_t b=0; b<sizeof(block); b+=4) memcpy(block + b, "a,1\n", 4);
+        while ( write(fds[1], block, sizeof(block)) == sizeof(block) );
+        _exit(0);
+    }
+    close(fds[1]);
+    splitterInit(&splitter, &stopLate, NULL);
+    assert(readStream(fds[0], &splitter) == 3);
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    // a pipe idle between two lines: the idle function is called while the reader waits
+    assert(pipe(fds) == 0);
+    pid = fork();
+    if ( pid == 0 ){
+        close(fds[0]);
+        if ( write(fds[1], "a,1\n", 4) != 4 ) _exit(1);
+        usleep(5 * READIDLE * 1000);
+        if ( write(fds[1], "b,2\n", 4) != 4 ) _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    UInt64 idle = 0;
+    nbLines = 0;
+    sumSeq = 0;
+    splitterInit(&splitter, &count, &idle);
+    splitter.idle = &countIdle;
+    assert(readStream(fds[0], &splitter) == 0);
+    assert(nbLines == 2 && idle >= 2);
+    close(fds[0]);
+
+    // the ranges of a file, cut anywhere in the lines, give each line once
+    char path[] = "/tmp/chimere_reader_XXXXXX";
+    int file = mkstemp(path);
+    assert(file >= 0);
+    UInt64 fileSize = 0;
+    for (int i=0; i<1000; i++){
+        char line[64];
+        int len = sprintf(line, "10.0.0.%d:%d,192.168.0.1:80,%d%s", i & 0xFF, 1000 + i, i, i < 999 ? "\n" : "");
+        assert(write(file, line, len) == len);
+        fileSize += len;
+    }
+    UInt64 cuts[] = { 1, 7, 33, 4096, fileSize };
+    for (int c=0; c<5; c++){
+        nbLines = 0;
+        sumSeq = 0;
+        splitterInit(&splitter, &count, NULL);
+        for (UInt64 begin=0; begin<fileSize; begin+=cuts[c]){
+            assert(readRange(file, begin, begin + cuts[c] < fileSize ? begin + cuts[c] : fileSize, &splitter) == 0);
+        }
+        assert(nbLines == 1000 && sumSeq == 999 * 1000 / 2);
+        // the reads stop at the end of the ranges
+        assert(splitter.bytes == fileSize);
+    }
+    // an over-long line across the ends of the ranges is dropped once
+    char longLine[3 * LINEMAX];
+    memset(longLine, 'x', sizeof(longLine));
+    longLine[sizeof(longLine) - 1] = '\n';
+    assert(write(file, "\n", 1) == 1 && write(file, longLine, sizeof(longLine)) == sizeof(longLine));
+    assert(write(file, "10.0.0.1:1000,192.168.0.1:80,1000\n", 34) == 34);
+    fileSize += 1 + sizeof(longLine) + 34;
+    UInt64 longCuts[] = { 7, LINEMAX, 4096 };
+    for (int c=0; c<3; c++){
+        nbLines = 0;
+        sumSeq = 0;
+        splitterInit(&splitter, &count, NULL);
+        for (UInt64 begin=0; begin<fileSize; begin+=longCuts[c]){
+            assert(readRange(file, begin, begin + longCuts[c] < fileSize ? begin + longCuts[c] : fileSize, &splitter) == 0);
+        }
+        assert(nbLines == 1001 && sumSeq == 999 * 1000 / 2 + 1000 && splitter.overlong == 1);
+    }
+    close(file);
+    unlink(path);
+
+    // an empty stream
+    int fd = open("/dev/null", O_RDONLY);
+    nbLines = 0;
+    splitterInit(&splitter, &count, NULL);
+    assert(readStream(fd, &splitter) == 0);
+    assert(nbLines == 0);
+    close(fd);
+    return 0;
+}
+
+// gcc -o reader pool.c lines.c decompress.c reader.c -g -D__UNITTEST_READER__ -pthread && ./reader
+
+#endif
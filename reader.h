@@ -0,0 +1,47 @@
+/**
+ * @file reader.h
+ * @author Sebastien Galvagno
+ * @brief Read a stream with large read() calls
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_READER_H__
+#define __SG__CHIMERE_READER_H__
+
+#include "lines.h"
+
+// the size of a read buffer and the number of buffers of the ring
+#define READBUFFER (1 << 20)
+#define READRING 4
+// the time without data after which the idle function of the splitter is called, in ms
+#define READIDLE 100
+
+/**
+ * @brief read a stream (a pipe, a file) until its end: a reader thread fills a ring of large
+ * buffers with read() while the lines of the previous buffers are split in place.
+ * A gzip or zstd stream is detected on the first buffer and decompressed. The idle function of the splitter
+ * is called every READIDLE ms while a plain stream has no data.
+ * 
+ * @param fd the stream
+ * @param splitter the line splitter
+ * @return int 0 at the end of the stream, the non zero return of the line function, -1 on error
+ */
+int readStream(int fd, lineSplitter* splitter);
+
+/**
+ * @brief read the lines of a file starting in a range of bytes, with pread(): a line belongs to the range
+ * where it starts, the line before begin is skipped and the last line is read past end until its end of line.
+ * The ranges following each other give each line of the file once.
+ * 
+ * @param fd the file
+ * @param begin the first byte of the range
+ * @param end the byte after the range
+ * @param splitter the line splitter
+ * @return int 0 at the end of the range, the non zero return of the line function, -1 on error
+ */
+int readRange(int fd, UInt64 begin, UInt64 end, lineSplitter* splitter);
+
+#endif
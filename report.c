@@ -0,0 +1,647 @@
+/**
+ * @file report.c
+ * @author Sebastien Galvagno
+ * @brief The final report of the flux table, ranked and formatted by several threads
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The flux of the store are copied in an array and sorted with compareFlux: the ties are broken
+ * by the keys, so a report does not depend on the threads or the order of the files. The IPv6 flux are sorted apart
+ * and merged line by line. The report is formatted by windows of chunks: the threads format the chunks of a window,
+ * the chunks are written in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __UNITTEST_REPORT__
+#include <assert.h>
+#include <arpa/inet.h>
+#endif
+
+#include "report.h"
+#include "pool.h"
+
+/**
+ * @brief a parallel loop: the threads take the tasks 0 to nbTasks-1 one by one, the calling thread is one of them
+ */
+typedef struct {
+    void (*task)(void* ctx, int i);
+    void* ctx;
+    int nbTasks;
+    int next;
+} parallelLoop;
+
+static void* parallelThread(void* arg){
+    parallelLoop* loop = (parallelLoop*)arg;
+    int i;
+    while ( (i = __atomic_fetch_add(&loop->next, 1, __ATOMIC_RELAXED)) < loop->nbTasks ){
+        loop->task(loop->ctx, i);
+    }
+    return NULL;
+}
+
+static void parallelFor(int threads, int nbTasks, void (*task)(void* ctx, int i), void* ctx){
+    parallelLoop loop = { .task = task, .ctx = ctx, .nbTasks = nbTasks, .next = 0 };
+    if ( threads > nbTasks ) threads = nbTasks;
+    pthread_t ids[threads > 1 ? threads - 1 : 1];
+    int nbIds = 0;
+    for (int t=1; t<threads; t++){
+        if ( pthread_create(&ids[nbIds], NULL, &parallelThread, &loop) == 0 ) nbIds++;
+    }
+    parallelThread(&loop);
+    for (int t=0; t<nbIds; t++) pthread_join(ids[t], NULL);
+}
+
+static int compareEntry(const void* a, const void* b){
+    return compareFlux(*(fromtopacket* const*)a, *(fromtopacket* const*)b);
+}
+
+typedef struct {
+    fromtopacket** from;
+    fromtopacket** to;
+    size_t nb;
+    size_t width;       // the runs to merge, or to sort in the first pass
+    int parts;          // the number of tasks of a merge
+} sortJob;
+
+static void sortRun(void* ctx, int i){
+    sortJob* job = (sortJob*)ctx;
+    size_t start = i * job->width;
+    size_t end = start + job->width < job->nb ? start + job->width : job->nb;
+    qsort(job->from + start, end - start, sizeof(fromtopacket*), &compareEntry);
+}
+
+/**
+ * @brief the number of items of a taken in the k first items of the merge of a and b
+ */
+static size_t coRank(size_t k, fromtopacket** a, size_t nbA, fromtopacket** b, size_t nbB){
+    size_t low = k > nbB ? k - nbB : 0;
+    size_t high = k < nbA ? k : nbA;
+    while ( low < high ){
+        size_t i = low + (high - low) / 2;
+        // a[i] is before b[k-i-1]: more items of a
+        if ( compareFlux(a[i], b[k - i - 1]) <= 0 ) low = i + 1;
+        else high = i;
+    }
+    return low;
+}
+
+static void mergePart(void* ctx, int task){
+    sortJob* job = (sortJob*)ctx;
+    size_t pair = task / job->parts;
+    int part = task % job->parts;
+
+    size_t start = pair * 2 * job->width;
+    size_t middle = start + job->width < job->nb ? start + job->width : job->nb;
+    size_t end = middle + job->width < job->nb ? middle + job->width : job->nb;
+    fromtopacket** a = job->from + start;
+    fromtopacket** b = job->from + middle;
+    size_t nbA = middle - start, nbB = end - middle, total = nbA + nbB;
+
+    // the part of the output written by this task
+    size_t k0 = total * part / job->parts;
+    size_t k1 = total * (part + 1) / job->parts;
+    size_t i = coRank(k0, a, nbA, b, nbB), j = k0 - i;
+    size_t iEnd = coRank(k1, a, nbA, b, nbB), jEnd = k1 - iEnd;
+
+    fromtopacket** out = job->to + start + k0;
+    while ( i < iEnd && j < jEnd ){
+        *out++ = compareFlux(a[i], b[j]) <= 0 ? a[i++] : b[j++];
+    }
+    while ( i < iEnd ) *out++ = a[i++];
+    while ( j < jEnd ) *out++ = b[j++];
+}
+
+/**
+ * @brief sort flux with compareFlux: the threads sort runs of the array, then merge them two by two,
+ * each merge split between the threads
+ * 
+ * @param flux the flux
+ * @param nb the number of flux
+ * @param threads the number of threads
+ * @return int 0, -1 if out of memory
+ */
+int sortFlux(fromtopacket** flux, size_t nb, int threads){
+    if ( threads < 1 ) threads = 1;
+    if ( threads == 1 || nb < 2 * REPORTCHUNK ){
+        qsort(flux, nb, sizeof(fromtopacket*), &compareEntry);
+        return 0;
+    }
+    fromtopacket** tmp = (fromtopacket**)memAlloc(nb * sizeof(fromtopacket*), MEMOTHER);
+    if ( tmp == NULL ) return -1;
+
+    // a run per thread
+    sortJob job = { .from = flux, .to = tmp, .nb = nb, .width = (nb + threads - 1) / threads };
+    parallelFor(threads, threads, &sortRun, &job);
+
+    while ( job.width < nb ){
+        int nbPairs = (int)((nb + 2 * job.width - 1) / (2 * job.width));
+        job.parts = (threads + nbPairs - 1) / nbPairs;
+        parallelFor(threads, nbPairs * job.parts, &mergePart, &job);
+        fromtopacket** swap = job.from;
+        job.from = job.to;
+        job.to = swap;
+        job.width *= 2;
+    }
+    if ( job.from != flux ) memcpy(flux, job.from, nb * sizeof(fromtopacket*));
+    memFree(tmp);
+    return 0;
+}
+
+/**
+ * @brief copy the flux of the store, in the order of the ids
+ */
+static void readStore(const flowStore* store, fromtopacket* packets, fromtopacket** flux){
+    for (UInt32 id=0; id<store->nb; id++){
+        flowStoreGet(store, id, &packets[id]);
+        flux[id] = &packets[id];
+    }
+}
+
+static int compareEntry6(const void* a, const void* b){
+    return compareFlux6(*(fromtopacket6* const*)a, *(fromtopacket6* const*)b);
+}
+
+/**
+ * @brief the order of the report across the families: by size, an IPv4 flux before an IPv6 flux of the same size
+ */
+static int compareFamilies(const fromtopacket* flux, const fromtopacket6* flux6){
+    return packetSize(flux) <= packetSize6(flux6) ? -1 : 1;
+}
+
+/**
+ * @brief the number of IPv4 flux in the k first lines of the report: the merge path of the 2 families
+ */
+static size_t coRankFamilies(size_t k, fromtopacket** a, size_t nbA, fromtopacket6** b, size_t nbB){
+    size_t low = k > nbB ? k - nbB : 0;
+    size_t high = k < nbA ? k : nbA;
+    while ( low < high ){
+        size_t i = low + (high - low) / 2;
+        if ( compareFamilies(a[i], b[k - i - 1]) <= 0 ) low = i + 1;
+        else high = i;
+    }
+    return low;
+}
+
+typedef struct {
+    fromtopacket** flux;
+    size_t nb;
+    fromtopacket6** flux6;  // the IPv6 flux, merged with the IPv4 flux line by line
+    size_t nb6;
+    size_t first;       // the first line of the window
+    char** buffers;     // a buffer per chunk of the window
+    size_t* lengths;
+} formatJob;
+
+static void formatChunk(void* ctx, int i){
+    formatJob* job = (formatJob*)ctx;
+    size_t total = job->nb + job->nb6;
+    size_t start = job->first + (size_t)i * REPORTCHUNK;
+    size_t end = start + REPORTCHUNK < total ? start + REPORTCHUNK : total;
+    // the chunk starts and ends at the same place of the merge for any number of threads
+    size_t f = coRankFamilies(start, job->flux, job->nb, job->flux6, job->nb6), g = start - f;
+    size_t fEnd = coRankFamilies(end, job->flux, job->nb, job->flux6, job->nb6), gEnd = end - fEnd;
+    char* out = job->buffers[i];
+    size_t len = 0;
+    while ( f < fEnd || g < gEnd ){
+        if ( g == gEnd || (f < fEnd && compareFamilies(job->flux[f], job->flux6[g]) <= 0) ){
+            len += packetSummary(job->flux[f++], out + len, PACKETSUMMARYSIZE);
+        } else {
+            len += packetSummary6(job->flux6[g++], out + len, PACKET6SUMMARYSIZE);
+        }
+        out[len++] = '\n';
+    }
+    job->lengths[i] = len;
+}
+
+/**
+ * @brief the report of a bidirectional table: the conversations in the order of sortConversations, merged
+ * with the IPv6 flux by size as reportFlux, formatted by the calling thread
+ */
+static int reportConversations(const fluxTable* table, FILE* out){
+    const flowStore* store = &table->flows;
+    size_t nb = store->nb, nb6 = table->flows6.nb;
+    UInt32* ids = (UInt32*)memAlloc((nb ? nb : 1) * sizeof(UInt32), MEMOTHER);
+    UInt32* sizes = (UInt32*)memAlloc((nb ? nb : 1) * sizeof(UInt32), MEMOTHER);
+    fromtopacket6** flux6 = (fromtopacket6**)memAlloc((nb6 ? nb6 : 1) * sizeof(fromtopacket6*), MEMOTHER);
+    int r = ids && sizes && flux6 ? 0 : -1;
+    if ( r == 0 ){
+        for (size_t id=0; id<nb; id++) ids[id] = (UInt32)id;
+        flowStoreSizes(store, sizes);
+        r = sortConversations(store, ids, (UInt32)nb);
+    }
+    if ( r == 0 ){
+        for (size_t f=0; f<nb6; f++) flux6[f] = &table->flows6.flows[f];
+        qsort(flux6, nb6, sizeof(fromtopacket6*), &compareEntry6);
+    }
+
+    size_t i = 0, j = 0;
+    while ( r == 0 && (i < nb || j < nb6) ){
+        // a conversation before an IPv6 flux of the same size
+        if ( j == nb6 || (i < nb && sizes[ids[i]] <= packetSize6(flux6[j])) ){
+            char summary[CONVERSATIONSUMMARYSIZE];
+            conversationSummary(store, ids[i++], summary, sizeof(summary));
+            r = fprintf(out, "%s\n", summary) < 0 ? -1 : 0;
+        } else {
+            char summary[PACKET6SUMMARYSIZE];
+            packetSummary6(flux6[j++], summary, sizeof(summary));
+            r = fprintf(out, "%s\n", summary) < 0 ? -1 : 0;
+        }
+    }
+    memFree(ids);
+    memFree(sizes);
+    memFree(flux6);
+    return r;
+}
+
+/**
+ * @brief print the flux of the table from the smallest to the biggest, the flux of the same size in the
+ * order of their keys, the IPv4 flux before the IPv6 flux: the lines are formatted by chunks by the threads
+ * and written in order. The conversations of a bidirectional table are printed with the size of each direction.
+ * 
+ * @param table the flux table
+ * @param threads the number of threads
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int reportFlux(const fluxTable* table, int threads, FILE* out){
+    if ( table->flows.bidirectional ) return reportConversations(table, out);
+    if ( threads < 1 ) threads = 1;
+    size_t nb = table->flows.nb, nb6 = table->flows6.nb;
+    if ( nb + nb6 == 0 ) return 0;
+
+    fromtopacket* packets = (fromtopacket*)memAlloc((nb ? nb : 1) * sizeof(fromtopacket), MEMOTHER);
+    fromtopacket** flux = (fromtopacket**)memAlloc((nb ? nb : 1) * sizeof(fromtopacket*), MEMOTHER);
+    fromtopacket6** flux6 = (fromtopacket6**)memAlloc((nb6 ? nb6 : 1) * sizeof(fromtopacket6*), MEMOTHER);
+    if ( packets == NULL || flux == NULL || flux6 == NULL ){
+        memFree(packets);
+        memFree(flux);
+        memFree(flux6);
+        return -1;
+    }
+    readStore(&table->flows, packets, flux);
+    // the IPv6 flux are read in their store: pointers sorted by one thread
+    for (size_t f=0; f<nb6; f++) flux6[f] = &table->flows6.flows[f];
+    qsort(flux6, nb6, sizeof(fromtopacket6*), &compareEntry6);
+    if ( sortFlux(flux, nb, threads) ){
+        memFree(packets);
+        memFree(flux);
+        memFree(flux6);
+        return -1;
+    }
+
+    // a window of 2 chunks per thread: the threads format the window, then it is written in order,
+    // the formatting and the writes do not overlap
+    int window = 2 * threads;
+    size_t total = nb + nb6;
+    formatJob job = { .flux = flux, .nb = nb, .flux6 = flux6, .nb6 = nb6, .first = 0 };
+    job.buffers = (char**)memCalloc(window, sizeof(char*), MEMOTHER);
+    job.lengths = (size_t*)memCalloc(window, sizeof(size_t), MEMOTHER);
+    int r = job.buffers && job.lengths ? 0 : -1;
+    for (int c=0; r == 0 && c<window; c++){
+        job.buffers[c] = (char*)memAlloc((size_t)REPORTCHUNK * (nb6 ? PACKET6SUMMARYSIZE : PACKETSUMMARYSIZE), MEMOTHER);
+        if ( job.buffers[c] == NULL ) r = -1;
+    }
+
+    while ( r == 0 && job.first < total ){
+        size_t chunks = (total - job.first + REPORTCHUNK - 1) / REPORTCHUNK;
+        int nbChunks = chunks < (size_t)window ? (int)chunks : window;
+        parallelFor(threads, nbChunks, &formatChunk, &job);
+        for (int c=0; c<nbChunks; c++){
+            if ( fwrite(job.buffers[c], 1, job.lengths[c], out) != job.lengths[c] ){
+                r = -1;
+                break;
+            }
+        }
+        job.first += (size_t)nbChunks * REPORTCHUNK;
+    }
+
+    for (int c=0; job.buffers && c<window; c++) memFree(job.buffers[c]);
+    memFree(job.buffers);
+    memFree(job.lengths);
+    memFree(flux);
+    memFree(flux6);
+    memFree(packets);
+    return r;
+}
+
+/**
+ * @brief the walk of the flux for the report of the sequences, and the totals
+ */
+typedef struct {
+    const fluxTable* table;
+    FILE* out;
+    UInt64 observed;
+    UInt64 gaps;
+    UInt64 duplicates;
+    UInt32 saturated;
+} sequenceWalk;
+
+static int sequenceLeaf(const UInt32* key, void* data, void* ctx){
+    (void)key;
+    sequenceWalk* w = (sequenceWalk*)ctx;
+    UInt32 id = LEAFFLOW(data);
+    fromtopacket p;
+    flowStoreGet(&w->table->flows, id, &p);
+    seqStats stats;
+    seqStatsOf(w->table->sequences, id, &stats);
+
+    char summary[PACKETSUMMARYSIZE];
+    packetSummary(&p, summary, sizeof(summary));
+    int r;
+    if ( stats.saturated ){
+        w->saturated++;
+        r = fprintf(w->out, "%s / Sature / Doublons : %u\n", summary, stats.duplicates);
+    } else {
+        r = fprintf(w->out, "%s / Vus : %llu / Trous : %u / Doublons : %u\n", summary,
+                    (unsigned long long)stats.observed, stats.gaps, stats.duplicates);
+    }
+    w->observed += stats.observed;
+    w->gaps += stats.gaps;
+    w->duplicates += stats.duplicates;
+    return r < 0 ? -1 : 0;
+}
+
+/**
+ * @brief print the sequence numbers seen in each IPv4 flux, in the order of their keys: the distinct
+ * sequence numbers, the ranges missing between the first and the last one and the duplicates, then the totals.
+ * The batch of the sequence numbers is flushed.
+ * 
+ * @param table the flux table, with its sequences
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int reportSequences(const fluxTable* table, FILE* out){
+    if ( table->sequences == NULL ) return 0;
+    seqFlush(table->sequences);
+    sequenceWalk w = { .table = table, .out = out, .observed = 0, .gaps = 0, .duplicates = 0, .saturated = 0 };
+    fprintf(out, "---- sequences ----\n");
+    if ( radix96Walk(&table->tree, NULL, 0, &sequenceLeaf, &w) ) return -1;
+    return fprintf(out, "---- %u flux / Vus : %llu / Trous : %llu / Doublons : %llu / Satures : %u ----\n", table->flows.nb,
+                   (unsigned long long)w.observed, (unsigned long long)w.gaps, (unsigned long long)w.duplicates, w.saturated) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief print the estimates of a sampling: the flux kept and the sum of their sizes multiplied by the sampling,
+ * nothing when the flux are not sampled
+ * 
+ * @param table the flux table
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int reportSample(const fluxTable* table, FILE* out){
+    if ( table->sample <= 1 ) return 0;
+    UInt64 size = 0;
+    for (UInt32 id=0; id<table->flows.nb; id++){
+        fromtopacket p;
+        flowStoreGet(&table->flows, id, &p);
+        size += packetSize(&p);
+    }
+    for (UInt32 id=0; id<table->flows6.nb; id++) size += packetSize6(&table->flows6.flows[id]);
+    UInt64 nb = (UInt64)table->flows.nb + table->flows6.nb;
+    return fprintf(out, "---- sample 1/%u: %llu flux, %llu lines of %llu / Estimation : %llu flux / Taille : %llu ----\n", table->sample,
+                   (unsigned long long)nb, (unsigned long long)table->lines, (unsigned long long)(table->lines + table->sampledOut),
+                   (unsigned long long)(nb * table->sample), (unsigned long long)(size * table->sample)) < 0 ? -1 : 0;
+}
+
+
+#ifdef __UNITTEST_REPORT__
+
+#define NBFLUX 200000
+
+static void randomFlux(fromtopacket* p){
+    memset(p, 0, sizeof(fromtopacket));
+    p->from = htonl(rand() & 0xFFFF);
+    p->to = htonl(0x0A000001);
+    p->portFrom = rand() & 0xFF;
+    p->portTo = 80;
+    p->firstPacket = 1000;
+    // few sizes: many ties
+    p->lastPacket = 1000 + rand() % 64;
+}
+
+int main(){
+    srand(7);
+    fromtopacket* packets = (fromtopacket*)malloc(NBFLUX * sizeof(fromtopacket));
+    fromtopacket** expected = (fromtopacket**)malloc(NBFLUX * sizeof(fromtopacket*));
+    fromtopacket** flux = (fromtopacket**)malloc(NBFLUX * sizeof(fromtopacket*));
+    for (int f=0; f<NBFLUX; f++){
+        randomFlux(&packets[f]);
+        expected[f] = &packets[f];
+    }
+    qsort(expected, NBFLUX, sizeof(fromtopacket*), &compareEntry);
+
+    // the same order for any number of threads
+    for (int threads=1; threads<=7; threads++){
+        for (int f=0; f<NBFLUX; f++) flux[f] = &packets[f];
+        assert(sortFlux(flux, NBFLUX, threads) == 0);
+        assert(memcmp(flux, expected, NBFLUX * sizeof(fromtopacket*)) == 0);
+        for (int f=1; f<NBFLUX; f++) assert(compareFlux(flux[f - 1], flux[f]) <= 0);
+    }
+
+    char summary[PACKETSUMMARYSIZE];
+
+    // a table: single packets (size 0) in the order of the reading and a few bigger flux
+    fluxTable table;
+    memset(&table, 0, sizeof(table));
+    char line[64];
+    for (int f=0; f<3 * REPORTCHUNK; f++){
+        snprintf(line, sizeof(line), "10.%d.%d.%d:%d,10.0.0.1:80,1000", (f * 7919) >> 16 & 0xFF, (f * 7919) >> 8 & 0xFF, (f * 7919) & 0xFF, 1000 + f % 7);
+        assert(processLine(&table, line) == 0);
+    }
+    for (int f=0; f<100; f++){
+        snprintf(line, sizeof(line), "10.%d.%d.%d:%d,10.0.0.1:80,%d", (f * 7919) >> 16 & 0xFF, (f * 7919) >> 8 & 0xFF, (f * 7919) & 0xFF, 1000 + f % 7, 1001 + f % 10);
+        assert(processLine(&table, line) == 0);
+    }
+
+    // the same report for any number of threads, the lines of printPacketSummary
+    char* reports[2];
+    size_t sizes[2];
+    for (int r=0; r<2; r++){
+        FILE* out = open_memstream(&reports[r], &sizes[r]);
+        assert(reportFlux(&table, r ? 5 : 1, out) == 0);
+        fclose(out);
+    }
+    assert(sizes[0] == sizes[1] && memcmp(reports[0], reports[1], sizes[0]) == 0);
+    assert(strncmp(reports[0], "Flux 10.0.4.40:1001,10.0.0.1:80 / Taille : 0\n", 45) == 0);
+    assert(strcmp(reports[0] + sizes[0] - 50, "Flux 10.11.246.109:1001,10.0.0.1:80 / Taille : 10\n") == 0);
+
+    // the top is the end of the report, the biggest first
+    fromtopacket top[3];
+    assert(topFlux(&table, 3, top) == 3);
+    packetSummary(&top[0], summary, sizeof(summary));
+    assert(strcmp(summary, "Flux 10.11.246.109:1001,10.0.0.1:80 / Taille : 10") == 0);
+    packetSummary(&top[2], summary, sizeof(summary));
+    assert(strcmp(summary, "Flux 10.9.139.193:1002,10.0.0.1:80 / Taille : 10") == 0);
+
+    // a range of 2^31 sequence numbers or more is the biggest flux, not a negative size
+    fluxTable wide;
+    memset(&wide, 0, sizeof(wide));
+    const char* wideLines[] = { "10.0.0.1:1000,10.0.0.2:80,4294967295", "10.0.0.1:1000,10.0.0.2:80,2147483647",
+                                "10.0.0.3:1000,10.0.0.2:80,100", "10.0.0.3:1000,10.0.0.2:80,110" };
+    for (int l=0; l<4; l++){
+        snprintf(line, sizeof(line), "%s", wideLines[l]);
+        assert(processLine(&wide, line) == 0);
+    }
+    fromtopacket big, small;
+    assert(topFlux(&wide, 2, top) == 2);
+    big = top[0];
+    small = top[1];
+    assert(packetSize(&big) == 2147483648u && packetSize(&small) == 10);
+    assert(compareFlux(&big, &small) > 0 && compareFlux(&small, &big) < 0);
+    char* wideReport;
+    size_t wideSize;
+    FILE* wideOut = open_memstream(&wideReport, &wideSize);
+    assert(reportFlux(&wide, 2, wideOut) == 0);
+    fclose(wideOut);
+    assert(strcmp(wideReport, "Flux 10.0.0.3:1000,10.0.0.2:80 / Taille : 10\n"
+                              "Flux 10.0.0.1:1000,10.0.0.2:80 / Taille : 2147483648\n") == 0);
+    free(wideReport);
+    freeFlux(&wide);
+
+    free(reports[0]);
+    free(reports[1]);
+
+    // the IPv6 flux in the same report: an IPv4 flux before an IPv6 flux of the same size
+    for (int f=0; f<2 * REPORTCHUNK; f++){
+        snprintf(line, sizeof(line), "[2001:db8::%x]:%d,[2001:db8::1]:80,1000", f, 1000 + f % 7);
+        assert(processLine(&table, line) == 0);
+    }
+    assert(processLine(&table, "[2001:db8::5]:1005,[2001:db8::1]:80,1010") == 0);
+    assert(processLine(&table, "[2001:db8::5]:1005,[2001:db8::1]:80,1020") == 0);
+    assert(table.flows6.nb == 2 * REPORTCHUNK);
+    for (int r=0; r<2; r++){
+        FILE* out = open_memstream(&reports[r], &sizes[r]);
+        assert(reportFlux(&table, r ? 5 : 1, out) == 0);
+        fclose(out);
+    }
+    assert(sizes[0] == sizes[1] && memcmp(reports[0], reports[1], sizes[0]) == 0);
+    assert(strncmp(reports[0], "Flux 10.0.4.40:1001,10.0.0.1:80 / Taille : 0\n", 45) == 0);
+    const char* v6 = strstr(reports[0], "Flux [2001:db8::]:1000,[2001:db8::1]:80 / Taille : 0\n");
+    assert(v6 && strstr(reports[0], "Flux 10.9.255.196:1000,10.0.0.1:80 / Taille : 0\n") < v6);
+    assert(strcmp(reports[0] + sizes[0] - 55, "Flux [2001:db8::5]:1005,[2001:db8::1]:80 / Taille : 20\n") == 0);
+    size_t lines = 0;
+    for (size_t c=0; c<sizes[0]; c++) lines += reports[0][c] == '\n';
+    assert(lines == table.flows.nb + table.flows6.nb);
+
+    freeFlux(&table);
+    free(reports[0]);
+    free(reports[1]);
+
+    // the sequences: a hole, a retransmission, the flux in the order of their keys
+    memset(&table, 0, sizeof(table));
+    table.sequences = seqTableCreate();
+    const char* packets2[] = { "10.0.0.2:1000,10.0.0.1:80,5", "10.0.0.2:1000,10.0.0.1:80,6", "10.0.0.2:1000,10.0.0.1:80,9",
+                               "10.0.0.1:1000,10.0.0.1:80,7" };
+    for (int l=0; l<4; l++){
+        snprintf(line, sizeof(line), "%s", packets2[l]);
+        assert(processLine(&table, line) == 0);
+    }
+    snprintf(line, sizeof(line), "10.0.0.2:1000,10.0.0.1:80,6");
+    assert(processLine(&table, line) == 0 && table.repeated == 1);
+    FILE* out = open_memstream(&reports[0], &sizes[0]);
+    assert(reportSequences(&table, out) == 0);
+    fclose(out);
+    assert(strcmp(reports[0], "---- sequences ----\n"
+                              "Flux 10.0.0.1:1000,10.0.0.1:80 / Taille : 0 / Vus : 1 / Trous : 0 / Doublons : 0\n"
+                              "Flux 10.0.0.2:1000,10.0.0.1:80 / Taille : 4 / Vus : 3 / Trous : 1 / Doublons : 1\n"
+                              "---- 2 flux / Vus : 4 / Trous : 1 / Doublons : 1 / Satures : 0 ----\n") == 0);
+    freeFlux(&table);
+    free(reports[0]);
+
+    // the conversations: the 2 directions under one key, the first packet of a conversation going back
+    memset(&table, 0, sizeof(table));
+    setBidirectional(&table);
+    const char* packets3[] = { "10.0.0.2:1000,10.0.0.1:80,5000", "10.0.0.1:80,10.0.0.2:1000,100", "10.0.0.1:80,10.0.0.2:1000,400",
+                               "10.0.0.2:1000,10.0.0.1:80,5010", "10.0.0.3:2000,10.0.0.4:22,7", "10.0.0.3:2000,10.0.0.4:22,9",
+                               "[2001:db8::1]:443,[2001:db8::2]:5000,1", "[2001:db8::1]:443,[2001:db8::2]:5000,3" };
+    for (int l=0; l<8; l++){
+        snprintf(line, sizeof(line), "%s", packets3[l]);
+        assert(processLine(&table, line) == 0);
+    }
+    assert(table.flows.nb == 2 && table.reordered == 0 && table.repeated == 0);
+    out = open_memstream(&reports[0], &sizes[0]);
+    assert(reportFlux(&table, 4, out) == 0);
+    fclose(out);
+    assert(strcmp(reports[0], "Flux 10.0.0.3:2000,10.0.0.4:22 / Taille : 2 / Aller : 2 / Retour : 0\n"
+                              "Flux [2001:db8::1]:443,[2001:db8::2]:5000 / Taille : 2\n"
+                              "Flux 10.0.0.1:80,10.0.0.2:1000 / Taille : 310 / Aller : 300 / Retour : 10\n") == 0);
+    free(reports[0]);
+    UInt32 ids[2];
+    assert(topConversations(&table, 2, ids) == 2);
+    conversationSummary(&table.flows, ids[0], line, sizeof(line));
+    assert(strncmp(line, "Flux 10.0.0.1:80,10.0.0.2:1000 / Taille : 310", 45) == 0);
+
+    // merged by direction: a direction seen in one table only is copied
+    fluxTable merged;
+    memset(&merged, 0, sizeof(merged));
+    setBidirectional(&merged);
+    snprintf(line, sizeof(line), "10.0.0.4:22,10.0.0.3:2000,50");
+    assert(processLine(&merged, line) == 0);
+    snprintf(line, sizeof(line), "10.0.0.2:1000,10.0.0.1:80,4990");
+    assert(processLine(&merged, line) == 0);
+    assert(mergeFlux(&merged, &table) == 0 && merged.flows.nb == 2);
+    char text[CONVERSATIONSUMMARYSIZE];
+    conversationSummary(&merged.flows, 0, text, sizeof(text));
+    assert(strcmp(text, "Flux 10.0.0.3:2000,10.0.0.4:22 / Taille : 2 / Aller : 2 / Retour : 0") == 0);
+    conversationSummary(&merged.flows, 1, text, sizeof(text));
+    assert(strcmp(text, "Flux 10.0.0.1:80,10.0.0.2:1000 / Taille : 320 / Aller : 300 / Retour : 20") == 0);
+    freeFlux(&merged);
+    freeFlux(&table);
+
+    // a sampling of 1 in 4: the flux kept have their exact size, the estimates are close to the full table
+    fluxTable full, sampled;
+    memset(&full, 0, sizeof(full));
+    memset(&sampled, 0, sizeof(sampled));
+    setSampling(&sampled, 4);
+    for (int f=0; f<2 * 20000; f++){
+        for (int t=0; t<2; t++){
+            int g = f % 20000;
+            snprintf(line, sizeof(line), "10.1.%d.%d:%d,10.0.0.1:80,%d", (g >> 8) % 80, g & 0xFF, 1000 + (g >> 8) / 80, f < 20000 ? 1000 : 1000 + f % 10);
+            assert(processLine(t ? &sampled : &full, line) == 0);
+        }
+    }
+    assert(sampled.lines + sampled.sampledOut == full.lines);
+    UInt64 fullSize = 0, sampledSize = 0;
+    for (UInt32 id=0; id<sampled.flows.nb; id++){
+        fromtopacket p;
+        flowStoreGet(&sampled.flows, id, &p);
+        UInt32 key[FLUXKEYWORDS];
+        fluxKey(&p, key);
+        fromtopacket q;
+        flowStoreGet(&full.flows, LEAFFLOW(*radix96Find(&full.tree, key)), &q);
+        assert(packetSize(&p) == packetSize(&q));
+        sampledSize += packetSize(&p);
+    }
+    for (UInt32 id=0; id<full.flows.nb; id++){
+        fromtopacket q;
+        flowStoreGet(&full.flows, id, &q);
+        fullSize += packetSize(&q);
+    }
+    assert(sampled.flows.nb * 4 > full.flows.nb * 0.9 && sampled.flows.nb * 4 < full.flows.nb * 1.1);
+    assert(sampledSize * 4 > fullSize * 0.9 && sampledSize * 4 < fullSize * 1.1);
+    out = open_memstream(&reports[0], &sizes[0]);
+    assert(reportSample(&full, out) == 0 && reportSample(&sampled, out) == 0);
+    fclose(out);
+    char expectedLine[160];
+    snprintf(expectedLine, sizeof(expectedLine), "---- sample 1/4: %u flux, %llu lines of %llu / Estimation : %u flux / Taille : %llu ----\n",
+             sampled.flows.nb, (unsigned long long)sampled.lines, (unsigned long long)full.lines, 4 * sampled.flows.nb, (unsigned long long)(4 * sampledSize));
+    assert(strcmp(reports[0], expectedLine) == 0);
+    freeFlux(&full);
+    freeFlux(&sampled);
+    free(reports[0]);
+    free(expected);
+    free(flux);
+    free(packets);
+    printf("report: OK\n");
+    return 0;
+}
+
+// gcc -o report pool.c packet.c radixfixed.c aggregate.c flowstore.c seqmap.c quarantine.c metrics.c shmflux.c query.c flux.c report.c -g -D__UNITTEST_REPORT__ -pthread -lrt && ./report
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file report.h
+ * @author Sebastien Galvagno
+ * @brief The final report of the flux table, ranked and formatted by several threads
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_REPORT_H__
+#define __SG__CHIMERE_REPORT_H__
+
+#include <stdio.h>
+#include "SG_Types.h"
+#include "flux.h"
+
+// the number of flux formatted by a task
+#define REPORTCHUNK 16384
+
+/**
+ * @brief sort flux with compareFlux: the threads sort runs of the array, then merge them two by two,
+ * each merge split between the threads
+ * 
+ * @param flux the flux
+ * @param nb the number of flux
+ * @param threads the number of threads
+ * @return int 0, -1 if out of memory
+ */
+int sortFlux(fromtopacket** flux, size_t nb, int threads);
+
+/**
+ * @brief print the flux of the table from the smallest to the biggest, the flux of the same size in the
+ * order of their keys: the lines are formatted by chunks by the threads and written in order.
+ * The conversations of a bidirectional table are printed with the size of each direction.
+ * 
+ * @param table the flux table
+ * @param threads the number of threads
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int reportFlux(const fluxTable* table, int threads, FILE* out);
+
+/**
+ * @brief print the sequence numbers seen in each IPv4 flux, in the order of their keys: the distinct
+ * sequence numbers, the ranges missing between the first and the last one and the duplicates, then the totals.
+ * The batch of the sequence numbers is flushed.
+ * 
+ * @param table the flux table, with its sequences
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int reportSequences(const fluxTable* table, FILE* out);
+
+/**
+ * @brief print the estimates of a sampling: the flux kept and the sum of their sizes multiplied by the sampling,
+ * nothing when the flux are not sampled
+ * 
+ * @param table the flux table
+ * @param out the output
+ * @return int 0, -1 on error
+ */
+int reportSample(const fluxTable* table, FILE* out);
+
+#endif
@@ -0,0 +1,273 @@
+/**
+ * @file rollup.c
+ * @author Sebastien Galvagno
+ * @brief Subnet queries and rollups on the radix tree
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The keys of the radix tree begin with the source address then the destination address (see fluxKey()):
+ * the flux of a source subnet are a sub tree, and the flux of a source prefix or of a pair are consecutive
+ * in the order of the keys. A rollup is computed in one walk, without sorting.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#ifdef __UNITTEST_ROLLUP__
+#include <assert.h>
+#endif
+
+#include "rollup.h"
+#include "packet.h"
+
+/**
+ * @brief parse a subnet "10.1.0.0/16" - a single address is a /32
+ * 
+ * @param str the string to parse
+ * @param s the subnet
+ * @return int 0 on success, -1 if the string is not a subnet
+ */
+int parseSubnet(const char* str, subnet* s){
+    char ip[sizeof(IPV4MASK)];
+    const char* slash = strchr(str, '/');
+    size_t size = slash ? (size_t)(slash - str) : strlen(str);
+    if ( size >= sizeof(ip) ) return -1;
+    memcpy(ip, str, size);
+    ip[size] = '\0';
+
+    struct in_addr addr;
+    if ( inet_aton(ip, &addr) == 0 ) return -1;
+
+    int bits = 32;
+    if ( slash ){
+        char* end;
+        bits = (int)strtol(slash + 1, &end, 10);
+        if ( end == slash + 1 || *end != '\0' || bits < 0 || bits > 32 ) return -1;
+    }
+    s->bits = bits;
+    s->net = ntohl(addr.s_addr) & (bits ? 0xFFFFFFFFu << (32 - bits) : 0);
+    return 0;
+}
+
+/**
+ * @brief the first bits of a 64 bits value
+ */
+static UInt64 prefix64(UInt64 value, int bits){
+    return bits >= 64 ? value : bits <= 0 ? 0 : value & (~0ULL << (64 - bits));
+}
+
+/**
+ * @brief the state of a walk of the sub tree of a subnet
+ */
+typedef struct {
+    const flowStore* store;
+    const subnet* s;
+    void (*fn)(void*);  // the function of printSubnet
+    int bits;           // the prefix of printRollup
+    FILE* out;          // the output of printRollup
+    UInt64 group;
+    UInt64 nb;
+    UInt64 size;
+} rollupWalk;
+
+/**
+ * @brief a key of the subnet - the digits of the sub tree may cover more than the subnet
+ */
+static int inSubnet(const UInt32* key, const subnet* s){
+    return s == NULL || prefix64((UInt64)key[0] << 32, s->bits) == (UInt64)s->net << 32;
+}
+
+/**
+ * @brief walk the leaves of the sub tree of the subnet, in the order of the keys
+ */
+static void walkSubnet(const radix96Tree* tree, rollupWalk* w, radixFixedFn fn){
+    UInt32 prefix[FLUXKEYWORDS] = {w->s ? w->s->net : 0, 0, 0};
+    radix96Walk(tree, w->s ? prefix : NULL, w->s ? w->s->bits : 0, fn, w);
+}
+
+static int subnetLeaf(const UInt32* key, void* data, void* ctx){
+    rollupWalk* w = (rollupWalk*)ctx;
+    if ( !inSubnet(key, w->s) ) return 0;
+    fromtopacket packet;
+    flowStoreGet(w->store, LEAFFLOW(data), &packet);
+    w->fn(&packet);
+    w->nb++;
+    return 0;
+}
+
+/**
+ * @brief print the flux from a source subnet, in the order of the keys
+ * 
+ * @param tree the radix tree of the flux
+ * @param store the flux of the leaves
+ * @param s the source subnet, NULL for all the flux
+ * @param fn a function to print the packet
+ * @return UInt64 the number of flux printed
+ */
+UInt64 printSubnet(const radix96Tree* tree, const flowStore* store, const subnet* s, void(*fn)(void*)){
+    rollupWalk w = {store, s, fn, 0, NULL, 0, 0, 0};
+    walkSubnet(tree, &w, &subnetLeaf);
+    return w.nb;
+}
+
+static void printGroup(FILE* out, UInt64 key, int bits, UInt64 nb, UInt64 size){
+    UInt32 addr = htonl((UInt32)(key >> 32));
+    char src[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr, src, sizeof(src));
+
+    if ( bits <= 32 ){
+        fprintf(out, "Rollup %s/%d / Flux : %llu / Taille : %llu\n", src, bits, (unsigned long long)nb, (unsigned long long)size);
+        return;
+    }
+
+    char dst[INET_ADDRSTRLEN];
+    addr = htonl((UInt32)key);
+    inet_ntop(AF_INET, &addr, dst, sizeof(dst));
+    if ( bits == ROLLUPPAIR ){
+        fprintf(out, "Rollup %s,%s / Flux : %llu / Taille : %llu\n", src, dst, (unsigned long long)nb, (unsigned long long)size);
+    } else {
+        fprintf(out, "Rollup %s,%s/%d / Flux : %llu / Taille : %llu\n", src, dst, bits - 32, (unsigned long long)nb, (unsigned long long)size);
+    }
+}
+
+static int rollupLeaf(const UInt32* key, void* data, void* ctx){
+    rollupWalk* w = (rollupWalk*)ctx;
+    if ( !inSubnet(key, w->s) ) return 0;
+    UInt64 group = prefix64((UInt64)key[0] << 32 | key[1], w->bits);
+    if ( w->nb && group != w->group ){
+        printGroup(w->out, w->group, w->bits, w->nb, w->size);
+        w->nb = w->size = 0;
+    }
+    fromtopacket packet;
+    flowStoreGet(w->store, LEAFFLOW(data), &packet);
+    w->group = group;
+    w->nb++;
+    w->size += packetSize(&packet);
+    return 0;
+}
+
+/**
+ * @brief aggregate the flux sizes per source prefix or per (source, destination) pair in one walk of the sub tree
+ * 
+ * @param tree the radix tree of the flux
+ * @param store the flux of the leaves
+ * @param s the source subnet, NULL for all the flux
+ * @param bits the length of the prefix of the (source, destination) key: 1 to 32 for a source prefix,
+ *             33 to 64 for a source and a destination prefix - ROLLUPPAIR for the pair
+ * @param out the output
+ */
+void printRollup(const radix96Tree* tree, const flowStore* store, const subnet* s, int bits, FILE* out){
+    rollupWalk w = {store, s, NULL, bits, out, 0, 0, 0};
+    walkSubnet(tree, &w, &rollupLeaf);
+    if ( w.nb ) printGroup(out, w.group, bits, w.nb, w.size);
+}
+
+
+#ifdef __UNITTEST_ROLLUP__
+
+void test_parseSubnet(){
+    subnet s;
+    assert(parseSubnet("10.1.0.0/16", &s) == 0);
+    assert(s.net == 0x0A010000 && s.bits == 16);
+    assert(parseSubnet("10.1.2.3/12", &s) == 0);
+    assert(s.net == 0x0A000000 && s.bits == 12);
+    assert(parseSubnet("10.1.2.3", &s) == 0);
+    assert(s.net == 0x0A010203 && s.bits == 32);
+    assert(parseSubnet("10.1.2.3/33", &s) == -1);
+    assert(parseSubnet("10.1.2/", &s) == -1);
+}
+
+static radix96Tree tree;
+static flowStore store;
+
+void add(const char* from, const char* to, UInt16 portFrom, tcp_seq first, tcp_seq last){
+    fromtopacket* packet = calloc(1, sizeof(fromtopacket));
+    struct in_addr addr;
+    inet_aton(from, &addr);
+    packet->from = addr.s_addr;
+    inet_aton(to, &addr);
+    packet->to = addr.s_addr;
+    packet->portFrom = portFrom;
+    packet->portTo = 80;
+    packet->firstPacket = first;
+    packet->lastPacket = last;
+
+    UInt32 key[FLUXKEYWORDS];
+    fluxKey(packet, key);
+    *radix96Insert(&tree, key) = FLOWLEAF(flowStoreAdd(&store, packet));
+    free(packet);
+}
+
+static UInt64 count;
+void countPacket(void* data){
+    (void)data;
+    count++;
+}
+
+int main(){
+    test_parseSubnet();
+
+    add("10.1.2.3", "192.168.0.1", 1000, 0, 10);
+    add("10.1.2.3", "192.168.0.1", 1001, 0, 20);
+    add("10.1.2.3", "192.168.0.2", 1000, 0, 30);
+    add("10.1.9.3", "192.168.0.1", 1000, 0, 40);
+    add("10.2.0.1", "192.168.0.1", 1000, 0, 50);
+    add("10.17.0.1", "192.168.0.1", 1000, 0, 60);
+    add("11.0.0.1", "192.168.0.1", 1000, 0, 70);
+
+    subnet s;
+    parseSubnet("10.1.0.0/16", &s);
+    assert(printSubnet(&tree, &store, &s, &countPacket) == 4);
+    parseSubnet("10.0.0.0/12", &s);
+    assert(printSubnet(&tree, &store, &s, &countPacket) == 5);
+    parseSubnet("10.1.2.3/32", &s);
+    assert(printSubnet(&tree, &store, &s, &countPacket) == 3);
+    parseSubnet("12.0.0.0/8", &s);
+    assert(printSubnet(&tree, &store, &s, &countPacket) == 0);
+    assert(printSubnet(&tree, &store, NULL, &countPacket) == 7);
+
+    // the groups in the order of the keys, with their number of flux and their size
+    char* rollup;
+    size_t size;
+    FILE* out = open_memstream(&rollup, &size);
+    printRollup(&tree, &store, NULL, 16, out);
+    fclose(out);
+    assert(strcmp(rollup,
+        "Rollup 10.1.0.0/16 / Flux : 4 / Taille : 100\n"
+        "Rollup 10.2.0.0/16 / Flux : 1 / Taille : 50\n"
+        "Rollup 10.17.0.0/16 / Flux : 1 / Taille : 60\n"
+        "Rollup 11.0.0.0/16 / Flux : 1 / Taille : 70\n") == 0);
+    free(rollup);
+
+    out = open_memstream(&rollup, &size);
+    parseSubnet("10.0.0.0/8", &s);
+    printRollup(&tree, &store, &s, ROLLUPPAIR, out);
+    fclose(out);
+    assert(strcmp(rollup,
+        "Rollup 10.1.2.3,192.168.0.1 / Flux : 2 / Taille : 30\n"
+        "Rollup 10.1.2.3,192.168.0.2 / Flux : 1 / Taille : 30\n"
+        "Rollup 10.1.9.3,192.168.0.1 / Flux : 1 / Taille : 40\n"
+        "Rollup 10.2.0.1,192.168.0.1 / Flux : 1 / Taille : 50\n"
+        "Rollup 10.17.0.1,192.168.0.1 / Flux : 1 / Taille : 60\n") == 0);
+    free(rollup);
+
+    // a source and a destination prefix in a single source
+    out = open_memstream(&rollup, &size);
+    parseSubnet("10.1.2.3", &s);
+    printRollup(&tree, &store, &s, 32 + 30, out);
+    fclose(out);
+    assert(strcmp(rollup, "Rollup 10.1.2.3,192.168.0.0/30 / Flux : 3 / Taille : 60\n") == 0);
+    free(rollup);
+
+    printf("rollup: OK\n");
+
+    return 0;
+}
+
+// gcc -o rollup pool.c packet.c radixfixed.c flowstore.c rollup.c -g -D__UNITTEST_ROLLUP__ && ./rollup
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file rollup.h
+ * @author Sebastien Galvagno
+ * @brief Subnet queries and rollups on the radix tree
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_ROLLUP_H__
+#define __SG__CHIMERE_ROLLUP_H__
+
+#include <stdio.h>
+#include "SG_Types.h"
+#include "radixfixed.h"
+#include "flowstore.h"
+
+// the rollup on the (source, destination) pair
+#define ROLLUPPAIR 64
+
+/**
+ * @brief a source subnet, in host order
+ */
+typedef struct {
+    UInt32 net;
+    int bits;
+} subnet;
+
+/**
+ * @brief parse a subnet "10.1.0.0/16" - a single address is a /32
+ * 
+ * @param str the string to parse
+ * @param s the subnet
+ * @return int 0 on success, -1 if the string is not a subnet
+ */
+int parseSubnet(const char* str, subnet* s);
+
+/**
+ * @brief print the flux from a source subnet, in the order of the keys
+ * 
+ * @param tree the radix tree of the flux
+ * @param store the flux of the leaves
+ * @param s the source subnet, NULL for all the flux
+ * @param fn a function to print the packet
+ * @return UInt64 the number of flux printed
+ */
+UInt64 printSubnet(const radix96Tree* tree, const flowStore* store, const subnet* s, void(*fn)(void*));
+
+/**
+ * @brief aggregate the flux sizes per source prefix or per (source, destination) pair in one walk of the sub tree
+ * 
+ * @param tree the radix tree of the flux
+ * @param store the flux of the leaves
+ * @param s the source subnet, NULL for all the flux
+ * @param bits the length of the prefix of the (source, destination) key: 1 to 32 for a source prefix,
+ *             33 to 64 for a source and a destination prefix - ROLLUPPAIR for the pair
+ * @param out the output
+ */
+void printRollup(const radix96Tree* tree, const flowStore* store, const subnet* s, int bits, FILE* out);
+
+#endif
@@ -1,9 +1,49 @@
-rm -rf chimere chimere.o  packet.o  radix.o  list.o
+rm -rf chimere chimerecol chimeretop chimeretop.o chimerecol.o chimere.o  packet.o  radixfixed.o  flowstore.o  seqmap.o  quarantine.o  metrics.o  snapshot.o  diff.o  rollup.o  aggregate.o  pcap.o  columnar.o  lines.o  decompress.o  reader.o  uring.o  pool.o  flux.o  batch.o  shmflux.o  query.o  report.o  libchimere.o  libchimere.a
 #CFLAGS="-g"
 CFLAGS="-O3"
 #OPTIONS="-D__SHOW_RADIX__"
+LIBS="-pthread -lrt"
+# the compressed logs are read in-process when the libraries are available
+if echo '#include <zlib.h>' | gcc -E - > /dev/null 2>&1; then
+    CFLAGS="$CFLAGS -DHAVE_ZLIB"
+    LIBS="$LIBS -lz"
+fi
+if echo '#include <zstd.h>' | gcc -E - > /dev/null 2>&1; then
+    CFLAGS="$CFLAGS -DHAVE_ZSTD"
+    LIBS="$LIBS -lzstd"
+fi
+# the text files are read with io_uring when the kernel headers have it
+if echo '#include <linux/io_uring.h>' | gcc -E - > /dev/null 2>&1; then
+    CFLAGS="$CFLAGS -DHAVE_URING"
+fi
+gcc -c -o pool.o pool.c $CFLAGS
 gcc -c -o packet.o packet.c $CFLAGS
-gcc -c -o radix.o radix.c $CFLAGS
-gcc -c -o list.o list.c $CFLAGS
+gcc -c -o radixfixed.o radixfixed.c $CFLAGS
+gcc -c -o flowstore.o flowstore.c $CFLAGS
+gcc -c -o seqmap.o seqmap.c $CFLAGS
+gcc -c -o quarantine.o quarantine.c $CFLAGS
+gcc -c -o metrics.o metrics.c $CFLAGS
+gcc -c -o rollup.o rollup.c $CFLAGS
+gcc -c -o aggregate.o aggregate.c $CFLAGS
+gcc -c -o pcap.o pcap.c $CFLAGS
+gcc -c -o columnar.o columnar.c $CFLAGS
+gcc -c -o lines.o lines.c $CFLAGS
+gcc -c -o decompress.o decompress.c $CFLAGS
+gcc -c -o reader.o reader.c $CFLAGS
+gcc -c -o uring.o uring.c $CFLAGS
+gcc -c -o flux.o flux.c $CFLAGS
+gcc -c -o batch.o batch.c $CFLAGS
+gcc -c -o shmflux.o shmflux.c $CFLAGS
+gcc -c -o query.o query.c $CFLAGS
+gcc -c -o report.o report.c $CFLAGS
+gcc -c -o snapshot.o snapshot.c $CFLAGS
+gcc -c -o diff.o diff.c $CFLAGS
 gcc -c -o chimere.o chimere.c $CFLAGS $OPTIONS
-gcc -o chimere chimere.o packet.o radix.o list.o
+gcc -o chimere chimere.o pool.o flowstore.o seqmap.o quarantine.o metrics.o flux.o batch.o shmflux.o query.o report.o snapshot.o diff.o packet.o radixfixed.o rollup.o aggregate.o pcap.o columnar.o lines.o decompress.o reader.o uring.o $LIBS
+gcc -c -o chimerecol.o chimerecol.c $CFLAGS
+gcc -o chimerecol chimerecol.o pool.o packet.o columnar.o
+gcc -c -o chimeretop.o chimeretop.c $CFLAGS
+gcc -o chimeretop chimeretop.o pool.o packet.o shmflux.o -pthread -lrt
+# the engine as a static library: libchimere.h
+gcc -c -o libchimere.o libchimere.c $CFLAGS
+ar rcs libchimere.a libchimere.o flowstore.o seqmap.o quarantine.o metrics.o flux.o shmflux.o query.o pool.o packet.o radixfixed.o aggregate.o lines.o
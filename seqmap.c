@@ -0,0 +1,460 @@
+/**
+ * @file seqmap.c
+ * @author Sebastien Galvagno
+ * @brief The sequence numbers seen in each flux, in compressed bitmaps
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The map of a flux splits the 32 bits sequence numbers by their 16 high bits, as a roaring bitmap:
+ * a container holds the sorted low bits, the runs of consecutive low bits or a bitmap of 8 KB,
+ * whichever is the smallest. A flux without loss is a run per 65536 sequence numbers.
+ *
+ * A packet only appends its flux id and sequence number to a batch. A full batch is sorted and each
+ * container touched is rebuilt once: its runs and the runs of the new values are merged, the overlap
+ * is the number of duplicates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __UNITTEST_SEQMAP__
+#include <assert.h>
+#include <time.h>
+#endif
+
+#include "seqmap.h"
+#include "flowstore.h"
+#include "pool.h"
+
+// the runs of a container: 32768 at most
+#define SEQRUNSMAX 32768
+
+/**
+ * @brief create an empty table of maps
+ *
+ * @return seqTable* NULL if out of memory
+ */
+seqTable* seqTableCreate(void){
+    seqTable* table = (seqTable*)memAlloc(sizeof(seqTable), MEMSEQUENCES);
+    if ( table == NULL ) return NULL;
+    memset(table, 0, sizeof(seqTable));
+    table->pending = (UInt64*)memAlloc(SEQBATCH * sizeof(UInt64), MEMSEQUENCES);
+    // the runs of a container, of the added values and the merged runs
+    table->runs = (UInt32*)memAlloc(3 * 2 * SEQRUNSMAX * sizeof(UInt32), MEMSEQUENCES);
+    if ( table->pending == NULL || table->runs == NULL ){
+        seqTableFree(table);
+        return NULL;
+    }
+    return table;
+}
+
+static void freeMap(seqMap* map){
+    for (UInt32 c=0; c<map->nb; c++) memFree(map->containers[c].data);
+    memFree(map->containers);
+    memset(map, 0, sizeof(seqMap));
+}
+
+/**
+ * @brief free a table of maps
+ *
+ * @param table the table, or NULL
+ */
+void seqTableFree(seqTable* table){
+    if ( table == NULL ) return;
+    for (UInt32 id=0; id<table->capacity; id++) freeMap(&table->maps[id]);
+    memFree(table->maps);
+    memFree(table->pending);
+    memFree(table->runs);
+    memFree(table);
+}
+
+/**
+ * @brief the map of a flux id, the table grows to the id
+ */
+static seqMap* mapOf(seqTable* table, UInt32 id){
+    if ( id >= table->capacity ){
+        UInt32 capacity = table->capacity ? table->capacity : 1024;
+        while ( capacity <= id ) capacity *= 2;
+        seqMap* maps = (seqMap*)memRealloc(table->maps, capacity * sizeof(seqMap), MEMSEQUENCES);
+        if ( maps == NULL ) return NULL;
+        memset(maps + table->capacity, 0, (capacity - table->capacity) * sizeof(seqMap));
+        table->maps = maps;
+        table->capacity = capacity;
+    }
+    return &table->maps[id];
+}
+
+/**
+ * @brief the runs of a container: the first and the last low bits of each run
+ *
+ * @return UInt32 the number of runs
+ */
+static UInt32 containerRuns(const seqContainer* c, UInt32* runs){
+    UInt32 nb = 0;
+    if ( c->type == SEQRUN ){
+        const UInt16* data = (const UInt16*)c->data;
+        for (UInt32 r=0; r<2 * c->nb; r++) runs[r] = data[r];
+        return c->nb;
+    }
+    if ( c->type == SEQARRAY ){
+        const UInt16* values = (const UInt16*)c->data;
+        for (UInt32 v=0; v<c->nb; v++){
+            if ( nb && runs[2 * nb - 1] + 1 == values[v] ){
+                runs[2 * nb - 1] = values[v];
+            } else {
+                runs[2 * nb] = runs[2 * nb + 1] = values[v];
+                nb++;
+            }
+        }
+        return nb;
+    }
+    const UInt64* words = (const UInt64*)c->data;
+    int open = 0;
+    for (UInt32 w=0; w<1024; w++){
+        UInt64 word = words[w];
+        // the words all set or all clear are the common case of a dense flux
+        if ( word == (open ? ~0ULL : 0) ) continue;
+        for (UInt32 b=0; b<64; b++){
+            int bit = (word >> b) & 1;
+            if ( bit == open ) continue;
+            if ( bit ){
+                runs[2 * nb] = w * 64 + b;
+            } else {
+                runs[2 * nb + 1] = w * 64 + b - 1;
+                nb++;
+            }
+            open = bit;
+        }
+    }
+    if ( open ){
+        runs[2 * nb + 1] = 0xFFFF;
+        nb++;
+    }
+    return nb;
+}
+
+/**
+ * @brief write the runs in the smallest container: sorted values, runs or bitmap
+ *
+ * @return int 0, -1 if out of memory
+ */
+static int encodeContainer(seqContainer* c, const UInt32* runs, UInt32 nbRuns, UInt32* bytes){
+    UInt32 card = 0;
+    for (UInt32 r=0; r<nbRuns; r++) card += runs[2 * r + 1] - runs[2 * r] + 1;
+    UInt32 runBytes = 4 * nbRuns, arrayBytes = card <= SEQARRAYMAX ? 2 * card : SEQBITMAPBYTES + 1;
+    UInt16 type = runBytes <= arrayBytes && runBytes <= SEQBITMAPBYTES ? SEQRUN : arrayBytes <= SEQBITMAPBYTES ? SEQARRAY : SEQBITMAP;
+    UInt32 size = type == SEQRUN ? runBytes : type == SEQARRAY ? arrayBytes : SEQBITMAPBYTES;
+
+    UInt32 previous = c->data ? (c->type == SEQRUN ? 4 * c->nb : c->type == SEQARRAY ? 2 * c->nb : SEQBITMAPBYTES) : 0;
+    void* data = memAlloc(size, MEMSEQUENCES);
+    if ( data == NULL ) return -1;
+    if ( type == SEQRUN ){
+        UInt16* out = (UInt16*)data;
+        for (UInt32 r=0; r<2 * nbRuns; r++) out[r] = (UInt16)runs[r];
+        c->nb = nbRuns;
+    } else if ( type == SEQARRAY ){
+        UInt16* out = (UInt16*)data;
+        UInt32 n = 0;
+        for (UInt32 r=0; r<nbRuns; r++){
+            for (UInt32 v=runs[2 * r]; v<=runs[2 * r + 1]; v++) out[n++] = (UInt16)v;
+        }
+        c->nb = card;
+    } else {
+        UInt64* words = (UInt64*)data;
+        memset(words, 0, SEQBITMAPBYTES);
+        for (UInt32 r=0; r<nbRuns; r++){
+            for (UInt32 v=runs[2 * r]; v<=runs[2 * r + 1]; v++) words[v >> 6] |= 1ULL << (v & 63);
+        }
+        c->nb = card;
+    }
+    *bytes -= previous;
+    memFree(c->data);
+    c->data = data;
+    c->type = type;
+    *bytes += size;
+    return 0;
+}
+
+/**
+ * @brief the number of values in both lists of runs
+ */
+static UInt32 overlap(const UInt32* a, UInt32 nbA, const UInt32* b, UInt32 nbB){
+    UInt32 i = 0, j = 0, n = 0;
+    while ( i < nbA && j < nbB ){
+        UInt32 start = a[2 * i] > b[2 * j] ? a[2 * i] : b[2 * j];
+        UInt32 end = a[2 * i + 1] < b[2 * j + 1] ? a[2 * i + 1] : b[2 * j + 1];
+        if ( start <= end ) n += end - start + 1;
+        if ( a[2 * i + 1] < b[2 * j + 1] ) i++;
+        else j++;
+    }
+    return n;
+}
+
+/**
+ * @brief the union of 2 lists of runs
+ *
+ * @return UInt32 the number of runs
+ */
+static UInt32 unionRuns(const UInt32* a, UInt32 nbA, const UInt32* b, UInt32 nbB, UInt32* out){
+    UInt32 i = 0, j = 0, nb = 0;
+    while ( i < nbA || j < nbB ){
+        const UInt32* r = j == nbB || (i < nbA && a[2 * i] <= b[2 * j]) ? &a[2 * i++] : &b[2 * j++];
+        if ( nb && r[0] <= out[2 * nb - 1] + 1 ){
+            if ( r[1] > out[2 * nb - 1] ) out[2 * nb - 1] = r[1];
+        } else {
+            out[2 * nb] = r[0];
+            out[2 * nb + 1] = r[1];
+            nb++;
+        }
+    }
+    return nb;
+}
+
+/**
+ * @brief add runs of low bits to the container of the high bits: the container is rebuilt once
+ *
+ * @return int 0, -1 if out of memory
+ */
+static int addRuns(seqTable* table, seqMap* map, UInt16 high, const UInt32* runs, UInt32 nbRuns){
+    if ( map->saturated ) return 0;
+    UInt32 low = 0, up = map->nb;
+    while ( low < up ){
+        UInt32 m = (low + up) / 2;
+        if ( map->containers[m].high < high ) low = m + 1;
+        else up = m;
+    }
+    if ( low == map->nb || map->containers[low].high != high ){
+        if ( map->nb == map->capacity ){
+            UInt32 capacity = map->capacity ? 2 * map->capacity : 4;
+            seqContainer* containers = (seqContainer*)memRealloc(map->containers, capacity * sizeof(seqContainer), MEMSEQUENCES);
+            if ( containers == NULL ) return -1;
+            map->bytes += (capacity - map->capacity) * sizeof(seqContainer);
+            map->containers = containers;
+            map->capacity = capacity;
+        }
+        memmove(&map->containers[low + 1], &map->containers[low], (map->nb - low) * sizeof(seqContainer));
+        memset(&map->containers[low], 0, sizeof(seqContainer));
+        map->containers[low].high = high;
+        map->containers[low].type = SEQRUN;
+        map->nb++;
+    }
+    seqContainer* c = &map->containers[low];
+    UInt32* current = table->runs + 2 * SEQRUNSMAX;
+    UInt32* merged = table->runs + 4 * SEQRUNSMAX;
+    UInt32 nbCurrent = c->data ? containerRuns(c, current) : 0;
+    map->duplicates += overlap(current, nbCurrent, runs, nbRuns);
+    UInt32 nbMerged = unionRuns(current, nbCurrent, runs, nbRuns, merged);
+    if ( encodeContainer(c, merged, nbMerged, &map->bytes) ) return -1;
+
+    // the memory of a flux is bounded: a flux with too many holes is not tracked anymore
+    if ( map->bytes > SEQMAPMAX ){
+        UInt32 duplicates = map->duplicates;
+        freeMap(map);
+        map->duplicates = duplicates;
+        map->saturated = 1;
+    }
+    return 0;
+}
+
+static int compareUInt64(const void* a, const void* b){
+    UInt64 x = *(const UInt64*)a, y = *(const UInt64*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/**
+ * @brief add the batch to the maps, sorted: a flux and a container are updated once
+ *
+ * @param table the table of maps
+ */
+void seqFlush(seqTable* table){
+    qsort(table->pending, table->nbPending, sizeof(UInt64), &compareUInt64);
+    UInt32* runs = table->runs;
+    UInt32 i = 0;
+    while ( i < table->nbPending ){
+        UInt64 group = table->pending[i] >> 16;
+        UInt32 id = (UInt32)(table->pending[i] >> 32);
+        seqMap* map = mapOf(table, id);
+        UInt32 nbRuns = 0, duplicates = 0;
+        // the values of the same flux and high bits, as runs
+        for (; i < table->nbPending && table->pending[i] >> 16 == group; i++){
+            UInt32 v = table->pending[i] & 0xFFFF;
+            if ( nbRuns && v <= runs[2 * nbRuns - 1] ){
+                duplicates++;
+            } else if ( nbRuns && v == runs[2 * nbRuns - 1] + 1 ){
+                runs[2 * nbRuns - 1] = v;
+            } else {
+                runs[2 * nbRuns] = runs[2 * nbRuns + 1] = v;
+                nbRuns++;
+            }
+        }
+        if ( map == NULL ) continue;
+        if ( !map->saturated ) map->duplicates += duplicates;
+        addRuns(table, map, (UInt16)group, runs, nbRuns);
+    }
+    table->nbPending = 0;
+}
+
+/**
+ * @brief the sequence number of a packet of a flux: kept in a batch, the batch is added to the maps
+ * when it is full
+ *
+ * @param table the table of maps
+ * @param id the flux id
+ * @param seq the sequence number
+ */
+void seqAdd(seqTable* table, UInt32 id, tcp_seq seq){
+    table->pending[table->nbPending++] = (UInt64)id << 32 | seq;
+    if ( table->nbPending == SEQBATCH ) seqFlush(table);
+}
+
+/**
+ * @brief a flux is removed and the flux moved takes its id - the batch must be flushed before
+ *
+ * @param table the table of maps
+ * @param id the id of the removed flux
+ * @param moved the previous id of the flux moved to id, FLOWNONE when no flux is moved
+ */
+void seqRemove(seqTable* table, UInt32 id, UInt32 moved){
+    if ( id >= table->capacity ) return;
+    freeMap(&table->maps[id]);
+    if ( moved != FLOWNONE && moved < table->capacity ){
+        table->maps[id] = table->maps[moved];
+        memset(&table->maps[moved], 0, sizeof(seqMap));
+    }
+}
+
+/**
+ * @brief add the map of a flux of a table to the map of a flux of another table
+ *
+ * @param into the table receiving the sequence numbers
+ * @param intoId the flux id in into
+ * @param from the other table, flushed
+ * @param fromId the flux id in from
+ * @return int 0, -1 if out of memory
+ */
+int seqMerge(seqTable* into, UInt32 intoId, const seqTable* from, UInt32 fromId){
+    if ( fromId >= from->capacity ) return 0;
+    const seqMap* source = &from->maps[fromId];
+    seqMap* map = mapOf(into, intoId);
+    if ( map == NULL ) return -1;
+    map->duplicates += source->duplicates;
+    if ( source->saturated && !map->saturated ){
+        UInt32 duplicates = map->duplicates;
+        freeMap(map);
+        map->duplicates = duplicates;
+        map->saturated = 1;
+    }
+    UInt32* runs = into->runs;
+    for (UInt32 c=0; c<source->nb; c++){
+        UInt32 nbRuns = containerRuns(&source->containers[c], runs);
+        if ( addRuns(into, map, source->containers[c].high, runs, nbRuns) ) return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the counts of the map of a flux - the batch must be flushed
+ *
+ * @param table the table of maps
+ * @param id the flux id
+ * @param stats the counts
+ */
+void seqStatsOf(const seqTable* table, UInt32 id, seqStats* stats){
+    memset(stats, 0, sizeof(seqStats));
+    if ( id >= table->capacity ) return;
+    const seqMap* map = &table->maps[id];
+    stats->duplicates = map->duplicates;
+    stats->saturated = map->saturated;
+    UInt32* runs = table->runs;
+    UInt64 previous = 0;
+    int first = 1;
+    for (UInt32 c=0; c<map->nb; c++){
+        UInt64 high = (UInt64)map->containers[c].high << 16;
+        UInt32 nbRuns = containerRuns(&map->containers[c], runs);
+        for (UInt32 r=0; r<nbRuns; r++){
+            // a run continued in the next container is not a gap
+            if ( !first && high + runs[2 * r] != previous + 1 ) stats->gaps++;
+            stats->observed += runs[2 * r + 1] - runs[2 * r] + 1;
+            previous = high + runs[2 * r + 1];
+            first = 0;
+        }
+    }
+}
+
+
+#ifdef __UNITTEST_SEQMAP__
+
+int main(){
+    seqTable* table = seqTableCreate();
+    assert(table);
+    seqStats stats;
+
+    // a dense flux: a run per container
+    for (tcp_seq s=1000; s<201000; s++) seqAdd(table, 0, s);
+    // a flux with a hole and duplicates
+    for (tcp_seq s=0; s<100; s++) seqAdd(table, 1, s == 50 ? 49 : s);
+    seqAdd(table, 1, 10);
+    // a sparse flux: an array container
+    for (tcp_seq s=0; s<3000; s++) seqAdd(table, 2, 0x70000000 + s * 7);
+    seqFlush(table);
+
+    seqStatsOf(table, 0, &stats);
+    assert(stats.observed == 200000 && stats.gaps == 0 && stats.duplicates == 0);
+    assert(table->maps[0].nb == 4 && table->maps[0].containers[1].type == SEQRUN);
+    seqStatsOf(table, 1, &stats);
+    assert(stats.observed == 99 && stats.gaps == 1 && stats.duplicates == 2);
+    seqStatsOf(table, 2, &stats);
+    assert(stats.observed == 3000 && stats.gaps == 2999 && table->maps[2].containers[0].type == SEQARRAY);
+
+    // one value in 2: a bitmap, then the memory bound
+    for (tcp_seq s=0; s<65536; s+=2) seqAdd(table, 3, 0x10000 + s);
+    seqFlush(table);
+    assert(table->maps[3].containers[0].type == SEQBITMAP && table->maps[3].bytes < SEQMAPMAX);
+    seqStatsOf(table, 3, &stats);
+    assert(stats.observed == 32768 && stats.gaps == 32767);
+    for (tcp_seq s=0; s<16 * 65536; s+=2) seqAdd(table, 3, 0x100000 + s);
+    seqFlush(table);
+    seqStatsOf(table, 3, &stats);
+    assert(stats.saturated && table->maps[3].nb == 0);
+
+    // the values added again are duplicates, the holes are filled
+    for (tcp_seq s=0; s<100; s++) seqAdd(table, 1, s);
+    seqFlush(table);
+    seqStatsOf(table, 1, &stats);
+    assert(stats.observed == 100 && stats.gaps == 0 && stats.duplicates == 2 + 99);
+
+    // the merge of 2 tables
+    seqTable* other = seqTableCreate();
+    for (tcp_seq s=201000; s<202000; s++) seqAdd(other, 5, s);
+    seqAdd(other, 5, 1000);
+    seqFlush(other);
+    assert(seqMerge(table, 0, other, 5) == 0);
+    seqStatsOf(table, 0, &stats);
+    assert(stats.observed == 201000 && stats.gaps == 0 && stats.duplicates == 1);
+
+    // the last flux takes the id of a removed one
+    seqRemove(table, 1, 2);
+    seqStatsOf(table, 1, &stats);
+    assert(stats.observed == 3000);
+    seqStatsOf(table, 2, &stats);
+    assert(stats.observed == 0);
+
+    // the cost of a packet of a dense flux
+    clock_t t0 = clock();
+    for (tcp_seq s=0; s<20000000; s++) seqAdd(other, s & 1023, s >> 10);
+    seqFlush(other);
+    printf("seqAdd: %.1f ns per packet, %u bytes per flux\n", (double)(clock() - t0) * 1e9 / CLOCKS_PER_SEC / 20000000,
+           other->maps[7].bytes);
+
+    seqTableFree(other);
+    seqTableFree(table);
+    printf("seqmap: OK\n");
+    return 0;
+}
+
+// gcc -o seqmap pool.c seqmap.c -O2 -D__UNITTEST_SEQMAP__ && ./seqmap
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * @file seqmap.h
+ * @author Sebastien Galvagno
+ * @brief The sequence numbers seen in each flux, in compressed bitmaps
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef __SG__CHIMERE_SEQMAP_H__
+#define __SG__CHIMERE_SEQMAP_H__
+
+#include "SG_Types.h"
+#include "packet.h"
+
+// the sequence numbers kept before they are added to the maps
+#define SEQBATCH 4096
+// the memory of the map of a flux: beyond it the flux is not tracked anymore
+#define SEQMAPMAX (64 * 1024)
+// a container of 65536 sequence numbers: sorted values, runs or a bitmap
+#define SEQARRAY 0
+#define SEQRUN 1
+#define SEQBITMAP 2
+// an array container has 4096 values at most, a bitmap is 8 KB
+#define SEQARRAYMAX 4096
+#define SEQBITMAPBYTES 8192
+
+/**
+ * @brief the sequence numbers of a flux with the same 16 high bits
+ *
+ * data: the sorted low bits (SEQARRAY), the first and last low bits of each run (SEQRUN),
+ * or 1024 words of 64 bits (SEQBITMAP)
+ */
+typedef struct {
+    UInt16 high;
+    UInt16 type;
+    UInt32 nb;          // the number of values or runs
+    void* data;
+} seqContainer;
+
+/**
+ * @brief the sequence numbers of a flux: the containers sorted by their high bits
+ */
+typedef struct {
+    seqContainer* containers;
+    UInt32 nb;
+    UInt32 capacity;
+    UInt32 bytes;       // the memory of the containers
+    UInt32 duplicates;  // the sequence numbers seen again
+    int saturated;      // more than SEQMAPMAX bytes: the map is dropped
+} seqMap;
+
+/**
+ * @brief the maps of the flux of a table, indexed by the flux id, and the sequence numbers not added yet
+ */
+typedef struct {
+    seqMap* maps;
+    UInt32 capacity;
+    UInt64* pending;    // the flux id in the high bits, the sequence number in the low bits
+    UInt32 nbPending;
+    UInt32* runs;       // the runs of a container and of the added values, merged
+} seqTable;
+
+/**
+ * @brief the counts of a map
+ */
+typedef struct {
+    UInt64 observed;    // the distinct sequence numbers
+    UInt32 gaps;        // the ranges of missing sequence numbers between the first and the last one
+    UInt32 duplicates;
+    int saturated;
+} seqStats;
+
+/**
+ * @brief create an empty table of maps
+ *
+ * @return seqTable* NULL if out of memory
+ */
+seqTable* seqTableCreate(void);
+
+/**
+ * @brief free a table of maps
+ *
+ * @param table the table, or NULL
+ */
+void seqTableFree(seqTable* table);
+
+/**
+ * @brief the sequence number of a packet of a flux: kept in a batch, the batch is added to the maps
+ * when it is full
+ *
+ * @param table the table of maps
+ * @param id the flux id
+ * @param seq the sequence number
+ */
+void seqAdd(seqTable* table, UInt32 id, tcp_seq seq);
+
+/**
+ * @brief add the batch to the maps, sorted: a flux and a container are updated once
+ *
+ * @param table the table of maps
+ */
+void seqFlush(seqTable* table);
+
+/**
+ * @brief a flux is removed and the flux moved takes its id - the batch must be flushed before
+ *
+ * @param table the table of maps
+ * @param id the id of the removed flux
+ * @param moved the previous id of the flux moved to id, FLOWNONE when no flux is moved
+ */
+void seqRemove(seqTable* table, UInt32 id, UInt32 moved);
+
+/**
+ * @brief add the map of a flux of a table to the map of a flux of another table
+ *
+ * @param into the table receiving the sequence numbers
+ * @param intoId the flux id in into
+ * @param from the other table, flushed
+ * @param fromId the flux id in from
+ * @return int 0, -1 if out of memory
+ */
+int seqMerge(seqTable* into, UInt32 intoId, const seqTable* from, UInt32 fromId);
+
+/**
+ * @brief the counts of the map of a flux - the batch must be flushed
+ *
+ * @param table the table of maps
+ * @param id the flux id
+ * @param stats the counts
+ */
+void seqStatsOf(const seqTable* table, UInt32 id, seqStats* stats);
+
+#endif
@@ -0,0 +1,594 @@
+/**
+ * @file shmflux.c
+ * @author Sebastien Galvagno
+ * @brief A flux table in a named POSIX shared memory segment, fed by several processes
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * The segment is mapped at any address: the radix tree links its nodes with indexes in the segment
+ * instead of pointers. The flux are not kept sorted: the biggest ones are selected when the top is read. The radix tree is on
+ * a binary key: a node branches on a nibble and its prefix is read in the key of a flux below it.
+ * The segment stays in the system: a process restarted attaches to the table and goes on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __UNITTEST_SHMFLUX__
+#include <assert.h>
+#include <sys/wait.h>
+#endif
+
+#include "shmflux.h"
+
+#define SHMMAGIC "CHIMSHM2"
+
+static size_t fluxOffset(void){
+    return (sizeof(shmHeader) + 7) & ~(size_t)7;
+}
+
+static size_t nodesOffset(UInt32 capacity){
+    return (fluxOffset() + (size_t)(capacity + 1) * sizeof(shmFlux) + 7) & ~(size_t)7;
+}
+
+static size_t segmentSize(UInt32 capacity){
+    return nodesOffset(capacity) + (size_t)(capacity + 1) * sizeof(shmNode);
+}
+
+static inline int nibble(const UInt8* key, UInt32 i){
+    return (key[i >> 1] >> ((i & 1) ? 0 : 4)) & 0xF;
+}
+
+static void makeKey(const fromtopacket* packet, UInt8* key){
+    // the addresses are already in network order
+    memcpy(key, &packet->from, 4);
+    memcpy(key + 4, &packet->to, 4);
+    key[8] = packet->portFrom >> 8;
+    key[9] = packet->portFrom & 0xFF;
+    key[10] = packet->portTo >> 8;
+    key[11] = packet->portTo & 0xFF;
+}
+
+static void toPacket(const shmFlux* f, fromtopacket* packet){
+    memset(packet, 0, sizeof(fromtopacket));
+    memcpy(&packet->from, f->key, 4);
+    memcpy(&packet->to, f->key + 4, 4);
+    packet->portFrom = (UInt16)(f->key[8] << 8 | f->key[9]);
+    packet->portTo = (UInt16)(f->key[10] << 8 | f->key[11]);
+    packet->firstPacket = f->firstPacket;
+    packet->lastPacket = f->lastPacket;
+}
+
+static inline UInt32 fluxSize(const shmFlux* f){
+    return f->lastPacket - f->firstPacket;
+}
+
+/**
+ * @brief open the segment /name, it is created for capacity flux when it does not exist
+ * 
+ * @param name the name of the segment, without /
+ * @param capacity the number of flux of a new segment
+ * @return shmTable* NULL on error
+ */
+shmTable* shmOpen(const char* name, UInt32 capacity){
+    char path[256];
+    snprintf(path, sizeof(path), "/%s", name);
+    if ( capacity == 0 || capacity >= SHMLEAF ) return NULL;
+
+    int created = 1;
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if ( fd < 0 && errno == EEXIST ){
+        created = 0;
+        fd = shm_open(path, O_RDWR, 0);
+    }
+    if ( fd < 0 ) return NULL;
+
+    struct stat st;
+    if ( created ){
+        // the pages are given as zeros: an empty table
+        if ( ftruncate(fd, segmentSize(capacity)) != 0 ){
+            close(fd);
+            shm_unlink(path);
+            return NULL;
+        }
+    } else {
+        // the creator may not have set the size yet
+        for (int i=0; i<1000 && fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(shmHeader); i++) usleep(1000);
+    }
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shmHeader) ){
+        close(fd);
+        return NULL;
+    }
+
+    void* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( base == MAP_FAILED ) return NULL;
+    shmHeader* h = (shmHeader*)base;
+
+    if ( created ){
+        memcpy(h->magic, SHMMAGIC, sizeof(h->magic));
+        h->capacity = capacity;
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&h->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        __atomic_store_n(&h->ready, 1, __ATOMIC_RELEASE);
+    } else {
+        for (int i=0; i<1000 && !__atomic_load_n(&h->ready, __ATOMIC_ACQUIRE); i++) usleep(1000);
+        if ( !h->ready || memcmp(h->magic, SHMMAGIC, sizeof(h->magic)) != 0
+             || (size_t)st.st_size != segmentSize(h->capacity) ){
+            munmap(base, st.st_size);
+            return NULL;
+        }
+    }
+
+    shmTable* t = (shmTable*)malloc(sizeof(shmTable));
+    if ( t == NULL ){
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    t->header = h;
+    t->flux = (shmFlux*)((char*)base + fluxOffset());
+    t->nodes = (shmNode*)((char*)base + nodesOffset(h->capacity));
+    t->size = st.st_size;
+    return t;
+}
+
+/**
+ * @brief unmap the segment, it stays in the system
+ * 
+ * @param table the segment
+ */
+void shmClose(shmTable* table){
+    if ( table == NULL ) return;
+    munmap(table->header, table->size);
+    free(table);
+}
+
+/**
+ * @brief remove the segment from the system
+ * 
+ * @param name the name of the segment
+ * @return int 0, -1 on error
+ */
+int shmRemove(const char* name){
+    char path[256];
+    snprintf(path, sizeof(path), "/%s", name);
+    return shm_unlink(path);
+}
+
+static UInt32 findFlux(shmTable* t, const UInt8* key, const fromtopacket* packet, int* created);
+
+/**
+ * @brief repair the table of a process dead with the lock: a flux is linked in the tree after it is counted,
+ * the last flux counted but not linked is removed, with the node made for it when it is counted:
+ * the flux is counted before its node, the last node counted is the one of the flux or an older one
+ */
+static void repairTable(shmTable* t){
+    shmHeader* h = t->header;
+    UInt32 f = h->nbFlux;
+    int created;
+    if ( f == 0 || findFlux(t, t->flux[f].key, NULL, &created) == f ) return;
+    if ( h->nbNodes && t->nodes[h->nbNodes].flux == f ) h->nbNodes--;
+    h->nbFlux = f - 1;
+}
+
+static int lockTable(shmTable* t){
+    int r = pthread_mutex_lock(&t->header->lock);
+    if ( r == EOWNERDEAD ){
+        // a process died with the lock: at most its last flux is half added
+        repairTable(t);
+        pthread_mutex_consistent(&t->header->lock);
+        r = 0;
+    }
+    return r == 0 ? 0 : -1;
+}
+
+static void unlockTable(shmTable* t){
+    pthread_mutex_unlock(&t->header->lock);
+}
+
+/**
+ * @brief find the flux of a key, it is inserted for a packet. A flux is written, then its node, then the flux
+ * is counted, then the node, then they are linked in the tree by a single store: a process dying in the middle
+ * leaves a flux counted but not linked, maybe with its node counted (repairTable), never a link to a flux
+ * or a node not written.
+ * 
+ * @param packet the first packet of the flux inserted, NULL to find only
+ * @return UInt32 the flux, 0 when it is not found or when the segment is full
+ */
+static UInt32 findFlux(shmTable* t, const UInt8* key, const fromtopacket* packet, int* created){
+    shmHeader* h = t->header;
+    *created = 0;
+
+    // the flux sharing the longest prefix with the key
+    UInt32 ref = h->root;
+    while ( ref && !(ref & SHMLEAF) ){
+        shmNode* n = &t->nodes[ref];
+        UInt32 child = n->children[nibble(key, n->depth)];
+        ref = child ? child : (n->flux | SHMLEAF);
+    }
+
+    UInt32 closest = ref & ~SHMLEAF;
+    UInt32 d = 0;
+    if ( closest ){
+        const UInt8* ck = t->flux[closest].key;
+        while ( d < SHMKEYNIBBLES && nibble(ck, d) == nibble(key, d) ) d++;
+        if ( d == SHMKEYNIBBLES ) return closest;
+    }
+    if ( packet == NULL ) return 0;
+    if ( h->nbFlux >= h->capacity ) return 0;
+
+    UInt32 f = h->nbFlux + 1;
+    shmFlux* flux = &t->flux[f];
+    memcpy(flux->key, key, SHMKEYSIZE);
+    flux->firstPacket = packet->firstPacket;
+    flux->lastPacket = packet->firstPacket;
+
+    // the link to replace: the first link to a node deeper than d, or to a flux
+    UInt32* slot = &h->root;
+    while ( *slot && !(*slot & SHMLEAF) && t->nodes[*slot].depth < d ){
+        shmNode* n = &t->nodes[*slot];
+        slot = &n->children[nibble(key, n->depth)];
+    }
+
+    UInt32* link;
+    UInt32 linked;
+    UInt32 node = 0;
+    if ( *slot == 0 ){
+        link = slot;
+        linked = f | SHMLEAF;
+    } else if ( !(*slot & SHMLEAF) && t->nodes[*slot].depth == d ){
+        link = &t->nodes[*slot].children[nibble(key, d)];
+        linked = f | SHMLEAF;
+    } else {
+        // a new node branching on the nibble d: the old link and the new flux
+        UInt32 ni = h->nbNodes + 1;
+        shmNode* n = &t->nodes[ni];
+        memset(n, 0, sizeof(shmNode));
+        n->depth = d;
+        n->flux = f;
+        n->children[nibble(t->flux[closest].key, d)] = *slot;
+        n->children[nibble(key, d)] = f | SHMLEAF;
+        node = ni;
+        link = slot;
+        linked = ni;
+    }
+    __atomic_store_n(&h->nbFlux, f, __ATOMIC_RELEASE);
+    if ( node ) __atomic_store_n(&h->nbNodes, node, __ATOMIC_RELEASE);
+    __atomic_store_n(link, linked, __ATOMIC_RELEASE);
+    *created = 1;
+    return f;
+}
+
+static void updateFlux(shmTable* t, const fromtopacket* packet){
+    shmHeader* h = t->header;
+    UInt8 key[SHMKEYSIZE];
+    makeKey(packet, key);
+
+    int created;
+    UInt32 i = findFlux(t, key, packet, &created);
+    h->lines++;
+    if ( i == 0 ){
+        h->dropped++;
+        return;
+    }
+    // in serial number arithmetic, as the private tables: a single store, the range stays valid
+    if ( !created ) seqExtend(&t->flux[i].firstPacket, &t->flux[i].lastPacket, packet->firstPacket);
+}
+
+/**
+ * @brief add packets to the segment, under one lock. A flux goes from the smallest
+ * first sequence number to the biggest last one: the processes can give its packets in any order.
+ * 
+ * @param table the segment
+ * @param packets the packets
+ * @param nb the number of packets
+ * @return int 0, -1 when the lock is lost
+ */
+int shmUpdate(shmTable* table, const fromtopacket* packets, int nb){
+    if ( lockTable(table) ) return -1;
+    for (int i=0; i<nb; i++) updateFlux(table, &packets[i]);
+    unlockTable(table);
+    return 0;
+}
+
+/**
+ * @brief add a packet, the packets are given to the segment by SHMBATCH
+ * 
+ * @param writer the writer
+ * @param packet the packet
+ * @return int 0, -1 when the lock is lost
+ */
+int shmAdd(shmWriter* writer, const fromtopacket* packet){
+    writer->pending[writer->nb++] = *packet;
+    return writer->nb == SHMBATCH ? shmFlush(writer) : 0;
+}
+
+/**
+ * @brief give the waiting packets to the segment
+ * 
+ * @param writer the writer
+ * @return int 0, -1 when the lock is lost
+ */
+int shmFlush(shmWriter* writer){
+    int r = writer->nb ? shmUpdate(writer->table, writer->pending, writer->nb) : 0;
+    writer->nb = 0;
+    return r;
+}
+
+/**
+ * @brief a flux of the top: its size and its index, the order of its creation
+ */
+typedef struct {
+    UInt32 size;
+    UInt32 index;
+} topEntry;
+
+/**
+ * @brief the order of the top: the biggest flux first, the oldest first for the same size
+ */
+static inline int topBefore(const topEntry* a, const topEntry* b){
+    return a->size != b->size ? a->size > b->size : a->index < b->index;
+}
+
+/**
+ * @brief the heap of the top: its root is the last flux of the top
+ */
+static void heapUp(topEntry* heap, UInt32 i){
+    while ( i > 0 && topBefore(&heap[(i - 1) / 2], &heap[i]) ){
+        topEntry e = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = e;
+        i = (i - 1) / 2;
+    }
+}
+
+static void heapDown(topEntry* heap, UInt32 nb, UInt32 i){
+    for (;;){
+        UInt32 last = i, l = 2 * i + 1, r = l + 1;
+        if ( l < nb && topBefore(&heap[last], &heap[l]) ) last = l;
+        if ( r < nb && topBefore(&heap[last], &heap[r]) ) last = r;
+        if ( last == i ) return;
+        topEntry e = heap[i];
+        heap[i] = heap[last];
+        heap[last] = e;
+        i = last;
+    }
+}
+
+/**
+ * @brief the biggest flux of the segment, the biggest first, the flux of the same size in the order of their creation:
+ * they are selected in the segment under the lock and given to fn after it
+ * 
+ * @param table the segment
+ * @param top the number of flux
+ * @param fn the function called for each flux
+ * @param ctx the context given to fn
+ * @return int the number of flux given to fn
+ */
+int shmTop(shmTable* table, int top, shmFluxFn fn, void* ctx){
+    if ( top <= 0 ) return 0;
+    UInt32 capacity = (UInt32)top < table->header->capacity ? (UInt32)top : table->header->capacity;
+    topEntry* heap = (topEntry*)malloc(capacity * sizeof(topEntry));
+    fromtopacket* flux = (fromtopacket*)malloc(capacity * sizeof(fromtopacket));
+    if ( heap == NULL || flux == NULL || lockTable(table) ){
+        free(heap);
+        free(flux);
+        return 0;
+    }
+
+    // the top in a heap of its smallest flux: a single pass over the flux
+    UInt32 nbTop = 0;
+    for (UInt32 i=1; i<=table->header->nbFlux; i++){
+        topEntry e = { .size = fluxSize(&table->flux[i]), .index = i };
+        if ( nbTop < capacity ){
+            heap[nbTop] = e;
+            heapUp(heap, nbTop++);
+        } else if ( topBefore(&e, &heap[0]) ){
+            heap[0] = e;
+            heapDown(heap, nbTop, 0);
+        }
+    }
+    // the heap emptied from its smallest flux: the biggest flux first
+    for (UInt32 n=nbTop; n>0; n--){
+        toPacket(&table->flux[heap[0].index], &flux[n - 1]);
+        heap[0] = heap[n - 1];
+        heapDown(heap, n - 1, 0);
+    }
+    unlockTable(table);
+
+    int nb = 0;
+    while ( (UInt32)nb < nbTop ){
+        if ( fn(&flux[nb++], ctx) ) break;
+    }
+    free(heap);
+    free(flux);
+    return nb;
+}
+
+/**
+ * @brief find a flux
+ * 
+ * @param table the segment
+ * @param key the source, destination and ports of the flux
+ * @param flux the flux found
+ * @return int 1 when the flux is found, 0 otherwise
+ */
+int shmLookup(shmTable* table, const fromtopacket* key, fromtopacket* flux){
+    UInt8 k[SHMKEYSIZE];
+    makeKey(key, k);
+    if ( lockTable(table) ) return 0;
+    int created;
+    UInt32 i = findFlux(table, k, NULL, &created);
+    if ( i ) toPacket(&table->flux[i], flux);
+    unlockTable(table);
+    return i != 0;
+}
+
+
+#ifdef __UNITTEST_SHMFLUX__
+
+#define NBFLUX 2000
+#define NBPROCESS 4
+
+static void packetOf(int f, tcp_seq seq, fromtopacket* p){
+    memset(p, 0, sizeof(fromtopacket));
+    p->from = htonl(0x0A000000 | f);
+    p->to = htonl(0xC0A80001);
+    p->portFrom = 1000 + f % 50;
+    p->portTo = 80;
+    p->firstPacket = seq;
+}
+
+static int checkTop(const fromtopacket* flux, void* ctx){
+    UInt32* previous = (UInt32*)ctx;
+    assert(packetSize(flux) <= *previous);
+    *previous = packetSize(flux);
+    return 0;
+}
+
+int main(){
+    const char* name = "chimere_shmflux_test";
+    shmRemove(name);
+
+    // the processes feed the same flux with interleaved sequence numbers, in any order
+    for (int p=0; p<NBPROCESS; p++){
+        if ( fork() == 0 ){
+            shmTable* t = shmOpen(name, NBFLUX + 10);
+            if ( t == NULL ) _exit(1);
+            shmWriter w = { .table = t, .nb = 0 };
+            for (int i=0; i<100; i++){
+                for (int f=0; f<NBFLUX; f++){
+                    fromtopacket packet;
+                    packetOf(f, 1000 + (i * NBPROCESS + p) * (1 + f % 10), &packet);
+                    if ( shmAdd(&w, &packet) ) _exit(1);
+                }
+            }
+            if ( shmFlush(&w) ) _exit(1);
+            shmClose(t);
+            _exit(0);
+        }
+    }
+    for (int p=0; p<NBPROCESS; p++){
+        int status;
+        wait(&status);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    // a reader process
+    shmTable* t = shmOpen(name, 1);
+    assert(t);
+    assert(t->header->capacity == NBFLUX + 10);
+    assert(t->header->nbFlux == NBFLUX);
+    assert(t->header->lines == (UInt64)NBPROCESS * 100 * NBFLUX);
+    assert(t->header->dropped == 0);
+
+    for (int f=0; f<NBFLUX; f++){
+        fromtopacket key, flux;
+        packetOf(f, 0, &key);
+        assert(shmLookup(t, &key, &flux));
+        assert(flux.firstPacket == 1000);
+        assert(packetSize(&flux) == (UInt32)(100 * NBPROCESS - 1) * (1 + f % 10));
+    }
+    fromtopacket key, flux;
+    packetOf(NBFLUX, 0, &key);
+    assert(!shmLookup(t, &key, &flux));
+
+    UInt32 previous = 0xFFFFFFFF;
+    assert(shmTop(t, 100, &checkTop, &previous) == 100);
+    assert(previous == (UInt32)(100 * NBPROCESS - 1) * 10);
+    previous = 0xFFFFFFFF;
+    assert(shmTop(t, NBFLUX + 10, &checkTop, &previous) == NBFLUX);
+    assert(previous == 100 * NBPROCESS - 1);
+
+    // full: the new flux are dropped
+    shmWriter w = { .table = t, .nb = 0 };
+    for (int f=NBFLUX; f<NBFLUX + 20; f++){
+        packetOf(f, 1, &key);
+        shmAdd(&w, &key);
+    }
+    shmFlush(&w);
+    assert(t->header->nbFlux == NBFLUX + 10);
+    assert(t->header->dropped == 10);
+
+    shmClose(t);
+    assert(shmRemove(name) == 0);
+
+    // the sequence numbers wrap around to 0: "..90, 0" and "..90, ..95, 0, ..92" have the size 6
+    t = shmOpen(name, 10);
+    assert(t);
+    w = (shmWriter){ .table = t, .nb = 0 };
+    const tcp_seq wrapped[] = { 4294967290u, 0, 4294967290u, 4294967295u, 0, 4294967292u };
+    for (int i=0; i<6; i++){
+        packetOf(i < 2 ? 1 : 2, wrapped[i], &key);
+        shmAdd(&w, &key);
+    }
+    shmFlush(&w);
+    for (int f=1; f<=2; f++){
+        packetOf(f, 0, &key);
+        assert(shmLookup(t, &key, &flux) && flux.firstPacket == 4294967290u && flux.lastPacket == 0 && packetSize(&flux) == 6);
+    }
+
+    // a process dies with the lock after counting a flux, before linking it: the flux is removed
+    if ( fork() == 0 ){
+        pthread_mutex_lock(&t->header->lock);
+        packetOf(3, 1000, &key);
+        makeKey(&key, t->flux[3].key);
+        t->header->nbFlux = 3;
+        _exit(0);
+    }
+    int status;
+    wait(&status);
+    packetOf(3, 2000, &key);
+    assert(!shmLookup(t, &key, &flux) && t->header->nbFlux == 2);
+    w = (shmWriter){ .table = t, .nb = 0 };
+    shmAdd(&w, &key);
+    shmFlush(&w);
+    previous = 0xFFFFFFFF;
+    assert(shmTop(t, 10, &checkTop, &previous) == 3 && t->header->nbFlux == 3);
+    assert(shmLookup(t, &key, &flux) && flux.firstPacket == 2000);
+
+    // a process dies with the lock after counting a flux and its node, before linking them: both are removed,
+    // then after counting the flux, before counting its node: the node is not counted, only the flux is removed
+    for (int step=0; step<2; step++){
+        UInt32 nodes = t->header->nbNodes;
+        if ( fork() == 0 ){
+            pthread_mutex_lock(&t->header->lock);
+            packetOf(4, 1000, &key);
+            makeKey(&key, t->flux[4].key);
+            t->nodes[nodes + 1] = (shmNode){ .depth = 0, .flux = 4 };
+            t->header->nbFlux = 4;
+            if ( step == 0 ) t->header->nbNodes = nodes + 1;
+            _exit(0);
+        }
+        wait(&status);
+        packetOf(4, 3000, &key);
+        assert(!shmLookup(t, &key, &flux) && t->header->nbFlux == 3 && t->header->nbNodes == nodes);
+    }
+    w = (shmWriter){ .table = t, .nb = 0 };
+    shmAdd(&w, &key);
+    shmFlush(&w);
+    previous = 0xFFFFFFFF;
+    assert(shmTop(t, 10, &checkTop, &previous) == 4 && t->header->nbFlux == 4);
+    assert(shmLookup(t, &key, &flux) && flux.firstPacket == 3000);
+    shmClose(t);
+    assert(shmRemove(name) == 0);
+    printf("shmflux: OK\n");
+    return 0;
+}
+
+// gcc -o shmflux pool.c packet.c shmflux.c -g -D__UNITTEST_SHMFLUX__ -pthread && ./shmflux
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * @file shmflux.h
+ * @author Sebastien Galvagno
+ * @brief A flux table in a named POSIX shared memory segment, fed by several processes
+ * @version 0.1
+ * @date 2022-04-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef __SG__CHIMERE_SHMFLUX_H__
+#define __SG__CHIMERE_SHMFLUX_H__
+
+#include <pthread.h>
+
+#include "SG_Types.h"
+#include "packet.h"
+
+// the default number of flux of a new segment
+#define SHMCAPACITY (1 << 20)
+// the packets given to the segment under one lock
+#define SHMBATCH 256
+// the key: source, destination, source port, destination port - in network order
+#define SHMKEYSIZE 12
+#define SHMKEYNIBBLES (2 * SHMKEYSIZE)
+
+/**
+ * @brief a flux of the segment: the links are indexes in the segment, 0 for none
+ */
+typedef struct {
+    UInt8 key[SHMKEYSIZE];
+    tcp_seq firstPacket;
+    tcp_seq lastPacket;
+} shmFlux;
+
+/**
+ * @brief a node of the radix tree of the segment: its children are nodes or flux (SHMLEAF)
+ */
+typedef struct {
+    UInt32 children[16];
+    UInt32 flux;        // a flux below the node: the first depth nibbles of its key are the prefix of the node
+    UInt32 depth;       // the nibble of the key chosing the child
+} shmNode;
+
+#define SHMLEAF 0x80000000u
+
+/**
+ * @brief the header of the segment, the flux and the nodes follow it
+ */
+typedef struct {
+    char magic[8];
+    UInt32 capacity;    // the number of flux
+    UInt32 ready;       // set when the segment is initialised
+    pthread_mutex_t lock; // process-shared, robust
+    UInt64 lines;       // the packets given to the segment
+    UInt64 dropped;     // the new flux dropped when the segment is full
+    UInt32 nbFlux;
+    UInt32 nbNodes;
+    UInt32 root;        // a node or a flux (SHMLEAF), 0 when empty
+} shmHeader;
+
+/**
+ * @brief a segment mapped by this process
+ */
+typedef struct {
+    shmHeader* header;
+    shmFlux* flux;      // flux[0] is not used
+    shmNode* nodes;     // nodes[0] is not used
+    size_t size;
+} shmTable;
+
+/**
+ * @brief the packets of a process waiting to be given to the segment
+ */
+typedef struct {
+    shmTable* table;
+    fromtopacket pending[SHMBATCH];
+    int nb;
+} shmWriter;
+
+/**
+ * @brief the function called for each flux of the segment
+ * 
+ * @param flux the flux
+ * @param ctx the context given to the call
+ * @return int 0 to continue
+ */
+typedef int (*shmFluxFn)(const fromtopacket* flux, void* ctx);
+
+/**
+ * @brief open the segment /name, it is created for capacity flux when it does not exist
+ * 
+ * @param name the name of the segment, without /
+ * @param capacity the number of flux of a new segment
+ * @return shmTable* NULL on error
+ */
+shmTable* shmOpen(const char* name, UInt32 capacity);
+
+/**
+ * @brief unmap the segment, it stays in the system
+ * 
+ * @param table the segment
+ */
+void shmClose(shmTable* table);
+
+/**
+ * @brief remove the segment from the system
+ * 
+ * @param name the name of the segment
+ * @return int 0, -1 on error
+ */
+int shmRemove(const char* name);
+
+/**
+ * @brief add packets to the segment, under one lock. A flux goes from the smallest
+ * first sequence number to the biggest last one: the processes can give its packets in any order.
+ * 
+ * @param table the segment
+ * @param packets the packets
+ * @param nb the number of packets
+ * @return int 0, -1 when the lock is lost
+ */
+int shmUpdate(shmTable* table, const fromtopacket* packets, int nb);
+
+/**
+ * @brief add a packet, the packets are given to the segment by SHMBATCH
+ * 
+ * @param writer the writer
+ * @param packet the packet
+ * @return int 0, -1 when the lock is lost
+ */
+int shmAdd(shmWriter* writer, const fromtopacket* packet);
+
+/**
+ * @brief give the waiting packets to the segment
+ * 
+ * @param writer the writer
+ * @return int 0, -1 when the lock is lost
+ */
+int shmFlush(shmWriter* writer);
+
+/**
+ * @brief the biggest flux of the segment, the biggest first, the flux of the same size in the order of their creation:
+ * they are selected in the segment under the lock and given to fn after it
+ * 
+ * @param table the segment
+ * @param top the number of flux
+ * @param fn the function called for each flux
+ * @param ctx the context given to fn
+ * @return int the number of flux given to fn
+ */
+int shmTop(shmTable* table, int top, shmFluxFn fn, void* ctx);
+
+/**
+ * @brief find a flux
+ * 
+ * @param table the segment
+ * @param key the source, destination and ports of the flux
+ * @param flux the flux found
+ * @return int 1 when the flux is found, 0 otherwise
+ */
+int shmLookup(shmTable* table, const fromtopacket* key, fromtopacket* flux);
+
+#endif
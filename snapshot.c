@@ -0,0 +1,210 @@
+/**
+ * @file snapshot.c
+ * @author Sebastien Galvagno
+ * @brief The flux of a table saved in a file, to be read again or compared without the logs
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The flux are written with the cursors of the radix trees: a snapshot is in the order of the keys
+ * and is read back by inserting the keys in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __UNITTEST_SNAPSHOT__
+#include <assert.h>
+#endif
+
+#include "snapshot.h"
+
+/**
+ * @brief write the flux of the table in a snapshot file, in the order of their keys
+ *
+ * @param table the flux table
+ * @param path the file
+ * @return int 0, -1 on a write error
+ */
+int writeSnapshot(const fluxTable* table, const char* path){
+    FILE* fp = fopen(path, "wb");
+    if ( fp == NULL ) return -1;
+
+    snapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOTMAGIC, sizeof(header.magic));
+    header.version = SNAPSHOTVERSION;
+    header.nbFlux = table->flows.nb;
+    header.nbFlux6 = table->flows6.nb;
+    header.lines = table->lines;
+    int r = fwrite(&header, sizeof(header), 1, fp) == 1 ? 0 : -1;
+
+    const UInt32* key;
+    void* data;
+    radix96Cursor cursor;
+    radix96CursorStart(&cursor, &table->tree);
+    while ( r == 0 && radix96CursorNext(&cursor, &key, &data) ){
+        UInt32 id = LEAFFLOW(data);
+        snapshotFlux f = { .from = key[0], .to = key[1], .portFrom = table->flows.portFrom[id], .portTo = table->flows.portTo[id],
+                           .firstPacket = table->flows.first[id], .lastPacket = table->flows.last[id] };
+        if ( fwrite(&f, sizeof(f), 1, fp) != 1 ) r = -1;
+    }
+
+    // the cursor of the IPv6 tree is big: 2 x 145 levels
+    radix288Cursor* cursor6 = (radix288Cursor*)malloc(sizeof(radix288Cursor));
+    if ( cursor6 == NULL ) r = -1;
+    else radix288CursorStart(cursor6, &table->tree6);
+    while ( r == 0 && radix288CursorNext(cursor6, &key, &data) ){
+        const fromtopacket6* p = &table->flows6.flows[LEAFFLOW(data)];
+        snapshotFlux6 f;
+        memset(&f, 0, sizeof(f));
+        memcpy(f.from, p->from, sizeof(f.from));
+        memcpy(f.to, p->to, sizeof(f.to));
+        f.portFrom = p->portFrom;
+        f.portTo = p->portTo;
+        f.firstPacket = p->firstPacket;
+        f.lastPacket = p->lastPacket;
+        if ( fwrite(&f, sizeof(f), 1, fp) != 1 ) r = -1;
+    }
+    free(cursor6);
+
+    if ( fclose(fp) != 0 ) r = -1;
+    return r;
+}
+
+/**
+ * @brief test whether a file is a snapshot
+ *
+ * @param path the file
+ * @return int 1 for a snapshot, 0 otherwise
+ */
+int isSnapshotFile(const char* path){
+    char magic[8];
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return 0;
+    ssize_t size = read(fd, magic, sizeof(magic));
+    close(fd);
+    return size == sizeof(magic) && memcmp(magic, SNAPSHOTMAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * @brief add the flux of a snapshot to a table (addFlux): a flux already in the table is merged
+ *
+ * @param path the file, mapped in memory
+ * @param table the flux table
+ * @return int 0, -1 on a bad file or out of memory
+ */
+int readSnapshot(const char* path, fluxTable* table){
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) return -1;
+    struct stat st;
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshotHeader) ){
+        close(fd);
+        return -1;
+    }
+    UInt8* data = (UInt8*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( data == MAP_FAILED ) return -1;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    const snapshotHeader* header = (const snapshotHeader*)data;
+    // the version 1 had a last sequence number 0 for a single packet
+    int old = header->version == 1;
+    int r = memcmp(header->magic, SNAPSHOTMAGIC, sizeof(header->magic)) == 0 && (header->version == SNAPSHOTVERSION || old)
+            && (size_t)st.st_size == sizeof(snapshotHeader) + (size_t)header->nbFlux * sizeof(snapshotFlux)
+                                     + (size_t)header->nbFlux6 * sizeof(snapshotFlux6) ? 0 : -1;
+
+    const snapshotFlux* flux = (const snapshotFlux*)(header + 1);
+    for (UInt32 i=0; r == 0 && i<header->nbFlux; i++){
+        fromtopacket p = { .from = htonl(flux[i].from), .to = htonl(flux[i].to), .portFrom = flux[i].portFrom, .portTo = flux[i].portTo,
+                           .firstPacket = flux[i].firstPacket, .lastPacket = flux[i].lastPacket, .lastUpdate = (UInt32)table->lines };
+        if ( old && p.lastPacket == 0 ) p.lastPacket = p.firstPacket;
+        if ( addFlux(table, &p) == FLOWNONE ) r = -1;
+    }
+    const snapshotFlux6* flux6 = (const snapshotFlux6*)(flux + header->nbFlux);
+    for (UInt32 i=0; r == 0 && i<header->nbFlux6; i++){
+        fromtopacket6 p;
+        memcpy(p.from, flux6[i].from, sizeof(p.from));
+        memcpy(p.to, flux6[i].to, sizeof(p.to));
+        p.portFrom = flux6[i].portFrom;
+        p.portTo = flux6[i].portTo;
+        p.firstPacket = flux6[i].firstPacket;
+        p.lastPacket = old && flux6[i].lastPacket == 0 ? flux6[i].firstPacket : flux6[i].lastPacket;
+        p.lastUpdate = (UInt32)table->lines;
+        if ( addFlux6(table, &p) == FLOWNONE ) r = -1;
+    }
+    if ( r == 0 ) table->lines += header->lines;
+
+    munmap(data, st.st_size);
+    return r;
+}
+
+
+#ifdef __UNITTEST_SNAPSHOT__
+
+int main(){
+    fluxTable table;
+    memset(&table, 0, sizeof(table));
+    char line[64];
+    for (int i=0; i<10000; i++){
+        snprintf(line, sizeof(line), "10.%d.%d.1:%d,10.0.0.1:80,%d", i % 97, i % 31, 1000 + i % 7, i);
+        assert(processLine(&table, line) == 0);
+    }
+    snprintf(line, sizeof(line), "[2001:db8::1]:443,[::1]:80,7");
+    assert(processLine(&table, line) == 0);
+    snprintf(line, sizeof(line), "[2001:db8::1]:443,[::1]:80,70");
+    assert(processLine(&table, line) == 0);
+
+    char path[] = "/tmp/chimere_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    assert(writeSnapshot(&table, path) == 0);
+    assert(isSnapshotFile(path));
+
+    // read back: the same flux, the same order of the keys
+    fluxTable copy;
+    memset(&copy, 0, sizeof(copy));
+    assert(readSnapshot(path, &copy) == 0);
+    assert(copy.lines == table.lines && copy.flows.nb == table.flows.nb && copy.flows6.nb == 1);
+    assert(copy.flows6.flows[0].firstPacket == 7 && copy.flows6.flows[0].lastPacket == 70);
+    radix96Cursor a, b;
+    radix96CursorStart(&a, &table.tree);
+    radix96CursorStart(&b, &copy.tree);
+    const UInt32 *keyA, *keyB;
+    void *dataA, *dataB;
+    while ( radix96CursorNext(&a, &keyA, &dataA) ){
+        assert(radix96CursorNext(&b, &keyB, &dataB));
+        assert(memcmp(keyA, keyB, FLUXKEYWORDS * sizeof(UInt32)) == 0);
+        fromtopacket p, q;
+        flowStoreGet(&table.flows, LEAFFLOW(dataA), &p);
+        flowStoreGet(&copy.flows, LEAFFLOW(dataB), &q);
+        assert(p.firstPacket == q.firstPacket && p.lastPacket == q.lastPacket);
+    }
+    assert(radix96CursorNext(&b, &keyB, &dataB) == 0);
+
+    // read twice: the flux are merged
+    assert(readSnapshot(path, &copy) == 0);
+    assert(copy.flows.nb == table.flows.nb && copy.lines == 2 * table.lines);
+
+    // a truncated file is refused
+    assert(truncate(path, sizeof(snapshotHeader) + 10) == 0);
+    assert(readSnapshot(path, &copy) == -1);
+
+    unlink(path);
+    freeFlux(&copy);
+    freeFlux(&table);
+    printf("snapshot: OK\n");
+    return 0;
+}
+
+// gcc -o snapshot pool.c packet.c radixfixed.c aggregate.c flowstore.c seqmap.c quarantine.c metrics.c shmflux.c query.c flux.c snapshot.c -g -D__UNITTEST_SNAPSHOT__ -pthread -lrt && ./snapshot
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file snapshot.h
+ * @author Sebastien Galvagno
+ * @brief The flux of a table saved in a file, to be read again or compared without the logs
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The file is a header, the IPv4 flux then the IPv6 flux, each family in the order of its radix keys.
+ * The addresses are in host order, the integers in the byte order of the host (little endian).
+ */
+#ifndef __SG__CHIMERE_SNAPSHOT_H__
+#define __SG__CHIMERE_SNAPSHOT_H__
+
+#include "SG_Types.h"
+#include "packet.h"
+#include "flux.h"
+
+#define SNAPSHOTMAGIC "CHIMSNP1"
+// the version 2: the last sequence number of a single packet is the first one
+#define SNAPSHOTVERSION 2
+
+typedef struct {
+    char magic[8];
+    UInt32 version;
+    UInt32 nbFlux;
+    UInt32 nbFlux6;
+    UInt32 reserved;
+    UInt64 lines;       // the lines read to build the table
+} snapshotHeader;
+
+typedef struct {
+    UInt32 from;
+    UInt32 to;
+    UInt16 portFrom;
+    UInt16 portTo;
+    tcp_seq firstPacket;
+    tcp_seq lastPacket;
+} snapshotFlux;
+
+typedef struct {
+    UInt32 from[4];
+    UInt32 to[4];
+    UInt16 portFrom;
+    UInt16 portTo;
+    tcp_seq firstPacket;
+    tcp_seq lastPacket;
+} snapshotFlux6;
+
+/**
+ * @brief write the flux of the table in a snapshot file, in the order of their keys
+ *
+ * @param table the flux table
+ * @param path the file
+ * @return int 0, -1 on a write error
+ */
+int writeSnapshot(const fluxTable* table, const char* path);
+
+/**
+ * @brief test whether a file is a snapshot
+ *
+ * @param path the file
+ * @return int 1 for a snapshot, 0 otherwise
+ */
+int isSnapshotFile(const char* path);
+
+/**
+ * @brief add the flux of a snapshot to a table (addFlux): a flux already in the table is merged
+ *
+ * @param path the file, mapped in memory
+ * @param table the flux table
+ * @return int 0, -1 on a bad file or out of memory
+ */
+int readSnapshot(const char* path, fluxTable* table);
+
+#endif
@@ -0,0 +1,365 @@
+/**
+ * @file uring.c
+ * @author Sebastien Galvagno
+ * @brief Read a file with io_uring: several large aligned reads in flight, optionally O_DIRECT
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The ring is driven with the raw system calls (no liburing): the URINGDEPTH buffers are registered once,
+ * the buffer k always holds the read k of a round, so the buffers are split in the order of the file
+ * while the reads of the next buffers complete in any order. A buffer is submitted again as soon as its lines are split.
+ * A read failed or short (the end of the file with O_DIRECT, a file system refusing O_DIRECT) is finished by pread()
+ * on the file opened without O_DIRECT. Built with -DHAVE_URING when the kernel headers have io_uring (see script.sh).
+ */
+
+// O_DIRECT
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#ifdef __UNITTEST_URING__
+#include <assert.h>
+#endif
+
+#include "uring.h"
+#include "reader.h"
+#include "pool.h"
+
+#ifdef HAVE_URING
+
+/**
+ * @brief the rings shared with the kernel: the submissions written here, the completions read here
+ */
+typedef struct {
+    int fd;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sqRing;
+    size_t sqSize;
+    void* cqRing;       // the same mapping as sqRing with IORING_FEAT_SINGLE_MMAP
+    size_t cqSize;
+    size_t sqesSize;
+    unsigned queued;    // the submissions not given to the kernel yet
+} uring;
+
+/**
+ * @brief a buffer and its read
+ */
+typedef struct {
+    char* data;
+    off_t offset;
+    int busy;           // a read is submitted
+    int done;           // its completion is received
+    int result;         // the bytes read, -errno
+} uringSlot;
+
+static int uringSetup(uring* ring, unsigned entries){
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if ( ring->fd < 0 ) return -1;
+
+    ring->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if ( single && ring->cqSize > ring->sqSize ) ring->sqSize = ring->cqSize;
+    ring->sqRing = mmap(NULL, ring->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if ( ring->sqRing == MAP_FAILED ){
+        close(ring->fd);
+        return -1;
+    }
+    ring->cqRing = single ? ring->sqRing
+                 : mmap(NULL, ring->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = ring->cqRing == MAP_FAILED ? MAP_FAILED
+               : mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if ( ring->sqes == MAP_FAILED ){
+        if ( !single && ring->cqRing != MAP_FAILED ) munmap(ring->cqRing, ring->cqSize);
+        munmap(ring->sqRing, ring->sqSize);
+        close(ring->fd);
+        return -1;
+    }
+
+    char* sq = (char*)ring->sqRing;
+    char* cq = (char*)ring->cqRing;
+    ring->sqTail = (unsigned*)(sq + p.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + p.sq_off.array);
+    ring->cqHead = (unsigned*)(cq + p.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + p.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void uringClose(uring* ring){
+    munmap(ring->sqes, ring->sqesSize);
+    if ( ring->cqRing != ring->sqRing ) munmap(ring->cqRing, ring->cqSize);
+    munmap(ring->sqRing, ring->sqSize);
+    close(ring->fd);
+}
+
+/**
+ * @brief queue the read of a buffer, given to the kernel by uringEnter
+ */
+static void uringRead(uring* ring, int fd, int fixed, uringSlot* slots, int k, off_t offset){
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (UInt64)(uintptr_t)slots[k].data;
+    sqe->len = URINGBUFFER;
+    sqe->off = (UInt64)offset;
+    sqe->buf_index = fixed ? k : 0;
+    sqe->user_data = (UInt64)k;
+    ring->sqArray[index] = index;
+    // the entry is written before the kernel sees the new tail
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+
+    slots[k].offset = offset;
+    slots[k].busy = 1;
+    slots[k].done = 0;
+}
+
+/**
+ * @brief give the queued reads to the kernel and wait for a completion if wait is set
+ */
+static int uringEnter(uring* ring, int wait){
+    for (;;){
+        int n = (int)syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if ( n >= 0 ){
+            ring->queued -= n < (int)ring->queued ? (unsigned)n : ring->queued;
+            if ( ring->queued == 0 || wait ) return 0;
+        } else if ( errno != EINTR && errno != EAGAIN && errno != EBUSY ){
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief receive the completions arrived, waiting for one when none is there
+ */
+static int uringReap(uring* ring, uringSlot* slots){
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    if ( head == tail ){
+        if ( uringEnter(ring, 1) ) return -1;
+        tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    }
+    for (; head != tail; head++){
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+        uringSlot* slot = &slots[cqe->user_data];
+        slot->result = cqe->res;
+        slot->done = 1;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief read a regular file until the size it has when the reading starts: URINGDEPTH reads are submitted
+ * to an io_uring in registered buffers and the lines of a buffer are split in place while the next reads are in flight.
+ * Without io_uring (an old kernel, a sandbox, built without HAVE_URING) or for a pipe, the file is read by readStream.
+ *
+ * @param path the file, opened again with O_DIRECT when direct is set
+ * @param fd the file opened, read by the fallbacks and for the ends of the short reads
+ * @param direct bypass the page cache: O_DIRECT, the file is read without it when its file system refuses O_DIRECT
+ * @param splitter the line splitter
+ * @return int 0 at the end of the file, the non zero return of the line function, -1 on error
+ */
+int readUring(const char* path, int fd, int direct, lineSplitter* splitter){
+    struct stat st;
+    if ( fstat(fd, &st) || !S_ISREG(st.st_mode) ) return readStream(fd, splitter);
+    uring ring;
+    if ( uringSetup(&ring, URINGDEPTH) ) return readStream(fd, splitter);
+
+    // the buffers in one block, aligned for O_DIRECT
+    void* block = memAlloc((size_t)URINGDEPTH * URINGBUFFER + URINGALIGN, MEMBUFFERS);
+    if ( block == NULL ){
+        uringClose(&ring);
+        return -1;
+    }
+    uringSlot slots[URINGDEPTH];
+    struct iovec iov[URINGDEPTH];
+    char* aligned = (char*)(((uintptr_t)block + URINGALIGN - 1) & ~(uintptr_t)(URINGALIGN - 1));
+    memset(slots, 0, sizeof(slots));
+    for (int k=0; k<URINGDEPTH; k++){
+        slots[k].data = aligned + (size_t)k * URINGBUFFER;
+        iov[k].iov_base = slots[k].data;
+        iov[k].iov_len = URINGBUFFER;
+    }
+    // the registered buffers are mapped once by the kernel, not at each read
+    int fixed = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iov, URINGDEPTH) == 0;
+    int dfd = direct ? open(path, O_RDONLY | O_DIRECT) : -1;
+    int rfd = dfd >= 0 ? dfd : fd;
+
+    off_t size = st.st_size;
+    off_t next = 0;
+    for (int k=0; k<URINGDEPTH && next < size; k++, next += URINGBUFFER){
+        uringRead(&ring, rfd, fixed, slots, k, next);
+    }
+    int r = ring.queued && uringEnter(&ring, 0) ? -1 : 0;
+
+    for (int k=0; r == 0 && slots[k].busy; k=(k+1)%URINGDEPTH){
+        uringSlot* slot = &slots[k];
+        while ( r == 0 && !slot->done ) r = uringReap(&ring, slots);
+        if ( r ) break;
+
+        // a failed or short read is finished without the ring
+        size_t expected = size - slot->offset < URINGBUFFER ? (size_t)(size - slot->offset) : URINGBUFFER;
+        size_t n = slot->result > 0 ? (size_t)slot->result : 0;
+        if ( n > expected ) n = expected;
+        while ( n < expected ){
+            ssize_t m = pread(fd, slot->data + n, expected - n, slot->offset + n);
+            if ( m < 0 && errno == EINTR ) continue;
+            if ( m < 0 ) r = -1;
+            if ( m <= 0 ) break;
+            n += m;
+        }
+        slot->busy = 0;
+        if ( r == 0 ) r = splitLines(splitter, slot->data, n);
+
+        if ( r == 0 && next < size ){
+            uringRead(&ring, rfd, fixed, slots, k, next);
+            next += URINGBUFFER;
+            if ( uringEnter(&ring, 0) ) r = -1;
+        }
+    }
+
+    // stopped before the end: the buffers are freed once the kernel has written them
+    for (int k=0; k<URINGDEPTH; k++){
+        while ( slots[k].busy && !slots[k].done && uringReap(&ring, slots) == 0 );
+    }
+    if ( r == 0 ) r = splitEnd(splitter);
+
+    uringClose(&ring);
+    if ( dfd >= 0 ) close(dfd);
+    memFree(block);
+    return r;
+}
+
+#else
+
+/**
+ * @brief built without io_uring: the file is read by readStream
+ */
+int readUring(const char* path, int fd, int direct, lineSplitter* splitter){
+    (void)path;
+    (void)direct;
+    return readStream(fd, splitter);
+}
+
+#endif
+
+
+#ifdef __UNITTEST_URING__
+
+static UInt64 nbLines, sumSeq;
+
+int count(char* line, void* ctx){
+    (void)ctx;
+    char* comma = strrchr(line, ',');
+    assert(comma != NULL);
+    sumSeq += strtoull(comma + 1, NULL, 10);
+    nbLines++;
+    return 0;
+}
+
+int stopAt(char* line, void* ctx){
+    (void)line;
+    return ++nbLines == *(UInt64*)ctx ? 3 : 0;
+}
+
+// more lines than the buffers of a round, the last buffer partial
+#define NBLINES 400000
+
+static void check(const char* path, int direct){
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0);
+    lineSplitter splitter;
+    nbLines = 0;
+    sumSeq = 0;
+    splitterInit(&splitter, &count, NULL);
+    assert(readUring(path, fd, direct, &splitter) == 0);
+    assert(nbLines == NBLINES);
+    assert(sumSeq == (UInt64)NBLINES * (NBLINES - 1) / 2);
+    close(fd);
+}
+
+int main(){
+    char path[] = "uringXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE* f = fdopen(fd, "w");
+    for (int i=0; i<NBLINES; i++){
+        fprintf(f, "10.0.%d.%d:%d,192.168.0.1:80,%d", (i >> 8) & 0xFF, i & 0xFF, 1000 + i % 1000, i);
+        // the last line without end of line
+        if ( i < NBLINES - 1 ) fputc('\n', f);
+    }
+    fclose(f);
+
+    // through the page cache, then O_DIRECT (or the page cache when the file system refuses it)
+    check(path, 0);
+    check(path, 1);
+
+    // stopped by the line function, the reads in flight are drained
+    fd = open(path, O_RDONLY);
+    lineSplitter splitter;
+    UInt64 stop = 2;
+    nbLines = 0;
+    splitterInit(&splitter, &stopAt, &stop);
+    assert(readUring(path, fd, 1, &splitter) == 3);
+    assert(nbLines == 2);
+    close(fd);
+
+    // an empty file, a pipe read by readStream
+    assert(truncate(path, 0) == 0);
+    fd = open(path, O_RDONLY);
+    nbLines = 0;
+    splitterInit(&splitter, &count, NULL);
+    assert(readUring(path, fd, 1, &splitter) == 0);
+    assert(nbLines == 0);
+    close(fd);
+    unlink(path);
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], "a,1\nb,2\n", 8) == 8);
+    close(fds[1]);
+    nbLines = 0;
+    sumSeq = 0;
+    splitterInit(&splitter, &count, NULL);
+    assert(readUring(NULL, fds[0], 1, &splitter) == 0);
+    assert(nbLines == 2 && sumSeq == 3);
+    close(fds[0]);
+    return 0;
+}
+
+// gcc -o uring pool.c lines.c decompress.c reader.c uring.c -g -D__UNITTEST_URING__ -DHAVE_URING -pthread && ./uring
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file uring.h
+ * @author Sebastien Galvagno
+ * @brief Read a file with io_uring: several large aligned reads in flight, optionally O_DIRECT
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef __SG__CHIMERE_URING_H__
+#define __SG__CHIMERE_URING_H__
+
+#include "lines.h"
+
+// the number of reads in flight, each in a buffer of its own
+#define URINGDEPTH 8
+// the size of a read: a multiple of the blocks of the device for O_DIRECT
+#define URINGBUFFER (1 << 20)
+// the alignment of the buffers and of the offsets for O_DIRECT
+#define URINGALIGN 4096
+
+/**
+ * @brief read a regular file until the size it has when the reading starts: URINGDEPTH reads are submitted
+ * to an io_uring in registered buffers and the lines of a buffer are split in place while the next reads are in flight.
+ * Without io_uring (an old kernel, a sandbox, built without HAVE_URING) or for a pipe, the file is read by readStream.
+ *
+ * @param path the file, opened again with O_DIRECT when direct is set
+ * @param fd the file opened, read by the fallbacks and for the ends of the short reads
+ * @param direct bypass the page cache: O_DIRECT, the file is read without it when its file system refuses O_DIRECT
+ * @param splitter the line splitter
+ * @return int 0 at the end of the file, the non zero return of the line function, -1 on error
+ */
+int readUring(const char* path, int fd, int direct, lineSplitter* splitter);
+
+#endif